@@ -1,19 +1,23 @@
 let submenu = require("submenu");
-let serial = require("serial");
+let wexbide = require("wexbide");
 let keyboard = require("keyboard");
 let textbox = require("textbox");
 let dialog = require("dialog");
 let storage = require("storage");
 
-serial.setup("usart", 115200);
+// Native line reader and saved AP parsing, see js_wexbide.c
+wexbide.open(115200);
 
 let shouldexit = false;
 let path = "/ext/apps_data/ollama_ia/SavedAPs.txt";
 let urlPath = "/ext/apps_data/ollama_ia/server_url.txt";
+let namePath = "/ext/apps_data/ollama_ia/user_name.txt";
+// Optional; the model name alone
+let modelPath = "/ext/apps_data/ollama_ia/model.txt";
 let systemMessagePath = "/ext/apps_data/ollama_ia/system_string.txt"; // Path for system message
 
 function sendSerialCommand(command, menutype) {
-  serial.write(command);
+  wexbide.write(command);
   if (menutype !== -1) {
     receiveSerialData(menutype);
   }
@@ -22,18 +26,18 @@ function sendSerialCommand(command, menutype) {
 function receiveSerialData(menutype) {
   textbox.setConfig("end", "text");
   textbox.show();
-  serial.readAny(0);
+  while (wexbide.readLine(0) !== undefined) {}
 
   while (textbox.isOpen()) {
-    let rx_data = serial.readAny(250);
-    if (rx_data !== undefined) {
-      console.log(`Received data: ${arraybuf_to_string(rx_data)}`); // Debug log
-      textbox.addText(rx_data);
+    let line = wexbide.readLine(250);
+    if (line !== undefined) {
+      console.log(`Received data: ${line}`); // Debug log
+      textbox.addText(line + "\n");
     } else {
       console.log("No data received."); // Debug log
     }
   }
-  serial.write("stop");
+  wexbide.write("stop");
 
   if (menutype === 0) {
     mainMenu();
@@ -63,14 +67,65 @@ function trimString(str) {
   return str.slice(start, end + 1);
 }
 
-function sendServerURL() {
-  if (storage.exists(urlPath)) {
-    let serverURL = storage.read(urlPath);
-    let serverURLString = arraybuf_to_string(serverURL);
-    console.log(`Connecting to server URL: ${serverURLString}`); // Debug log
-    sendSerialCommand(serverURLString, -1);
-  } else {
+function readFileString(filePath, fallback) {
+  if (!storage.exists(filePath)) {
+    return fallback;
+  }
+  return trimString(arraybuf_to_string(storage.read(filePath)));
+}
+
+// Queues a whole line, waiting while the UART transmit queue is full
+function sendLine(line) {
+  while (!wexbide.write(line + "\n")) {
+    delay(10);
+  }
+}
+
+function waitForLine(prefix, timeoutMs) {
+  for (let waited = 0; waited < timeoutMs; waited += 250) {
+    let line = wexbide.readLine(250);
+    if (line !== undefined && line.slice(0, prefix.length) === prefix) {
+      return line;
+    }
+  }
+  return undefined;
+}
+
+// The ESP32 keeps its settings in NVS and boots straight into them, so they are sent
+// only when their version, a hash of the same text on both sides, differs from the
+// one it has (see esp32_WexbideBot.ino)
+function syncConfig() {
+  let url = readFileString(urlPath, "");
+  if (url.length === 0) {
     dialog.message("Error", "Ollama server URL not found.");
+    return;
+  }
+  let name = readFileString(namePath, "");
+  let model = readFileString(modelPath, "mistral");
+  let aps = storage.exists(path) ? wexbide.loadAPs(path) : [];
+  let networks = "";
+  for (let i = 0; i < aps.length; i++) {
+    networks += aps[i].ssid + "//" + aps[i].password + "\n";
+  }
+  let version = wexbide.hash(url + "\n" + name + "\n" + model + "\n" + networks);
+
+  while (wexbide.readLine(0) !== undefined) {}
+  sendLine("CONFIG?");
+  let stored = waitForLine("CONFIG:", 2000);
+  if (stored !== undefined && stored.slice(7) === version) {
+    return;
+  }
+
+  sendLine("CONFIG BEGIN " + version);
+  sendLine("CONFIG URL " + url);
+  sendLine("CONFIG USER " + name);
+  sendLine("CONFIG MODEL " + model);
+  for (let i = 0; i < aps.length; i++) {
+    sendLine("CONFIG AP " + aps[i].ssid + "//" + aps[i].password);
+  }
+  sendLine("CONFIG END");
+  if (waitForLine("CONFIG_OK", 2000) === undefined) {
+    dialog.message("Error", "The ESP32 did not take the settings.");
   }
 }
 
@@ -97,113 +152,25 @@ function promptForText(header, defaultValue) {
 function setName() {
   let name = promptForText("Enter your name", "");
   if (name !== undefined) {
-    sendSerialCommand(name, -1);
+    storage.write(namePath, trimString(name));
 
     // Save the system message after setting the name
     saveSystemMessage(name);
 
-    delay(5000);
-
-    if (storage.exists(path)) {
-      let savedAPData = storage.read(path);
-      let apString = arraybuf_to_string(savedAPData);
-
-      let apLines = [];
-      let currentLine = "";
-
-      for (let i = 0; i < apString.length; i++) {
-        let char = apString[i];
-        if (char === "\n") {
-          apLines.push(trimString(currentLine));
-          currentLine = "";
-        } else {
-          currentLine += char;
-        }
-      }
-
-      if (currentLine.length > 0) {
-        apLines.push(trimString(currentLine));
-      }
-
-      let apCombined = "";
-      if (apLines.length === 1) {
-        apCombined = apLines[0];
-      } else if (apLines.length > 1) {
-        for (let i = 0; i < apLines.length; i++) {
-          apCombined += apLines[i];
-          if (i < apLines.length - 1) {
-            apCombined += ", ";
-          }
-        }
-      }
-
-      if (apCombined.length > 0) {
-        sendSerialCommand(apCombined, -1);
-      }
-
-      receiveSerialData(0);
-    } else {
+    if (!storage.exists(path)) {
       dialog.message(
         "Error",
         "No saved APs found. Connect manually to a new AP (see output)"
       );
-      receiveSerialData(0);
     }
-  } else {
-    receiveSerialData(0);
+    syncConfig();
   }
+  receiveSerialData(0);
 }
 
+// Moves the network to the front of SavedAPs.txt, replacing any older password
 function saveAPToFile(ssid, password) {
-  let apData = ssid + "//" + password + "\n";
-  let updatedData = "";
-
-  if (storage.exists(path)) {
-    let savedAPData = storage.read(path);
-    let apString = arraybuf_to_string(savedAPData);
-
-    let apLines = [];
-    let currentLine = "";
-
-    for (let i = 0; i < apString.length; i++) {
-      let char = apString[i];
-      if (char === "\n") {
-        apLines.push(trimString(currentLine));
-        currentLine = "";
-      } else {
-        currentLine += char;
-      }
-    }
-
-    if (currentLine.length > 0) {
-      apLines.push(trimString(currentLine));
-    }
-
-    let ssidExists = false;
-
-    for (let i = 0; i < apLines.length; i++) {
-      let line = trimString(apLines[i]);
-
-      if (line.length === 0) continue;
-
-      let existingAP = splitInput(line, "//")[0];
-
-      if (existingAP === ssid) {
-        ssidExists = true;
-        updatedData += apData;
-      } else {
-        updatedData += line + "\n";
-      }
-    }
-
-    if (!ssidExists) {
-      updatedData += apData;
-    }
-
-    storage.write(path, updatedData);
-  } else {
-    storage.write(path, apData);
-  }
+  wexbide.saveAP(path, ssid, password);
 }
 
 function connectToNewAP() {
@@ -216,10 +183,6 @@ function connectToNewAP() {
 
   let tempSSID = trimString(ssid);
 
-  sendSerialCommand(tempSSID, -1);
-
-  delay(500);
-
   let password = promptForText("Enter Password", "");
   if (password === undefined || trimString(password).length === 0) {
     dialog.message("Error", "No password entered.");
@@ -229,14 +192,10 @@ function connectToNewAP() {
 
   let tempPassword = trimString(password);
 
-  sendSerialCommand(tempPassword, -1);
-
-  delay(500);
-
-  receiveSerialData(0);
-
-  let formattedAP = tempSSID + "//" + tempPassword;
+  // The new network goes to the front of the list, so the ESP32 switches to it
   saveAPToFile(tempSSID, tempPassword);
+  syncConfig();
+  receiveSerialData(0);
 }
 
 function startChatting() {
@@ -288,7 +247,7 @@ function mainMenu() {
 }
 
 function mainLoop() {
-  sendServerURL();
+  syncConfig();
   while (!shouldexit) {
     mainMenu();
     let confirm = dialog.message("Exit", "Press OK to exit, Cancel to return.");
@@ -0,0 +1,95 @@
+#include "ap_store.h"
+#include <storage/storage.h>
+#include <string.h>
+
+static char* ap_store_trim(char* text) {
+    while(*text == ' ' || *text == '\t') {
+        text++;
+    }
+    size_t length = strlen(text);
+    while(length > 0 && (text[length - 1] == ' ' || text[length - 1] == '\t')) {
+        text[--length] = '\0';
+    }
+    return text;
+}
+
+static bool ap_store_parse_line(char* line, ApRecord* record) {
+    char* separator = strstr(line, "//");
+    if(!separator) {
+        return false;
+    }
+    *separator = '\0';
+    const char* ssid = ap_store_trim(line);
+    const char* password = ap_store_trim(separator + 2);
+    if(ssid[0] == '\0' || strlen(ssid) >= MAX_SSID_LENGTH || strlen(password) >= MAX_PASSWORD_LENGTH) {
+        return false;
+    }
+    strcpy(record->ssid, ssid);
+    strcpy(record->password, password);
+    return true;
+}
+
+size_t ap_store_load(const char* path, ApRecord* records, size_t max) {
+    Storage* storage = furi_record_open(RECORD_STORAGE);
+    File* file = storage_file_alloc(storage);
+    size_t count = 0;
+
+    if(storage_file_open(file, path, FSAM_READ, FSOM_OPEN_EXISTING)) {
+        char buffer[64];
+        char line[MAX_SSID_LENGTH + MAX_PASSWORD_LENGTH + 8];
+        size_t line_length = 0;
+        uint16_t bytes_read;
+        do {
+            bytes_read = storage_file_read(file, buffer, sizeof(buffer));
+            for(uint16_t i = 0; i <= bytes_read && count < max; i++) {
+                bool end = i == bytes_read ? bytes_read < sizeof(buffer) : buffer[i] == '\n';
+                if(!end) {
+                    if(i < bytes_read && buffer[i] != '\r' && line_length < sizeof(line) - 1) {
+                        line[line_length++] = buffer[i];
+                    }
+                    continue;
+                }
+                line[line_length] = '\0';
+                if(ap_store_parse_line(line, &records[count])) {
+                    count++;
+                }
+                line_length = 0;
+            }
+        } while(bytes_read == sizeof(buffer) && count < max);
+    }
+
+    storage_file_close(file);
+    storage_file_free(file);
+    furi_record_close(RECORD_STORAGE);
+    return count;
+}
+
+bool ap_store_save(const char* path, const char* ssid, const char* password) {
+    ApRecord* records = malloc(sizeof(ApRecord) * AP_STORE_MAX_RECORDS);
+    size_t count = ap_store_load(path, records, AP_STORE_MAX_RECORDS);
+
+    Storage* storage = furi_record_open(RECORD_STORAGE);
+    File* file = storage_file_alloc(storage);
+    bool success = false;
+
+    if(storage_file_open(file, path, FSAM_WRITE, FSOM_CREATE_ALWAYS)) {
+        char buffer[MAX_SSID_LENGTH + MAX_PASSWORD_LENGTH + 3];
+        int len = snprintf(buffer, sizeof(buffer), "%s//%s\n", ssid, password);
+        success = len > 0 && storage_file_write(file, buffer, len) == (size_t)len;
+        size_t kept = 1;
+        for(size_t i = 0; i < count && kept < AP_STORE_MAX_RECORDS && success; i++) {
+            if(strcmp(records[i].ssid, ssid) == 0) {
+                continue;
+            }
+            len = snprintf(buffer, sizeof(buffer), "%s//%s\n", records[i].ssid, records[i].password);
+            success = len > 0 && storage_file_write(file, buffer, len) == (size_t)len;
+            kept++;
+        }
+    }
+
+    storage_file_close(file);
+    storage_file_free(file);
+    furi_record_close(RECORD_STORAGE);
+    free(records);
+    return success;
+}
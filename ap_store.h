@@ -0,0 +1,28 @@
+#pragma once
+
+#include "ollama_app_i.h"
+
+/**
+ * The saved access point file holds one "ssid//password" line per network, most
+ * recently used first.  Shared by the app and the wexbide JS module, so the scripts
+ * get parsed records instead of splitting the file a character at a time.
+*/
+typedef struct {
+    char ssid[MAX_SSID_LENGTH];
+    char password[MAX_PASSWORD_LENGTH];
+} ApRecord;
+
+/**
+ * Reads up to max records; blank and malformed lines are skipped.
+ *
+ * @return  number of records read, 0 if the file does not exist
+*/
+size_t ap_store_load(const char* path, ApRecord* records, size_t max);
+
+/**
+ * Moves ssid to the front of the file with the given password, keeping the other
+ * networks after it (up to AP_STORE_MAX_RECORDS in all).
+ *
+ * @return  false if the file could not be written
+*/
+bool ap_store_save(const char* path, const char* ssid, const char* password);
@@ -0,0 +1,516 @@
+#include "archive.h"
+#include "ollama_app_i.h"
+#include "trace.h"
+#include <storage/storage.h>
+#include <string.h>
+
+#define ARCHIVE_INDEX_MAGIC 0x58444943 // "CIDX" little-endian
+#define ARCHIVE_INDEX_VERSION 1
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t slot_count;
+    uint32_t indexed; // archive bytes whose lines have their postings
+    uint32_t words;   // slots in use
+    uint32_t postings;
+} ArchiveIndexHeader;
+
+// One per word, found by linear probing from its hash
+typedef struct {
+    uint32_t hash; // 0 for a free slot
+    uint32_t head; // index offset of the word's newest posting
+    uint32_t count;
+    uint32_t skip; // its newest posting when count was last a multiple of ARCHIVE_SKIP_INTERVAL
+} ArchiveSlot;
+
+typedef struct {
+    uint32_t offset; // of the archive line holding the word
+    uint32_t next;   // the word's previous posting, 0 after its oldest
+    uint32_t skip;   // one up to ARCHIVE_SKIP_INTERVAL postings further back, 0 if none
+} ArchivePosting;
+
+// A word as it streams past a character at a time
+typedef struct {
+    uint32_t hash;
+    uint8_t length;
+} ArchiveWord;
+
+typedef struct {
+    uint32_t offset; // line of the posting read last
+    uint32_t next;
+    uint32_t skip;
+    uint32_t skip_failed; // a skip target already found to be too far back
+} ArchiveCursor;
+
+struct Archive {
+    Storage* storage;
+    File* file;
+    File* index;
+    ArchiveIndexHeader header;
+    uint32_t flushed;    // archive bytes on the card; the buffer holds what follows
+    uint32_t index_size; // where the next postings go
+    bool write_failed;
+    // The message being archived: where its line starts and its distinct words so far
+    bool open;
+    uint32_t line;
+    ArchiveWord word;
+    uint16_t term_count;
+    uint32_t terms[ARCHIVE_MESSAGE_WORDS];
+    // Write-behind for the text; postings borrow it once the text is on the card
+    uint16_t buffered;
+    union {
+        char text[ARCHIVE_BUFFER_SIZE];
+        ArchivePosting postings[ARCHIVE_BUFFER_SIZE / sizeof(ArchivePosting)];
+    } buffer;
+};
+
+#define ARCHIVE_TABLE_END (sizeof(ArchiveIndexHeader) + ARCHIVE_INDEX_SLOTS * sizeof(ArchiveSlot))
+
+// Words are runs of letters, digits and non-ASCII bytes, hashed (FNV-1a) in lower case.
+// Feeds one character; true when it ended a word long enough to index, with its hash.
+static bool archive_word_feed(ArchiveWord* word, char c, uint32_t* hash) {
+    uint8_t byte = (uint8_t)c;
+    bool letter = (byte >= 'a' && byte <= 'z') || (byte >= 'A' && byte <= 'Z');
+    if(letter || (byte >= '0' && byte <= '9') || byte >= 0x80) {
+        if(word->length == 0) {
+            word->hash = 2166136261u;
+        }
+        word->hash = (word->hash ^ (letter ? byte | 0x20 : byte)) * 16777619u;
+        if(word->length < UINT8_MAX) {
+            word->length++;
+        }
+        return false;
+    }
+
+    bool ended = word->length >= ARCHIVE_MIN_WORD;
+    // 0 marks a free slot
+    *hash = word->hash ? word->hash : 1;
+    word->length = 0;
+    return ended;
+}
+
+static bool archive_read_at(File* file, uint32_t offset, void* data, size_t size, uint32_t* reads) {
+    if(reads) {
+        (*reads)++;
+    }
+    return storage_file_seek(file, offset, true) && storage_file_read(file, data, size) == size;
+}
+
+static bool archive_write_at(File* file, uint32_t offset, const void* data, size_t size) {
+    return storage_file_seek(file, offset, true) && storage_file_write(file, data, size) == size;
+}
+
+static uint32_t archive_slot_offset(uint32_t slot) {
+    return sizeof(ArchiveIndexHeader) + slot * sizeof(ArchiveSlot);
+}
+
+// Finds the word's slot, or the free one it would take; false if the index is unreadable
+static bool archive_find_slot(
+    Archive* archive,
+    uint32_t hash,
+    uint32_t* slot,
+    ArchiveSlot* entry,
+    uint32_t* reads) {
+    // The table is never filled past 3/4, so a free slot ends every probe
+    for(uint32_t probe = 0; probe < archive->header.slot_count; probe++) {
+        *slot = (hash + probe) % archive->header.slot_count;
+        if(!archive_read_at(archive->index, archive_slot_offset(*slot), entry, sizeof(*entry), reads)) {
+            return false;
+        }
+        if(entry->hash == hash || entry->hash == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool archive_flush(Archive* archive) {
+    if(archive->buffered == 0) {
+        return true;
+    }
+
+    bool success = archive_write_at(archive->file, archive->flushed, archive->buffer.text, archive->buffered);
+    archive->flushed += archive->buffered;
+    archive->buffered = 0;
+    return success;
+}
+
+static void archive_put(Archive* archive, char c) {
+    archive->buffer.text[archive->buffered++] = c;
+    if(archive->buffered == ARCHIVE_BUFFER_SIZE && !archive_flush(archive)) {
+        archive->write_failed = true;
+    }
+}
+
+// Adds the word c ends, if any, to the message's distinct words
+static void archive_take(Archive* archive, char c) {
+    uint32_t hash;
+    if(!archive_word_feed(&archive->word, c, &hash)) {
+        return;
+    }
+    for(uint16_t i = 0; i < archive->term_count; i++) {
+        if(archive->terms[i] == hash) {
+            return;
+        }
+    }
+    if(archive->term_count < ARCHIVE_MESSAGE_WORDS) {
+        archive->terms[archive->term_count++] = hash;
+    }
+}
+
+static bool archive_write_postings(Archive* archive, size_t count) {
+    size_t size = count * sizeof(ArchivePosting);
+    bool success = archive_write_at(archive->index, archive->index_size, archive->buffer.postings, size);
+    archive->index_size += size;
+    archive->header.postings += count;
+    return success;
+}
+
+// Gives each of the message's words a posting for the line, in front of its older ones
+static bool archive_index_line(Archive* archive, uint32_t line) {
+    const size_t capacity = COUNT_OF(archive->buffer.postings);
+    bool success = true;
+    bool full = false;
+    size_t pending = 0;
+    for(uint16_t i = 0; i < archive->term_count; i++) {
+        uint32_t hash = archive->terms[i];
+        uint32_t slot;
+        ArchiveSlot entry;
+        if(!archive_find_slot(archive, hash, &slot, &entry, NULL)) {
+            success = false;
+            continue;
+        }
+        if(entry.hash == 0) {
+            if(archive->header.words >= archive->header.slot_count / 4 * 3) {
+                full = true;
+                continue;
+            }
+            entry = (ArchiveSlot){.hash = hash};
+            archive->header.words++;
+        }
+
+        archive->buffer.postings[pending] =
+            (ArchivePosting){.offset = line, .next = entry.head, .skip = entry.skip};
+        entry.head = archive->index_size + pending * sizeof(ArchivePosting);
+        if(++entry.count % ARCHIVE_SKIP_INTERVAL == 0) {
+            // The postings until the next multiple skip to here, and this one a whole interval
+            entry.skip = entry.head;
+        }
+        success &= archive_write_at(archive->index, archive_slot_offset(slot), &entry, sizeof(entry));
+        if(++pending == capacity) {
+            success &= archive_write_postings(archive, pending);
+            pending = 0;
+        }
+    }
+    if(pending > 0) {
+        success &= archive_write_postings(archive, pending);
+    }
+    if(full) {
+        APP_LOG_W("Archive", "Word table full, new words are not indexed");
+    }
+
+    archive->term_count = 0;
+    archive->word.length = 0;
+    return success;
+}
+
+static bool archive_write_header(Archive* archive) {
+    return archive_write_at(archive->index, 0, &archive->header, sizeof(archive->header));
+}
+
+static bool archive_index_create(Archive* archive) {
+    archive->header = (ArchiveIndexHeader){
+        .magic = ARCHIVE_INDEX_MAGIC,
+        .version = ARCHIVE_INDEX_VERSION,
+        .slot_count = ARCHIVE_INDEX_SLOTS,
+    };
+    bool success = archive_write_header(archive);
+
+    // The table is written out once, all free, so postings can follow it
+    memset(archive->buffer.text, 0, sizeof(archive->buffer.text));
+    size_t left = ARCHIVE_INDEX_SLOTS * sizeof(ArchiveSlot);
+    while(left > 0 && success) {
+        size_t chunk = left < sizeof(archive->buffer.text) ? left : sizeof(archive->buffer.text);
+        success = storage_file_write(archive->index, archive->buffer.text, chunk) == chunk;
+        left -= chunk;
+    }
+    archive->index_size = ARCHIVE_TABLE_END;
+    return success;
+}
+
+// Indexes the lines past header.indexed, ending a last line that a crash cut short
+static bool archive_catch_up(Archive* archive) {
+    uint32_t position = archive->header.indexed;
+    uint32_t column = 0;
+    bool success = true;
+    char chunk[64];
+    archive->line = position;
+    archive->term_count = 0;
+    archive->word.length = 0;
+
+    while(position < archive->flushed) {
+        size_t want = archive->flushed - position < sizeof(chunk) ? archive->flushed - position : sizeof(chunk);
+        if(!archive_read_at(archive->file, position, chunk, want, NULL)) {
+            return false;
+        }
+        for(size_t i = 0; i < want; i++) {
+            if(chunk[i] == '\n') {
+                archive_take(archive, ' ');
+                success &= archive_index_line(archive, archive->line);
+                archive->line = position + i + 1;
+                column = 0;
+            } else if(column++ >= 2) {
+                // Past the "U " or "A " in front of the text
+                archive_take(archive, chunk[i]);
+            }
+        }
+        position += want;
+    }
+    if(archive->line < archive->flushed) {
+        archive_take(archive, ' ');
+        archive_put(archive, '\n');
+        success &= archive_flush(archive);
+        success &= archive_index_line(archive, archive->line);
+    }
+
+    archive->header.indexed = archive->flushed;
+    return archive_write_header(archive) && success;
+}
+
+Archive* archive_alloc(const char* path, const char* index_path) {
+    Archive* archive = malloc(sizeof(Archive));
+    memset(archive, 0, sizeof(Archive));
+    archive->storage = furi_record_open(RECORD_STORAGE);
+    archive->file = storage_file_alloc(archive->storage);
+    archive->index = storage_file_alloc(archive->storage);
+
+    if(!storage_file_open(archive->file, path, FSAM_READ_WRITE, FSOM_OPEN_ALWAYS) ||
+       !storage_file_open(archive->index, index_path, FSAM_READ_WRITE, FSOM_OPEN_ALWAYS)) {
+        archive_free(archive);
+        return NULL;
+    }
+    archive->flushed = storage_file_size(archive->file);
+    archive->index_size = storage_file_size(archive->index);
+
+    ArchiveIndexHeader* header = &archive->header;
+    bool valid = archive->index_size >= ARCHIVE_TABLE_END &&
+                 archive_read_at(archive->index, 0, header, sizeof(*header), NULL) &&
+                 header->magic == ARCHIVE_INDEX_MAGIC && header->version == ARCHIVE_INDEX_VERSION &&
+                 header->slot_count == ARCHIVE_INDEX_SLOTS && header->indexed <= archive->flushed;
+    if(!valid) {
+        // Missing, from another version or ahead of the archive: the whole archive is indexed again
+        storage_file_close(archive->index);
+        if(!storage_file_open(archive->index, index_path, FSAM_READ_WRITE, FSOM_CREATE_ALWAYS) ||
+           !archive_index_create(archive)) {
+            archive_free(archive);
+            return NULL;
+        }
+    }
+    if(header->indexed < archive->flushed) {
+        uint32_t behind = archive->flushed - header->indexed;
+        if(!archive_catch_up(archive)) {
+            APP_LOG_W("Archive", "Indexing %lu archived bytes failed", (unsigned long)behind);
+        }
+    }
+    return archive;
+}
+
+void archive_free(Archive* archive) {
+    if(archive->open) {
+        archive_end(archive);
+    }
+    storage_file_close(archive->file);
+    storage_file_free(archive->file);
+    storage_file_close(archive->index);
+    storage_file_free(archive->index);
+    furi_record_close(RECORD_STORAGE);
+    free(archive);
+}
+
+void archive_begin(Archive* archive, bool is_user) {
+    if(archive->open) {
+        archive_end(archive);
+    }
+    archive->open = true;
+    archive->write_failed = false;
+    archive->line = archive_size(archive);
+    archive->term_count = 0;
+    archive->word.length = 0;
+    archive_put(archive, is_user ? 'U' : 'A');
+    archive_put(archive, ' ');
+}
+
+void archive_append(Archive* archive, const char* text, size_t length) {
+    for(size_t i = 0; i < length; i++) {
+        // One line per message
+        char c = text[i] == '\n' || text[i] == '\r' ? ' ' : text[i];
+        archive_put(archive, c);
+        archive_take(archive, c);
+    }
+}
+
+bool archive_end(Archive* archive) {
+    if(!archive->open) {
+        return true;
+    }
+    archive->open = false;
+
+    archive_take(archive, ' ');
+    archive_put(archive, '\n');
+    bool success = archive_flush(archive) && !archive->write_failed;
+    // Postings only for text that made it to the card
+    if(success) {
+        success = archive_index_line(archive, archive->line);
+    }
+    // Left behind after a failure, so the next archive_alloc indexes the line again
+    if(success && archive->header.indexed == archive->line) {
+        archive->header.indexed = archive->flushed;
+    }
+    return archive_write_header(archive) && success;
+}
+
+// Reads the posting at address into cursor; false at the end of the chain
+static bool archive_cursor_load(
+    Archive* archive,
+    ArchiveCursor* cursor,
+    uint32_t address,
+    ArchiveSearchStats* stats) {
+    ArchivePosting posting;
+    if(address == 0 || !archive_read_at(archive->index, address, &posting, sizeof(posting), &stats->reads)) {
+        return false;
+    }
+    stats->postings++;
+    // Postings only point back; anything else was torn by a crash and ends the chain
+    cursor->offset = posting.offset;
+    cursor->next = posting.next < address ? posting.next : 0;
+    cursor->skip = posting.skip < address ? posting.skip : 0;
+    return true;
+}
+
+// Moves back to the newest posting at or below lowest, or below it when past is set;
+// false if the chain ends first
+static bool archive_cursor_seek(
+    Archive* archive,
+    ArchiveCursor* cursor,
+    uint32_t lowest,
+    bool past,
+    ArchiveSearchStats* stats) {
+    while(cursor->offset > lowest || (past && cursor->offset == lowest)) {
+        // A skip that stays above lowest passes over postings the walk would only step
+        // through; one that does not is remembered, as the postings after it share it
+        if(cursor->skip && cursor->skip != cursor->skip_failed && cursor->offset > lowest) {
+            ArchiveCursor ahead = {.skip_failed = cursor->skip_failed};
+            if(archive_cursor_load(archive, &ahead, cursor->skip, stats) && ahead.offset > lowest) {
+                *cursor = ahead;
+                continue;
+            }
+            cursor->skip_failed = cursor->skip;
+        }
+        ArchiveCursor older = {.skip_failed = cursor->skip_failed};
+        if(!archive_cursor_load(archive, &older, cursor->next, stats)) {
+            return false;
+        }
+        *cursor = older;
+    }
+    return true;
+}
+
+uint8_t archive_search(
+    Archive* archive,
+    const char* query,
+    uint32_t* offsets,
+    uint8_t max,
+    ArchiveSearchStats* stats) {
+    ArchiveSearchStats unused;
+    if(!stats) {
+        stats = &unused;
+    }
+    memset(stats, 0, sizeof(ArchiveSearchStats));
+
+    uint32_t hashes[ARCHIVE_QUERY_WORDS];
+    uint8_t count = 0;
+    ArchiveWord word = {0};
+    for(const char* p = query;; p++) {
+        uint32_t hash;
+        if(archive_word_feed(&word, *p ? *p : ' ', &hash) && count < ARCHIVE_QUERY_WORDS) {
+            bool repeated = false;
+            for(uint8_t i = 0; i < count; i++) {
+                repeated |= hashes[i] == hash;
+            }
+            if(!repeated) {
+                hashes[count++] = hash;
+            }
+        }
+        if(*p == '\0') break;
+    }
+    if(count == 0 || max == 0) {
+        return 0;
+    }
+    archive_flush(archive);
+
+    // A word that is not in the table has no lines, and neither has the query
+    ArchiveCursor cursors[ARCHIVE_QUERY_WORDS];
+    for(uint8_t i = 0; i < count; i++) {
+        uint32_t slot;
+        ArchiveSlot entry;
+        if(!archive_find_slot(archive, hashes[i], &slot, &entry, &stats->reads) || entry.hash == 0) {
+            return 0;
+        }
+        cursors[i] = (ArchiveCursor){0};
+        if(!archive_cursor_load(archive, &cursors[i], entry.head, stats)) {
+            return 0;
+        }
+    }
+
+    // Every word's postings run newest first; a line is a hit once all of them are on it.
+    // Each round moves every word back to the oldest line any of them is on.
+    uint8_t found = 0;
+    while(found < max) {
+        uint32_t lowest = cursors[0].offset;
+        bool all = true;
+        for(uint8_t i = 1; i < count; i++) {
+            all &= cursors[i].offset == lowest;
+            if(cursors[i].offset < lowest) {
+                lowest = cursors[i].offset;
+            }
+        }
+        if(all) {
+            offsets[found++] = lowest;
+        }
+        for(uint8_t i = 0; i < count; i++) {
+            if(!archive_cursor_seek(archive, &cursors[i], lowest, all, stats)) {
+                return found;
+            }
+        }
+    }
+    return found;
+}
+
+size_t archive_read(Archive* archive, uint32_t offset, char* out, size_t size) {
+    if(size == 0) {
+        return 0;
+    }
+    archive_flush(archive);
+
+    size_t copied = 0;
+    if(offset < archive->flushed && storage_file_seek(archive->file, offset, true)) {
+        size_t want = archive->flushed - offset < size - 1 ? archive->flushed - offset : size - 1;
+        copied = storage_file_read(archive->file, out, want);
+    }
+    char* end = memchr(out, '\n', copied);
+    if(end) {
+        copied = end - out;
+    }
+    out[copied] = '\0';
+    return copied;
+}
+
+uint32_t archive_size(const Archive* archive) {
+    return archive->flushed + archive->buffered;
+}
+
+uint32_t archive_word_count(const Archive* archive) {
+    return archive->header.words;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Archive keeps every chat message on the SD card, one line each, next to an inverted
+ * index from each word to the lines holding it.  The index is a hash table of words,
+ * each pointing at its newest posting; a message's postings are appended when it is
+ * archived and link back to the word's previous ones, so a search reads the postings
+ * of its own words only, newest first, however large the archive has grown.
+*/
+typedef struct Archive Archive;
+
+typedef struct {
+    uint32_t postings; // walked by the search
+    uint32_t reads;    // storage reads it took, word table probes included
+} ArchiveSearchStats;
+
+/**
+ * Opens the archive and its index, creating both if needed.  Lines the index does not
+ * cover yet, after a crash or from an older index, are indexed first.
+ *
+ * @return  NULL if either file could not be opened
+*/
+Archive* archive_alloc(const char* path, const char* index_path);
+void archive_free(Archive* archive);
+
+/**
+ * Starts a message; its text follows in any number of archive_append calls and is
+ * indexed by archive_end.
+*/
+void archive_begin(Archive* archive, bool is_user);
+void archive_append(Archive* archive, const char* text, size_t length);
+
+/**
+ * @return  false if a write failed; the message may be missing from the index
+*/
+bool archive_end(Archive* archive);
+
+/**
+ * Finds the messages holding every word of query (case-insensitive), newest first.
+ *
+ * @param offsets  receives up to max line offsets for archive_read
+ * @return         number of offsets written
+*/
+uint8_t archive_search(
+    Archive* archive,
+    const char* query,
+    uint32_t* offsets,
+    uint8_t max,
+    ArchiveSearchStats* stats);
+
+/**
+ * Copies the line at offset, without its newline and cut to fit, into out.  The first
+ * character is 'U' for the user's messages and 'A' for replies, then a space.
+ *
+ * @return  characters copied
+*/
+size_t archive_read(Archive* archive, uint32_t offset, char* out, size_t size);
+
+uint32_t archive_size(const Archive* archive);
+uint32_t archive_word_count(const Archive* archive);
@@ -0,0 +1,361 @@
+#include "batch.h"
+#include "wifi.h"
+#include "trace.h"
+#include <string.h>
+
+// Reads the next line into batch->line, cutting it at BATCH_LINE_LENGTH; false at EOF
+static bool batch_read_line(BatchScreen* batch) {
+    size_t length = 0;
+    bool any = false;
+    for(;;) {
+        if(batch->read_pos == batch->read_length) {
+            batch->read_length = storage_file_read(batch->input, batch->read_buffer, sizeof(batch->read_buffer));
+            batch->read_pos = 0;
+            if(batch->read_length == 0) {
+                break;
+            }
+        }
+        char c = batch->read_buffer[batch->read_pos++];
+        any = true;
+        if(c == '\n') {
+            break;
+        }
+        if(c != '\r' && length < sizeof(batch->line) - 1) {
+            batch->line[length++] = c;
+        }
+    }
+    batch->line[length] = '\0';
+    return any;
+}
+
+/**
+ * Finds "key": "..." in a JSON object and returns the value still escaped, which is
+ * what the ESP32 pastes into its request body.  *complete is false when the closing
+ * quote is missing because the line was cut.
+*/
+static const char* batch_find_string(const char* line, const char* key, size_t* length, bool* complete) {
+    char quoted[16];
+    snprintf(quoted, sizeof(quoted), "\"%s\"", key);
+    for(const char* p = strstr(line, quoted); p; p = strstr(p + 1, quoted)) {
+        // An escaped quote belongs to some other value
+        if(p > line && p[-1] == '\\') {
+            continue;
+        }
+        const char* value = p + strlen(quoted);
+        while(*value == ' ') value++;
+        if(*value != ':') {
+            continue;
+        }
+        value++;
+        while(*value == ' ') value++;
+        if(*value != '"') {
+            continue;
+        }
+        value++;
+
+        size_t i = 0;
+        while(value[i] && value[i] != '"') {
+            i += value[i] == '\\' && value[i + 1] ? 2 : 1;
+        }
+        *length = i;
+        *complete = value[i] == '"';
+        return value;
+    }
+    return NULL;
+}
+
+// Longest prefix of an escaped string no longer than max that does not split an escape
+static size_t batch_escaped_prefix(const char* text, size_t length, size_t max) {
+    if(length <= max) {
+        return length;
+    }
+    size_t i = 0;
+    while(i < max) {
+        size_t step = text[i] != '\\' ? 1 : text[i + 1] == 'u' ? 6 : 2;
+        if(i + step > max) {
+            break;
+        }
+        i += step;
+    }
+    return i;
+}
+
+static void batch_write(BatchScreen* batch, const char* text, size_t length) {
+    storage_file_write(batch->output, text, length);
+}
+
+static void batch_write_skipped(BatchScreen* batch, const char* error) {
+    char record[64];
+    int len = snprintf(record, sizeof(record), "{\"line\":%lu,\"error\":\"%s\"}\n",
+                       (unsigned long)batch->line_number, error);
+    if(len > 0) {
+        batch_write(batch, record, len);
+    }
+    batch->skipped++;
+}
+
+// Builds the next BATCH command from the input, skipping lines without a prompt
+static bool batch_prepare_next(BatchScreen* batch) {
+    static const char* const keys[] = {"prompt", "body", "title"};
+    while(!batch->input_done) {
+        if(!batch_read_line(batch)) {
+            batch->input_done = true;
+            break;
+        }
+        batch->line_number++;
+        if(batch->line[0] == '\0') {
+            continue;
+        }
+
+        const char* prompt = NULL;
+        size_t length = 0;
+        bool complete = false;
+        for(size_t i = 0; i < COUNT_OF(keys) && !prompt; i++) {
+            prompt = batch_find_string(batch->line, keys[i], &length, &complete);
+            if(prompt && length == 0) {
+                prompt = NULL;
+            }
+        }
+        if(!prompt) {
+            batch_write_skipped(batch, "no prompt");
+            continue;
+        }
+
+        size_t sent = batch_escaped_prefix(prompt, length, BATCH_PROMPT_LENGTH);
+        int len = snprintf(batch->command, sizeof(batch->command), "BATCH %lu %.*s\r\n",
+                           (unsigned long)batch->line_number, (int)sent, prompt);
+        batch->command_length = len > 0 ? (size_t)len : 0;
+        batch->command_id = batch->line_number;
+        batch->command_truncated = !complete || sent < length;
+        return true;
+    }
+    return false;
+}
+
+static void batch_finish(BatchScreen* batch) {
+    batch->running = false;
+    batch->finished = true;
+    batch->finish_tick = furi_get_tick();
+
+    uint32_t rate = batch_rate_x10(batch);
+    char record[160];
+    int len = snprintf(record, sizeof(record),
+                       "{\"summary\":true,\"answered\":%lu,\"errors\":%lu,\"skipped\":%lu,"
+                       "\"in_flight\":%u,\"elapsed_ms\":%lu,\"prompts_per_min\":%lu.%lu}\n",
+                       (unsigned long)batch->answered, (unsigned long)batch->errors,
+                       (unsigned long)batch->skipped, batch->window,
+                       (unsigned long)(batch->finish_tick - batch->start_tick),
+                       (unsigned long)(rate / 10), (unsigned long)(rate % 10));
+    if(len > 0) {
+        batch_write(batch, record, len);
+    }
+    storage_file_sync(batch->output);
+}
+
+// Writes the answer the worker left in batch->done and frees its slot
+static void batch_write_done(BatchScreen* batch) {
+    BatchDone* done = &batch->done;
+    BatchSlot* slot = NULL;
+    for(uint8_t i = 0; i < BATCH_MAX_IN_FLIGHT; i++) {
+        if(batch->slots[i].id == done->id) {
+            slot = &batch->slots[i];
+        }
+    }
+    done->ready = false;
+    if(!slot) {
+        return;
+    }
+
+    long status = done->fields[0];
+    batch->last_ms = done->flipper_ms;
+    char record[224];
+    int len = snprintf(record, sizeof(record),
+                       "{\"line\":%lu,\"status\":%ld,\"flipper_ms\":%lu,\"queue_ms\":%ld,\"ttfb_ms\":%ld,"
+                       "\"total_ms\":%ld,\"tokens\":%ld,%s%s\"answer\":",
+                       (unsigned long)done->id, status, (unsigned long)done->flipper_ms, done->fields[1],
+                       done->fields[2], done->fields[3], done->fields[4],
+                       slot->truncated ? "\"truncated\":true," : "",
+                       done->cut ? "\"answer_truncated\":true," : "");
+    if(len > 0) {
+        batch_write(batch, record, len);
+        batch_write(batch, done->answer, strlen(done->answer));
+        batch_write(batch, "}\n", 2);
+    }
+
+    if(status == 200) {
+        batch->answered++;
+    } else {
+        batch->errors++;
+    }
+    slot->id = 0;
+    batch->in_flight--;
+}
+
+void batch_start(OllamaAppState* state) {
+    BatchScreen* batch = state->batch;
+    if(!batch || batch->running) {
+        return;
+    }
+    batch_close(batch);
+    uint8_t window = batch->window;
+    memset(batch, 0, sizeof(BatchScreen));
+    batch->window = window;
+
+    batch->storage = furi_record_open(RECORD_STORAGE);
+    batch->input = storage_file_alloc(batch->storage);
+    batch->output = storage_file_alloc(batch->storage);
+    if(!storage_file_open(batch->input, BATCH_INPUT_PATH, FSAM_READ, FSOM_OPEN_EXISTING) ||
+       !storage_file_open(batch->output, BATCH_OUTPUT_PATH, FSAM_WRITE, FSOM_CREATE_ALWAYS)) {
+        APP_LOG_W("Batch", "Cannot open %s or %s", BATCH_INPUT_PATH, BATCH_OUTPUT_PATH);
+        batch_close(batch);
+        batch->finished = true;
+        state->ui_update_needed = true;
+        return;
+    }
+
+    batch->running = true;
+    batch->start_tick = furi_get_tick();
+    batch_pump(state);
+}
+
+void batch_pump(OllamaAppState* state) {
+    BatchScreen* batch = state->batch;
+    if(!batch || !batch->running) {
+        return;
+    }
+    if(batch->done.ready) {
+        batch_write_done(batch);
+    }
+
+    while(batch->in_flight < batch->window) {
+        if(batch->command_length == 0 && !batch_prepare_next(batch)) {
+            break;
+        }
+        // All or nothing; if the TX queue is full the main loop tries again shortly
+        if(!wifi_send_batch(state, batch->command, batch->command_length)) {
+            break;
+        }
+        for(uint8_t i = 0; i < BATCH_MAX_IN_FLIGHT; i++) {
+            if(batch->slots[i].id == 0) {
+                batch->slots[i].id = batch->command_id;
+                batch->slots[i].sent = furi_get_tick();
+                batch->slots[i].truncated = batch->command_truncated;
+                break;
+            }
+        }
+        batch->in_flight++;
+        batch->command_length = 0;
+    }
+
+    if(batch->input_done && batch->in_flight == 0 && batch->command_length == 0) {
+        batch_finish(batch);
+    }
+    state->ui_update_needed = true;
+}
+
+void batch_complete(OllamaAppState* state, const char* result) {
+    BatchScreen* batch = state->batch;
+    if(!batch || !batch->running) {
+        return;
+    }
+
+    char* end;
+    uint32_t id = strtoul(result, &end, 10);
+    long fields[5];
+    for(size_t i = 0; i < COUNT_OF(fields); i++) {
+        if(*end != ',') {
+            return;
+        }
+        fields[i] = strtol(end + 1, &end, 10);
+    }
+    if(*end != ',') {
+        return;
+    }
+    const char* answer = end + 1;
+    if(*answer != '"') {
+        answer = "\"\"";
+    }
+
+    // Ignore answers nothing is waiting for
+    BatchSlot* slot = NULL;
+    for(uint8_t i = 0; i < BATCH_MAX_IN_FLIGHT; i++) {
+        if(batch->slots[i].id == id) {
+            slot = &batch->slots[i];
+        }
+    }
+    if(id == 0 || !slot) {
+        return;
+    }
+    uint32_t flipper_ms = furi_get_tick() - slot->sent;
+
+    // This runs in process_line, which holds the screen mutex: while the main loop has
+    // not written the last answer, let it have the mutex and wait, and flow control
+    // holds the ESP32 back meanwhile
+    while(state->batch && state->batch->done.ready) {
+        furi_mutex_release(state->screen_mutex);
+        furi_delay_ms(1);
+        furi_mutex_acquire(state->screen_mutex, FuriWaitForever);
+    }
+    if(state->batch != batch || !batch->running || slot->id != id) {
+        // The batch screen closed while the worker waited
+        return;
+    }
+
+    BatchDone* done = &batch->done;
+    done->id = id;
+    memcpy(done->fields, fields, sizeof(fields));
+    done->flipper_ms = flipper_ms;
+    // Keep the literal whole: cut between escapes and close the quote again
+    size_t length = strlen(answer);
+    done->cut = length >= sizeof(done->answer);
+    if(done->cut) {
+        length = 1 + batch_escaped_prefix(answer + 1, length - 1, sizeof(done->answer) - 3);
+        memcpy(done->answer, answer, length);
+        done->answer[length++] = '"';
+        done->answer[length] = '\0';
+    } else {
+        memcpy(done->answer, answer, length + 1);
+    }
+    done->ready = true;
+    ollama_app_wake(state);
+}
+
+void batch_close(BatchScreen* batch) {
+    batch->running = false;
+    if(batch->input) {
+        storage_file_close(batch->input);
+        storage_file_free(batch->input);
+        batch->input = NULL;
+    }
+    if(batch->output) {
+        storage_file_close(batch->output);
+        storage_file_free(batch->output);
+        batch->output = NULL;
+    }
+    if(batch->storage) {
+        furi_record_close(RECORD_STORAGE);
+        batch->storage = NULL;
+    }
+}
+
+uint32_t batch_rate_x10(const BatchScreen* batch) {
+    uint32_t end = batch->running ? furi_get_tick() : batch->finish_tick;
+    uint32_t elapsed = end - batch->start_tick;
+    if(elapsed == 0) {
+        return 0;
+    }
+    return (uint32_t)((uint64_t)(batch->answered + batch->errors) * 600000 / elapsed);
+}
+
+void process_batch(OllamaAppState* state, InputEvent* event) {
+    BatchScreen* batch = state->batch;
+    if(event->key == InputKeyLeft) {
+        if(batch->window > 1) batch->window--;
+    } else if(event->key == InputKeyRight) {
+        if(batch->window < BATCH_MAX_IN_FLIGHT) batch->window++;
+    } else if(event->key == InputKeyOk) {
+        batch_start(state);
+    }
+    // A wider window takes effect at once; a narrower one as answers come back
+    batch_pump(state);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "ollama_app_i.h"
+
+/**
+ * Batch mode runs every prompt in BATCH_INPUT_PATH, one JSON object per line with a
+ * "prompt" (or "body" or "title") field, and appends one JSON object per answer to
+ * BATCH_OUTPUT_PATH as answers arrive.  Up to window prompts are at the ESP32 at a
+ * time; it runs them concurrently, each worker on its own keep-alive connection.
+*/
+void batch_start(OllamaAppState* state);
+
+/**
+ * Writes the answer batch_complete left, then sends prompts until window of them are
+ * in flight.  Called from the main loop, which a BATCH_DONE wakes; it also retries a
+ * command the TX queue had no room for.  All of batch mode's SD access happens here.
+*/
+void batch_pump(OllamaAppState* state);
+
+/**
+ * Takes "<id>,<status>,<queue_ms>,<ttfb_ms>,<total_ms>,<tokens>,<answer>" from a
+ * BATCH_DONE line for batch_pump to write; answer is a JSON string literal.  Called from
+ * the UART worker, which it holds while the previous answer is still unwritten.
+*/
+void batch_complete(OllamaAppState* state, const char* result);
+
+void batch_close(BatchScreen* batch);
+void process_batch(OllamaAppState* state, InputEvent* event);
+
+/**
+ * @return  Answers per minute since the run started, times ten.
+*/
+uint32_t batch_rate_x10(const BatchScreen* batch);
@@ -0,0 +1,130 @@
+"""Boot-to-ready time of the ESP32 sketch with its settings kept in NVS.
+
+Runs the host build of esp32_WexbideBot (host/build/esp32) against a mock Ollama with
+the shim's NVS in a temporary directory and times, from process start to its READY
+line, three boots: the first one with empty NVS, where the Flipper has to send the
+settings; a reboot, which needs nothing from the Flipper; and a reboot after the
+network it used last has gone, which has to scan for another known one.
+
+    make -C host
+    python3 bench/boot_bench.py --esp32 host/build/esp32
+"""
+
+import argparse
+import os
+import sys
+import tempfile
+import time
+from types import SimpleNamespace
+
+import mock_ollama
+from failover_bench import Sketch
+
+NETWORKS = (("HostNetwork", "hunter22"), ("Neighbour", "letmein1"))
+
+
+def config_version(url, user, model, networks):
+    """FNV-1a of the settings text, as computed by the sketch and wexbide.hash."""
+    text = "%s\n%s\n%s\n" % (url, user, model)
+    text += "".join("%s//%s\n" % network for network in networks)
+    value = 2166136261
+    for byte in text.encode():
+        value = ((value ^ byte) * 16777619) & 0xFFFFFFFF
+    return value
+
+
+def send_config(sketch, url, user, model, networks):
+    """What Wexbide_AI.js does: asks for the stored version and sends the settings if it differs."""
+    version = config_version(url, user, model, networks)
+    sketch.send("CONFIG?")
+    stored = int(sketch.expect("CONFIG:", 5)[len("CONFIG:"):])
+    if stored == version:
+        return False
+    sketch.send("CONFIG BEGIN %d" % version)
+    sketch.send("CONFIG URL " + url)
+    sketch.send("CONFIG USER " + user)
+    sketch.send("CONFIG MODEL " + model)
+    for network in networks:
+        sketch.send("CONFIG AP %s//%s" % network)
+    sketch.send("CONFIG END")
+    sketch.expect("CONFIG_OK:%d" % version, 5)
+    return True
+
+
+def boot(options, configure=None):
+    """Starts the sketch; returns (ms to READY, its millis(), lines before it, settings sent)."""
+    start = time.monotonic()
+    sketch = Sketch(options.esp32)
+    seen = []
+    try:
+        sketch.expect("Welcome to the Ollama ESP32!", 10)
+        sent = configure(sketch) if configure else False
+        ready = sketch.expect("READY:", options.timeout, seen)
+        elapsed = (time.monotonic() - start) * 1000
+        # Whatever the boot needed, the Flipper should now find nothing to send
+        if configure is None and configure_needed(sketch, options):
+            raise AssertionError("settings were lost over the reboot")
+        return elapsed, int(ready[len("READY:"):]), seen, sent
+    finally:
+        sketch.close()
+
+
+def configure_needed(sketch, options):
+    return send_config(sketch, options.url, "bench", options.model, NETWORKS)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--esp32", default="host/build/esp32")
+    parser.add_argument("--assoc-ms", type=int, default=1000, help="simulated WiFi association time")
+    parser.add_argument("--timeout", type=float, default=30.0, help="per boot, seconds")
+    parser.add_argument("--model", default="mistral")
+    mock_ollama.add_behaviour_arguments(parser.add_argument_group("mock server"))
+    parser.set_defaults(load_delay=0.0, first_token_delay=0.0, tokens=8, token_rate=400.0)
+    options = parser.parse_args()
+
+    server_options = SimpleNamespace(**vars(options))
+    server_options.host, server_options.port, server_options.verbose = "127.0.0.1", 0, False
+    server, options.url = mock_ollama.start_in_background(server_options)
+
+    rows = []
+    failures = []
+    with tempfile.TemporaryDirectory() as nvs:
+        os.environ["ESP32_SHIM_NVS_DIR"] = nvs
+        os.environ["ESP32_SHIM_ASSOC_MS"] = str(options.assoc_ms)
+        os.environ["ESP32_SHIM_NETWORKS"] = ",".join(
+            "%s:-%d" % (ssid, 40 + 20 * i) for i, (ssid, _) in enumerate(NETWORKS))
+        try:
+            elapsed, ready, _, sent = boot(options, lambda sketch: configure_needed(sketch, options))
+            if not sent:
+                failures.append("first boot already had settings")
+            rows.append(("first boot, empty NVS", elapsed, ready, "settings sent"))
+
+            elapsed, ready, seen, _ = boot(options)
+            scanned = any(line.startswith("Found matching SSID") for line in seen)
+            rows.append(("reboot", elapsed, ready, "scanned" if scanned else "no scan"))
+            if scanned:
+                failures.append("reboot scanned although the last network was still there")
+
+            os.environ["ESP32_SHIM_FAIL_SSID"] = NETWORKS[0][0]
+            elapsed, ready, seen, _ = boot(options)
+            scanned = any(line.startswith("Found matching SSID: " + NETWORKS[1][0]) for line in seen)
+            rows.append(("reboot, last AP gone", elapsed, ready, "scanned" if scanned else "no scan"))
+            if not scanned:
+                failures.append("did not fall back to %s" % NETWORKS[1][0])
+        except (TimeoutError, AssertionError) as error:
+            failures.append(str(error))
+        finally:
+            os.environ.pop("ESP32_SHIM_FAIL_SSID", None)
+            server.shutdown()
+
+    print("%-24s %9s %9s  %s" % ("boot", "wall ms", "READY ms", ""))
+    for name, elapsed, ready, note in rows:
+        print("%-24s %9.0f %9d  %s" % (name, elapsed, ready, note))
+    for failure in failures:
+        print("FAIL: %s" % failure, file=sys.stderr)
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == "__main__":
+    main()
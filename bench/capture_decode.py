@@ -0,0 +1,54 @@
+"""Decodes a UART capture the app writes to /ext/ollama/uart_capture.bin.
+
+Prints one chunk per line with the time since the capture started and since the
+previous chunk, its direction and its bytes, so the traffic on the serial link can be
+read back without replaying it.
+
+    python3 bench/capture_decode.py uart_capture.bin
+"""
+
+import argparse
+import struct
+import sys
+
+CAPTURE_MAGIC = 0x50414355
+HEADER = struct.Struct("<IHHII")
+RECORD = struct.Struct("<IHB")
+
+# Mirrors UartCaptureDirection in helpers/uart_helper.h
+DIRECTIONS = ["rx", "tx"]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("file")
+    options = parser.parse_args()
+
+    with open(options.file, "rb") as f:
+        data = f.read()
+
+    magic, version, record_size, start_tick, app_state = HEADER.unpack_from(data)
+    if magic != CAPTURE_MAGIC or record_size != RECORD.size:
+        sys.exit("%s: not a UART capture (version %d)" % (options.file, version))
+
+    print("started on app state %d" % app_state)
+    offset = HEADER.size
+    previous = start_tick
+    totals = [0, 0]
+    while offset + RECORD.size <= len(data):
+        tick, length, direction = RECORD.unpack_from(data, offset)
+        chunk = data[offset + RECORD.size:offset + RECORD.size + length]
+        offset += RECORD.size + length
+        if len(chunk) < length:
+            print("capture ends inside a chunk", file=sys.stderr)
+            break
+        totals[direction & 1] += length
+        name = DIRECTIONS[direction] if direction < len(DIRECTIONS) else "dir%d" % direction
+        print("%8d ms %+6d  %s %3d %r" % ((tick - start_tick) & 0xFFFFFFFF,
+                                          (tick - previous) & 0xFFFFFFFF, name, length, chunk))
+        previous = tick
+    print("%d bytes rx, %d bytes tx" % tuple(totals))
+
+
+if __name__ == "__main__":
+    main()
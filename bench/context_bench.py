@@ -0,0 +1,156 @@
+"""File context through the ESP32 sketch: an SD file streamed into the request body.
+
+Runs the host build of the dev sketch (host/build/esp32_dev) against a mock Ollama and
+plays the Flipper's side of FILE: the command, then the file in chunks, never more than
+the Flipper's window ahead of the sketch's last FILE_ACK.  For each file size the mock
+checks that the prompt it decoded from the chunked body is the file, escapes and all,
+followed by the question; the sketch's TELEMETRY shows whether its low-water heap mark
+moved with the file size.  Then an upload the Flipper abandons half way and one the
+server turns down must both end in FILE_FAILED and leave the sketch answering prompts.
+
+    make -C host
+    python3 bench/context_bench.py --esp32 host/build/esp32_dev
+"""
+
+import argparse
+import sys
+import time
+from types import SimpleNamespace
+
+import mock_ollama
+from failover_bench import Sketch
+
+# CONTEXT_CHUNK_SIZE, CONTEXT_WINDOW and CONTEXT_ESCAPE in ollama_app_i.h
+CHUNK = 128
+WINDOW = 256
+ESCAPE = 0x10
+QUESTION = 'what does "this" file say?'
+# Everything the sketch has to escape, UTF-8 split across chunks, and the bytes the
+# Flipper escapes on the line: XON, XOFF and the escape itself
+LINE = 'line %06d: "quoted" C:\\path\ttab \u00e9t\u00e9 \u2014 \U0001F642 \x01 \x11\x13\x10 end\r\n'
+
+
+def file_text(size):
+    data = b""
+    while len(data) < size:
+        data += (LINE % (len(data) // 64)).encode()
+    return data[:size]
+
+
+def min_free_heap(sketch):
+    sketch.send("TELEMETRY")
+    return int(sketch.expect("TELEMETRY:", 5)[len("TELEMETRY:"):].split(",")[1])
+
+
+def escape(data):
+    """The file as context_pump puts it on the line."""
+    out = bytearray()
+    for byte in data:
+        if byte in (0x11, 0x13, ESCAPE):
+            out += bytes((ESCAPE, byte ^ 0x20))
+        else:
+            out.append(byte)
+    return bytes(out)
+
+
+def upload(sketch, data, timeout, stop_at=None):
+    """Sends FILE and the data as the Flipper does; returns the final FILE_ line."""
+    sketch.send("FILE %d %s" % (len(data), QUESTION))
+    line = sketch.expect("FILE_", timeout)
+    # Chunks, window and FILE_ACK all count bytes on the line, escapes included
+    wire = escape(data)
+    stop_at = len(wire) if stop_at is None else len(escape(data[:stop_at]))
+    sent = 0
+    while line.startswith("FILE_ACK:"):
+        acked = int(line[len("FILE_ACK:"):])
+        if acked >= len(wire):
+            return line
+        while sent < stop_at and sent - acked + CHUNK <= WINDOW:
+            chunk = wire[sent:min(sent + CHUNK, stop_at)]
+            sketch.process.stdin.write(chunk)
+            sketch.process.stdin.flush()
+            sent += len(chunk)
+        line = sketch.expect("FILE_", timeout)
+    return line
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--esp32", default="host/build/esp32_dev")
+    parser.add_argument("--sizes", default="1024,16384,65536", help="file sizes, bytes")
+    parser.add_argument("--timeout", type=float, default=30.0, help="per step, seconds")
+    parser.add_argument("--model", default="mistral")
+    mock_ollama.add_behaviour_arguments(parser.add_argument_group("mock server"))
+    parser.set_defaults(load_delay=0.0, first_token_delay=0.02, tokens=8, token_rate=400.0)
+    options = parser.parse_args()
+
+    server_options = SimpleNamespace(**vars(options))
+    server_options.host, server_options.port, server_options.verbose = "127.0.0.1", 0, False
+    server, url = mock_ollama.start_in_background(server_options)
+    sketch = Sketch(options.esp32)
+    rows = []
+    failures = []
+    try:
+        sketch.expect("DEBUG: ESP32 WiFi Scanner Ready", 10)
+        sketch.send("CONNECT bench password")
+        sketch.expect("CONNECTED:", 10)
+        sketch.send("URL " + url)
+        sketch.expect("URL_OK", 5)
+        sketch.expect("WARMUP", 10)
+        heap_before = min_free_heap(sketch)
+
+        for size in (int(size) for size in options.sizes.split(",")):
+            data = file_text(size)
+            start = time.monotonic()
+            last = upload(sketch, data, options.timeout)
+            uploaded = time.monotonic() - start
+            if not last.startswith("FILE_ACK:"):
+                raise AssertionError("%d bytes: %s" % (size, last))
+            sketch.expect('Ollama: "', options.timeout)
+            answered = time.monotonic() - start
+            heap = min_free_heap(sketch)
+            rows.append((size, uploaded * 1000, answered * 1000, server.last_body_chunks,
+                         heap_before - heap))
+            if server.last_prompt != data.decode() + "\n\n" + QUESTION:
+                failures.append("%d bytes: the server got a different prompt" % size)
+
+        # The Flipper goes quiet half way: the sketch gives up and drops the request
+        served = server.requests_served
+        data = file_text(4096)
+        last = upload(sketch, data, options.timeout, stop_at=2048)
+        if not last.startswith("FILE_FAILED:"):
+            failures.append("abandoned upload ended with %r" % last)
+        if server.requests_served != served:
+            failures.append("the server answered an abandoned upload")
+        print("abandoned at 2048 of 4096 bytes: %s" % last)
+
+        # The server turns the request down once it has read it
+        server.fault = "error"
+        last = upload(sketch, data, options.timeout)
+        if last.startswith("FILE_ACK:"):
+            last = sketch.expect("FILE_FAILED:", options.timeout)
+        server.fault = None
+        if last != "FILE_FAILED:500":
+            failures.append("refused upload ended with %r" % last)
+        print("refused by the server: %s" % last)
+
+        sketch.send("plain prompt after the failures")
+        sketch.expect('Ollama: "', options.timeout)
+    except (TimeoutError, AssertionError) as error:
+        failures.append(str(error))
+    finally:
+        sketch.close()
+        server.shutdown()
+
+    print("%10s %10s %10s %8s %8s %14s" % ("bytes", "upload ms", "answer ms", "KB/s", "chunks",
+                                           "heap low moved"))
+    for size, uploaded, answered, chunks, heap in rows:
+        print("%10d %10.0f %10.0f %8.0f %8d %14d" % (
+            size, uploaded, answered, size / 1024 / (uploaded / 1000), chunks, heap))
+    for failure in failures:
+        print("FAIL: %s" % failure, file=sys.stderr)
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == "__main__":
+    main()
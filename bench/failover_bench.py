@@ -0,0 +1,184 @@
+"""Endpoint selection and failover test for the ESP32 sketch's server list.
+
+Starts several mock Ollama servers with different injected latencies, runs the host
+build of the dev sketch (host/build/esp32_dev) over pipes, gives it the list with the
+URL command and then checks, prompt by prompt, that requests go to the fastest healthy
+server and still get answered while servers return errors, hang or go away.
+
+    make -C host
+    python3 bench/failover_bench.py --esp32 host/build/esp32_dev
+"""
+
+import argparse
+import queue
+import subprocess
+import sys
+import threading
+import time
+from types import SimpleNamespace
+
+import mock_ollama
+
+# Injected latency per server, in server_url.txt order: the fastest is not listed first
+LATENCIES = (0.15, 0.02, 0.08)
+NAMES = ("slow", "fast", "medium")
+
+
+class Sketch:
+    """The sketch process; lines it prints are collected by a reader thread."""
+
+    def __init__(self, path):
+        self.process = subprocess.Popen(
+            [path], stdin=subprocess.PIPE, stdout=subprocess.PIPE, bufsize=0)
+        self.lines = queue.Queue()
+        threading.Thread(target=self.read_lines, daemon=True).start()
+
+    def read_lines(self):
+        for raw in self.process.stdout:
+            self.lines.put(raw.decode(errors="replace").rstrip("\r\n"))
+
+    def send(self, line):
+        self.process.stdin.write(line.encode() + b"\n")
+        self.process.stdin.flush()
+
+    def expect(self, prefix, timeout, seen=None):
+        """Returns the first line starting with `prefix`; earlier lines go to `seen`."""
+        deadline = time.monotonic() + timeout
+        while True:
+            remaining = deadline - time.monotonic()
+            if remaining <= 0:
+                raise TimeoutError("no %r line within %.0f s" % (prefix, timeout))
+            try:
+                line = self.lines.get(timeout=remaining)
+            except queue.Empty:
+                continue
+            if line.startswith(prefix):
+                return line
+            if seen is not None:
+                seen.append(line)
+
+    def endpoints(self):
+        """[(healthy, latency_ms or -1)] in list order, from the ENDPOINTS command."""
+        self.send("ENDPOINTS")
+        self.expect("DEBUG: Received command: ENDPOINTS", 5)
+        result = []
+        while True:
+            try:
+                line = self.lines.get(timeout=0.2)
+            except queue.Empty:
+                return result
+            if line.startswith("ENDPOINT:"):
+                _, healthy, latency, _ = line[len("ENDPOINT:"):].split(",", 3)
+                result.append((healthy == "1", int(latency)))
+
+    def wait_endpoints(self, predicate, timeout):
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            state = self.endpoints()
+            if predicate(state):
+                return state
+            time.sleep(0.25)
+        raise TimeoutError("endpoint state never matched: %s" % self.endpoints())
+
+    def close(self):
+        self.process.stdin.close()
+        self.process.wait(timeout=5)
+
+
+def start_servers(options):
+    servers = []
+    urls = []
+    for latency in LATENCIES:
+        server_options = SimpleNamespace(**vars(options))
+        server_options.host, server_options.port, server_options.verbose = "127.0.0.1", 0, False
+        server_options.latency = latency
+        server, url = mock_ollama.start_in_background(server_options)
+        servers.append(server)
+        urls.append(url)
+    return servers, urls
+
+
+def prompt(sketch, servers, text, timeout):
+    """Sends one prompt; returns (elapsed_ms, names of servers that answered, failovers)."""
+    before = [server.requests_served for server in servers]
+    seen = []
+    start = time.monotonic()
+    sketch.send(text)
+    sketch.expect('Ollama: "', timeout, seen)
+    elapsed = (time.monotonic() - start) * 1000
+    served = [NAMES[i] for i, server in enumerate(servers) if server.requests_served > before[i]]
+    failovers = sum("failing over" in line for line in seen)
+    if any(line.startswith("Error on HTTP request") for line in seen):
+        raise AssertionError("%r was not answered" % text)
+    return elapsed, served, failovers
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--esp32", default="host/build/esp32_dev")
+    parser.add_argument("--timeout", type=float, default=30.0, help="per prompt, seconds")
+    parser.add_argument("--model", default="mistral")
+    mock_ollama.add_behaviour_arguments(parser.add_argument_group("mock server"))
+    parser.set_defaults(load_delay=0.0, first_token_delay=0.0, tokens=8, token_rate=400.0)
+    options = parser.parse_args()
+
+    servers, urls = start_servers(options)
+    sketch = Sketch(options.esp32)
+    slow, fast, medium = range(3)
+    rows = []
+    failures = []
+
+    def check(scenario, expected, result):
+        elapsed, served, failovers = result
+        rows.append((scenario, elapsed, "+".join(served) or "-", failovers))
+        if served != [NAMES[expected]]:
+            failures.append("%s: answered by %s, expected %s" % (scenario, served, NAMES[expected]))
+
+    try:
+        sketch.expect("DEBUG: ESP32 WiFi Scanner Ready", 10)
+        sketch.send("CONNECT bench password")
+        sketch.expect("WiFi connected", 10)
+        sketch.send("URL " + " ".join(urls))
+        sketch.expect("URL_OK", 5)
+        sketch.expect("WARMUP", 10)
+
+        state = sketch.wait_endpoints(lambda s: len(s) == 3 and all(l >= 0 for _, l in s), 10)
+        print("probed latencies (ms): %s" % ", ".join(
+            "%s %d" % (NAMES[i], latency) for i, (_, latency) in enumerate(state)))
+
+        check("all healthy", fast, prompt(sketch, servers, "route to fastest", options.timeout))
+
+        servers[fast].fault = "error"
+        check("fast returns 500", medium, prompt(sketch, servers, "fail over on 500", options.timeout))
+        check("fast still down", medium, prompt(sketch, servers, "stay on medium", options.timeout))
+
+        servers[fast].fault = None
+        sketch.wait_endpoints(lambda s: s[fast][0], 15)
+        check("fast recovered", fast, prompt(sketch, servers, "back to fastest", options.timeout))
+
+        # Unless a probe gets there first, this prompt waits out the request timeout on
+        # fast and is then refused by medium before slow answers
+        servers[fast].fault = "hang"
+        servers[medium].shutdown()
+        servers[medium].server_close()
+        check("fast hangs, medium gone", slow, prompt(sketch, servers, "last one standing", options.timeout))
+        check("after failover", slow, prompt(sketch, servers, "no second wait", options.timeout))
+    except (TimeoutError, AssertionError) as error:
+        failures.append(str(error))
+    finally:
+        servers[fast].fault = None
+        sketch.close()
+        for i, server in enumerate(servers):
+            if i != medium:
+                server.shutdown()
+
+    print("%-24s %9s %-8s %9s" % ("scenario", "ms", "served", "failovers"))
+    for scenario, elapsed, served, failovers in rows:
+        print("%-24s %9.0f %-8s %9d" % (scenario, elapsed, served, failovers))
+    for failure in failures:
+        print("FAIL: %s" % failure, file=sys.stderr)
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,121 @@
+"""Tail latency of the ESP32 sketch's prompts with and without hedging.
+
+Starts two mock Ollama servers that each answer a random share of prompts late, runs
+the host build of the dev sketch (host/build/esp32_dev) against both and sends the
+same number of prompts with hedging off and then on.  The sketch's HEDGE command
+reports the p99 of each run, how many prompts were hedged and how many hedges won;
+the servers confirm that the losing request of a hedged prompt was cancelled.
+
+    make -C host
+    python3 bench/hedge_bench.py --esp32 host/build/esp32_dev
+"""
+
+import argparse
+import sys
+import time
+from types import SimpleNamespace
+
+import mock_ollama
+from failover_bench import Sketch
+
+
+def start_servers(options):
+    servers = []
+    urls = []
+    for seed in (1, 2):
+        server_options = SimpleNamespace(**vars(options))
+        server_options.host, server_options.port, server_options.verbose = "127.0.0.1", 0, False
+        server_options.seed = seed
+        server, url = mock_ollama.start_in_background(server_options)
+        servers.append(server)
+        urls.append(url)
+    return servers, urls
+
+
+def hedge_stats(sketch):
+    """(delay ms, hedged prompts, hedges, hedge wins, p99 ms off, p99 ms on)"""
+    sketch.send("HEDGE")
+    line = sketch.expect("HEDGE:", 5)
+    return tuple(int(field) for field in line[len("HEDGE:"):].split(","))
+
+
+def run_phase(sketch, name, prompts, timeout):
+    elapsed = []
+    for i in range(prompts):
+        seen = []
+        start = time.monotonic()
+        sketch.send("%s prompt %d" % (name, i))
+        sketch.expect('Ollama: "', timeout, seen)
+        elapsed.append((time.monotonic() - start) * 1000)
+        if any(line.startswith("Error on HTTP request") for line in seen):
+            raise AssertionError("%s prompt %d was not answered" % (name, i))
+    elapsed.sort()
+    return elapsed
+
+
+def percentile(values, p):
+    return values[max(0, (len(values) * p + 99) // 100 - 1)]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--esp32", default="host/build/esp32_dev")
+    parser.add_argument("--prompts", type=int, default=100, help="per phase")
+    parser.add_argument("--hedge-ms", type=int, default=150, help="first-token deadline")
+    parser.add_argument("--timeout", type=float, default=30.0, help="per prompt, seconds")
+    parser.add_argument("--model", default="mistral")
+    mock_ollama.add_behaviour_arguments(parser.add_argument_group("mock server"))
+    parser.set_defaults(load_delay=0.0, first_token_delay=0.02, tokens=8, token_rate=400.0,
+                        slow_fraction=0.08, slow_delay=1.0)
+    options = parser.parse_args()
+
+    servers, urls = start_servers(options)
+    sketch = Sketch(options.esp32)
+    rows = []
+    failures = []
+    try:
+        sketch.expect("DEBUG: ESP32 WiFi Scanner Ready", 10)
+        sketch.send("CONNECT bench password")
+        sketch.expect("CONNECTED:", 10)
+        sketch.send("URL " + " ".join(urls))
+        sketch.expect("URL_OK", 5)
+        sketch.expect("WARMUP", 10)
+
+        sketch.send("HEDGE OFF")
+        plain = run_phase(sketch, "unhedged", options.prompts, options.timeout)
+        sketch.send("HEDGE %d" % options.hedge_ms)
+        cancelled = sum(server.requests_cancelled for server in servers)
+        hedged = run_phase(sketch, "hedged", options.prompts, options.timeout)
+        cancelled = sum(server.requests_cancelled for server in servers) - cancelled
+
+        delay, prompts, hedges, wins, p99_off, p99_on = hedge_stats(sketch)
+        rows.append(("off", plain, "-", p99_off))
+        rows.append(("%d ms" % delay, hedged, "%d/%d, %d won" % (hedges, prompts, wins), p99_on))
+        print("slowed answers: %d, losing requests cancelled: %d"
+              % (sum(server.requests_slowed for server in servers), cancelled))
+
+        if prompts != options.prompts:
+            failures.append("%d prompts were hedged, expected %d" % (prompts, options.prompts))
+        if p99_on >= p99_off:
+            failures.append("hedging did not cut the p99 (%d ms vs %d ms)" % (p99_on, p99_off))
+        if wins > 0 and cancelled == 0:
+            failures.append("hedges won but no losing request was cancelled")
+    except (TimeoutError, AssertionError) as error:
+        failures.append(str(error))
+    finally:
+        sketch.close()
+        for server in servers:
+            server.shutdown()
+
+    # Client-side columns include the UART; the p99 column is the sketch's own
+    print("%-8s %8s %8s %8s %18s %12s" % ("hedging", "p50 ms", "p90 ms", "max ms", "hedged", "sketch p99"))
+    for name, elapsed, hedged, p99 in rows:
+        print("%-8s %8.0f %8.0f %8.0f %18s %12d" % (
+            name, percentile(elapsed, 50), percentile(elapsed, 90), elapsed[-1], hedged, p99))
+    for failure in failures:
+        print("FAIL: %s" % failure, file=sys.stderr)
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,348 @@
+"""Local stand-in for an Ollama server's /api/generate endpoint.
+
+Answers with generated filler tokens at a configurable rate so client changes can be
+measured without a GPU box.  Supports streaming (NDJSON over chunked encoding) and
+non-streaming responses, chunked request bodies, HTTP/1.1 keep-alive, and a simulated
+model load that is paid on the first request and again whenever keep_alive has expired.  --latency adds a fixed
+delay to every request, --slow-fraction makes a random share of answers start
+--slow-delay late, and a driver can set `server.fault` to make it fail.  With
+--tls-cert and --tls-key it serves HTTPS (TLS 1.2, like mbed TLS on the ESP32) and
+counts full and resumed handshakes; a driver can clear `server.keep_alive` so every
+connection is closed after one response.
+
+    python3 bench/mock_ollama.py --port 11434 --token-rate 30 --first-token-delay 0.2
+"""
+
+import argparse
+import json
+import random
+import re
+import socket
+import ssl
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+WORDS = (
+    "the model answers with a steady stream of plausible words so that the "
+    "client can be timed end to end without any real inference happening"
+).split()
+
+# With --markdown: the markup, typography and emoji a real model answers with
+MARKDOWN_WORDS = (
+    "## Answer\n\nHere is **bold** text with \u201csmart quotes\u201d, an emoji \U0001F642 "
+    "\u2014 and `inline code` plus a [link](http://example.com)\u2026\n\n* first item\n"
+    "* second item\n\n1. numbered\n2. list\n\n"
+).split(" ")
+
+
+def parse_keep_alive(value, default):
+    """Ollama accepts a duration string ("5m", "30s") or a number of seconds."""
+    if value is None:
+        return default
+    if isinstance(value, (int, float)):
+        return float(value)
+    match = re.fullmatch(r"(\d+(?:\.\d+)?)([smh]?)", str(value).strip())
+    if not match:
+        return default
+    scale = {"": 1, "s": 1, "m": 60, "h": 3600}[match.group(2)]
+    return float(match.group(1)) * scale
+
+
+class MockModel:
+    """Tracks whether the model is resident, like Ollama's keep_alive handling."""
+
+    def __init__(self, load_delay):
+        self.load_delay = load_delay
+        self.expires_at = 0.0
+        self.lock = threading.Lock()
+
+    def ensure_loaded(self, keep_alive):
+        """Returns the seconds spent loading (0 when already warm)."""
+        with self.lock:
+            now = time.monotonic()
+            load = 0.0
+            if now >= self.expires_at:
+                time.sleep(self.load_delay)
+                load = self.load_delay
+            self.expires_at = time.monotonic() + keep_alive
+            return load
+
+
+class MockOllamaServer(ThreadingHTTPServer):
+    daemon_threads = True
+
+    def __init__(self, address, options):
+        super().__init__(address, MockOllamaHandler)
+        self.options = options
+        self.model = MockModel(options.load_delay)
+        # Requests beyond --parallel queue for a slot, like OLLAMA_NUM_PARALLEL
+        self.slots = threading.Semaphore(options.parallel)
+        self.requests_served = 0
+        self.requests_slowed = 0
+        self.requests_cancelled = 0
+        # The prompt of the last request and, if its body was chunked, how many chunks it came in
+        self.last_prompt = None
+        self.last_body_chunks = 0
+        self.random = random.Random(getattr(options, "seed", None))
+        self.counter_lock = threading.Lock()
+        # None, "error" (answer 500) or "hang" (say nothing until the fault is cleared)
+        self.fault = None
+        # False answers every request with "Connection: close"
+        self.keep_alive = True
+
+        self.ssl_context = None
+        self.tls_full = 0
+        self.tls_resumed = 0
+        self.tls_files = None
+        if getattr(options, "tls_cert", None):
+            self.tls_files = (options.tls_cert, options.tls_key)
+            self.forget_sessions()
+
+    def forget_sessions(self):
+        """Drops the session cache and ticket keys, as a restarted server would."""
+        context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+        context.maximum_version = ssl.TLSVersion.TLSv1_2
+        context.load_cert_chain(*self.tls_files)
+        self.ssl_context = context
+
+    def get_request(self):
+        sock, address = super().get_request()
+        # Go's net/http, which Ollama is built on, does this for every connection; without
+        # it the body of a kept-alive response waits out the client's delayed ACK
+        sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        if self.ssl_context is not None:
+            # The handshake is left to the handler thread so a slow one blocks no one else
+            sock = self.ssl_context.wrap_socket(sock, server_side=True, do_handshake_on_connect=False)
+        return sock, address
+
+
+class MockOllamaHandler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def setup(self):
+        self.handshake_failed = False
+        if self.server.ssl_context is not None:
+            try:
+                self.request.do_handshake()
+            except (ssl.SSLError, OSError):
+                self.handshake_failed = True
+            else:
+                with self.server.counter_lock:
+                    if self.request.session_reused:
+                        self.server.tls_resumed += 1
+                    else:
+                        self.server.tls_full += 1
+        super().setup()
+
+    def handle(self):
+        if not self.handshake_failed:
+            super().handle()
+
+    def end_headers(self):
+        if not self.server.keep_alive:
+            self.send_header("Connection", "close")
+        super().end_headers()
+
+    def log_message(self, format, *args):
+        if self.server.options.verbose:
+            super().log_message(format, *args)
+
+    def send_json(self, code, body):
+        data = json.dumps(body).encode()
+        self.send_response(code)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(data)))
+        self.end_headers()
+        self.wfile.write(data)
+
+    def write_chunk(self, data):
+        self.wfile.write(b"%x\r\n%s\r\n" % (len(data), data))
+        self.wfile.flush()
+
+    def injected(self):
+        """Applies --latency and any fault; returns True when the request was handled."""
+        time.sleep(self.server.options.latency)
+        if self.server.fault == "hang":
+            while self.server.fault == "hang":
+                time.sleep(0.05)
+            self.close_connection = True
+            return True
+        if self.server.fault == "error":
+            self.send_json(500, {"error": "injected fault"})
+            return True
+        return False
+
+    def do_GET(self):
+        if self.injected():
+            return
+        if self.path == "/api/tags":
+            self.send_json(200, {"models": [{"name": self.server.options.model}]})
+        else:
+            self.send_json(404, {"error": "not found"})
+
+    def do_POST(self):
+        if self.path != "/api/generate":
+            self.send_json(404, {"error": "not found"})
+            return
+
+        if "chunked" in self.headers.get("Transfer-Encoding", "").lower():
+            body, chunks = self.read_chunked()
+            if body is None:
+                # The client went away before the body ended
+                self.close_connection = True
+                return
+        else:
+            body, chunks = self.rfile.read(int(self.headers.get("Content-Length", 0))), 0
+        try:
+            request = json.loads(body or b"{}")
+        except (json.JSONDecodeError, UnicodeDecodeError) as error:
+            self.send_json(400, {"error": str(error)})
+            return
+        if self.injected():
+            return
+
+        with self.server.counter_lock:
+            self.server.requests_served += 1
+            self.server.last_prompt = request.get("prompt", "")
+            self.server.last_body_chunks = chunks
+
+        with self.server.slots:
+            self.generate(request)
+
+    def read_chunked(self):
+        """A chunked request body and the number of chunks it came in; None if it was cut off."""
+        body = b""
+        chunks = 0
+        while True:
+            line = self.rfile.readline()
+            if not line:
+                return None, chunks
+            size = int(line.split(b";")[0], 16)
+            if size == 0:
+                # Trailers, if any, end with a blank line
+                while self.rfile.readline() not in (b"\r\n", b"\n", b""):
+                    pass
+                return body, chunks
+            data = self.rfile.read(size)
+            if len(data) < size:
+                return None, chunks
+            body += data
+            self.rfile.readline()
+            chunks += 1
+
+    def generate(self, request):
+        options = self.server.options
+        start = time.monotonic()
+        keep_alive = parse_keep_alive(request.get("keep_alive"), options.model_keep_alive)
+        load = self.server.model.ensure_loaded(keep_alive)
+        model = request.get("model", options.model)
+        prompt = request.get("prompt", "")
+        words = MARKDOWN_WORDS if options.markdown else WORDS
+
+        # An empty prompt only loads the model, exactly like Ollama's preload request
+        tokens = 0 if prompt == "" else options.tokens
+        stream = request.get("stream", True)
+
+        if tokens > 0:
+            time.sleep(options.first_token_delay)
+            with self.server.counter_lock:
+                slow = self.server.random.random() < options.slow_fraction
+                self.server.requests_slowed += slow
+            if slow:
+                time.sleep(options.slow_delay)
+
+        if stream:
+            try:
+                self.send_response(200)
+                self.send_header("Content-Type", "application/x-ndjson")
+                self.send_header("Transfer-Encoding", "chunked")
+                self.end_headers()
+                for i in range(tokens):
+                    if i > 0:
+                        time.sleep(1.0 / options.token_rate)
+                    piece = {"model": model, "response": words[i % len(words)] + " ", "done": False}
+                    self.write_chunk(json.dumps(piece).encode() + b"\n")
+                final = self.final_stats(model, start, load, tokens)
+                final["response"] = ""
+                self.write_chunk(json.dumps(final).encode() + b"\n")
+                self.write_chunk(b"")
+            except (BrokenPipeError, ConnectionResetError):
+                # Like Ollama, stop generating for a client that has gone away
+                with self.server.counter_lock:
+                    self.server.requests_cancelled += 1
+                self.close_connection = True
+        else:
+            if tokens > 1:
+                time.sleep((tokens - 1) / options.token_rate)
+            body = self.final_stats(model, start, load, tokens)
+            body["response"] = " ".join(words[i % len(words)] for i in range(tokens))
+            self.send_json(200, body)
+
+    @staticmethod
+    def final_stats(model, start, load, tokens):
+        return {
+            "model": model,
+            "done": True,
+            "total_duration": int((time.monotonic() - start) * 1e9),
+            "load_duration": int(load * 1e9),
+            "eval_count": tokens,
+        }
+
+
+def add_arguments(parser):
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=11434)
+    parser.add_argument("--model", default="mistral")
+    parser.add_argument("--verbose", action="store_true")
+    parser.add_argument("--tls-cert", help="PEM certificate; serve HTTPS")
+    parser.add_argument("--tls-key", help="PEM private key for --tls-cert")
+    add_behaviour_arguments(parser)
+
+
+def add_behaviour_arguments(parser):
+    """Options that shape the simulated model; shared with the benchmark drivers."""
+    parser.add_argument("--token-rate", type=float, default=30.0, help="tokens per second")
+    parser.add_argument("--tokens", type=int, default=60, help="tokens per answer")
+    parser.add_argument("--first-token-delay", type=float, default=0.2, help="seconds")
+    parser.add_argument("--load-delay", type=float, default=2.0, help="cold model load, seconds")
+    parser.add_argument("--model-keep-alive", type=float, default=300.0,
+                        help="keep_alive when a request sets none, seconds")
+    parser.add_argument("--parallel", type=int, default=4, help="requests generated at once")
+    parser.add_argument("--latency", type=float, default=0.0,
+                        help="extra delay before answering any request, seconds")
+    parser.add_argument("--slow-fraction", type=float, default=0.0,
+                        help="share of answers whose first token is --slow-delay late")
+    parser.add_argument("--slow-delay", type=float, default=1.0, help="seconds")
+    parser.add_argument("--seed", type=int, help="for --slow-fraction")
+    parser.add_argument("--markdown", action="store_true",
+                        help="answer with markdown, smart quotes and emoji instead of plain words")
+
+
+def start_in_background(options):
+    """Starts a server on a thread; returns (server, base_url)."""
+    server = MockOllamaServer((options.host, options.port), options)
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    host, port = server.server_address[:2]
+    return server, "%s://%s:%d/api/generate" % (server_scheme(server), host, port)
+
+
+def server_scheme(server):
+    return "http" if server.ssl_context is None else "https"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    add_arguments(parser)
+    options = parser.parse_args()
+    server = MockOllamaServer((options.host, options.port), options)
+    print("Mock Ollama listening on %s://%s:%d/api/generate"
+          % ((server_scheme(server),) + server.server_address[:2]))
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,226 @@
+"""Load and latency benchmark for an Ollama /api/generate endpoint.
+
+Replays prompts from a JSONL file (a "prompt" field, or "title"/"body" as in
+requests.jsonl) at several concurrency levels and reports throughput plus p50/p95/p99
+of time to first token and total latency.  With --mock a local mock server is started
+so no real GPU box is needed.
+
+    python3 bench/ollama_bench.py --mock --prompts requests.jsonl --concurrency 1,4,8
+    python3 bench/ollama_bench.py --url http://192.168.50.149:25570/api/generate --stream
+"""
+
+import argparse
+import http.client
+import json
+import sys
+import threading
+import time
+from urllib.parse import urlsplit
+
+import mock_ollama
+
+
+def load_prompts(path, limit):
+    prompts = []
+    try:
+        with open(path) as f:
+            for line in f:
+                line = line.strip()
+                if not line:
+                    continue
+                item = json.loads(line)
+                prompt = item.get("prompt") or item.get("body") or item.get("title")
+                if prompt:
+                    prompts.append(prompt)
+    except FileNotFoundError:
+        print("%s not found, using a built-in prompt" % path, file=sys.stderr)
+    if not prompts:
+        prompts = ["What is your purpose"]
+    return prompts[:limit] if limit else prompts
+
+
+def percentile(values, pct):
+    """Nearest-rank percentile; 0 for an empty list."""
+    if not values:
+        return 0.0
+    ordered = sorted(values)
+    rank = max(1, -(-len(ordered) * pct // 100))
+    return ordered[int(rank) - 1]
+
+
+class Client:
+    """One worker's HTTP connection.  With keep_alive the connection is reused."""
+
+    def __init__(self, url, keep_alive, timeout):
+        parts = urlsplit(url)
+        self.host = parts.hostname
+        self.port = parts.port or (443 if parts.scheme == "https" else 80)
+        self.path = parts.path or "/"
+        self.https = parts.scheme == "https"
+        self.keep_alive = keep_alive
+        self.timeout = timeout
+        self.connection = None
+
+    def connect(self):
+        if self.https:
+            import ssl
+
+            context = ssl.create_default_context()
+            context.check_hostname = False
+            context.verify_mode = ssl.CERT_NONE
+            return http.client.HTTPSConnection(self.host, self.port, timeout=self.timeout, context=context)
+        return http.client.HTTPConnection(self.host, self.port, timeout=self.timeout)
+
+    def generate(self, model, prompt, stream):
+        """Returns (ttft_seconds, total_seconds, tokens)."""
+        if self.connection is None or not self.keep_alive:
+            if self.connection is not None:
+                self.connection.close()
+            self.connection = self.connect()
+
+        body = json.dumps({"model": model, "prompt": prompt, "stream": stream})
+        start = time.monotonic()
+        self.connection.request("POST", self.path, body, {"Content-Type": "application/json"})
+        response = self.connection.getresponse()
+        if response.status != 200:
+            response.read()
+            raise RuntimeError("HTTP %d" % response.status)
+
+        ttft = None
+        tokens = 0
+        if stream:
+            for line in response:
+                if ttft is None:
+                    ttft = time.monotonic() - start
+                piece = json.loads(line)
+                if not piece.get("done"):
+                    tokens += 1
+        else:
+            data = json.loads(response.read())
+            ttft = time.monotonic() - start
+            tokens = data.get("eval_count", 0)
+        return ttft, time.monotonic() - start, tokens
+
+    def close(self):
+        if self.connection is not None:
+            self.connection.close()
+
+
+def run_level(options, prompts, concurrency):
+    """Runs every prompt once with `concurrency` workers; returns a result dict."""
+    results = []
+    errors = []
+    lock = threading.Lock()
+    next_index = [0]
+
+    def worker():
+        client = Client(options.url, options.http_keep_alive, options.timeout)
+        while True:
+            with lock:
+                if next_index[0] >= len(prompts):
+                    break
+                prompt = prompts[next_index[0]]
+                next_index[0] += 1
+            try:
+                sample = client.generate(options.model, prompt, options.stream)
+                with lock:
+                    results.append(sample)
+            except Exception as error:  # noqa: BLE001 - every failure counts the same
+                with lock:
+                    errors.append(str(error))
+                client.close()
+                client.connection = None
+        client.close()
+
+    start = time.monotonic()
+    threads = [threading.Thread(target=worker) for _ in range(concurrency)]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    elapsed = time.monotonic() - start
+
+    ttft = [r[0] * 1000 for r in results]
+    total = [r[1] * 1000 for r in results]
+    tokens = sum(r[2] for r in results)
+    return {
+        "concurrency": concurrency,
+        "requests": len(results),
+        "errors": len(errors),
+        "elapsed_s": elapsed,
+        "prompts_per_min": len(results) * 60 / elapsed if elapsed else 0,
+        "tokens_per_s": tokens / elapsed if elapsed else 0,
+        "ttft_ms": {p: percentile(ttft, p) for p in (50, 95, 99)},
+        "total_ms": {p: percentile(total, p) for p in (50, 95, 99)},
+    }
+
+
+def print_table(rows):
+    print(
+        "%5s %6s %4s %9s %8s | %8s %8s %8s | %8s %8s %8s"
+        % ("conc", "reqs", "err", "prompt/m", "tok/s", "ttft50", "ttft95", "ttft99", "tot50", "tot95", "tot99")
+    )
+    for r in rows:
+        print(
+            "%5d %6d %4d %9.1f %8.1f | %8.0f %8.0f %8.0f | %8.0f %8.0f %8.0f"
+            % (
+                r["concurrency"],
+                r["requests"],
+                r["errors"],
+                r["prompts_per_min"],
+                r["tokens_per_s"],
+                r["ttft_ms"][50],
+                r["ttft_ms"][95],
+                r["ttft_ms"][99],
+                r["total_ms"][50],
+                r["total_ms"][95],
+                r["total_ms"][99],
+            )
+        )
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--url", help="Ollama /api/generate URL (default: the --mock server)")
+    parser.add_argument("--mock", action="store_true", help="start a local mock server")
+    parser.add_argument("--prompts", default="requests.jsonl")
+    parser.add_argument("--limit", type=int, default=0, help="use only the first N prompts")
+    parser.add_argument("--concurrency", default="1,2,4,8")
+    parser.add_argument("--model", default="mistral")
+    parser.add_argument("--stream", action="store_true")
+    parser.add_argument("--no-keep-alive", dest="http_keep_alive", action="store_false",
+                        help="open a new connection per request")
+    parser.add_argument("--timeout", type=float, default=120.0)
+    parser.add_argument("--warm", action="store_true", help="send a preload request first")
+    parser.add_argument("--json", action="store_true", help="print results as JSON")
+
+    mock_ollama.add_behaviour_arguments(parser.add_argument_group("mock server"))
+
+    options = parser.parse_args()
+    server = None
+    if options.mock or not options.url:
+        options.host, options.port, options.verbose = "127.0.0.1", 0, False
+        server, options.url = mock_ollama.start_in_background(options)
+
+    prompts = load_prompts(options.prompts, options.limit)
+    if options.warm:
+        Client(options.url, False, options.timeout).generate(options.model, "", False)
+
+    rows = [run_level(options, prompts, int(c)) for c in options.concurrency.split(",")]
+    if options.json:
+        print(json.dumps(rows, indent=2))
+    else:
+        print("%d prompts against %s (%s, %s)" % (
+            len(prompts),
+            options.url,
+            "streaming" if options.stream else "non-streaming",
+            "keep-alive" if options.http_keep_alive else "new connection per request",
+        ))
+        print_table(rows)
+
+    if server is not None:
+        server.shutdown()
+
+
+if __name__ == "__main__":
+    main()
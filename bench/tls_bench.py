@@ -0,0 +1,146 @@
+"""TLS handshake cost for the ESP32 sketch's HTTPS endpoints.
+
+Serves the mock Ollama over HTTPS with a throwaway self-signed certificate, runs the
+host build of the dev sketch (host/build/esp32_dev) against it and sends the same
+prompts four ways: on a new connection each time with session resumption off (a full
+handshake per prompt), on a new connection with resumption on, the same with the server
+forgetting every session first (offered, but a full handshake), and on one kept-alive
+connection.  Handshake times come from the sketch's TLS command; the server confirms
+which handshakes actually resumed a session, and the sketch must agree.
+
+    make -C host
+    python3 bench/tls_bench.py --esp32 host/build/esp32_dev
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+import time
+from types import SimpleNamespace
+
+import mock_ollama
+from failover_bench import Sketch
+
+
+def make_certificate(directory):
+    cert = os.path.join(directory, "cert.pem")
+    key = os.path.join(directory, "key.pem")
+    subprocess.run(
+        ["openssl", "req", "-x509", "-newkey", "rsa:2048", "-nodes", "-days", "1",
+         "-subj", "/CN=127.0.0.1", "-addext", "subjectAltName=IP:127.0.0.1,DNS:localhost",
+         "-keyout", key, "-out", cert],
+        check=True, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    return cert, key
+
+
+def tls_stats(sketch):
+    """(full count, full ms, resumed count, resumed ms) from the TLS command."""
+    sketch.send("TLS")
+    line = sketch.expect("TLS:", 5)
+    return tuple(int(field) for field in line[len("TLS:"):].split(","))
+
+
+def run_phase(sketch, server, name, prompts, timeout, forget=False):
+    before = tls_stats(sketch)
+    before_server = (server.tls_full, server.tls_resumed)
+    elapsed = []
+    for i in range(prompts):
+        if forget:
+            server.forget_sessions()
+        seen = []
+        start = time.monotonic()
+        sketch.send("%s prompt %d" % (name, i))
+        sketch.expect('Ollama: "', timeout, seen)
+        elapsed.append((time.monotonic() - start) * 1000)
+        if any(line.startswith("Error on HTTP request") for line in seen):
+            raise AssertionError("%s prompt %d was not answered" % (name, i))
+    after = tls_stats(sketch)
+    full, full_ms, resumed, resumed_ms = (a - b for a, b in zip(after, before))
+    handshakes = full + resumed
+    return {
+        "name": name,
+        "handshakes": handshakes,
+        "handshake_ms": (full_ms + resumed_ms) / handshakes if handshakes else 0.0,
+        "resumed": resumed,
+        "server_full": server.tls_full - before_server[0],
+        "server_resumed": server.tls_resumed - before_server[1],
+        "prompt_ms": sum(elapsed) / len(elapsed),
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--esp32", default="host/build/esp32_dev")
+    parser.add_argument("--prompts", type=int, default=20, help="per phase")
+    parser.add_argument("--timeout", type=float, default=30.0, help="per prompt, seconds")
+    parser.add_argument("--model", default="mistral")
+    mock_ollama.add_behaviour_arguments(parser.add_argument_group("mock server"))
+    parser.set_defaults(load_delay=0.0, first_token_delay=0.0, tokens=8, token_rate=400.0)
+    options = parser.parse_args()
+
+    failures = []
+    rows = []
+    with tempfile.TemporaryDirectory() as directory:
+        options.tls_cert, options.tls_key = make_certificate(directory)
+        server_options = SimpleNamespace(**vars(options))
+        server_options.host, server_options.port, server_options.verbose = "127.0.0.1", 0, False
+        server, url = mock_ollama.start_in_background(server_options)
+        # The sketch trusts the certificate through the shim's CA bundle
+        os.environ["ESP32_SHIM_CA_FILE"] = options.tls_cert
+        sketch = Sketch(options.esp32)
+
+        try:
+            sketch.expect("DEBUG: ESP32 WiFi Scanner Ready", 10)
+            sketch.send("CONNECT bench password")
+            sketch.expect("WiFi connected", 10)
+            sketch.send("URL " + url)
+            sketch.expect("URL_OK", 5)
+            warmup = sketch.expect("WARMUP", 10)
+            if not warmup.startswith("WARMUP:"):
+                raise AssertionError("warm-up over HTTPS failed: %s" % warmup)
+
+            server.keep_alive = False
+            sketch.send("TLS RESUME OFF")
+            rows.append(run_phase(sketch, server, "full handshake", options.prompts, options.timeout))
+            sketch.send("TLS RESUME ON")
+            rows.append(run_phase(sketch, server, "resumed", options.prompts, options.timeout))
+            rows.append(run_phase(sketch, server, "forgotten", options.prompts, options.timeout, forget=True))
+            server.keep_alive = True
+            rows.append(run_phase(sketch, server, "keep-alive", options.prompts, options.timeout))
+
+            full, resumed, forgotten, kept = rows
+            if full["server_resumed"] != 0:
+                failures.append("sessions were resumed with resumption off")
+            if resumed["server_resumed"] < options.prompts:
+                failures.append("only %d of %d reconnects resumed a session"
+                                % (resumed["server_resumed"], options.prompts))
+            if forgotten["server_resumed"] != 0:
+                failures.append("sessions were resumed after the server forgot them")
+            for row in rows:
+                if row["resumed"] != row["server_resumed"]:
+                    failures.append("%s: the sketch counted %d resumed handshakes, the server %d"
+                                    % (row["name"], row["resumed"], row["server_resumed"]))
+            if kept["handshakes"] > 1:
+                failures.append("keep-alive still made %d handshakes" % kept["handshakes"])
+        except (TimeoutError, AssertionError) as error:
+            failures.append(str(error))
+        finally:
+            sketch.close()
+            server.shutdown()
+
+    # Background probes add handshakes of the same kind to each phase
+    print("%-16s %10s %12s %14s %10s" % ("phase", "handshakes", "handshake ms", "server resumed", "prompt ms"))
+    for row in rows:
+        print("%-16s %10d %12.2f %14s %10.1f" % (
+            row["name"], row["handshakes"], row["handshake_ms"],
+            "%d/%d" % (row["server_resumed"], row["server_full"] + row["server_resumed"]),
+            row["prompt_ms"]))
+    for failure in failures:
+        print("FAIL: %s" % failure, file=sys.stderr)
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == "__main__":
+    main()
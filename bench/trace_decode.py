@@ -0,0 +1,83 @@
+"""Decodes the binary trace ring the app writes to /ext/ollama/trace.bin.
+
+Prints one event per line with the time since the first event and since the previous
+one, so gaps on the UART and UI paths stand out.
+
+    python3 bench/trace_decode.py trace.bin
+"""
+
+import argparse
+import struct
+import sys
+
+TRACE_MAGIC = 0x4352544F
+HEADER = struct.Struct("<IHHIII")
+RECORD = struct.Struct("<IHHI")
+
+# Mirrors TraceEventId in trace.h
+EVENTS = [
+    "uart_rx",
+    "uart_line",
+    "uart_tx",
+    "line",
+    "state",
+    "ui_update",
+    "key",
+    "latency",
+    "heap",
+    "uart_flow",
+]
+
+
+def describe(event_id, arg0, arg1):
+    name = EVENTS[event_id] if event_id < len(EVENTS) else "event_%d" % event_id
+    if name == "uart_rx":
+        return name, "%d bytes, %d left" % (arg0, arg1)
+    if name in ("uart_line", "uart_tx"):
+        return name, "%d bytes" % arg0
+    if name == "line":
+        prefix = bytes([arg0 & 0xFF, arg0 >> 8]).decode("latin-1")
+        return name, "%r... state %d" % (prefix, arg1)
+    if name == "state":
+        return name, "%d -> %d" % (arg0, arg1)
+    if name == "ui_update":
+        return name, "state %d" % arg0
+    if name == "key":
+        return name, "key %d type %d" % (arg0, arg1)
+    if name == "heap":
+        return name, "state %d peak %d bytes" % (arg0, arg1)
+    if name == "uart_flow":
+        return name, "%s, %d waiting" % ("XON" if arg0 else "XOFF", arg1)
+    if name == "latency":
+        return name, "n=%d key>render %d ms" % (arg0, arg1)
+    return name, "%d %d" % (arg0, arg1)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("file")
+    options = parser.parse_args()
+
+    with open(options.file, "rb") as f:
+        data = f.read()
+
+    magic, version, record_size, count, cycles_per_us, overwritten = HEADER.unpack_from(data)
+    if magic != TRACE_MAGIC or record_size != RECORD.size:
+        sys.exit("%s: not a trace file (version %d)" % (options.file, version))
+
+    print("%d events, %d older ones overwritten" % (count, overwritten))
+    first = previous = None
+    for i in range(count):
+        timestamp, event_id, arg0, arg1 = RECORD.unpack_from(data, HEADER.size + i * RECORD.size)
+        if first is None:
+            first = previous = timestamp
+        # The cycle counter wraps every ~67 s at 64 MHz; unsigned deltas survive one wrap
+        since_first = ((timestamp - first) & 0xFFFFFFFF) / cycles_per_us
+        delta = ((timestamp - previous) & 0xFFFFFFFF) / cycles_per_us
+        previous = timestamp
+        name, text = describe(event_id, arg0, arg1)
+        print("%12.0f us %+10.0f  %-10s %s" % (since_first, delta, name, text))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,50 @@
+#include "capture.h"
+#include "file_ops.h"
+#include "wifi.h"
+#include <furi.h>
+
+bool capture_start(OllamaAppState* state) {
+    UartCapture* capture = &state->capture;
+    CaptureFileHeader header = {
+        .magic = CAPTURE_MAGIC,
+        .version = CAPTURE_VERSION,
+        .record_size = sizeof(UartCaptureRecord),
+        .start_tick = furi_get_tick(),
+        .app_state = state->current_state,
+    };
+    if(!write_capture_header(&header)) {
+        return false;
+    }
+    if(!wifi_capture_start(CAPTURE_BUFFER_SIZE)) {
+        return false;
+    }
+    capture->active = true;
+    capture->bytes = sizeof(header);
+    capture->flush_tick = header.start_tick;
+    return true;
+}
+
+void capture_stop(OllamaAppState* state) {
+    UartCapture* capture = &state->capture;
+    if(!capture->active) {
+        return;
+    }
+    wifi_capture_stop();
+    capture->bytes += append_capture(wifi_capture_read);
+    capture->active = false;
+
+    UartHelperStats uart;
+    wifi_get_uart_stats(&uart);
+    APP_LOG_I("Capture", "Wrote %lu bytes, %lu chunks dropped", (unsigned long)capture->bytes,
+              (unsigned long)uart.capture_dropped);
+}
+
+void capture_flush(OllamaAppState* state) {
+    UartCapture* capture = &state->capture;
+    uint32_t now = furi_get_tick();
+    if(!capture->active || now - capture->flush_tick < CAPTURE_FLUSH_MS) {
+        return;
+    }
+    capture->flush_tick = now;
+    capture->bytes += append_capture(wifi_capture_read);
+}
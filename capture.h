@@ -0,0 +1,25 @@
+#pragma once
+
+#include "ollama_app_i.h"
+
+/**
+ * UART capture file: a CaptureFileHeader, then the records uart_helper captured, each a
+ * UartCaptureRecord followed by its bytes.  host/app_bench replays one with "replay".
+*/
+#define CAPTURE_MAGIC 0x50414355 // "UCAP"
+#define CAPTURE_VERSION 1
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size; // sizeof(UartCaptureRecord)
+    uint32_t start_tick;
+    uint32_t app_state; // the screen the capture started on, which a replay opens first
+} CaptureFileHeader;
+
+// Starts a new CAPTURE_FILE_PATH; false if the file or the buffer could not be had
+bool capture_start(OllamaAppState* state);
+// Stops recording and writes out the rest
+void capture_stop(OllamaAppState* state);
+// Called from the main loop; writes out what was recorded every CAPTURE_FLUSH_MS
+void capture_flush(OllamaAppState* state);
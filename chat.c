@@ -1,57 +1,372 @@
 #include "ollama_app_i.h"
+#include "wifi.h"
+#include "latency.h"
+#include "file_ops.h"
+#include "context.h"
+
+// Learns a sent prompt: the prompt itself and each of its words, in memory and on SD
+static void chat_learn(Completion* completion, const char* prompt) {
+    completion_add(completion, prompt, 1);
+    append_completion(prompt);
+    if(!strchr(prompt, ' ')) {
+        return;
+    }
+
+    char word[COMPLETION_MAX_LENGTH];
+    size_t length = 0;
+    for(const char* p = prompt;; p++) {
+        if(*p == ' ' || *p == '\0') {
+            if(length > 1) {
+                word[length] = '\0';
+                completion_add(completion, word, 1);
+                append_completion(word);
+            }
+            length = 0;
+            if(*p == '\0') break;
+        } else if(length < sizeof(word) - 1) {
+            word[length++] = *p;
+        }
+    }
+}
+
+static void chat_load_completion(ChatScreen* chat) {
+    chat->completion = completion_alloc(COMPLETION_MAX_NODES);
+    uint16_t lines = read_completion_file(chat->completion);
+
+    // Every sent prompt appends lines; fold repeats back into one line per entry
+    if(lines > COMPLETION_FILE_COMPACT_RATIO * completion_entry_count(chat->completion)) {
+        write_completion_file(chat->completion);
+    }
+}
+
+static void chat_update_suggestions(ChatScreen* chat) {
+    chat->suggestion_count = 0;
+    chat->suggestion_index = 0;
+    if(!chat->completion) {
+        return;
+    }
+
+    // The whole input first, which brings back past prompts, then the word being typed
+    size_t cursor = chat->cursor_position;
+    size_t word = cursor;
+    while(word > 0 && chat->current_message[word - 1] != ' ') {
+        word--;
+    }
+    size_t starts[] = {0, word};
+    for(size_t i = 0; i < COUNT_OF(starts) && chat->suggestion_count < COMPLETION_SUGGESTIONS; i++) {
+        if(i > 0 && starts[i] == starts[0]) {
+            break;
+        }
+        uint8_t found = completion_lookup(
+            chat->completion,
+            chat->current_message + starts[i],
+            cursor - starts[i],
+            chat->suggestions[chat->suggestion_count],
+            COMPLETION_MAX_LENGTH,
+            COMPLETION_SUGGESTIONS - chat->suggestion_count);
+        for(uint8_t j = 0; j < found; j++) {
+            chat->suggestion_from[chat->suggestion_count++] = starts[i];
+        }
+    }
+}
+
+// Replaces the prefix before the cursor with the highlighted suggestion
+static void chat_accept_suggestion(ChatScreen* chat) {
+    if(chat->suggestion_count == 0) {
+        return;
+    }
+
+    const char* suggestion = chat->suggestions[chat->suggestion_index];
+    char* message = chat->current_message;
+    size_t from = chat->suggestion_from[chat->suggestion_index];
+    size_t length = strlen(suggestion);
+    size_t tail = strlen(message + chat->cursor_position);
+    size_t space = message[chat->cursor_position] == ' ' ? 0 : 1;
+    if(from + length + space + tail >= MAX_MESSAGE_LENGTH) {
+        return;
+    }
+
+    memmove(message + from + length + space, message + chat->cursor_position, tail + 1);
+    memcpy(message + from, suggestion, length);
+    if(space) {
+        message[from + length] = ' ';
+    }
+    chat->cursor_position = from + length + space;
+}
 
 void add_chat_message(OllamaAppState* state, const char* message, bool is_user) {
-    if (state->chat_message_count >= MAX_CHAT_MESSAGES) {
+    ChatScreen* chat = state->chat;
+    if (!chat) {
+        // A reply that arrives after the chat screen was closed has nowhere to go
+        return;
+    }
+
+    if (chat->message_count >= MAX_CHAT_MESSAGES) {
         // Remove the oldest message
         for (int i = 0; i < MAX_CHAT_MESSAGES - 1; i++) {
-            memcpy(&state->chat_messages[i], &state->chat_messages[i+1], sizeof(ChatMessage));
+            memcpy(&chat->messages[i], &chat->messages[i+1], sizeof(ChatMessage));
         }
-        state->chat_message_count--;
+        chat->message_count--;
     }
     
-    strncpy(state->chat_messages[state->chat_message_count].content, message, MAX_MESSAGE_LENGTH - 1);
-    state->chat_messages[state->chat_message_count].content[MAX_MESSAGE_LENGTH - 1] = '\0';
-    state->chat_messages[state->chat_message_count].is_user = is_user;
-    state->chat_message_count++;
+    strncpy(chat->messages[chat->message_count].content, message, MAX_MESSAGE_LENGTH - 1);
+    chat->messages[chat->message_count].content[MAX_MESSAGE_LENGTH - 1] = '\0';
+    chat->messages[chat->message_count].is_user = is_user;
+    chat->messages[chat->message_count].spool_offset = 0;
+    chat->messages[chat->message_count].spool_rows = 0;
+    chat->message_count++;
+    if(chat->archive_pending < MAX_CHAT_MESSAGES) {
+        chat->archive_pending++;
+    }
+}
+
+void chat_archive_flush(OllamaAppState* state) {
+    ChatScreen* chat = state->chat;
+    if(!chat || chat->archive_pending == 0) {
+        return;
+    }
+    if(!chat->archive) {
+        chat->archive = archive_alloc(ARCHIVE_FILE_PATH, ARCHIVE_INDEX_PATH);
+    }
+    if(!chat->archive) {
+        chat->archive_pending = 0;
+        return;
+    }
+
+    for(uint8_t i = chat->message_count - chat->archive_pending; i < chat->message_count; i++) {
+        ChatMessage* message = &chat->messages[i];
+        archive_begin(chat->archive, message->is_user);
+        if(message->spool_rows > 0 && chat->spool) {
+            // The whole reply from the spool rather than the preview in content
+            char row[RESPONSE_ROW_BYTES];
+            for(uint32_t r = 0; r < message->spool_rows; r++) {
+                if(spool_read(chat->spool, message->spool_offset + r * RESPONSE_ROW_BYTES, row, sizeof(row)) <
+                   sizeof(row)) {
+                    break;
+                }
+                row[RESPONSE_ROW_CHARS] = '\0';
+                if(r > 0) {
+                    archive_append(chat->archive, " ", 1);
+                }
+                archive_append(chat->archive, row, strlen(row));
+            }
+        } else {
+            archive_append(chat->archive, message->content, strlen(message->content));
+        }
+        if(!archive_end(chat->archive)) {
+            APP_LOG_W("Chat", "Archive write failed, a message will be missing from search");
+        }
+    }
+    chat->archive_pending = 0;
+}
+
+// Stages one screen row, or the end of the reply, for the main loop to spool.  This runs
+// in process_line, which holds the screen mutex: while the stage is full it lets the main
+// loop have the mutex and waits, and flow control holds the ESP32 back meanwhile.
+static void chat_reply_stage(OllamaAppState* state, const char* text, size_t length, bool end) {
+    while(state->chat && state->chat->reply_staged == REPLY_STAGE_ROWS) {
+        furi_mutex_release(state->screen_mutex);
+        furi_delay_ms(1);
+        furi_mutex_acquire(state->screen_mutex, FuriWaitForever);
+    }
+    ChatScreen* chat = state->chat;
+    if(!chat) {
+        // The chat screen closed while the worker waited
+        return;
+    }
+
+    ReplyRow* row = &chat->reply_stage[chat->reply_staged++];
+    memcpy(row->text, text, length);
+    row->length = length;
+    row->end = end;
+    if(chat->reply_staged == 1) {
+        ollama_app_wake(state);
+    }
+}
+
+void chat_reply_append(OllamaAppState* state, const char* text, size_t length) {
+    if(!state->chat) {
+        return;
+    }
+
+    // The ESP32 sends one wrapped row per line; cut anything longer, from older firmware
+    while(length > 0) {
+        size_t row = length < RESPONSE_ROW_CHARS ? length : RESPONSE_ROW_CHARS;
+        chat_reply_stage(state, text, row, false);
+        text += row;
+        length -= row;
+    }
+}
+
+void chat_reply_finish(OllamaAppState* state) {
+    if(!state->chat) {
+        return;
+    }
+    chat_reply_stage(state, "", 0, true);
+}
+
+// Appends one screen row to the preview and, padded to a fixed-size record, to the spool
+static void chat_reply_row(ChatScreen* chat, const char* text, size_t length) {
+    size_t used = strlen(chat->reply_preview);
+    if(used > 0 && used < MAX_MESSAGE_LENGTH - 1) {
+        chat->reply_preview[used++] = ' ';
+    }
+    size_t copy = length < MAX_MESSAGE_LENGTH - 1 - used ? length : MAX_MESSAGE_LENGTH - 1 - used;
+    memcpy(chat->reply_preview + used, text, copy);
+    chat->reply_preview[used + copy] = '\0';
+
+    if(chat->spool) {
+        char row[RESPONSE_ROW_BYTES] = {0};
+        memcpy(row, text, length);
+        if(!spool_append(chat->spool, row, sizeof(row))) {
+            APP_LOG_W("Chat", "Spool write failed, reply will be incomplete");
+        }
+    }
+    chat->reply_rows++;
+}
+
+void chat_reply_flush(OllamaAppState* state) {
+    ChatScreen* chat = state->chat;
+    if(!chat) {
+        return;
+    }
+    for(uint8_t i = 0; i < chat->reply_staged; i++) {
+        ReplyRow* row = &chat->reply_stage[i];
+        if(!chat->reply_open) {
+            if(!chat->spool) {
+                chat->spool = spool_alloc(SPOOL_FILE_PATH);
+            }
+            chat->reply_open = true;
+            chat->reply_offset = chat->spool ? spool_size(chat->spool) : 0;
+            chat->reply_rows = 0;
+            chat->reply_preview[0] = '\0';
+        }
+        if(!row->end) {
+            chat_reply_row(chat, row->text, row->length);
+            continue;
+        }
+
+        add_chat_message(state, chat->reply_preview, false);
+        if(chat->spool && chat->reply_rows > 1) {
+            ChatMessage* message = &chat->messages[chat->message_count - 1];
+            message->spool_offset = chat->reply_offset;
+            message->spool_rows = chat->reply_rows;
+        }
+        chat->reply_open = false;
+        latency_mark_delivered(state);
+        state->ui_update_needed = true;
+    }
+    chat->reply_staged = 0;
+}
+
+static void chat_view_load(ChatScreen* chat) {
+    memset(chat->view_rows, 0, sizeof(chat->view_rows));
+    uint32_t first = chat->view_page * RESPONSE_VIEW_ROWS;
+    uint32_t rows = chat->view_row_count - first < RESPONSE_VIEW_ROWS ? chat->view_row_count - first :
+                                                                         RESPONSE_VIEW_ROWS;
+    spool_read(
+        chat->spool,
+        chat->view_offset + chat->view_page * RESPONSE_PAGE_BYTES,
+        (char*)chat->view_rows,
+        rows * RESPONSE_ROW_BYTES);
+}
+
+void chat_open_viewer(OllamaAppState* state) {
+    ChatScreen* chat = state->chat;
+    for(int i = chat->message_count - 1; i >= 0; i--) {
+        ChatMessage* message = &chat->messages[i];
+        if(!message->is_user && message->spool_rows > 0) {
+            chat->view_offset = message->spool_offset;
+            chat->view_row_count = message->spool_rows;
+            chat->view_page = 0;
+            chat_view_load(chat);
+            ollama_app_set_state(state, AppStateResponseView);
+            return;
+        }
+    }
+}
+
+void process_response_view(OllamaAppState* state, InputEvent* event) {
+    ChatScreen* chat = state->chat;
+    if(event->key == InputKeyUp || event->key == InputKeyLeft) {
+        if(chat->view_page > 0) {
+            chat->view_page--;
+            chat_view_load(chat);
+        }
+    } else if(event->key == InputKeyDown || event->key == InputKeyRight) {
+        if((chat->view_page + 1) * RESPONSE_VIEW_ROWS < chat->view_row_count) {
+            chat->view_page++;
+            chat_view_load(chat);
+        }
+    } else if(event->key == InputKeyBack) {
+        ollama_app_set_state(state, AppStateChat);
+    }
 }
 
 void process_chat(OllamaAppState* state, InputEvent* event) {
-    if(event->type == InputTypeShort || event->type == InputTypeRepeat) {
+    ChatScreen* chat = state->chat;
+    if(!chat->completion) {
+        // Loaded on first use so opening the chat screen stays instant
+        chat_load_completion(chat);
+    }
+
+    if(event->type == InputTypeLong && event->key == InputKeyOk) {
+        // The typed text becomes a question about CONTEXT_FILE_PATH, sent along with it
+        if(strlen(chat->current_message) > 0 && context_start(state, chat->current_message)) {
+            char message[MAX_MESSAGE_LENGTH];
+            snprintf(message, sizeof(message), "[file] %.*s", (int)sizeof(message) - 8, chat->current_message);
+            add_chat_message(state, message, true);
+            chat_learn(chat->completion, chat->current_message);
+            chat->current_message[0] = '\0';
+            chat->cursor_position = 0;
+        }
+    } else if(event->type == InputTypeShort || event->type == InputTypeRepeat) {
         switch(event->key) {
             case InputKeyUp:
-            case InputKeyDown:
-                // TODO: Implement chat history scrolling
+                chat_accept_suggestion(chat);
                 break;
+            case InputKeyDown:
+                if(chat->suggestion_count > 0) {
+                    chat->suggestion_index = (chat->suggestion_index + 1) % chat->suggestion_count;
+                }
+                return;
             case InputKeyRight:
-                if (state->cursor_position < strlen(state->current_message)) {
-                    state->cursor_position++;
+                if (chat->cursor_position < strlen(chat->current_message)) {
+                    chat->cursor_position++;
                 }
                 break;
             case InputKeyLeft:
-                if (state->cursor_position > 0) {
-                    state->cursor_position--;
+                if (chat->cursor_position > 0) {
+                    chat->cursor_position--;
                 }
                 break;
             case InputKeyOk:
-                if (strlen(state->current_message) > 0) {
-                    add_chat_message(state, state->current_message, true);
-                    // TODO: Implement API call to get AI response
-                    add_chat_message(state, "I am a simulated response.", false);
-                    state->current_message[0] = '\0';
-                    state->cursor_position = 0;
+                if (strlen(chat->current_message) > 0) {
+                    latency_mark_key_ok(state);
+                    if(!wifi_send_prompt(state, chat->current_message)) {
+                        // The TX queue is still busy; keep the prompt for another OK
+                        latency_cancel(state);
+                        add_chat_message(state, "Not sent: UART busy, press OK again", false);
+                        break;
+                    }
+                    add_chat_message(state, chat->current_message, true);
+                    chat_learn(chat->completion, chat->current_message);
+                    chat->current_message[0] = '\0';
+                    chat->cursor_position = 0;
                 }
                 break;
             default:
-                if (strlen(state->current_message) < MAX_MESSAGE_LENGTH - 1) {
+                if (strlen(chat->current_message) < MAX_MESSAGE_LENGTH - 1) {
                     memmove(
-                        &state->current_message[state->cursor_position + 1],
-                        &state->current_message[state->cursor_position],
-                        strlen(&state->current_message[state->cursor_position]) + 1
+                        &chat->current_message[chat->cursor_position + 1],
+                        &chat->current_message[chat->cursor_position],
+                        strlen(&chat->current_message[chat->cursor_position]) + 1
                     );
-                    state->current_message[state->cursor_position] = 'A' + (event->key % 26); // Simple key to char mapping
-                    state->cursor_position++;
+                    chat->current_message[chat->cursor_position] = 'A' + (event->key % 26); // Simple key to char mapping
+                    chat->cursor_position++;
                 }
                 break;
         }
     }
-}
\ No newline at end of file
+    chat_update_suggestions(chat);
+}
@@ -3,4 +3,13 @@
 #include "ollama_app_i.h"
 
 void add_chat_message(OllamaAppState* state, const char* message, bool is_user);
-void process_chat(OllamaAppState* state, InputEvent* event);
\ No newline at end of file
+// Appends the messages added since the last call to the searchable archive
+void chat_archive_flush(OllamaAppState* state);
+void process_chat(OllamaAppState* state, InputEvent* event);
+// Stage a reply's rows and its end for the main loop; called from the UART worker
+void chat_reply_append(OllamaAppState* state, const char* text, size_t length);
+void chat_reply_finish(OllamaAppState* state);
+// Spools the staged rows and adds the replies they finish to the chat
+void chat_reply_flush(OllamaAppState* state);
+void chat_open_viewer(OllamaAppState* state);
+void process_response_view(OllamaAppState* state, InputEvent* event);
\ No newline at end of file
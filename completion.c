@@ -0,0 +1,193 @@
+#include "completion.h"
+#include "ollama_app_i.h"
+#include "helpers/arena.h"
+#include <ctype.h>
+#include <string.h>
+
+#define COMPLETION_NONE 0xFFFF
+
+typedef struct {
+    uint16_t child;
+    uint16_t sibling;
+    uint16_t parent;
+    uint16_t top[COMPLETION_SUGGESTIONS]; // best entries in this subtree, by weight
+    uint8_t weight; // non-zero when an entry ends here; saturates at 255
+    char c;
+} CompletionNode;
+
+struct Completion {
+    Arena* arena;
+    CompletionNode* nodes;
+    uint16_t count;
+    uint16_t capacity;
+};
+
+static uint16_t completion_new_node(Completion* completion, uint16_t parent, char c) {
+    if(completion->count >= completion->capacity) {
+        return COMPLETION_NONE;
+    }
+
+    uint16_t index = completion->count++;
+    CompletionNode* node = &completion->nodes[index];
+    node->child = COMPLETION_NONE;
+    node->sibling = COMPLETION_NONE;
+    node->parent = parent;
+    memset(node->top, 0xFF, sizeof(node->top));
+    node->weight = 0;
+    node->c = c;
+    return index;
+}
+
+static uint16_t completion_find_child(const Completion* completion, uint16_t parent, char c) {
+    c = tolower((unsigned char)c);
+    for(uint16_t child = completion->nodes[parent].child; child != COMPLETION_NONE;
+        child = completion->nodes[child].sibling) {
+        if(tolower((unsigned char)completion->nodes[child].c) == c) {
+            return child;
+        }
+    }
+    return COMPLETION_NONE;
+}
+
+// Re-ranks entry in node's top list after its weight went up
+static void completion_rank(Completion* completion, uint16_t node, uint16_t entry) {
+    uint16_t* top = completion->nodes[node].top;
+    uint8_t weight = completion->nodes[entry].weight;
+
+    uint8_t slot = COMPLETION_SUGGESTIONS - 1;
+    for(uint8_t i = 0; i < COMPLETION_SUGGESTIONS; i++) {
+        if(top[i] == entry || top[i] == COMPLETION_NONE) {
+            slot = i;
+            break;
+        }
+    }
+    if(top[slot] != entry && top[slot] != COMPLETION_NONE &&
+       completion->nodes[top[slot]].weight >= weight) {
+        return;
+    }
+
+    while(slot > 0 && completion->nodes[top[slot - 1]].weight < weight) {
+        top[slot] = top[slot - 1];
+        slot--;
+    }
+    top[slot] = entry;
+}
+
+Completion* completion_alloc(uint16_t max_nodes) {
+    Arena* arena = arena_alloc(sizeof(Completion) + max_nodes * sizeof(CompletionNode));
+    Completion* completion = arena_push(arena, sizeof(Completion));
+    completion->arena = arena;
+    completion->nodes = arena_push(arena, max_nodes * sizeof(CompletionNode));
+    completion->capacity = max_nodes;
+    completion_new_node(completion, COMPLETION_NONE, '\0');
+    return completion;
+}
+
+void completion_free(Completion* completion) {
+    arena_free(completion->arena);
+}
+
+bool completion_add(Completion* completion, const char* text, uint16_t weight) {
+    size_t length = strlen(text);
+    if(length == 0 || length >= COMPLETION_MAX_LENGTH || weight == 0) {
+        return false;
+    }
+
+    uint16_t node = 0;
+    for(size_t i = 0; i < length; i++) {
+        uint16_t child = completion_find_child(completion, node, text[i]);
+        if(child == COMPLETION_NONE) {
+            child = completion_new_node(completion, node, text[i]);
+            if(child == COMPLETION_NONE) {
+                return false;
+            }
+            completion->nodes[child].sibling = completion->nodes[node].child;
+            completion->nodes[node].child = child;
+        }
+        node = child;
+    }
+
+    uint16_t total = completion->nodes[node].weight + weight;
+    completion->nodes[node].weight = total > UINT8_MAX ? UINT8_MAX : total;
+    for(uint16_t ancestor = node; ancestor != COMPLETION_NONE;
+        ancestor = completion->nodes[ancestor].parent) {
+        completion_rank(completion, ancestor, node);
+    }
+    return true;
+}
+
+uint8_t completion_lookup(
+    const Completion* completion,
+    const char* prefix,
+    size_t prefix_length,
+    char* out,
+    size_t out_size,
+    uint8_t max) {
+    uint16_t node = 0;
+    for(size_t i = 0; i < prefix_length && node != COMPLETION_NONE; i++) {
+        node = completion_find_child(completion, node, prefix[i]);
+    }
+    if(node == COMPLETION_NONE || prefix_length == 0) {
+        return 0;
+    }
+
+    uint8_t found = 0;
+    for(uint8_t i = 0; i < COMPLETION_SUGGESTIONS && found < max; i++) {
+        uint16_t entry = completion->nodes[node].top[i];
+        if(entry == COMPLETION_NONE) {
+            break;
+        }
+        if(entry == node) {
+            continue;
+        }
+
+        // Walk up to the root to find the length, then fill the row from the end
+        size_t length = 0;
+        for(uint16_t n = entry; n != 0; n = completion->nodes[n].parent) {
+            length++;
+        }
+        if(length >= out_size) {
+            continue;
+        }
+        char* row = out + found * out_size;
+        row[length] = '\0';
+        for(uint16_t n = entry; n != 0; n = completion->nodes[n].parent) {
+            row[--length] = completion->nodes[n].c;
+        }
+        found++;
+    }
+    return found;
+}
+
+void completion_foreach(
+    const Completion* completion,
+    void (*each)(const char* text, uint16_t weight, void* context),
+    void* context) {
+    char text[COMPLETION_MAX_LENGTH];
+    for(uint16_t entry = 1; entry < completion->count; entry++) {
+        if(completion->nodes[entry].weight == 0) {
+            continue;
+        }
+        size_t length = 0;
+        for(uint16_t n = entry; n != 0; n = completion->nodes[n].parent) {
+            length++;
+        }
+        text[length] = '\0';
+        for(uint16_t n = entry; n != 0; n = completion->nodes[n].parent) {
+            text[--length] = completion->nodes[n].c;
+        }
+        each(text, completion->nodes[entry].weight, context);
+    }
+}
+
+uint16_t completion_node_count(const Completion* completion) {
+    return completion->count;
+}
+
+uint16_t completion_entry_count(const Completion* completion) {
+    uint16_t entries = 0;
+    for(uint16_t i = 1; i < completion->count; i++) {
+        if(completion->nodes[i].weight > 0) entries++;
+    }
+    return entries;
+}
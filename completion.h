@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Completion is a compact prefix trie of words and past prompts.  Every node caches
+ * the best-weighted entries below it, so a lookup costs one walk down the prefix
+ * plus one walk up per suggestion, independent of how many entries share the prefix.
+ * All nodes live in a single arena sized at allocation time.
+*/
+typedef struct Completion Completion;
+
+Completion* completion_alloc(uint16_t max_nodes);
+void completion_free(Completion* completion);
+
+/**
+ * Adds weight to an entry, inserting it if needed.
+ * 
+ * @return  false when the trie is full or the entry is too long
+*/
+bool completion_add(Completion* completion, const char* text, uint16_t weight);
+
+/**
+ * Finds the best entries starting with prefix (case-insensitive), best first.  An
+ * entry equal to the prefix is not suggested.
+ * 
+ * @param out      max rows of out_size characters each
+ * @return         number of rows written
+*/
+uint8_t completion_lookup(
+    const Completion* completion,
+    const char* prefix,
+    size_t prefix_length,
+    char* out,
+    size_t out_size,
+    uint8_t max);
+
+/**
+ * Calls each with every entry and its weight, in no particular order.
+*/
+void completion_foreach(
+    const Completion* completion,
+    void (*each)(const char* text, uint16_t weight, void* context),
+    void* context);
+
+uint16_t completion_node_count(const Completion* completion);
+uint16_t completion_entry_count(const Completion* completion);
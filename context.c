@@ -0,0 +1,167 @@
+#include "context.h"
+#include "chat.h"
+#include "wifi.h"
+#include "trace.h"
+#include <string.h>
+
+// Ends the upload with a note in the chat where the answer would have gone
+static void context_abort(OllamaAppState* state, const char* reason) {
+    context_close(&state->chat->context);
+    char message[MAX_MESSAGE_LENGTH];
+    snprintf(message, sizeof(message), "File not sent: %s", reason);
+    add_chat_message(state, message, false);
+    state->ui_update_needed = true;
+    APP_LOG_W("Context", "Upload of %s failed: %s", CONTEXT_FILE_PATH, reason);
+}
+
+// All of the file is on the line and the ESP32 has forwarded all of it
+static bool context_finished(const ContextUpload* context) {
+    return context->ready && context->sent >= context->size && context->acked >= context->queued;
+}
+
+// Escapes file bytes into chunk until it holds CONTEXT_CHUNK_SIZE bytes for the line or
+// the file runs out, reading more as needed; false if the SD card returns nothing.  Full
+// chunks line up with the ESP32's FILE_ACKs, so an escape may be split across two.
+static bool context_fill_chunk(ContextUpload* context) {
+    context->chunk_bytes = 0;
+    if(context->carry_pending) {
+        context->chunk[context->chunk_length++] = context->carry;
+        context->chunk_bytes++;
+        context->carry_pending = false;
+    }
+    while(context->chunk_length < CONTEXT_CHUNK_SIZE) {
+        if(context->raw_next == context->raw_length) {
+            uint32_t left = context->size - context->read;
+            if(left == 0) {
+                break;
+            }
+            context->raw_length = storage_file_read(
+                context->file, context->raw, left < CONTEXT_CHUNK_SIZE ? left : CONTEXT_CHUNK_SIZE);
+            context->raw_next = 0;
+            if(context->raw_length == 0) {
+                return false;
+            }
+            context->read += context->raw_length;
+        }
+        // XON and XOFF would be taken for flow control on the way
+        char c = context->raw[context->raw_next++];
+        if(c == 0x11 || c == 0x13 || c == CONTEXT_ESCAPE) {
+            context->chunk[context->chunk_length++] = CONTEXT_ESCAPE;
+            c ^= 0x20;
+            if(context->chunk_length == CONTEXT_CHUNK_SIZE) {
+                context->carry = c;
+                context->carry_pending = true;
+                break;
+            }
+        }
+        context->chunk[context->chunk_length++] = c;
+        context->chunk_bytes++;
+    }
+    return true;
+}
+
+bool context_start(OllamaAppState* state, const char* question) {
+    ContextUpload* context = &state->chat->context;
+    if(context->file) {
+        return false;
+    }
+    memset(context, 0, sizeof(ContextUpload));
+
+    context->storage = furi_record_open(RECORD_STORAGE);
+    context->file = storage_file_alloc(context->storage);
+    if(!storage_file_open(context->file, CONTEXT_FILE_PATH, FSAM_READ, FSOM_OPEN_EXISTING)) {
+        APP_LOG_W("Context", "Cannot open %s", CONTEXT_FILE_PATH);
+        context_close(context);
+        return false;
+    }
+    context->size = storage_file_size(context->file);
+    context->start_tick = context->ack_tick = furi_get_tick();
+    if(!wifi_send_file(state, context->size, question)) {
+        context_close(context);
+        return false;
+    }
+    return true;
+}
+
+void context_pump(OllamaAppState* state) {
+    ChatScreen* chat = state->chat;
+    if(!chat) {
+        return;
+    }
+    ContextUpload* context = &chat->context;
+    if(context->failure[0] != '\0') {
+        context_abort(state, context->failure);
+        context->failure[0] = '\0';
+        return;
+    }
+    if(!context->file) {
+        return;
+    }
+    if(furi_get_tick() - context->ack_tick >= CONTEXT_ACK_TIMEOUT_MS) {
+        context_abort(state, "no FILE_ACK");
+        return;
+    }
+    if(context_finished(context)) {
+        APP_LOG_I("Context", "Sent %lu bytes of %s in %lu ms", (unsigned long)context->size,
+                  CONTEXT_FILE_PATH, (unsigned long)(context->ack_tick - context->start_tick));
+        // The answer arrives as PART and Ollama lines like any other
+        context_close(context);
+        return;
+    }
+
+    while(context->ready && context->sent < context->size) {
+        if(context->chunk_length == 0 && !context_fill_chunk(context)) {
+            // The ESP32 gives up on the missing bytes by itself
+            context_abort(state, "SD read failed");
+            return;
+        }
+        if(context->queued - context->acked + context->chunk_length > CONTEXT_WINDOW) {
+            break;
+        }
+        // All or nothing; if the TX queue is full the main loop tries again shortly
+        if(!wifi_send_file_data(state, context->chunk, context->chunk_length)) {
+            break;
+        }
+        context->sent += context->chunk_bytes;
+        context->queued += context->chunk_length;
+        context->chunk_length = 0;
+    }
+}
+
+void context_ack(OllamaAppState* state, const char* ack) {
+    ChatScreen* chat = state->chat;
+    if(!chat || !chat->context.file) {
+        return;
+    }
+    ContextUpload* context = &chat->context;
+    context->ready = true;
+    context->acked = strtoul(ack, NULL, 10);
+    context->ack_tick = furi_get_tick();
+    state->ui_update_needed = true;
+    // The main loop reads and sends what the window now allows, off the UART worker
+    ollama_app_wake(state);
+}
+
+void context_fail(OllamaAppState* state, const char* error) {
+    // Once all of the file is acknowledged the upload is over, and a note that it was
+    // not sent would be wrong; the main loop closes the file and puts the note in the chat
+    if(!state->chat || !state->chat->context.file || context_finished(&state->chat->context)) {
+        APP_LOG_W("Context", "FILE_FAILED:%s with no upload running", error);
+        return;
+    }
+    ContextUpload* context = &state->chat->context;
+    snprintf(context->failure, sizeof(context->failure), "error %s", error);
+    ollama_app_wake(state);
+}
+
+void context_close(ContextUpload* context) {
+    if(context->file) {
+        storage_file_close(context->file);
+        storage_file_free(context->file);
+        context->file = NULL;
+    }
+    if(context->storage) {
+        furi_record_close(RECORD_STORAGE);
+        context->storage = NULL;
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "ollama_app_i.h"
+
+/**
+ * File context asks a question about CONTEXT_FILE_PATH, which is far too big to be a
+ * prompt.  The ESP32 is sent "FILE <size> <question>", opens its request and answers
+ * FILE_ACK:0; the file follows as raw bytes with only XON, XOFF and CONTEXT_ESCAPE
+ * escaped, read a chunk at a time and sent no more than CONTEXT_WINDOW ahead of the last
+ * FILE_ACK:<line bytes forwarded>.  The answer comes back like any prompt's, and
+ * FILE_FAILED:<error> ends the upload at any point until all of it is acknowledged.
+ *
+ * @return  false if the file cannot be opened or an upload is already running
+*/
+bool context_start(OllamaAppState* state, const char* question);
+
+/**
+ * Queues file bytes while the window allows, and closes the upload once all of it is
+ * acknowledged or it has failed.  Called from the main loop, which a FILE_ACK wakes; it
+ * also retries a chunk the TX queue had no room for and gives up on an ESP32 that has
+ * stopped acknowledging.
+*/
+void context_pump(OllamaAppState* state);
+
+// Records "<bytes forwarded>" from a FILE_ACK line for context_pump
+void context_ack(OllamaAppState* state, const char* ack);
+
+// Records "<error>" from a FILE_FAILED line for context_pump while an upload is running
+void context_fail(OllamaAppState* state, const char* error);
+
+void context_close(ContextUpload* context);
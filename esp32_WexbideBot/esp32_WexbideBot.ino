@@ -1,70 +1,225 @@
 #include <WiFi.h>
 #include <HTTPClient.h>
 #include <ArduinoJson.h>
+#include <Preferences.h>
+// From libraries/WexbideBot in this repository
+#include <FlowControlSerial.h>
+#include <ReplyText.h>
+
+FlowControlSerial flipper;
 
 String serverURL;
 String apiKey;
 String endpoint;
 String userName;
+String modelName = "mistral";
+
+// How long Ollama should keep the model resident after the warm-up request.
+const char* warmupKeepAlive = "10m";
+
+// The settings from the Flipper are kept in NVS, so after a power cycle the ESP32
+// connects and warms up the model on its own instead of waiting for the Flipper to send
+// them again.  Their version is an FNV-1a hash of the settings text below, which the
+// Flipper computes the same way (wexbide.hash) and checks with "CONFIG?" before
+// sending anything.  An update is a run of lines, applied only once all have arrived
+// and match the version:
+//   CONFIG BEGIN <version>
+//   CONFIG URL <server url>
+//   CONFIG USER <name>
+//   CONFIG MODEL <model>
+//   CONFIG AP <ssid>//<password>     one per known network, most recently used first
+//   CONFIG END
+const char* prefsNamespace = "wexbide";
+Preferences prefs;
+uint32_t configVersion = 0;
+// "ssid//password" lines, most recently used first
+String knownNetworks;
+
+// Update being received; configVersion stays as it was until CONFIG END
+uint32_t pendingVersion = 0;
+String pendingURL;
+String pendingUser;
+String pendingModel;
+String pendingNetworks;
+
+// Per association attempt; a scan of all channels takes a few seconds more
+const unsigned long wifiConnectTimeoutMs = 15000;
+bool readyReported = false;
+
+// FNV-1a over "<url>\n<user>\n<model>\n" followed by the network lines
+uint32_t configHash(const String &url, const String &user, const String &model, const String &networks) {
+  String text = url + "\n" + user + "\n" + model + "\n" + networks;
+  uint32_t hash = 2166136261UL;
+  for (unsigned int i = 0; i < text.length(); i++) {
+    hash ^= (uint8_t)text[i];
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+// Loads the settings saved by the last update; false when there are none, or when a
+// power cut interrupted the save and they no longer match their version
+bool loadConfig() {
+  prefs.begin(prefsNamespace, true);
+  uint32_t version = prefs.getUInt("version", 0);
+  String url = prefs.getString("url");
+  String user = prefs.getString("user");
+  String model = prefs.getString("model", modelName);
+  String networks = prefs.getString("aps");
+  prefs.end();
+  if (version == 0 || configHash(url, user, model, networks) != version) {
+    return false;
+  }
+  configVersion = version;
+  serverURL = url;
+  userName = user;
+  modelName = model;
+  knownNetworks = networks;
+  return true;
+}
+
+// The version goes last, so a partly written update fails the check in loadConfig
+void saveConfig() {
+  prefs.begin(prefsNamespace, false);
+  prefs.putUInt("version", 0);
+  prefs.putString("url", serverURL);
+  prefs.putString("user", userName);
+  prefs.putString("model", modelName);
+  prefs.putString("aps", knownNetworks);
+  prefs.putUInt("version", configVersion);
+  prefs.end();
+}
+
+// Not part of the versioned settings: which network the ESP32 itself got onto last
+void saveLastNetwork(const String &ssid) {
+  prefs.begin(prefsNamespace, false);
+  if (prefs.getString("last") != ssid) prefs.putString("last", ssid);
+  prefs.end();
+}
+
+String loadLastNetwork() {
+  prefs.begin(prefsNamespace, true);
+  String ssid = prefs.getString("last");
+  prefs.end();
+  return ssid;
+}
+
+// Looks ssid up in knownNetworks
+bool knownPassword(const String &ssid, String &password) {
+  int start = 0;
+  while (start < (int)knownNetworks.length()) {
+    int end = knownNetworks.indexOf('\n', start);
+    if (end == -1) end = knownNetworks.length();
+    String pair = knownNetworks.substring(start, end);
+    int separator = pair.indexOf("//");
+    if (separator != -1 && pair.substring(0, separator) == ssid) {
+      password = pair.substring(separator + 2);
+      return true;
+    }
+    start = end + 1;
+  }
+  return false;
+}
+
+// "READY:<ms since boot>" once the first prompt can go out without further setup
+void reportReady() {
+  if (readyReported || WiFi.status() != WL_CONNECTED || serverURL.length() == 0) {
+    return;
+  }
+  flipper.print("READY:");
+  flipper.println(millis());
+  readyReported = true;
+}
+
+// Sends an empty prompt so Ollama loads the model into memory before the user's first
+// real prompt. Reports "WARMUP:<total_ms>,<load_ms>" where load_ms is the server-side
+// model load time (0 when the model was already resident).
+void warmUpModel() {
+  if (WiFi.status() != WL_CONNECTED || serverURL.length() == 0) {
+    return;
+  }
 
-void connectToWiFi(const char* ssid, const char* password) {
+  HTTPClient http;
+  http.setTimeout(60000);
+  http.begin(serverURL);
+  http.addHeader("Content-Type", "application/json");
+
+  String payload = "{\"model\":\"" + modelName + "\",\"prompt\":\"\",\"keep_alive\":\"" + String(warmupKeepAlive) + "\",\"stream\":false}";
+
+  unsigned long start = millis();
+  int httpResponseCode = http.POST(payload);
+  if (httpResponseCode > 0) {
+    String response = http.getString();
+    unsigned long elapsed = millis() - start;
+
+    StaticJsonDocument<64> filter;
+    filter["load_duration"] = true;
+    DynamicJsonDocument doc(256);
+    unsigned long loadMs = 0;
+    if (!deserializeJson(doc, response, DeserializationOption::Filter(filter))) {
+      loadMs = (unsigned long)(doc["load_duration"].as<uint64_t>() / 1000000ULL);
+    }
+
+    flipper.print("WARMUP:");
+    flipper.print(elapsed);
+    flipper.print(",");
+    flipper.println(loadMs);
+  } else {
+    flipper.print("WARMUP_FAILED:");
+    flipper.println(httpResponseCode);
+  }
+  http.end();
+}
+
+bool connectToWiFi(const char* ssid, const char* password) {
   WiFi.mode(WIFI_STA);
   WiFi.disconnect();
-  delay(1000);
+  delay(100);
 
   WiFi.begin(ssid, password);
 
-  int retries = 0;
-  const int maxRetries = 30;
-  while (WiFi.status() != WL_CONNECTED && retries < maxRetries) {
-    delay(1000);
-    Serial.print(".");
-    retries++;
-    delay(500);
+  // Polled often so the connection is used as soon as it is up; a dot every half second
+  unsigned long start = millis();
+  unsigned long lastDot = start;
+  wl_status_t status;
+  while ((status = WiFi.status()) != WL_CONNECTED && status != WL_CONNECT_FAILED &&
+         status != WL_NO_SSID_AVAIL && millis() - start < wifiConnectTimeoutMs) {
+    delay(50);
+    if (millis() - lastDot >= 500) {
+      flipper.print(".");
+      lastDot = millis();
+    }
   }
 
-  if (WiFi.status() == WL_CONNECTED) {
-    Serial.println("");
-    Serial.println("WiFi connected");
-    Serial.println("IP address: ");
-    Serial.println(WiFi.localIP());
+  if (status == WL_CONNECTED) {
+    flipper.println("");
+    flipper.println("WiFi connected");
+    flipper.println("IP address: ");
+    flipper.println(WiFi.localIP());
+    saveLastNetwork(ssid);
+    return true;
   } else {
-    Serial.println("");
-    Serial.println("Error: Could not connect to WiFi network.");
+    flipper.println("");
+    flipper.println("Error: Could not connect to WiFi network.");
+    return false;
   }
 }
 
-void loadServerURL() {
-  Serial.println("Please send the Ollama server URL file (server_url.txt) over Serial:");
-  
-  while (!Serial.available());
-  serverURL = Serial.readStringUntil('\n');
-  serverURL.trim();
-  Serial.println("Ollama server URL loaded successfully.");
-}
-
 void loadAPIKey() {
-  Serial.println("Please send the API key file (api.txt) over Serial:");
+  flipper.println("Please send the API key file (api.txt) over Serial:");
   
-  while (!Serial.available());
-  apiKey = Serial.readStringUntil('\n');
+  while (!flipper.available());
+  apiKey = flipper.readStringUntil('\n');
   apiKey.trim();
   endpoint = "https://generativelanguage.googleapis.com/v1beta/models/gemini-pro:generateContent?key=" + apiKey;
-  Serial.println("API key loaded successfully.");
-}
-
-void saveAP(const char* ssid, const char* password) {
-  Serial.println("Saving Access Point information...");
-  String apData = String(ssid) + "//" + String(password) + "\n";
-  Serial.print("Writing to SavedAPs.txt: ");
-  Serial.println(apData);
+  flipper.println("API key loaded successfully.");
 }
 
 bool loadSavedAP(String &ssid, String &password) {
-  Serial.println("Loading saved Access Points from SavedAPs.txt...");
+  flipper.println("Loading saved Access Points from SavedAPs.txt...");
   
-  while (!Serial.available());
-  String apData = Serial.readStringUntil('\n');
+  while (!flipper.available());
+  String apData = flipper.readStringUntil('\n');
   
   int separatorIndex = apData.indexOf("//");
   if (separatorIndex == -1) return false;
@@ -78,114 +233,139 @@ bool loadSavedAP(String &ssid, String &password) {
   return true;
 }
 
-bool autoConnectToWiFi(const String &networks) {
-  Serial.println("Attempting to auto-connect to known networks...");
+// Tries `first` straight away, as a scan takes seconds; it is the network that worked
+// last time, or one the user just added, which may be hidden.  Then scans and tries the
+// known networks in range, most recently used first.
+bool autoConnectToWiFi(const String &first) {
+  flipper.println("Attempting to auto-connect to known networks...");
+
+  String password;
+  if (first.length() > 0 && knownPassword(first, password)) {
+    flipper.println("Trying " + first);
+    if (connectToWiFi(first.c_str(), password.c_str())) {
+      flipper.println("Connected successfully to " + first);
+      return true;
+    }
+  }
 
   int n = WiFi.scanNetworks();
-  
-  int startIndex = 0;
-  while (startIndex < networks.length()) {
-    int separatorIndex = networks.indexOf(",", startIndex);
-    if (separatorIndex == -1) separatorIndex = networks.length();
-    
-    String pair = networks.substring(startIndex, separatorIndex);
-    pair.trim();
-
-    int ssidPasswordSeparator = pair.indexOf("//");
-    if (ssidPasswordSeparator == -1) {
-      Serial.println("Invalid format, skipping: " + pair);
-      startIndex = separatorIndex + 1;
+
+  int start = 0;
+  while (start < (int)knownNetworks.length()) {
+    int end = knownNetworks.indexOf('\n', start);
+    if (end == -1) end = knownNetworks.length();
+    String pair = knownNetworks.substring(start, end);
+    start = end + 1;
+
+    int separator = pair.indexOf("//");
+    if (separator == -1) {
+      flipper.println("Invalid format, skipping: " + pair);
       continue;
     }
-
-    String ssid = pair.substring(0, ssidPasswordSeparator);
-    String password = pair.substring(ssidPasswordSeparator + 2);
-    ssid.trim();
-    password.trim();
+    String ssid = pair.substring(0, separator);
+    password = pair.substring(separator + 2);
+    if (ssid == first) continue;
 
     for (int i = 0; i < n; ++i) {
       if (ssid == WiFi.SSID(i)) {
-        Serial.print("Found matching SSID: ");
-        Serial.println(ssid);
-        connectToWiFi(ssid.c_str(), password.c_str());
-        if (WiFi.status() == WL_CONNECTED) {
-          Serial.println("Connected successfully to " + ssid);
+        flipper.print("Found matching SSID: ");
+        flipper.println(ssid);
+        if (connectToWiFi(ssid.c_str(), password.c_str())) {
+          flipper.println("Connected successfully to " + ssid);
+          WiFi.scanDelete();
           return true;
         } else {
-          Serial.println("Failed to connect to " + ssid);
+          flipper.println("Failed to connect to " + ssid);
         }
+        break;
       }
     }
-
-    startIndex = separatorIndex + 1;
   }
-  Serial.println("No matching networks found.");
+  WiFi.scanDelete();
+  flipper.println("No matching networks found.");
   return false;
 }
 
-void manualConnect() {
-  Serial.println("Please enter the SSID of the WiFi network you want to connect to:");
-  while (!Serial.available());
-  String ssid = Serial.readStringUntil('\n');
-  ssid.trim();
-
-  Serial.println("Please enter the password for the WiFi network:");
-  while (!Serial.available());
-  String password = Serial.readStringUntil('\n');
-  password.trim();
-
-  String formattedInput = ssid + "//" + password;
-
-  connectToWiFi(ssid.c_str(), password.c_str());
+// Stores a complete update and acts on what changed: reconnects when the network list
+// now starts with another network (one the user just added) and warms up the model
+// when the server or the model changed
+void applyConfig() {
+  if (pendingVersion == 0 || configHash(pendingURL, pendingUser, pendingModel, pendingNetworks) != pendingVersion) {
+    flipper.println("CONFIG_ERROR: settings do not match their version, not saved");
+    return;
+  }
+  bool serverChanged = pendingURL != serverURL || pendingModel != modelName;
+  bool networksChanged = pendingNetworks != knownNetworks;
+  configVersion = pendingVersion;
+  serverURL = pendingURL;
+  userName = pendingUser;
+  modelName = pendingModel;
+  knownNetworks = pendingNetworks;
+  pendingNetworks = "";
+  saveConfig();
+  flipper.print("CONFIG_OK:");
+  flipper.println(configVersion);
+  flipper.println("Hello, " + userName + "!");
+
+  int separator = knownNetworks.indexOf("//");
+  String first = separator == -1 ? String() : knownNetworks.substring(0, separator);
+  bool connected = WiFi.status() == WL_CONNECTED;
+  if (!connected || (networksChanged && WiFi.SSID() != first)) {
+    bool reconnected = autoConnectToWiFi(first);
+    serverChanged |= reconnected && !connected;
+  }
+  if (serverChanged) warmUpModel();
+  reportReady();
+}
 
-  if (WiFi.status() == WL_CONNECTED) {
-    saveAP(ssid.c_str(), password.c_str());
-  } else {
-    Serial.println("Failed to connect to " + ssid + ". Manual entry required.");
+// Handles one "CONFIG ..." line from the Flipper
+void handleConfig(const String &command) {
+  if (command == "CONFIG?") {
+    flipper.print("CONFIG:");
+    flipper.println(configVersion);
+  } else if (command.startsWith("CONFIG BEGIN ")) {
+    pendingVersion = strtoul(command.c_str() + 13, NULL, 10);
+    pendingURL = pendingUser = pendingNetworks = "";
+    pendingModel = "mistral";
+  } else if (command.startsWith("CONFIG URL ")) {
+    pendingURL = command.substring(11);
+  } else if (command.startsWith("CONFIG USER ")) {
+    pendingUser = command.substring(12);
+  } else if (command.startsWith("CONFIG MODEL ")) {
+    pendingModel = command.substring(13);
+  } else if (command.startsWith("CONFIG AP ")) {
+    pendingNetworks += command.substring(10) + "\n";
+  } else if (command == "CONFIG END") {
+    applyConfig();
   }
 }
 
+// Nothing here waits for the Flipper: with settings in NVS the ESP32 connects and warms
+// up straight away, and without them it waits in loop() for a CONFIG update
 void setup() {
   Serial.begin(115200);
   delay(10);
 
-  loadServerURL();
-
-  Serial.println("Welcome to the Ollama ESP32!");
-  Serial.println("Please enter your name:");
-  while (!Serial.available());
-  userName = Serial.readStringUntil('\n');
-  userName.trim();
-
-  Serial.println("Hello, " + userName + "!");
-
-  Serial.println("Scanning WiFi networks...");
-  int n = WiFi.scanNetworks();
-  Serial.println("Available WiFi networks:");
-  for (int i = 0; i < n; ++i) {
-    Serial.print(i + 1);
-    Serial.print(": ");
-    Serial.print(WiFi.SSID(i));
-    Serial.print(" (");
-    Serial.print(WiFi.RSSI(i));
-    Serial.println(")");
-  }
-
-  while (!Serial.available());
-  String networks = Serial.readStringUntil('\n');
-  networks.trim();
-
-  if (!autoConnectToWiFi(networks)) {
-    manualConnect();
+  flipper.println("Welcome to the Ollama ESP32!");
+  if (loadConfig()) {
+    flipper.println("Hello, " + userName + "!");
+    if (autoConnectToWiFi(loadLastNetwork())) {
+      warmUpModel();
+    }
+    reportReady();
+  } else {
+    flipper.println("No saved settings, waiting for CONFIG from the Flipper");
   }
 }
 
 void loop() {
-  if (Serial.available() > 0) {
-    String userQuery = Serial.readStringUntil('\n');
+  if (flipper.available() > 0) {
+    String userQuery = flipper.readStringUntil('\n');
     userQuery.trim();
 
-    if (userQuery.length() > 0) {
+    if (userQuery.startsWith("CONFIG")) {
+      handleConfig(userQuery);
+    } else if (userQuery.length() > 0) {
       if (WiFi.status() == WL_CONNECTED) {
         HTTPClient http;
 
@@ -193,7 +373,7 @@ void loop() {
         http.begin(serverURL);
         http.addHeader("Content-Type", "application/json");
 
-        String payload = "{\"model\":\"mistral\",\"prompt\":\"" + userQuery + "\",\"stream\":false}";
+        String payload = "{\"model\":\"" + modelName + "\",\"prompt\":\"" + userQuery + "\",\"keep_alive\":\"" + String(warmupKeepAlive) + "\",\"stream\":false}";
 
         int httpResponseCode = http.POST(payload);
 
@@ -204,23 +384,23 @@ void loop() {
           DeserializationError error = deserializeJson(doc, response);
 
           if (!error) {
-            const char* text = doc["response"];
-            Serial.println(userName + ": \"" + userQuery + "\""); 
-            Serial.println("Ollama: \"" + String(text) + "\"");
+            String text = doc["response"].as<String>();
+            flipper.println(userName + ": \"" + userQuery + "\""); 
+            sendReply(flipper, text);
           } else {
-            Serial.print("Error parsing JSON: ");
-            Serial.println(error.c_str());
+            flipper.print("Error parsing JSON: ");
+            flipper.println(error.c_str());
           }
         } else {
-          Serial.print("Request error: ");
-          Serial.println(httpResponseCode);
-          Serial.print("HTTP error: ");
-          Serial.println(http.errorToString(httpResponseCode).c_str());
+          flipper.print("Request error: ");
+          flipper.println(httpResponseCode);
+          flipper.print("HTTP error: ");
+          flipper.println(http.errorToString(httpResponseCode).c_str());
         }
 
         http.end();
       } else {
-        Serial.println("WiFi connection error");
+        flipper.println("WiFi connection error");
       }
     }
   }
@@ -1,64 +1,624 @@
 #include <WiFi.h>
 #include <HTTPClient.h>
 #include <ArduinoJson.h>
+#include "mbedtls/ssl.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/platform_util.h"
+#include "esp_crt_bundle.h"
+// From libraries/WexbideBot in this repository
+#include <FlowControlSerial.h>
+#include <ReplyText.h>
+
+FlowControlSerial flipper;
 
-String serverURL;
 String apiKey;
 String endpoint;
 String userName;
+String modelName = "mistral";
+
+// Ollama unloads an idle model after its keep_alive expires (5 minutes by default), so
+// while the Flipper has the chat screen open we re-send the preload a little before that.
+const char* warmupKeepAlive = "10m";
+const unsigned long warmupIntervalMs = 4UL * 60UL * 1000UL;
+// Loading a model from disk can take a while
+const uint16_t warmupTimeoutMs = 60000;
+bool keepWarm = false;
+unsigned long lastWarmupMs = 0;
+
+// The ESP32 gives up on an association after this long
+const unsigned long wifiConnectTimeoutMs = 10000;
+
+// millis() timestamps of the last prompt, reported to the Flipper by the STATS command
+unsigned long spanReceive = 0;
+unsigned long spanConnect = 0;
+unsigned long spanFirstByte = 0;
+unsigned long spanLastByte = 0;
+unsigned long spanUartDone = 0;
+
+// Splits "http://host:port/path" into host and port so the TCP connect can be timed
+// separately from the request itself.
+bool parseServerURL(const String &url, String &host, uint16_t &port) {
+  int hostStart = url.indexOf("://");
+  hostStart = hostStart == -1 ? 0 : hostStart + 3;
+  int pathStart = url.indexOf('/', hostStart);
+  if (pathStart == -1) pathStart = url.length();
+
+  String hostPort = url.substring(hostStart, pathStart);
+  int portSeparator = hostPort.indexOf(':');
+  if (portSeparator == -1) {
+    host = hostPort;
+    port = url.startsWith("https") ? 443 : 80;
+  } else {
+    host = hostPort.substring(0, portSeparator);
+    port = hostPort.substring(portSeparator + 1).toInt();
+  }
+  return host.length() > 0;
+}
+
+// Endpoints from the Flipper's server_url.txt, in file order.  A background task probes
+// each one and keeps a smoothed round-trip time; prompts go to the fastest healthy
+// endpoint and fail over to the next when a request errors out.
+const uint8_t maxEndpoints = 4;
+const unsigned long probeIntervalMs = 5000;
+const unsigned long probeTimeoutMs = 2000;
+const unsigned long connectTimeoutMs = 2000;
+
+struct Endpoint {
+  String url;
+  bool healthy;
+  bool probed;
+  unsigned long latencyMs;
+};
+
+Endpoint endpoints[maxEndpoints];
+uint8_t endpointCount = 0;
+SemaphoreHandle_t endpointMutex = NULL;
+TaskHandle_t probeTask = NULL;
+
+// Replaces the list with the space-separated URLs in `list`; all start out healthy
+void setEndpoints(const String &list) {
+  xSemaphoreTake(endpointMutex, portMAX_DELAY);
+  endpointCount = 0;
+  int start = 0;
+  while (start < (int)list.length() && endpointCount < maxEndpoints) {
+    int end = list.indexOf(' ', start);
+    if (end == -1) end = list.length();
+    if (end > start) {
+      Endpoint &e = endpoints[endpointCount++];
+      e.url = list.substring(start, end);
+      e.healthy = true;
+      e.probed = false;
+      e.latencyMs = 0;
+    }
+    start = end + 1;
+  }
+  xSemaphoreGive(endpointMutex);
+  if (probeTask != NULL) xTaskNotifyGive(probeTask);
+}
+
+// Returns the index of the endpoint to try next, skipping those in `tried`: the healthy
+// one with the lowest probed latency, then healthy but not yet probed ones in file
+// order, then, when every endpoint is down, the rest in file order.  -1 when none remain.
+int pickEndpoint(uint32_t tried, String &url) {
+  int best = -1;
+  xSemaphoreTake(endpointMutex, portMAX_DELAY);
+  for (uint8_t i = 0; i < endpointCount; i++) {
+    const Endpoint &e = endpoints[i];
+    if ((tried & (1UL << i)) || !e.healthy) continue;
+    if (best == -1 ||
+        (e.probed && (!endpoints[best].probed || e.latencyMs < endpoints[best].latencyMs))) {
+      best = i;
+    }
+  }
+  for (uint8_t i = 0; best == -1 && i < endpointCount; i++) {
+    if (!(tried & (1UL << i))) best = i;
+  }
+  if (best != -1) url = endpoints[best].url;
+  xSemaphoreGive(endpointMutex);
+  return best;
+}
+
+// Records a probe or request outcome.  A success folds `elapsedMs` into the moving
+// average (pass 0 to only mark the endpoint up).  Ignored if the list was replaced
+// since `url` was picked.
+void recordEndpoint(int index, const String &url, bool ok, unsigned long elapsedMs) {
+  xSemaphoreTake(endpointMutex, portMAX_DELAY);
+  if (index < endpointCount && endpoints[index].url == url) {
+    Endpoint &e = endpoints[index];
+    e.healthy = ok;
+    if (ok && elapsedMs > 0) {
+      e.latencyMs = e.probed ? (3 * e.latencyMs + elapsedMs) / 4 : elapsedMs;
+      e.probed = true;
+    }
+  }
+  xSemaphoreGive(endpointMutex);
+}
+
+// HTTPS endpoints go over mbed TLS directly rather than WiFiClientSecure, so the session
+// from each endpoint's last full handshake can be kept and offered on the next connect.
+// A resumed handshake skips the certificate chain and the key exchange, which on the
+// ESP32 saves hundreds of milliseconds of RSA/ECDHE work per new connection.  Server
+// certificates are checked against the ESP-IDF CA bundle.
+const unsigned long tlsHandshakeTimeoutMs = 5000;
+
+struct TlsSessionSlot {
+  String target;
+  mbedtls_ssl_session session;
+  bool valid;
+};
+
+// One cached session per endpoint; the oldest slot is reused for a new one
+TlsSessionSlot tlsSessions[maxEndpoints];
+uint8_t tlsNextSlot = 0;
+SemaphoreHandle_t tlsMutex = NULL;
+// Cleared by "TLS RESUME OFF" to measure full handshakes
+bool tlsResume = true;
+// Handshake counts and total milliseconds, reported by the TLS command
+unsigned long tlsFullCount = 0;
+unsigned long tlsFullMs = 0;
+unsigned long tlsResumedCount = 0;
+unsigned long tlsResumedMs = 0;
+
+// mbed TLS 3 hides session fields behind MBEDTLS_PRIVATE; 2.x has them public
+#ifndef MBEDTLS_PRIVATE
+#define MBEDTLS_PRIVATE(member) member
+#endif
+const size_t tlsMasterLength = sizeof(mbedtls_ssl_session::MBEDTLS_PRIVATE(master));
+
+// Offers the cached session for target, if any, and copies its master secret to
+// offeredMaster; true when one was offered
+bool loadTlsSession(const String &target, mbedtls_ssl_context &ssl, unsigned char *offeredMaster) {
+  bool offered = false;
+  xSemaphoreTake(tlsMutex, portMAX_DELAY);
+  for (uint8_t i = 0; i < maxEndpoints && tlsResume && !offered; i++) {
+    if (tlsSessions[i].valid && tlsSessions[i].target == target) {
+      offered = mbedtls_ssl_set_session(&ssl, &tlsSessions[i].session) == 0;
+      if (offered) memcpy(offeredMaster, tlsSessions[i].session.MBEDTLS_PRIVATE(master), tlsMasterLength);
+    }
+  }
+  xSemaphoreGive(tlsMutex);
+  return offered;
+}
+
+// Caches the session of a finished handshake and counts it as full or resumed.  A server
+// that has forgotten an offered session falls back to a full handshake, so only one that
+// kept the offered master secret counts as resumed.  The session ID does not tell: with a
+// ticket the client sends a fresh random ID, which the server echoes either way.
+void saveTlsSession(const String &target, const mbedtls_ssl_context &ssl, const unsigned char *offeredMaster,
+                    unsigned long elapsedMs) {
+  xSemaphoreTake(tlsMutex, portMAX_DELAY);
+  uint8_t slot = tlsNextSlot;
+  for (uint8_t i = 0; i < maxEndpoints; i++) {
+    if (tlsSessions[i].valid && tlsSessions[i].target == target) {
+      slot = i;
+      break;
+    }
+  }
+  if (slot == tlsNextSlot) tlsNextSlot = (tlsNextSlot + 1) % maxEndpoints;
+
+  TlsSessionSlot &s = tlsSessions[slot];
+  mbedtls_ssl_session_free(&s.session);
+  mbedtls_ssl_session_init(&s.session);
+  s.valid = mbedtls_ssl_get_session(&ssl, &s.session) == 0;
+  s.target = target;
+
+  bool resumed = offeredMaster != NULL && s.valid &&
+                 memcmp(s.session.MBEDTLS_PRIVATE(master), offeredMaster, tlsMasterLength) == 0;
+  if (resumed) {
+    tlsResumedCount++;
+    tlsResumedMs += elapsedMs;
+  } else {
+    tlsFullCount++;
+    tlsFullMs += elapsedMs;
+  }
+  xSemaphoreGive(tlsMutex);
+}
+
+// A WiFiClient that speaks TLS over an inner TCP client, so HTTPClient can use it as is
+class TlsClient : public WiFiClient {
+public:
+  TlsClient() {
+    mbedtls_entropy_init(&entropy);
+    mbedtls_ctr_drbg_init(&drbg);
+    mbedtls_ssl_config_init(&conf);
+    mbedtls_ssl_init(&ssl);
+  }
+
+  ~TlsClient() {
+    stop();
+    mbedtls_ssl_free(&ssl);
+    mbedtls_ssl_config_free(&conf);
+    mbedtls_ctr_drbg_free(&drbg);
+    mbedtls_entropy_free(&entropy);
+  }
+
+  // Connects and completes the handshake, resuming the cached session for target
+  int connect(const char *host, uint16_t port, int32_t timeoutMs) {
+    stop();
+    if (!setUp() || !tcp.connect(host, port, timeoutMs)) return 0;
+    String target = "https://" + String(host) + ":" + String(port);
+    mbedtls_ssl_session_reset(&ssl);
+    mbedtls_ssl_set_hostname(&ssl, host);
+    unsigned char offeredMaster[tlsMasterLength];
+    bool offered = loadTlsSession(target, ssl, offeredMaster);
+
+    unsigned long start = millis();
+    int ret;
+    while ((ret = mbedtls_ssl_handshake(&ssl)) != 0) {
+      if ((ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) ||
+          millis() - start >= tlsHandshakeTimeoutMs) {
+        mbedtls_platform_zeroize(offeredMaster, sizeof(offeredMaster));
+        tcp.stop();
+        return 0;
+      }
+      delay(1);
+    }
+    saveTlsSession(target, ssl, offered ? offeredMaster : NULL, millis() - start);
+    mbedtls_platform_zeroize(offeredMaster, sizeof(offeredMaster));
+    open = true;
+    return 1;
+  }
+
+  uint8_t connected() override {
+    decrypt();
+    return plainHead < plainTail || (open && tcp.connected());
+  }
+
+  void stop() override {
+    if (open && tcp.connected()) mbedtls_ssl_close_notify(&ssl);
+    open = false;
+    plainHead = plainTail = 0;
+    tcp.stop();
+  }
+
+  int available() override {
+    decrypt();
+    return plainTail - plainHead;
+  }
+
+  int read() override {
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+  }
+
+  int read(uint8_t *data, size_t length) override {
+    if (!decrypt()) return -1;
+    size_t count = plainTail - plainHead < length ? plainTail - plainHead : length;
+    memcpy(data, plain + plainHead, count);
+    plainHead += count;
+    return count;
+  }
+
+  int peek() override {
+    return decrypt() ? plain[plainHead] : -1;
+  }
+
+  size_t write(uint8_t c) override {
+    return write(&c, 1);
+  }
+
+  size_t write(const uint8_t *data, size_t length) override {
+    size_t written = 0;
+    while (open && written < length) {
+      int ret = mbedtls_ssl_write(&ssl, data + written, length - written);
+      if (ret > 0) {
+        written += ret;
+      } else if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+        delay(1);
+      } else {
+        open = false;
+      }
+    }
+    return written;
+  }
+
+  void flush() override {}
+
+private:
+  // Seeds the RNG and loads the CA bundle on first use
+  bool setUp() {
+    if (configured) return true;
+    if (mbedtls_ctr_drbg_seed(&drbg, mbedtls_entropy_func, &entropy, NULL, 0) != 0 ||
+        mbedtls_ssl_config_defaults(&conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                    MBEDTLS_SSL_PRESET_DEFAULT) != 0 ||
+        esp_crt_bundle_attach(&conf) != ESP_OK) {
+      return false;
+    }
+    mbedtls_ssl_conf_authmode(&conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+    mbedtls_ssl_conf_rng(&conf, mbedtls_ctr_drbg_random, &drbg);
+    mbedtls_ssl_conf_session_tickets(&conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+    if (mbedtls_ssl_setup(&ssl, &conf) != 0) return false;
+    mbedtls_ssl_set_bio(&ssl, &tcp, sendTcp, recvTcp, NULL);
+    configured = true;
+    return true;
+  }
+
+  // Decrypts whatever has arrived into plain[]; true when something is there to read
+  bool decrypt() {
+    if (plainHead < plainTail) return true;
+    if (!open) return false;
+    int ret = mbedtls_ssl_read(&ssl, plain, sizeof(plain));
+    if (ret > 0) {
+      plainHead = 0;
+      plainTail = ret;
+      return true;
+    }
+    if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) open = false;
+    return false;
+  }
 
+  static int sendTcp(void *context, const unsigned char *data, size_t length) {
+    WiFiClient *tcp = (WiFiClient *)context;
+    size_t written = tcp->write(data, length);
+    return written > 0 ? (int)written : MBEDTLS_ERR_NET_CONN_RESET;
+  }
+
+  // Never blocks; HTTPClient does its own waiting and timing out
+  static int recvTcp(void *context, unsigned char *data, size_t length) {
+    WiFiClient *tcp = (WiFiClient *)context;
+    if (tcp->available() > 0) return tcp->read(data, length);
+    return tcp->connected() ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_CONN_RESET;
+  }
+
+  WiFiClient tcp;
+  mbedtls_entropy_context entropy;
+  mbedtls_ctr_drbg_context drbg;
+  mbedtls_ssl_config conf;
+  mbedtls_ssl_context ssl;
+  bool configured = false;
+  bool open = false;
+  uint8_t plain[512];
+  size_t plainHead = 0;
+  size_t plainTail = 0;
+};
+
+// A keep-alive connection to whichever endpoint was used last, over TLS for https URLs.
+// Each is big enough that they live in globals rather than on task stacks.
+struct EndpointConnection {
+  WiFiClient plain;
+  TlsClient tls;
+  String target;
+  bool secure = false;
+
+  WiFiClient &client() {
+    return secure ? tls : plain;
+  }
+
+  void close() {
+    plain.stop();
+    tls.stop();
+    target = "";
+  }
+};
+
+// millis() timestamps of a request, for STATS and the batch results
+struct RequestTiming {
+  unsigned long connected;
+  unsigned long firstByte;
+  unsigned long lastByte;
+};
+
+// POSTs `payload` to url, or GETs it when the payload is empty, over `connection`,
+// connecting first unless it is still open to url's scheme, host and port.  A reused
+// connection the server has closed in the meantime is retried once on a new one, but a
+// read timeout is not: the server got the request and is just not answering.
+int requestKeepAlive(EndpointConnection &connection, const String &url, const String &payload,
+                     String &response, uint16_t timeoutMs, RequestTiming &timing) {
+  String host;
+  uint16_t port;
+  timing.connected = timing.firstByte = timing.lastByte = millis();
+  if (!parseServerURL(url, host, port)) return HTTPC_ERROR_CONNECTION_REFUSED;
+  bool secure = url.startsWith("https://");
+  String target = (secure ? "https://" : "http://") + host + ":" + String(port);
+
+  for (int attempt = 0; attempt < 2; attempt++) {
+    bool reused = connection.target == target && connection.client().connected();
+    if (!reused) {
+      connection.close();
+      connection.secure = secure;
+      // connect() is called on the concrete class; the three-argument overload is not
+      // virtual in every core
+      int connected = secure ? connection.tls.connect(host.c_str(), port, connectTimeoutMs)
+                             : connection.plain.connect(host.c_str(), port, connectTimeoutMs);
+      timing.connected = timing.firstByte = timing.lastByte = millis();
+      if (!connected) return HTTPC_ERROR_CONNECTION_REFUSED;
+      connection.target = target;
+    }
+
+    HTTPClient http;
+    http.setReuse(true);
+    http.setTimeout(timeoutMs);
+    http.begin(connection.client(), url);
+    int httpResponseCode;
+    if (payload.length() > 0) {
+      http.addHeader("Content-Type", "application/json");
+      httpResponseCode = http.POST(payload);
+    } else {
+      httpResponseCode = http.GET();
+    }
+    timing.firstByte = millis();
+    if (httpResponseCode > 0) response = http.getString();
+    timing.lastByte = millis();
+    http.end();
+    if (httpResponseCode > 0 || !reused || httpResponseCode == HTTPC_ERROR_READ_TIMEOUT) {
+      if (httpResponseCode <= 0) connection.close();
+      return httpResponseCode;
+    }
+    connection.close();
+  }
+  return HTTPC_ERROR_CONNECTION_LOST;
+}
+
+EndpointConnection probeConnection;
+// Used by loop() for prompts and warm-ups
+EndpointConnection promptConnection;
+
+// Times GET /api/tags on each endpoint, which Ollama answers without touching the model.
+// Runs every probeIntervalMs, or straight away when notified of a new list or network.
+// Probes share the TLS session cache, so an https endpoint is usually resumed.
+void probeEndpoints(void *parameter) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(probeIntervalMs));
+    if (WiFi.status() != WL_CONNECTED) continue;
+
+    String urls[maxEndpoints];
+    xSemaphoreTake(endpointMutex, portMAX_DELAY);
+    uint8_t count = endpointCount;
+    for (uint8_t i = 0; i < count; i++) urls[i] = endpoints[i].url;
+    xSemaphoreGive(endpointMutex);
+
+    for (uint8_t i = 0; i < count; i++) {
+      String host;
+      uint16_t port;
+      if (!parseServerURL(urls[i], host, port)) continue;
+      int pathStart = urls[i].indexOf('/', urls[i].indexOf("://") + 3);
+      String tagsURL = (pathStart == -1 ? urls[i] : urls[i].substring(0, pathStart)) + "/api/tags";
+
+      // A probe of each endpoint in turn reconnects anyway, and a single one keeps
+      // its connection open between rounds
+      String body;
+      RequestTiming timing;
+      unsigned long start = millis();
+      bool ok = requestKeepAlive(probeConnection, tagsURL, String(), body, probeTimeoutMs, timing) == HTTP_CODE_OK;
+      unsigned long elapsed = timing.lastByte - start;
+      recordEndpoint(i, urls[i], ok, elapsed > 0 ? elapsed : 1);
+    }
+  }
+}
+
+// Sends an empty prompt so Ollama loads the model into memory before the user's first
+// real prompt. Reports "WARMUP:<total_ms>,<load_ms>" where load_ms is the server-side
+// model load time (0 when the model was already resident).
+void warmUpModel() {
+  if (WiFi.status() != WL_CONNECTED) {
+    return;
+  }
+
+  String payload = "{\"model\":\"" + modelName + "\",\"prompt\":\"\",\"keep_alive\":\"" + String(warmupKeepAlive) + "\",\"stream\":false}";
+
+  // Warms the endpoint the next prompt will go to, failing over like a prompt does
+  uint32_t tried = 0;
+  int index;
+  String url;
+  int httpResponseCode = HTTPC_ERROR_NOT_CONNECTED;
+  while ((index = pickEndpoint(tried, url)) != -1) {
+    tried |= 1UL << index;
+
+    // Over the prompt connection, which is then already open (and its TLS handshake
+    // done) when the first prompt comes
+    String response;
+    RequestTiming timing;
+    unsigned long start = millis();
+    httpResponseCode = requestKeepAlive(promptConnection, url, payload, response, warmupTimeoutMs, timing);
+    if (httpResponseCode > 0 && httpResponseCode < 500) {
+      unsigned long elapsed = timing.lastByte - start;
+      recordEndpoint(index, url, true, 0);
+
+      StaticJsonDocument<64> filter;
+      filter["load_duration"] = true;
+      DynamicJsonDocument doc(256);
+      unsigned long loadMs = 0;
+      if (!deserializeJson(doc, response, DeserializationOption::Filter(filter))) {
+        loadMs = (unsigned long)(doc["load_duration"].as<uint64_t>() / 1000000ULL);
+      }
+
+      flipper.print("WARMUP:");
+      flipper.print(elapsed);
+      flipper.print(",");
+      flipper.println(loadMs);
+      break;
+    }
+    recordEndpoint(index, url, false, 0);
+  }
+  if (index == -1) {
+    flipper.print("WARMUP_FAILED:");
+    flipper.println(httpResponseCode);
+  }
+
+  lastWarmupMs = millis();
+}
+
+// Ends with CONNECTED:<ip>,<ms> or CONNECT_FAILED:<reason>,<ms>, reason being auth,
+// no_ssid or timeout, so the Flipper waits for an answer instead of asking again
 void connectToWiFi(const char* ssid, const char* password) {
+  unsigned long start = millis();
+  if (WiFi.status() == WL_CONNECTED && WiFi.SSID() == ssid) {
+    // Already on it; a repeated CONNECT does not restart the association
+    flipper.print("CONNECTED:");
+    flipper.print(WiFi.localIP());
+    flipper.println(",0");
+    return;
+  }
+
   WiFi.mode(WIFI_STA);
   WiFi.begin(ssid, password);
-  Serial.print("Connecting to WiFi");
-  
-  int attempts = 0;
-  while (WiFi.status() != WL_CONNECTED && attempts < 20) {
-    delay(500);
-    Serial.print(".");
-    attempts++;
+  flipper.print("Connecting to WiFi");
+
+  // Polled often so the connection is used as soon as it is up; a dot every half second
+  unsigned long lastDot = start;
+  wl_status_t status;
+  while ((status = WiFi.status()) != WL_CONNECTED && status != WL_CONNECT_FAILED &&
+         status != WL_NO_SSID_AVAIL && millis() - start < wifiConnectTimeoutMs) {
+    delay(50);
+    if (millis() - lastDot >= 500) {
+      flipper.print(".");
+      lastDot = millis();
+    }
   }
-  
-  if (WiFi.status() == WL_CONNECTED) {
-    Serial.println("\nWiFi connected");
-    Serial.print("IP address: ");
-    Serial.println(WiFi.localIP());
+  unsigned long elapsed = millis() - start;
+
+  if (status == WL_CONNECTED) {
+    flipper.println("\nWiFi connected");
+    flipper.print("IP address: ");
+    flipper.println(WiFi.localIP());
+    flipper.print("CONNECTED:");
+    flipper.print(WiFi.localIP());
+    flipper.print(",");
+    flipper.println(elapsed);
+    xTaskNotifyGive(probeTask);
+    warmUpModel();
   } else {
-    Serial.println("\nFailed to connect to WiFi");
+    flipper.println("\nFailed to connect to WiFi");
+    flipper.print("CONNECT_FAILED:");
+    flipper.print(status == WL_CONNECT_FAILED ? "auth" : status == WL_NO_SSID_AVAIL ? "no_ssid" : "timeout");
+    flipper.print(",");
+    flipper.println(elapsed);
   }
 }
 
 void loadServerURL() {
-  Serial.println("Please send the Ollama server URL file (server_url.txt) over Serial:");
+  flipper.println("Please send the Ollama server URL file (server_url.txt) over Serial:");
   
-  while (!Serial.available());
-  serverURL = Serial.readStringUntil('\n');
-  serverURL.trim();
-  Serial.println("Ollama server URL loaded successfully.");
+  while (!flipper.available());
+  String list = flipper.readStringUntil('\n');
+  list.trim();
+  setEndpoints(list);
+  flipper.println("Ollama server URL loaded successfully.");
 }
 
 void loadAPIKey() {
-  Serial.println("Please send the API key file (api.txt) over Serial:");
+  flipper.println("Please send the API key file (api.txt) over Serial:");
   
-  while (!Serial.available());
-  apiKey = Serial.readStringUntil('\n');
+  while (!flipper.available());
+  apiKey = flipper.readStringUntil('\n');
   apiKey.trim();
   endpoint = "https://generativelanguage.googleapis.com/v1beta/models/gemini-pro:generateContent?key=" + apiKey;
-  Serial.println("API key loaded successfully.");
+  flipper.println("API key loaded successfully.");
 }
 
 void saveAP(const char* ssid, const char* password) {
-  Serial.println("Saving Access Point information...");
+  flipper.println("Saving Access Point information...");
   String apData = String(ssid) + "//" + String(password) + "\n";
-  Serial.print("Writing to SavedAPs.txt: ");
-  Serial.println(apData);
+  flipper.print("Writing to SavedAPs.txt: ");
+  flipper.println(apData);
 }
 
 bool loadSavedAP(String &ssid, String &password) {
-  Serial.println("Loading saved Access Points from SavedAPs.txt...");
+  flipper.println("Loading saved Access Points from SavedAPs.txt...");
   
-  while (!Serial.available());
-  String apData = Serial.readStringUntil('\n');
+  while (!flipper.available());
+  String apData = flipper.readStringUntil('\n');
   
   int separatorIndex = apData.indexOf("//");
   if (separatorIndex == -1) return false;
@@ -73,7 +633,7 @@ bool loadSavedAP(String &ssid, String &password) {
 }
 
 bool autoConnectToWiFi(const String &networks) {
-  Serial.println("Attempting to auto-connect to known networks...");
+  flipper.println("Attempting to auto-connect to known networks...");
 
   int n = WiFi.scanNetworks();
   
@@ -87,7 +647,7 @@ bool autoConnectToWiFi(const String &networks) {
 
     int ssidPasswordSeparator = pair.indexOf("//");
     if (ssidPasswordSeparator == -1) {
-      Serial.println("Invalid format, skipping: " + pair);
+      flipper.println("Invalid format, skipping: " + pair);
       startIndex = separatorIndex + 1;
       continue;
     }
@@ -99,33 +659,33 @@ bool autoConnectToWiFi(const String &networks) {
 
     for (int i = 0; i < n; ++i) {
       if (ssid == WiFi.SSID(i)) {
-        Serial.print("Found matching SSID: ");
-        Serial.println(ssid);
+        flipper.print("Found matching SSID: ");
+        flipper.println(ssid);
         connectToWiFi(ssid.c_str(), password.c_str());
         if (WiFi.status() == WL_CONNECTED) {
-          Serial.println("Connected successfully to " + ssid);
+          flipper.println("Connected successfully to " + ssid);
           return true;
         } else {
-          Serial.println("Failed to connect to " + ssid);
+          flipper.println("Failed to connect to " + ssid);
         }
       }
     }
 
     startIndex = separatorIndex + 1;
   }
-  Serial.println("No matching networks found.");
+  flipper.println("No matching networks found.");
   return false;
 }
 
 void manualConnect() {
-  Serial.println("Please enter the SSID of the WiFi network you want to connect to:");
-  while (!Serial.available());
-  String ssid = Serial.readStringUntil('\n');
+  flipper.println("Please enter the SSID of the WiFi network you want to connect to:");
+  while (!flipper.available());
+  String ssid = flipper.readStringUntil('\n');
   ssid.trim();
 
-  Serial.println("Please enter the password for the WiFi network:");
-  while (!Serial.available());
-  String password = Serial.readStringUntil('\n');
+  flipper.println("Please enter the password for the WiFi network:");
+  while (!flipper.available());
+  String password = flipper.readStringUntil('\n');
   password.trim();
 
   String formattedInput = ssid + "//" + password;
@@ -135,32 +695,742 @@ void manualConnect() {
   if (WiFi.status() == WL_CONNECTED) {
     saveAP(ssid.c_str(), password.c_str());
   } else {
-    Serial.println("Failed to connect to " + ssid + ". Manual entry required.");
+    flipper.println("Failed to connect to " + ssid + ". Manual entry required.");
   }
 }
 
+// 2.4 GHz channels 1-13; 120 ms is the ESP-IDF default active dwell per channel
+const uint8_t scanChannels = 13;
+const uint32_t scanMsPerChannel = 120;
+
 void scanNetworks() {
-  Serial.println("DEBUG: Starting WiFi scan...");
+  flipper.println("DEBUG: Starting WiFi scan...");
   WiFi.mode(WIFI_STA);
   WiFi.disconnect();
   delay(100);
   
-  Serial.println("DEBUG: Initiating scan...");
-  int n = WiFi.scanNetworks();
-  Serial.println("DEBUG: Scan complete. Networks found: " + String(n));
-  
-  if (n == 0) {
-    Serial.println("No networks found");
-  } else {
+  // One channel at a time, so the Flipper can list (and the user pick) networks found
+  // on the first channels while the rest are still being scanned
+  flipper.println("DEBUG: Initiating scan...");
+  int found = 0;
+  for (uint8_t channel = 1; channel <= scanChannels; channel++) {
+    int n = WiFi.scanNetworks(false, false, false, scanMsPerChannel, channel);
     for (int i = 0; i < n; ++i) {
-      Serial.print("NETWORK:");
-      Serial.print(WiFi.SSID(i));
-      Serial.print(",");
-      Serial.println(WiFi.RSSI(i));
-      delay(10);
+      flipper.print("NETWORK:");
+      flipper.print(WiFi.SSID(i));
+      flipper.print(",");
+      flipper.println(WiFi.RSSI(i));
+    }
+    if (n > 0) found += n;
+    WiFi.scanDelete();
+  }
+  flipper.println("DEBUG: Scan complete. Networks found: " + String(found));
+
+  if (found == 0) {
+    flipper.println("No networks found");
+  }
+  flipper.println("SCAN_COMPLETE");
+}
+
+// HTTPClient's default; a hung endpoint is given up on after this long
+const uint16_t promptTimeoutMs = 5000;
+
+// Posts one prompt over the kept-alive prompt connection, timing the connect and first
+// byte for STATS (the connect span is near zero when the connection was reused).
+// Returns the HTTP status or a negative HTTPClient error; the body is left in `response`.
+int postPrompt(const String &url, const String &payload, String &response) {
+  RequestTiming timing;
+  int httpResponseCode = requestKeepAlive(promptConnection, url, payload, response, promptTimeoutMs, timing);
+  spanConnect = timing.connected;
+  spanFirstByte = timing.firstByte;
+  spanLastByte = httpResponseCode > 0 ? timing.lastByte : timing.firstByte;
+  return httpResponseCode;
+}
+
+// Hedged prompts: after HEDGE <ms> [model], a prompt whose first token has not arrived
+// within <ms> is sent again, to the next best endpoint or, when there is no other, to
+// <model> on the same one.  Both requests stream; the first to produce a token wins and
+// the other's connection is closed, which makes Ollama stop generating it.  Prompt
+// latencies are kept apart with hedging on and off so HEDGE can report the p99 of each.
+unsigned long hedgeDelayMs = 0;
+String hedgeModel;
+EndpointConnection hedgeConnection;
+unsigned long hedgePrompts = 0;
+unsigned long hedgesSent = 0;
+unsigned long hedgeWins = 0;
+
+const uint8_t latencySampleCount = 100;
+
+struct LatencySamples {
+  unsigned long ms[latencySampleCount];
+  uint8_t count;
+  uint8_t next;
+};
+
+LatencySamples plainLatency;
+LatencySamples hedgedLatency;
+
+void addLatencySample(LatencySamples &samples, unsigned long ms) {
+  samples.ms[samples.next] = ms;
+  samples.next = (samples.next + 1) % latencySampleCount;
+  if (samples.count < latencySampleCount) samples.count++;
+}
+
+// Nearest-rank p99 of the samples, 0 when there are none
+unsigned long latencyP99(const LatencySamples &samples) {
+  if (samples.count == 0) return 0;
+  unsigned long sorted[latencySampleCount];
+  for (uint8_t i = 0; i < samples.count; i++) {
+    uint8_t j = i;
+    for (; j > 0 && sorted[j - 1] > samples.ms[i]; j--) sorted[j] = sorted[j - 1];
+    sorted[j] = samples.ms[i];
+  }
+  return sorted[(samples.count * 99 + 99) / 100 - 1];
+}
+
+// One streamed /api/generate request, parsed as its bytes arrive so that two of them
+// can be polled side by side from loop()
+struct StreamRequest {
+  enum Part { Head, ChunkSize, ChunkData, ChunkEnd, Trailer, Body };
+
+  EndpointConnection *connection = nullptr;
+  const String *payload = nullptr;
+  int index = -1;
+  String url;
+  bool active = false;
+  bool reused = false;
+  bool received = false;
+  bool done = false;
+  int status = 0;
+  unsigned long sent = 0;
+  unsigned long lastByte = 0;
+  unsigned long firstToken = 0;
+  String text;
+
+  Part part = Head;
+  bool chunked = false;
+  long remaining = -1;
+  String line;
+  String body;
+};
+
+void failStream(StreamRequest &request, int error) {
+  request.connection->close();
+  request.status = error;
+  request.done = true;
+}
+
+// Writes the request head, reusing the connection if it is still open to url's host.
+// `framing` is the header that says how the body is sent: its Content-Length, or
+// Transfer-Encoding: chunked when its length is not known up front.
+bool openStream(StreamRequest &request, EndpointConnection &connection, int index, const String &url,
+                const String &framing, bool allowReuse) {
+  request = StreamRequest();
+  request.connection = &connection;
+  request.index = index;
+  request.url = url;
+  request.active = true;
+  request.sent = request.lastByte = millis();
+
+  String host;
+  uint16_t port;
+  if (!parseServerURL(url, host, port)) {
+    failStream(request, HTTPC_ERROR_CONNECTION_REFUSED);
+    return false;
+  }
+  bool secure = url.startsWith("https://");
+  String target = (secure ? "https://" : "http://") + host + ":" + String(port);
+  request.reused = allowReuse && connection.target == target && connection.client().connected();
+  if (!request.reused) {
+    connection.close();
+    connection.secure = secure;
+    int connected = secure ? connection.tls.connect(host.c_str(), port, connectTimeoutMs)
+                           : connection.plain.connect(host.c_str(), port, connectTimeoutMs);
+    if (!connected) {
+      failStream(request, HTTPC_ERROR_CONNECTION_REFUSED);
+      return false;
+    }
+    connection.target = target;
+  }
+
+  int pathStart = url.indexOf('/', url.indexOf("://") + 3);
+  String head = "POST " + (pathStart == -1 ? String("/") : url.substring(pathStart)) + " HTTP/1.1\r\n" +
+                "Host: " + host + ":" + String(port) + "\r\n" +
+                "Content-Type: application/json\r\n" + framing + "\r\n\r\n";
+  if (connection.client().write((const uint8_t *)head.c_str(), head.length()) != head.length()) {
+    failStream(request, HTTPC_ERROR_SEND_PAYLOAD_FAILED);
+    return false;
+  }
+  return true;
+}
+
+// Writes the whole request
+bool startStream(StreamRequest &request, EndpointConnection &connection, int index, const String &url,
+                 const String &payload, bool allowReuse = true) {
+  if (!openStream(request, connection, index, url, "Content-Length: " + String(payload.length()), allowReuse)) {
+    return false;
+  }
+  request.payload = &payload;
+  if (connection.client().write((const uint8_t *)payload.c_str(), payload.length()) != payload.length()) {
+    failStream(request, HTTPC_ERROR_SEND_PAYLOAD_FAILED);
+    return false;
+  }
+  return true;
+}
+
+// One NDJSON line of the stream: {"response":"<token>","done":false}
+void streamPiece(StreamRequest &request) {
+  DynamicJsonDocument doc(1024);
+  if (deserializeJson(doc, request.line)) return;
+  String piece = doc["response"].as<String>();
+  if (request.firstToken == 0 && (piece.length() > 0 || doc["done"].as<bool>())) {
+    request.firstToken = millis();
+  }
+  request.text += piece;
+}
+
+void streamByte(StreamRequest &request, char c) {
+  switch (request.part) {
+    case StreamRequest::Head:
+    case StreamRequest::ChunkSize:
+    case StreamRequest::ChunkEnd:
+    case StreamRequest::Trailer:
+      if (c != '\n') {
+        if (c != '\r') request.line += c;
+        return;
+      }
+      break;
+    case StreamRequest::ChunkData:
+      if (c == '\n') {
+        streamPiece(request);
+        request.line = "";
+      } else {
+        request.line += c;
+      }
+      if (--request.remaining == 0) request.part = StreamRequest::ChunkEnd;
+      return;
+    case StreamRequest::Body:
+      request.body += c;
+      if (--request.remaining == 0) request.done = true;
+      return;
+  }
+
+  // A whole line of the head or of the chunk framing
+  String line = request.line;
+  request.line = "";
+  if (request.part == StreamRequest::Head) {
+    if (request.status == 0) {
+      request.status = line.startsWith("HTTP/1.") ? line.substring(9, 12).toInt() : HTTPC_ERROR_NO_HTTP_SERVER;
+      if (request.status <= 0) failStream(request, HTTPC_ERROR_NO_HTTP_SERVER);
+    } else if (line.length() > 0) {
+      line.toLowerCase();
+      if (line.startsWith("transfer-encoding:") && line.indexOf("chunked") != -1) request.chunked = true;
+      if (line.startsWith("content-length:")) request.remaining = line.substring(15).toInt();
+    } else if (request.chunked) {
+      request.part = StreamRequest::ChunkSize;
+    } else {
+      request.part = StreamRequest::Body;
+      if (request.remaining == 0) request.done = true;
+    }
+  } else if (request.part == StreamRequest::ChunkSize) {
+    request.remaining = strtol(line.c_str(), NULL, 16);
+    request.part = request.remaining > 0 ? StreamRequest::ChunkData : StreamRequest::Trailer;
+  } else if (request.part == StreamRequest::ChunkEnd) {
+    request.part = StreamRequest::ChunkSize;
+  } else if (line.length() == 0) {
+    // The blank line after the last chunk; the connection is ready for the next request
+    request.done = true;
+  }
+}
+
+// Reads whatever has arrived.  A reused connection the server closed before answering
+// is retried once on a new one, like requestKeepAlive does, unless the body was streamed
+// and is gone.
+void pollStream(StreamRequest &request) {
+  if (!request.active || request.done) return;
+  WiFiClient &client = request.connection->client();
+  uint8_t data[256];
+  int length;
+  while (!request.done && client.available() > 0 && (length = client.read(data, sizeof(data))) > 0) {
+    request.received = true;
+    request.lastByte = millis();
+    for (int i = 0; i < length && !request.done; i++) streamByte(request, data[i]);
+  }
+  if (request.done) {
+    if (request.firstToken == 0) request.firstToken = millis();
+    if (request.part == StreamRequest::Body) request.text = request.body;
+  } else if (!client.connected()) {
+    if (!request.received && request.reused && request.payload != nullptr) {
+      String url = request.url;
+      startStream(request, *request.connection, request.index, url, *request.payload, false);
+    } else {
+      failStream(request, HTTPC_ERROR_CONNECTION_LOST);
+    }
+  } else if (millis() - request.lastByte >= promptTimeoutMs) {
+    failStream(request, HTTPC_ERROR_READ_TIMEOUT);
+  }
+}
+
+bool streamFailed(const StreamRequest &request) {
+  return request.done && (request.status <= 0 || request.status >= 500);
+}
+
+// Runs one prompt hedged as described above and leaves the winner's text, already
+// pieced together from the stream, in `response`.
+// Returns its HTTP status, or the primary's error when neither request got anywhere.
+int postPromptHedged(const String &command, String &response) {
+  StreamRequest requests[2];
+  String payloads[2];
+  String url;
+  uint32_t tried = 0;
+  int index = pickEndpoint(tried, url);
+  if (index == -1) return HTTPC_ERROR_NOT_CONNECTED;
+  tried |= 1UL << index;
+
+  payloads[0] = "{\"model\":\"" + modelName + "\",\"prompt\":\"" + command + "\",\"keep_alive\":\"" + String(warmupKeepAlive) + "\",\"stream\":true}";
+  startStream(requests[0], promptConnection, index, url, payloads[0]);
+  spanConnect = millis();
+  hedgePrompts++;
+
+  bool hedged = false;
+  StreamRequest *winner = nullptr;
+  for (;;) {
+    pollStream(requests[0]);
+    pollStream(requests[1]);
+    for (uint8_t i = 0; i < 2 && winner == nullptr; i++) {
+      if (requests[i].active && requests[i].firstToken != 0 && !streamFailed(requests[i])) {
+        winner = &requests[i];
+        StreamRequest &loser = requests[1 - i];
+        if (loser.active && !loser.done) loser.connection->close();
+        loser.active = false;
+        if (i == 1) hedgeWins++;
+        spanFirstByte = winner->firstToken;
+      }
+    }
+    if (winner != nullptr && winner->done) break;
+
+    // Hedge when the first token is late, or at once when the primary has failed
+    if (!hedged && winner == nullptr &&
+        (streamFailed(requests[0]) || millis() - requests[0].sent >= hedgeDelayMs)) {
+      hedged = true;
+      int hedgeIndex = pickEndpoint(tried, url);
+      String model = modelName;
+      if (hedgeIndex == -1 && hedgeModel.length() > 0) {
+        hedgeIndex = index;
+        url = requests[0].url;
+        model = hedgeModel;
+      }
+      if (hedgeIndex != -1) {
+        payloads[1] = "{\"model\":\"" + model + "\",\"prompt\":\"" + command + "\",\"keep_alive\":\"" + String(warmupKeepAlive) + "\",\"stream\":true}";
+        startStream(requests[1], hedgeConnection, hedgeIndex, url, payloads[1]);
+        hedgesSent++;
+      }
+    }
+
+    bool pending = false;
+    for (uint8_t i = 0; i < 2; i++) pending = pending || (requests[i].active && !requests[i].done);
+    if (!pending && (hedged || winner != nullptr)) break;
+    delay(1);
+  }
+
+  for (uint8_t i = 0; i < 2; i++) {
+    if (requests[i].active && requests[i].index != -1) {
+      recordEndpoint(requests[i].index, requests[i].url, !streamFailed(requests[i]), 0);
+    }
+  }
+  spanLastByte = millis();
+  if (winner == nullptr || !winner->done) {
+    return requests[0].status < 0 || requests[1].status == 0 ? requests[0].status : requests[1].status;
+  }
+  response = winner->text;
+  return winner->status;
+}
+
+// Batch mode: the Flipper sends "BATCH <id> <prompt>" for each line of its prompt file,
+// the prompt still JSON-escaped, and keeps up to its in-flight window of them here at
+// once.  Worker tasks run them concurrently, each over its own keep-alive connection,
+// since Ollama only serves one request at a time on a connection.  Finished prompts
+// are reported from loop(), which owns the UART, as
+//   BATCH_DONE:<id>,<status>,<queue_ms>,<ttfb_ms>,<total_ms>,<tokens>,"<answer>"
+const uint8_t maxBatchWorkers = 4;
+const uint8_t batchRingSize = 8;
+const uint16_t batchTimeoutMs = 60000;
+
+struct BatchJob {
+  unsigned long id;
+  String prompt;
+  unsigned long queuedMs;
+};
+
+struct BatchResult {
+  unsigned long id;
+  int status;
+  unsigned long queueMs;
+  unsigned long firstByteMs;
+  unsigned long totalMs;
+  long tokens;
+  String answer;
+};
+
+BatchJob batchJobs[batchRingSize];
+uint8_t batchJobHead = 0;
+uint8_t batchJobCount = 0;
+BatchResult batchResults[batchRingSize];
+uint8_t batchResultHead = 0;
+uint8_t batchResultCount = 0;
+SemaphoreHandle_t batchMutex = NULL;
+TaskHandle_t batchWorkers[maxBatchWorkers];
+uint8_t batchWorkerCount = 0;
+
+// Escapes one byte for use inside a JSON string literal into `out`, which needs room
+// for jsonEscapeMax characters; returns how many it took.  Bytes of a UTF-8 sequence
+// pass through unchanged, so text can be escaped a piece at a time.
+const size_t jsonEscapeMax = 6;
+
+size_t jsonEscapeByte(char c, char *out) {
+  if (c == '"' || c == '\\') {
+    out[0] = '\\';
+    out[1] = c;
+    return 2;
+  }
+  if (c == '\n' || c == '\r' || c == '\t') {
+    out[0] = '\\';
+    out[1] = c == '\n' ? 'n' : c == '\r' ? 'r' : 't';
+    return 2;
+  }
+  if ((uint8_t)c < 0x20) {
+    char escaped[jsonEscapeMax + 1];
+    snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+    memcpy(out, escaped, jsonEscapeMax);
+    return jsonEscapeMax;
+  }
+  out[0] = c;
+  return 1;
+}
+
+// Escapes text for use inside a JSON string literal
+String jsonEscape(const String &text) {
+  String out;
+  out.reserve(text.length() + 16);
+  char escaped[jsonEscapeMax + 1];
+  for (unsigned int i = 0; i < text.length(); i++) {
+    escaped[jsonEscapeByte(text[i], escaped)] = '\0';
+    out += escaped;
+  }
+  return out;
+}
+
+// Queues a prompt for the workers; false when every slot is taken
+bool queueBatchJob(unsigned long id, const String &prompt) {
+  xSemaphoreTake(batchMutex, portMAX_DELAY);
+  bool queued = batchJobCount < batchRingSize;
+  if (queued) {
+    BatchJob &job = batchJobs[(batchJobHead + batchJobCount) % batchRingSize];
+    job.id = id;
+    job.prompt = prompt;
+    job.queuedMs = millis();
+    batchJobCount++;
+  }
+  xSemaphoreGive(batchMutex);
+  if (queued) {
+    for (uint8_t i = 0; i < batchWorkerCount; i++) xTaskNotifyGive(batchWorkers[i]);
+  }
+  return queued;
+}
+
+bool takeBatchJob(BatchJob &job) {
+  xSemaphoreTake(batchMutex, portMAX_DELAY);
+  bool taken = batchJobCount > 0;
+  if (taken) {
+    BatchJob &next = batchJobs[batchJobHead];
+    job.id = next.id;
+    job.queuedMs = next.queuedMs;
+    job.prompt = next.prompt;
+    next.prompt = String();
+    batchJobHead = (batchJobHead + 1) % batchRingSize;
+    batchJobCount--;
+  }
+  xSemaphoreGive(batchMutex);
+  return taken;
+}
+
+// Hands a result to loop(), waiting while the ring is full
+void putBatchResult(const BatchResult &result) {
+  for (;;) {
+    xSemaphoreTake(batchMutex, portMAX_DELAY);
+    if (batchResultCount < batchRingSize) {
+      batchResults[(batchResultHead + batchResultCount) % batchRingSize] = result;
+      batchResultCount++;
+      xSemaphoreGive(batchMutex);
+      return;
     }
+    xSemaphoreGive(batchMutex);
+    vTaskDelay(pdMS_TO_TICKS(10));
   }
-  Serial.println("SCAN_COMPLETE");
+}
+
+void printBatchResult(const BatchResult &result) {
+  flipper.print("BATCH_DONE:");
+  flipper.print(result.id);
+  flipper.print(",");
+  flipper.print(result.status);
+  flipper.print(",");
+  flipper.print(result.queueMs);
+  flipper.print(",");
+  flipper.print(result.firstByteMs);
+  flipper.print(",");
+  flipper.print(result.totalMs);
+  flipper.print(",");
+  flipper.print(result.tokens);
+  flipper.print(",\"");
+  flipper.print(jsonEscape(result.answer));
+  flipper.println("\"");
+}
+
+void reportBatchResults() {
+  for (;;) {
+    BatchResult result;
+    xSemaphoreTake(batchMutex, portMAX_DELAY);
+    bool have = batchResultCount > 0;
+    if (have) {
+      result = batchResults[batchResultHead];
+      batchResults[batchResultHead].answer = String();
+      batchResultHead = (batchResultHead + 1) % batchRingSize;
+      batchResultCount--;
+    }
+    xSemaphoreGive(batchMutex);
+    if (!have) return;
+    printBatchResult(result);
+  }
+}
+
+EndpointConnection batchConnections[maxBatchWorkers];
+
+// `parameter` is the worker's own connection
+void batchWorker(void *parameter) {
+  EndpointConnection &connection = *(EndpointConnection *)parameter;
+  for (;;) {
+    BatchJob job;
+    if (!takeBatchJob(job)) {
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+      continue;
+    }
+
+    BatchResult result;
+    result.id = job.id;
+    result.queueMs = millis() - job.queuedMs;
+    result.firstByteMs = 0;
+    result.tokens = 0;
+    unsigned long start = millis();
+
+    String payload = "{\"model\":\"" + modelName + "\",\"prompt\":\"" + job.prompt + "\",\"keep_alive\":\"" + String(warmupKeepAlive) + "\",\"stream\":false}";
+    job.prompt = String();
+
+    // Same failover rule as an interactive prompt
+    uint32_t tried = 0;
+    int index;
+    String url;
+    String response;
+    result.status = HTTPC_ERROR_NOT_CONNECTED;
+    while ((index = pickEndpoint(tried, url)) != -1) {
+      tried |= 1UL << index;
+      RequestTiming timing;
+      result.status = requestKeepAlive(connection, url, payload, response, batchTimeoutMs, timing);
+      result.firstByteMs = timing.firstByte - start;
+      if (result.status > 0 && result.status < 500) {
+        recordEndpoint(index, url, true, 0);
+        break;
+      }
+      recordEndpoint(index, url, false, 0);
+    }
+    payload = String();
+
+    if (result.status > 0 && result.status < 500) {
+      StaticJsonDocument<64> filter;
+      filter["response"] = true;
+      filter["eval_count"] = true;
+      filter["error"] = true;
+      DynamicJsonDocument doc(response.length() + 256);
+      if (!deserializeJson(doc, response, DeserializationOption::Filter(filter))) {
+        result.answer = doc[result.status == HTTP_CODE_OK ? "response" : "error"].as<String>();
+        result.tokens = doc["eval_count"].as<long>();
+      }
+    }
+    response = String();
+    result.totalMs = millis() - start;
+    putBatchResult(result);
+  }
+}
+
+// "BATCH <id> <prompt>"; replies at once with status 0 when the job ring is full
+void startBatchJob(const String &command) {
+  int separator = command.indexOf(' ', 6);
+  unsigned long id = command.substring(6, separator == -1 ? command.length() : separator).toInt();
+  String prompt = separator == -1 ? String() : command.substring(separator + 1);
+
+  if (batchMutex == NULL) batchMutex = xSemaphoreCreateMutex();
+  while (batchWorkerCount < maxBatchWorkers) {
+    xTaskCreatePinnedToCore(batchWorker, "batch", 8192, &batchConnections[batchWorkerCount], 1,
+                            &batchWorkers[batchWorkerCount], 0);
+    batchWorkerCount++;
+  }
+
+  if (id == 0 || prompt.length() == 0 || !queueBatchJob(id, prompt)) {
+    BatchResult result;
+    result.id = id;
+    result.status = 0;
+    result.queueMs = result.firstByteMs = result.totalMs = 0;
+    result.tokens = 0;
+    printBatchResult(result);
+  }
+}
+
+// File context: "FILE <size> <question>" asks about a file on the Flipper's SD card,
+// which follows as <size> raw bytes.  Each byte is JSON-escaped as it arrives and goes
+// out in a chunked request body, so only one chunk of the file is ever held here.
+// XON and XOFF are flow control on this line, so the Flipper sends them, and fileEscape
+// itself, as fileEscape followed by the byte XOR 0x20; <size> counts them once.
+// The Flipper sends nothing until the first FILE_ACK:<bytes> and keeps within its
+// window of the last one, both counted as they were on the line; FILE_FAILED:<error>
+// stops it at any point.  The answer comes back like any prompt's.
+// Each chunk of this many bytes on the line is acknowledged, which holds at most as many
+// bytes of the file; an escape may be split between two
+const size_t fileChunkSize = 128;
+// CONTEXT_ESCAPE on the Flipper
+const uint8_t fileEscape = 0x10;
+// The Flipper has stopped sending
+const unsigned long fileIdleTimeoutMs = 5000;
+// After a failure, bytes already on their way are dropped until the line goes quiet
+const unsigned long fileDrainMs = 200;
+
+// One chunk of a chunked request body; an empty one ends the body
+bool writeBodyChunk(WiFiClient &client, const char *data, size_t length) {
+  char size[12];
+  size_t sizeLength = snprintf(size, sizeof(size), "%x\r\n", (unsigned)length);
+  return client.write((const uint8_t *)size, sizeLength) == sizeLength &&
+         client.write((const uint8_t *)data, length) == length &&
+         client.write((const uint8_t *)"\r\n", 2) == 2;
+}
+
+void failFilePrompt(int error, bool drain) {
+  flipper.print("FILE_FAILED:");
+  flipper.println(error);
+  unsigned long quiet = millis();
+  while (drain && millis() - quiet < fileDrainMs) {
+    if (flipper.read() >= 0) {
+      quiet = millis();
+    } else {
+      delay(1);
+    }
+  }
+}
+
+void streamFilePrompt(const String &command) {
+  int separator = command.indexOf(' ', 5);
+  long size = command.substring(5, separator == -1 ? command.length() : separator).toInt();
+  String question = separator == -1 ? String() : command.substring(separator + 1);
+  if (WiFi.status() != WL_CONNECTED) {
+    failFilePrompt(HTTPC_ERROR_NOT_CONNECTED, false);
+    return;
+  }
+  spanReceive = millis();
+
+  // The file goes first and the question after it, where the model reads it last
+  String prefix = "{\"model\":\"" + modelName + "\",\"prompt\":\"";
+  String suffix = "\\n\\n" + jsonEscape(question) + "\",\"keep_alive\":\"" + String(warmupKeepAlive) + "\",\"stream\":true}";
+
+  // Fail over only while nothing of the file has been asked for; it cannot be sent twice
+  StreamRequest request;
+  uint32_t tried = 0;
+  int index;
+  String url;
+  bool open = false;
+  while (!open && (index = pickEndpoint(tried, url)) != -1) {
+    tried |= 1UL << index;
+    open = openStream(request, promptConnection, index, url, "Transfer-Encoding: chunked", true) &&
+           writeBodyChunk(promptConnection.client(), prefix.c_str(), prefix.length());
+    if (!open) {
+      promptConnection.close();
+      recordEndpoint(index, url, false, 0);
+    }
+  }
+  if (!open) {
+    failFilePrompt(HTTPC_ERROR_CONNECTION_REFUSED, false);
+    return;
+  }
+  spanConnect = millis();
+  flipper.println("FILE_ACK:0");
+
+  WiFiClient &client = promptConnection.client();
+  char escaped[fileChunkSize * jsonEscapeMax];
+  size_t escapedLength = 0;
+  long received = 0;
+  long lineBytes = 0;
+  bool unescapeNext = false;
+  unsigned long lastByte = millis();
+  while (received < size) {
+    int c = flipper.read();
+    if (c < 0) {
+      if (millis() - lastByte >= fileIdleTimeoutMs) {
+        // Ollama drops a request whose body never ends when the connection closes
+        promptConnection.close();
+        failFilePrompt(HTTPC_ERROR_READ_TIMEOUT, false);
+        return;
+      }
+      delay(1);
+      continue;
+    }
+    lastByte = millis();
+    lineBytes++;
+    if (unescapeNext) {
+      c ^= 0x20;
+      unescapeNext = false;
+    } else if (c == fileEscape) {
+      unescapeNext = true;
+    }
+    if (!unescapeNext) {
+      received++;
+      escapedLength += jsonEscapeByte((char)c, escaped + escapedLength);
+    }
+    if (lineBytes % fileChunkSize == 0 || received == size) {
+      // An empty chunk would end the body
+      if (escapedLength > 0 && !writeBodyChunk(client, escaped, escapedLength)) {
+        promptConnection.close();
+        recordEndpoint(index, url, false, 0);
+        failFilePrompt(HTTPC_ERROR_SEND_PAYLOAD_FAILED, true);
+        return;
+      }
+      escapedLength = 0;
+      flipper.print("FILE_ACK:");
+      flipper.println(lineBytes);
+    }
+  }
+
+  if (!writeBodyChunk(client, suffix.c_str(), suffix.length()) || !writeBodyChunk(client, "", 0)) {
+    promptConnection.close();
+    recordEndpoint(index, url, false, 0);
+    failFilePrompt(HTTPC_ERROR_SEND_PAYLOAD_FAILED, false);
+    return;
+  }
+  // The read timeout runs from the end of the upload, however long that took
+  request.lastByte = millis();
+  while (!request.done) {
+    pollStream(request);
+    delay(1);
+  }
+  spanFirstByte = request.firstToken;
+  spanLastByte = millis();
+  recordEndpoint(index, url, !streamFailed(request), 0);
+
+  if (request.status == HTTP_CODE_OK) {
+    flipper.println("User: \"" + question + "\"");
+    sendReply(flipper, request.text);
+  } else {
+    failFilePrompt(request.status, false);
+  }
+  flipper.flush();
+  spanUartDone = millis();
+  lastWarmupMs = millis();
 }
 
 void setup() {
@@ -169,15 +1439,34 @@ void setup() {
     ; // wait for serial port to connect
   }
   delay(1000);
-  Serial.println("DEBUG: ESP32 WiFi Scanner Ready");
+  endpointMutex = xSemaphoreCreateMutex();
+  tlsMutex = xSemaphoreCreateMutex();
+  for (uint8_t i = 0; i < maxEndpoints; i++) {
+    mbedtls_ssl_session_init(&tlsSessions[i].session);
+    tlsSessions[i].valid = false;
+  }
+  xTaskCreatePinnedToCore(probeEndpoints, "probe", 8192, NULL, 1, &probeTask, 0);
+  flipper.println("DEBUG: ESP32 WiFi Scanner Ready");
 }
 
 void loop() {
-  if (Serial.available() > 0) {
-    String command = Serial.readStringUntil('\n');
+  if (batchMutex != NULL) reportBatchResults();
+
+  if (keepWarm && millis() - lastWarmupMs >= warmupIntervalMs) {
+    warmUpModel();
+  }
+
+  if (flipper.available() > 0) {
+    String command = flipper.readStringUntil('\n');
     command.trim();
 
-    Serial.println("DEBUG: Received command: " + command);
+    // A batch prompt is not echoed back; the UART is busy enough with the answers
+    if (command.startsWith("BATCH ")) {
+      startBatchJob(command);
+      return;
+    }
+
+    flipper.println("DEBUG: Received command: " + command);
 
     if (command == "SCAN") {
       scanNetworks();
@@ -188,35 +1477,156 @@ void loop() {
         String password = command.substring(separatorIndex + 1);
         connectToWiFi(ssid.c_str(), password.c_str());
       }
+    } else if (command.startsWith("URL ")) {
+      String list = command.substring(4);
+      list.trim();
+      setEndpoints(list);
+      flipper.println("URL_OK");
+      warmUpModel();
+    } else if (command == "WARMUP ON") {
+      keepWarm = true;
+      if (lastWarmupMs == 0 || millis() - lastWarmupMs >= warmupIntervalMs) {
+        warmUpModel();
+      }
+    } else if (command == "WARMUP OFF") {
+      keepWarm = false;
+    } else if (command == "STATS") {
+      flipper.print("STATS:");
+      flipper.print(spanConnect - spanReceive);
+      flipper.print(",");
+      flipper.print(spanFirstByte - spanConnect);
+      flipper.print(",");
+      flipper.print(spanLastByte - spanFirstByte);
+      flipper.print(",");
+      flipper.println(spanUartDone - spanLastByte);
+    } else if (command == "TELEMETRY") {
+      // TELEMETRY:<free heap>,<min free heap>,<largest free block>,<loop stack>,<probe stack>,
+      // <batch stack>,<rssi> - stacks are the least each task has ever had left, the batch
+      // one the lowest of its workers or -1 before the first BATCH
+      long batchStack = -1;
+      for (uint8_t i = 0; i < batchWorkerCount; i++) {
+        long stackLeft = uxTaskGetStackHighWaterMark(batchWorkers[i]);
+        if (batchStack == -1 || stackLeft < batchStack) batchStack = stackLeft;
+      }
+      flipper.print("TELEMETRY:");
+      flipper.print(ESP.getFreeHeap());
+      flipper.print(",");
+      flipper.print(ESP.getMinFreeHeap());
+      flipper.print(",");
+      flipper.print(ESP.getMaxAllocHeap());
+      flipper.print(",");
+      flipper.print(uxTaskGetStackHighWaterMark(NULL));
+      flipper.print(",");
+      flipper.print(probeTask != NULL ? uxTaskGetStackHighWaterMark(probeTask) : 0);
+      flipper.print(",");
+      flipper.print(batchStack);
+      flipper.print(",");
+      flipper.println(WiFi.status() == WL_CONNECTED ? WiFi.RSSI() : 0);
+    } else if (command == "TLS") {
+      // TLS:<full handshakes>,<their total ms>,<resumed handshakes>,<their total ms>
+      xSemaphoreTake(tlsMutex, portMAX_DELAY);
+      flipper.print("TLS:");
+      flipper.print(tlsFullCount);
+      flipper.print(",");
+      flipper.print(tlsFullMs);
+      flipper.print(",");
+      flipper.print(tlsResumedCount);
+      flipper.print(",");
+      flipper.println(tlsResumedMs);
+      xSemaphoreGive(tlsMutex);
+    } else if (command == "TLS RESUME ON" || command == "TLS RESUME OFF") {
+      tlsResume = command.endsWith("ON");
+    } else if (command == "HEDGE") {
+      // HEDGE:<delay ms>,<hedged prompts>,<hedges sent>,<hedges that won>,<p99 ms off>,<p99 ms on>
+      flipper.print("HEDGE:");
+      flipper.print(hedgeDelayMs);
+      flipper.print(",");
+      flipper.print(hedgePrompts);
+      flipper.print(",");
+      flipper.print(hedgesSent);
+      flipper.print(",");
+      flipper.print(hedgeWins);
+      flipper.print(",");
+      flipper.print(latencyP99(plainLatency));
+      flipper.print(",");
+      flipper.println(latencyP99(hedgedLatency));
+    } else if (command.startsWith("HEDGE ")) {
+      // HEDGE <ms> [model], or HEDGE OFF
+      String args = command.substring(6);
+      args.trim();
+      int separator = args.indexOf(' ');
+      hedgeDelayMs = args == "OFF" ? 0 : args.substring(0, separator == -1 ? args.length() : separator).toInt();
+      hedgeModel = separator == -1 ? String() : args.substring(separator + 1);
+    } else if (command.startsWith("FILE ")) {
+      streamFilePrompt(command);
+    } else if (command == "ENDPOINTS") {
+      xSemaphoreTake(endpointMutex, portMAX_DELAY);
+      for (uint8_t i = 0; i < endpointCount; i++) {
+        flipper.print("ENDPOINT:");
+        flipper.print(i);
+        flipper.print(",");
+        flipper.print(endpoints[i].healthy ? 1 : 0);
+        flipper.print(",");
+        flipper.print(endpoints[i].probed ? (long)endpoints[i].latencyMs : -1L);
+        flipper.print(",");
+        flipper.println(endpoints[i].url);
+      }
+      xSemaphoreGive(endpointMutex);
     } else if (WiFi.status() == WL_CONNECTED) {
       // Handle chat functionality
-      HTTPClient http;
-      http.begin(serverURL);
-      http.addHeader("Content-Type", "application/json");
-      
-      String payload = "{\"model\":\"mistral\",\"prompt\":\"" + command + "\",\"stream\":false}";
-      
-      int httpResponseCode = http.POST(payload);
-      
-      if (httpResponseCode > 0) {
-        String response = http.getString();
-        DynamicJsonDocument doc(4096);
-        DeserializationError error = deserializeJson(doc, response);
-        
-        if (!error) {
-          const char* text = doc["response"];
-          Serial.println("User: \"" + command + "\"");
-          Serial.println("Ollama: \"" + String(text) + "\"");
+      spanReceive = millis();
+
+      String payload = "{\"model\":\"" + modelName + "\",\"prompt\":\"" + command + "\",\"keep_alive\":\"" + String(warmupKeepAlive) + "\",\"stream\":false}";
+
+      // Fail over on connection errors and 5xx; a 4xx would fail the same everywhere
+      uint32_t tried = 0;
+      int index;
+      String url;
+      String response;
+      int httpResponseCode = HTTPC_ERROR_NOT_CONNECTED;
+      spanConnect = spanFirstByte = spanLastByte = spanReceive;
+      if (hedgeDelayMs > 0) {
+        httpResponseCode = postPromptHedged(command, response);
+      } else {
+        while ((index = pickEndpoint(tried, url)) != -1) {
+          tried |= 1UL << index;
+          httpResponseCode = postPrompt(url, payload, response);
+          if (httpResponseCode > 0 && httpResponseCode < 500) {
+            recordEndpoint(index, url, true, 0);
+            break;
+          }
+          recordEndpoint(index, url, false, 0);
+          flipper.println("DEBUG: " + url + " failed (" + String(httpResponseCode) + "), failing over");
+        }
+      }
+
+      if (httpResponseCode > 0 && httpResponseCode < 500) {
+        addLatencySample(hedgeDelayMs > 0 ? hedgedLatency : plainLatency, spanLastByte - spanReceive);
+        // A hedged answer is the streamed text itself
+        String text = response;
+        bool parsed = hedgeDelayMs > 0;
+        if (!parsed) {
+          DynamicJsonDocument doc(4096);
+          parsed = !deserializeJson(doc, response);
+          text = doc["response"].as<String>();
+        }
+
+        if (parsed) {
+          flipper.println("User: \"" + command + "\"");
+          sendReply(flipper, text);
         } else {
-          Serial.println("Error parsing JSON");
+          flipper.println("Error parsing JSON");
         }
       } else {
-        Serial.println("Error on HTTP request");
+        flipper.println("Error on HTTP request");
       }
+      flipper.flush();
+      spanUartDone = millis();
       
-      http.end();
+      // A real prompt refreshes keep_alive just like a warm-up does.
+      lastWarmupMs = millis();
     } else {
-      Serial.println("WiFi not connected");
+      flipper.println("WiFi not connected");
     }
   }
 }
\ No newline at end of file
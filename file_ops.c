@@ -1,47 +1,222 @@
 #include "file_ops.h"
 #include "ollama_app_i.h"
+#include "ap_store.h"
 #include <storage/storage.h>
 #include <furi.h>
+#include <furi_hal.h>
 
-bool read_url_from_file(OllamaAppState* state) {
+uint8_t read_url_from_file(char* urls, size_t size) {
     Storage* storage = furi_record_open(RECORD_STORAGE);
     File* file = storage_file_alloc(storage);
-    bool success = false;
+    uint8_t count = 0;
 
     if(storage_file_open(file, URL_FILE_PATH, FSAM_READ, FSOM_OPEN_EXISTING)) {
-        uint16_t bytes_read = storage_file_read(file, state->server_url, MAX_URL_LENGTH - 1);
-        if(bytes_read > 0) {
-            state->server_url[bytes_read] = '\0';
-            success = true;
+        uint16_t bytes_read = storage_file_read(file, urls, size - 1);
+        urls[bytes_read] = '\0';
+
+        // One URL per line, blank lines and '#' comments skipped; compacted in place
+        // into the space-separated list the ESP32's URL command takes
+        char* out = urls;
+        char* line = urls;
+        while(*line && count < MAX_SERVER_URLS) {
+            size_t length = strcspn(line, "\r\n");
+            char* next = line + length;
+            while(*next == '\r' || *next == '\n') {
+                next++;
+            }
+            while(length > 0 && (*line == ' ' || *line == '\t')) {
+                line++;
+                length--;
+            }
+            while(length > 0 && (line[length - 1] == ' ' || line[length - 1] == '\t')) {
+                length--;
+            }
+            if(length > 0 && *line != '#') {
+                if(count > 0) {
+                    *out++ = ' ';
+                }
+                memmove(out, line, length);
+                out += length;
+                count++;
+            }
+            line = next;
         }
+        *out = '\0';
     }
 
     storage_file_close(file);
     storage_file_free(file);
     furi_record_close(RECORD_STORAGE);
-    return success;
+    return count;
 }
 
 bool read_wifi_config(OllamaAppState* state) {
+    // The password lives in the WiFi screens' arena
+    if(!state->wifi) {
+        return false;
+    }
+
+    // The most recently used network comes first
+    ApRecord record;
+    if(ap_store_load(WIFI_CONFIG_PATH, &record, 1) == 0) {
+        return false;
+    }
+    strcpy(state->wifi_ssid, record.ssid);
+    strcpy(state->wifi->password, record.password);
+    return true;
+}
+
+void save_ap(OllamaAppState* state) {
+    if(!state->wifi) {
+        return;
+    }
+
+    ap_store_save(WIFI_CONFIG_PATH, state->wifi_ssid, state->wifi->password);
+}
+
+uint16_t read_completion_file(Completion* completion) {
+    Storage* storage = furi_record_open(RECORD_STORAGE);
+    File* file = storage_file_alloc(storage);
+    uint16_t lines = 0;
+
+    // One entry per line: "<weight> <text>"
+    if(storage_file_open(file, COMPLETION_FILE_PATH, FSAM_READ, FSOM_OPEN_EXISTING)) {
+        char buffer[64];
+        char line[MAX_MESSAGE_LENGTH];
+        size_t line_length = 0;
+        uint16_t bytes_read;
+        do {
+            bytes_read = storage_file_read(file, buffer, sizeof(buffer));
+            for(uint16_t i = 0; i <= bytes_read; i++) {
+                bool end = i == bytes_read ? bytes_read < sizeof(buffer) : buffer[i] == '\n';
+                if(!end) {
+                    if(i < bytes_read && buffer[i] != '\r' && line_length < sizeof(line) - 1) {
+                        line[line_length++] = buffer[i];
+                    }
+                    continue;
+                }
+                line[line_length] = '\0';
+                char* text = NULL;
+                unsigned long weight = strtoul(line, &text, 10);
+                if(text != line && *text == ' ' && weight > 0) {
+                    completion_add(completion, text + 1, weight > UINT16_MAX ? UINT16_MAX : weight);
+                    lines++;
+                }
+                line_length = 0;
+            }
+        } while(bytes_read == sizeof(buffer));
+    }
+
+    storage_file_close(file);
+    storage_file_free(file);
+    furi_record_close(RECORD_STORAGE);
+    return lines;
+}
+
+static void write_completion_entry(const char* text, uint16_t weight, void* context) {
+    File* file = context;
+    char buffer[COMPLETION_MAX_LENGTH + 8];
+    int len = snprintf(buffer, sizeof(buffer), "%u %s\n", weight, text);
+    if(len > 0) {
+        storage_file_write(file, buffer, len);
+    }
+}
+
+bool write_completion_file(const Completion* completion) {
     Storage* storage = furi_record_open(RECORD_STORAGE);
     File* file = storage_file_alloc(storage);
     bool success = false;
 
-    if(storage_file_open(file, WIFI_CONFIG_PATH, FSAM_READ, FSOM_OPEN_EXISTING)) {
-        char buffer[MAX_SSID_LENGTH + MAX_PASSWORD_LENGTH + 2];
-        uint16_t bytes_read = storage_file_read(file, buffer, sizeof(buffer) - 1);
-        if(bytes_read > 0) {
-            buffer[bytes_read] = '\0';
-            char* password_start = strchr(buffer, '/');
-            if(password_start && *(password_start + 1) == '/') {
-                *password_start = '\0';
-                password_start += 2;
-                strncpy(state->wifi_ssid, buffer, MAX_SSID_LENGTH - 1);
-                strncpy(state->wifi_password, password_start, MAX_PASSWORD_LENGTH - 1);
-                state->wifi_ssid[MAX_SSID_LENGTH - 1] = '\0';
-                state->wifi_password[MAX_PASSWORD_LENGTH - 1] = '\0';
-                success = true;
+    if(storage_file_open(file, COMPLETION_FILE_PATH, FSAM_WRITE, FSOM_CREATE_ALWAYS)) {
+        completion_foreach(completion, write_completion_entry, file);
+        success = true;
+    }
+
+    storage_file_close(file);
+    storage_file_free(file);
+    furi_record_close(RECORD_STORAGE);
+    return success;
+}
+
+void append_completion(const char* text) {
+    Storage* storage = furi_record_open(RECORD_STORAGE);
+    File* file = storage_file_alloc(storage);
+
+    if(storage_file_open(file, COMPLETION_FILE_PATH, FSAM_WRITE, FSOM_OPEN_APPEND)) {
+        char buffer[MAX_MESSAGE_LENGTH + 4];
+        int len = snprintf(buffer, sizeof(buffer), "1 %s\n", text);
+        if(len > 0) {
+            storage_file_write(file, buffer, len);
+        }
+    }
+
+    storage_file_close(file);
+    storage_file_free(file);
+    furi_record_close(RECORD_STORAGE);
+}
+
+uint8_t read_scan_cache(WifiScreen* wifi) {
+    Storage* storage = furi_record_open(RECORD_STORAGE);
+    File* file = storage_file_alloc(storage);
+    wifi->network_count = 0;
+    wifi->cache_time = 0;
+
+    // "<timestamp>" on the first line, then "<rssi> <ssid>" strongest first
+    if(storage_file_open(file, WIFI_SCAN_CACHE_PATH, FSAM_READ, FSOM_OPEN_EXISTING)) {
+        char buffer[64];
+        char line[MAX_SSID_LENGTH + 8];
+        size_t line_length = 0;
+        bool header = true;
+        uint16_t bytes_read;
+        do {
+            bytes_read = storage_file_read(file, buffer, sizeof(buffer));
+            for(uint16_t i = 0; i <= bytes_read && wifi->network_count < MAX_NETWORKS; i++) {
+                bool end = i == bytes_read ? bytes_read < sizeof(buffer) : buffer[i] == '\n';
+                if(!end) {
+                    if(i < bytes_read && buffer[i] != '\r' && line_length < sizeof(line) - 1) {
+                        line[line_length++] = buffer[i];
+                    }
+                    continue;
+                }
+                line[line_length] = '\0';
+                if(header) {
+                    wifi->cache_time = strtoul(line, NULL, 10);
+                    header = false;
+                } else {
+                    char* ssid = NULL;
+                    long rssi = strtol(line, &ssid, 10);
+                    if(ssid != line && *ssid == ' ' && ssid[1] != '\0') {
+                        WiFiNetwork* network = &wifi->networks[wifi->network_count++];
+                        strncpy(network->ssid, ssid + 1, MAX_SSID_LENGTH - 1);
+                        network->ssid[MAX_SSID_LENGTH - 1] = '\0';
+                        network->rssi = rssi;
+                        network->cached = true;
+                    }
+                }
+                line_length = 0;
             }
+        } while(bytes_read == sizeof(buffer) && wifi->network_count < MAX_NETWORKS);
+    }
+
+    storage_file_close(file);
+    storage_file_free(file);
+    furi_record_close(RECORD_STORAGE);
+    return wifi->network_count;
+}
+
+bool write_scan_cache(const WifiScreen* wifi) {
+    Storage* storage = furi_record_open(RECORD_STORAGE);
+    File* file = storage_file_alloc(storage);
+    bool success = false;
+
+    if(storage_file_open(file, WIFI_SCAN_CACHE_PATH, FSAM_WRITE, FSOM_CREATE_ALWAYS)) {
+        char buffer[MAX_SSID_LENGTH + 16];
+        int len = snprintf(buffer, sizeof(buffer), "%lu\n", (unsigned long)furi_hal_rtc_get_timestamp());
+        success = len > 0 && storage_file_write(file, buffer, len) == (size_t)len;
+        for(uint8_t i = 0; i < wifi->network_count && success; i++) {
+            len = snprintf(buffer, sizeof(buffer), "%ld %s\n",
+                           (long)wifi->networks[i].rssi, wifi->networks[i].ssid);
+            success = len > 0 && storage_file_write(file, buffer, len) == (size_t)len;
         }
     }
 
@@ -51,13 +226,85 @@ bool read_wifi_config(OllamaAppState* state) {
     return success;
 }
 
-void save_ap(OllamaAppState* state) {
+void save_heap_report(OllamaAppState* state) {
     Storage* storage = furi_record_open(RECORD_STORAGE);
     File* file = storage_file_alloc(storage);
 
-    if(storage_file_open(file, WIFI_CONFIG_PATH, FSAM_WRITE, FSOM_OPEN_ALWAYS)) {
-        char buffer[MAX_SSID_LENGTH + MAX_PASSWORD_LENGTH + 3];
-        int len = snprintf(buffer, sizeof(buffer), "%s//%s\n", state->wifi_ssid, state->wifi_password);
+    if(storage_file_open(file, HEAP_REPORT_PATH, FSAM_WRITE, FSOM_CREATE_ALWAYS)) {
+        const char* header = "state,heap_peak,arena_peak\n";
+        storage_file_write(file, header, strlen(header));
+        char buffer[48];
+        for(AppState app_state = 0; app_state < AppStateCount; app_state++) {
+            int len = snprintf(buffer, sizeof(buffer), "%s,%u,%u\n",
+                               ollama_app_state_name(app_state),
+                               (unsigned)state->heap_peak[app_state],
+                               (unsigned)state->arena_peak[app_state]);
+            if(len > 0) {
+                storage_file_write(file, buffer, len);
+            }
+        }
+    }
+
+    storage_file_close(file);
+    storage_file_free(file);
+    furi_record_close(RECORD_STORAGE);
+}
+
+void append_latency_log(const uint32_t* segments, size_t count) {
+    Storage* storage = furi_record_open(RECORD_STORAGE);
+    File* file = storage_file_alloc(storage);
+
+    if(storage_file_open(file, LATENCY_LOG_PATH, FSAM_WRITE, FSOM_OPEN_APPEND)) {
+        char buffer[16];
+        if(storage_file_size(file) == 0) {
+            const char* header = "key_tx,uart,connect,ttfb,body,esp_tx,render\n";
+            storage_file_write(file, header, strlen(header));
+        }
+        for(size_t i = 0; i < count; i++) {
+            int len = snprintf(buffer, sizeof(buffer), "%lu%c", (unsigned long)segments[i], i + 1 < count ? ',' : '\n');
+            if(len > 0) {
+                storage_file_write(file, buffer, len);
+            }
+        }
+    }
+
+    storage_file_close(file);
+    storage_file_free(file);
+    furi_record_close(RECORD_STORAGE);
+}
+
+void append_telemetry_log(const Telemetry* telemetry) {
+    Storage* storage = furi_record_open(RECORD_STORAGE);
+    File* file = storage_file_alloc(storage);
+
+    if(storage_file_open(file, TELEMETRY_LOG_PATH, FSAM_WRITE, FSOM_OPEN_APPEND)) {
+        char buffer[160];
+        if(storage_file_size(file) == 0) {
+            const char* header = "time,heap_free,heap_min,heap_block,app_stack,uart_stack,rx_waiting,rx_high,"
+                                 "queue,queue_high,esp_heap_free,esp_heap_min,esp_heap_block,"
+                                 "esp_loop_stack,esp_probe_stack,esp_batch_stack,esp_rssi\n";
+            storage_file_write(file, header, strlen(header));
+        }
+        int len = snprintf(buffer, sizeof(buffer), "%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu",
+                           (unsigned long)furi_hal_rtc_get_timestamp(),
+                           (unsigned long)telemetry->heap_free, (unsigned long)telemetry->heap_min,
+                           (unsigned long)telemetry->heap_block, (unsigned long)telemetry->app_stack,
+                           (unsigned long)telemetry->uart_stack, (unsigned long)telemetry->rx_waiting,
+                           (unsigned long)telemetry->rx_high_water, (unsigned long)telemetry->queue_depth,
+                           (unsigned long)telemetry->queue_high);
+        if(len > 0) {
+            storage_file_write(file, buffer, len);
+        }
+        // The ESP32 columns stay empty when it did not answer
+        if(telemetry->esp_reported) {
+            len = snprintf(buffer, sizeof(buffer), ",%lu,%lu,%lu,%lu,%lu,%ld,%ld\n",
+                           (unsigned long)telemetry->esp_heap_free, (unsigned long)telemetry->esp_heap_min,
+                           (unsigned long)telemetry->esp_heap_block, (unsigned long)telemetry->esp_loop_stack,
+                           (unsigned long)telemetry->esp_probe_stack, (long)telemetry->esp_batch_stack,
+                           (long)telemetry->esp_rssi);
+        } else {
+            len = snprintf(buffer, sizeof(buffer), ",,,,,,,\n");
+        }
         if(len > 0) {
             storage_file_write(file, buffer, len);
         }
@@ -66,4 +313,62 @@ void save_ap(OllamaAppState* state) {
     storage_file_close(file);
     storage_file_free(file);
     furi_record_close(RECORD_STORAGE);
-}
\ No newline at end of file
+}
+
+bool write_capture_header(const CaptureFileHeader* header) {
+    Storage* storage = furi_record_open(RECORD_STORAGE);
+    File* file = storage_file_alloc(storage);
+    bool success = false;
+
+    if(storage_file_open(file, CAPTURE_FILE_PATH, FSAM_WRITE, FSOM_CREATE_ALWAYS)) {
+        success = storage_file_write(file, header, sizeof(CaptureFileHeader)) == sizeof(CaptureFileHeader);
+    }
+
+    storage_file_close(file);
+    storage_file_free(file);
+    furi_record_close(RECORD_STORAGE);
+    return success;
+}
+
+uint32_t append_capture(size_t (*read)(void* data, size_t size)) {
+    Storage* storage = furi_record_open(RECORD_STORAGE);
+    File* file = storage_file_alloc(storage);
+    uint32_t written = 0;
+
+    if(storage_file_open(file, CAPTURE_FILE_PATH, FSAM_WRITE, FSOM_OPEN_APPEND)) {
+        uint8_t buffer[128];
+        size_t length;
+        while((length = read(buffer, sizeof(buffer))) > 0) {
+            written += storage_file_write(file, buffer, length);
+        }
+    }
+
+    storage_file_close(file);
+    storage_file_free(file);
+    furi_record_close(RECORD_STORAGE);
+    return written;
+}
+
+bool write_trace_file(
+    const TraceFileHeader* header,
+    const TraceRecord* first,
+    size_t first_count,
+    const TraceRecord* second,
+    size_t second_count) {
+    Storage* storage = furi_record_open(RECORD_STORAGE);
+    File* file = storage_file_alloc(storage);
+    bool success = false;
+
+    if(storage_file_open(file, TRACE_FILE_PATH, FSAM_WRITE, FSOM_CREATE_ALWAYS)) {
+        size_t first_size = first_count * sizeof(TraceRecord);
+        size_t second_size = second_count * sizeof(TraceRecord);
+        success = storage_file_write(file, header, sizeof(TraceFileHeader)) == sizeof(TraceFileHeader) &&
+                  storage_file_write(file, first, first_size) == first_size &&
+                  storage_file_write(file, second, second_size) == second_size;
+    }
+
+    storage_file_close(file);
+    storage_file_free(file);
+    furi_record_close(RECORD_STORAGE);
+    return success;
+}
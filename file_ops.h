@@ -1,7 +1,28 @@
 #pragma once
 
 #include "ollama_app_i.h"
+#include "trace.h"
+#include "capture.h"
 
-bool read_url_from_file(OllamaAppState* state);
+// Returns the number of server URLs read, stored space-separated in `urls`
+uint8_t read_url_from_file(char* urls, size_t size);
 bool read_wifi_config(OllamaAppState* state);
-void save_ap(OllamaAppState* state);
\ No newline at end of file
+void save_ap(OllamaAppState* state);
+void save_heap_report(OllamaAppState* state);
+// Fills the table from WIFI_SCAN_CACHE_PATH with every row marked cached
+uint8_t read_scan_cache(WifiScreen* wifi);
+bool write_scan_cache(const WifiScreen* wifi);
+uint16_t read_completion_file(Completion* completion);
+bool write_completion_file(const Completion* completion);
+void append_completion(const char* text);
+void append_latency_log(const uint32_t* segments, size_t count);
+void append_telemetry_log(const Telemetry* telemetry);
+bool write_capture_header(const CaptureFileHeader* header);
+// Appends to CAPTURE_FILE_PATH whatever read hands over until it returns 0
+uint32_t append_capture(size_t (*read)(void* data, size_t size));
+bool write_trace_file(
+    const TraceFileHeader* header,
+    const TraceRecord* first,
+    size_t first_count,
+    const TraceRecord* second,
+    size_t second_count);
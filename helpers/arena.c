@@ -0,0 +1,44 @@
+#include "arena.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGNMENT sizeof(uint64_t)
+
+struct Arena {
+    size_t capacity;
+    size_t used;
+    uint64_t data[];
+};
+
+Arena* arena_alloc(size_t capacity) {
+    capacity = (capacity + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+    Arena* arena = malloc(sizeof(Arena) + capacity);
+    arena->capacity = capacity;
+    arena->used = 0;
+    return arena;
+}
+
+void* arena_push(Arena* arena, size_t size) {
+    size = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+    if(size > arena->capacity - arena->used) {
+        return NULL;
+    }
+
+    uint8_t* block = (uint8_t*)arena->data + arena->used;
+    arena->used += size;
+    memset(block, 0, size);
+    return block;
+}
+
+size_t arena_used(const Arena* arena) {
+    return arena->used;
+}
+
+size_t arena_capacity(const Arena* arena) {
+    return arena->capacity;
+}
+
+void arena_free(Arena* arena) {
+    free(arena);
+}
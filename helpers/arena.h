@@ -0,0 +1,42 @@
+/**
+ * Arena is a fixed-size bump allocator.  Everything pushed into an arena lives in
+ * one heap block and is released in one step by arena_free, so a screen can allocate
+ * its working data on entry without tracking individual frees on exit.
+*/
+#pragma once
+
+#include <stddef.h>
+
+typedef struct Arena Arena;
+
+/**
+ * Allocates an arena with room for capacity bytes of pushes.
+ * 
+ * @param capacity  Bytes available to arena_push (alignment padding included)
+ * @return          Arena instance
+*/
+Arena* arena_alloc(size_t capacity);
+
+/**
+ * Reserves size zeroed bytes, aligned for any scalar type.
+ * 
+ * @param arena  Arena instance
+ * @param size   Bytes to reserve
+ * @return       Pointer into the arena, or NULL when it does not fit
+*/
+void* arena_push(Arena* arena, size_t size);
+
+/**
+ * @return  Bytes pushed so far, including alignment padding
+*/
+size_t arena_used(const Arena* arena);
+
+/**
+ * @return  Bytes the arena was allocated with
+*/
+size_t arena_capacity(const Arena* arena);
+
+/**
+ * Frees the arena and everything pushed into it.
+*/
+void arena_free(Arena* arena);
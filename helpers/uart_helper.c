@@ -5,17 +5,74 @@
  * a ring buffer to hold data until a delimiter is found, at which point the line
  * is extracted and the process_line callback is invoked.
  * 
+ * Transmit is asynchronous too: uart_helper_send copies the data into a TX stream
+ * buffer and returns, and the same worker writes it to the UART between RX chunks,
+ * reporting progress through the tx_complete callback.
+ * 
+ * Traffic can be captured: the worker records each chunk it receives or transmits,
+ * with a timestamp, in a buffer the app drains to wherever it keeps captures.
+ * 
+ * Flow control is XON/XOFF: when the rx_stream fills past a high-water level the ISR
+ * sends XOFF, and the worker sends XON once it has drained the stream again.  Bytes
+ * the stream could not take anyway are counted, never silently lost.
+ * 
  * @author CodeAllNight
 */
 
 #include <furi_hal.h>
 #include "ring_buffer.h"
+#include "../trace.h"
 
 /**
  * Callback invoked when a line is read from the UART.
 */
 typedef void (*ProcessLine)(FuriString* line, void* context);
 
+/**
+ * Callback invoked when the TX queue has drained onto the wire.
+*/
+typedef void (*TxComplete)(uint32_t sent, void* context);
+
+/**
+ * Receive-side counters, see uart_helper_get_stats.
+*/
+typedef struct {
+    uint32_t rx_bytes;
+    uint32_t rx_dropped;
+    uint32_t rx_high_water;
+    uint32_t rx_capacity;
+    uint32_t xoff_sent;
+    uint32_t rx_waiting;
+    uint32_t worker_stack_free;
+    uint32_t capture_dropped;
+} UartHelperStats;
+
+/**
+ * Captured chunk header, see uart_helper_capture_start.
+*/
+typedef enum {
+    UartCaptureRx,
+    UartCaptureTx,
+} UartCaptureDirection;
+
+typedef struct __attribute__((packed)) {
+    uint32_t tick;
+    uint16_t length;
+    uint8_t direction;
+} UartCaptureRecord;
+
+/**
+ * Software flow control characters (DC1/DC3).  Neither appears in the text protocol.
+*/
+#define UART_XON 0x11
+#define UART_XOFF 0x13
+
+/**
+ * Bytes that may still arrive after an XOFF before it is sent again, in case it was lost.
+ * More than the ESP32's 128-byte TX FIFO, which it cannot take back once it has paused.
+*/
+#define UART_XOFF_RESEND_BYTES 160
+
 /**
  * UartHelper is a utility class that helps with reading lines of data from a UART.
 */
@@ -37,6 +94,41 @@ typedef struct {
     // Callback to invoke when a line is read
     ProcessLine process_line;
     void* context;
+
+    // Data waiting to be transmitted (worker will dequeue and send)
+    FuriStreamBuffer* tx_stream;
+    size_t tx_capacity;
+    // Serialises senders so each message is queued contiguously
+    FuriMutex* tx_mutex;
+    // Bytes ever queued and ever written; a message is out once tx_sent reaches its ticket
+    uint32_t tx_queued;
+    uint32_t tx_sent;
+
+    // Callback to invoke when the TX queue drains
+    TxComplete tx_complete;
+    void* tx_context;
+
+    // XOFF is sent when rx_stream holds rx_xoff_level bytes, XON when it is back to rx_xon_level
+    bool flow_control;
+    volatile bool rx_paused;
+    size_t rx_xoff_level;
+    size_t rx_xon_level;
+    // Bytes received since the last XOFF, so a lost XOFF gets repeated
+    size_t rx_since_xoff;
+    // Set while the worker writes to the UART: the ISR then leaves its XOFF to the worker,
+    // which sends it before the next chunk.  XON from other threads goes the same way.
+    volatile bool tx_busy;
+    volatile bool xoff_pending;
+    volatile bool xon_pending;
+
+    // Updated by the ISR, read by anyone
+    UartHelperStats stats;
+
+    // Chunks recorded by the worker for uart_helper_capture_read; the mutex keeps the
+    // buffer from going away under the worker
+    FuriStreamBuffer* capture_stream;
+    FuriMutex* capture_mutex;
+    volatile bool capturing;
 } UartHelper;
 
 /**
@@ -47,6 +139,7 @@ typedef struct {
 typedef enum {
     WorkerEventDataWaiting = 1 << 0, // bit flag 0 - data is waiting to be processed
     WorkerEventExiting = 1 << 1, // bit flag 1 - worker thread is exiting
+    WorkerEventTxWaiting = 1 << 2, // bit flag 2 - data is waiting to be transmitted
 } WorkerEventFlags;
 
 /** 
@@ -65,16 +158,176 @@ static void uart_helper_received_byte_callback(
 
     if(event == FuriHalSerialRxEventData) {
         uint8_t data = furi_hal_serial_async_rx(handle);
-        FURI_LOG_D("UART", "Received byte: 0x%02X", data);
-        furi_stream_buffer_send(helper->rx_stream, (void*)&data, 1, 0);
+        APP_LOG_T("UART", "Received byte: 0x%02X", data);
+        helper->stats.rx_bytes++;
+        if(furi_stream_buffer_send(helper->rx_stream, (void*)&data, 1, 0) == 0) {
+            helper->stats.rx_dropped++;
+        }
+
+        size_t waiting = furi_stream_buffer_bytes_available(helper->rx_stream);
+        if(waiting > helper->stats.rx_high_water) {
+            helper->stats.rx_high_water = waiting;
+        }
+        if(helper->flow_control && waiting >= helper->rx_xoff_level) {
+            // Ask again if the sender keeps going, in case the first XOFF was lost
+            if(!helper->rx_paused || ++helper->rx_since_xoff >= UART_XOFF_RESEND_BYTES) {
+                helper->rx_paused = true;
+                helper->rx_since_xoff = 0;
+                helper->stats.xoff_sent++;
+                TRACE(TraceEventUartFlow, 0, waiting);
+                if(helper->tx_busy) {
+                    helper->xoff_pending = true;
+                    furi_thread_flags_set(furi_thread_get_id(helper->worker_thread), WorkerEventTxWaiting);
+                } else {
+                    // Nothing else is writing, so the byte goes straight to the data
+                    // register; a stuck worker cannot hold it back
+                    uint8_t xoff = UART_XOFF;
+                    furi_hal_serial_tx(handle, &xoff, 1);
+                }
+            }
+        }
         furi_thread_flags_set(furi_thread_get_id(helper->worker_thread), WorkerEventDataWaiting);
     }
 }
 
+/**
+ * Records one chunk for the capture, whole or not at all.  Only the worker writes to
+ * the capture_stream, so the space checked is still there when the chunk goes in.
+ * 
+ * @param helper     UartHelper instance
+ * @param direction  UartCaptureRx or UartCaptureTx
+ * @param data       The chunk
+ * @param length     Bytes in the chunk
+*/
+static void uart_helper_capture(
+    UartHelper* helper,
+    UartCaptureDirection direction,
+    const uint8_t* data,
+    size_t length) {
+    if(!helper->capturing) {
+        return;
+    }
+    furi_mutex_acquire(helper->capture_mutex, FuriWaitForever);
+    if(helper->capturing) {
+        UartCaptureRecord record = {
+            .tick = furi_get_tick(),
+            .length = length,
+            .direction = direction,
+        };
+        if(furi_stream_buffer_spaces_available(helper->capture_stream) >= sizeof(record) + length) {
+            furi_stream_buffer_send(helper->capture_stream, &record, sizeof(record), 0);
+            furi_stream_buffer_send(helper->capture_stream, data, length, 0);
+        } else {
+            helper->stats.capture_dropped++;
+        }
+    }
+    furi_mutex_release(helper->capture_mutex);
+}
+
+/**
+ * Writes to the UART from the worker, with the ISR kept off it meanwhile.  Flow control
+ * bytes left for the worker go first.
+ * 
+ * @param helper  UartHelper instance
+ * @param data    Bytes to write, or NULL to send only the pending flow control
+ * @param length  Bytes in data
+*/
+static void uart_helper_write(UartHelper* helper, const uint8_t* data, size_t length) {
+    helper->tx_busy = true;
+    if(helper->xoff_pending) {
+        uint8_t xoff = UART_XOFF;
+        helper->xoff_pending = false;
+        furi_hal_serial_tx(helper->serial_handle, &xoff, 1);
+    }
+    if(helper->xon_pending) {
+        uint8_t xon = UART_XON;
+        helper->xon_pending = false;
+        furi_hal_serial_tx(helper->serial_handle, &xon, 1);
+    }
+    if(length > 0) {
+        furi_hal_serial_tx(helper->serial_handle, data, length);
+    }
+    helper->tx_busy = false;
+}
+
+/**
+ * Dequeues one chunk from the rx_stream and feeds it to the line parser.  When a
+ * delimiter is found in the data, the line is extracted and the process_line callback
+ * is invoked.
+ * 
+ * @param helper  UartHelper instance
+ * @param line    Line being assembled across chunks
+ * @return        true if any data was dequeued
+*/
+static bool uart_helper_process_rx(UartHelper* helper, FuriString* line) {
+    uint8_t buffer[64];
+    size_t length_read = furi_stream_buffer_receive(helper->rx_stream, buffer, sizeof(buffer), 0);
+    size_t waiting = furi_stream_buffer_bytes_available(helper->rx_stream);
+    if(helper->rx_paused && waiting <= helper->rx_xon_level) {
+        uint8_t xon = UART_XON;
+        helper->rx_paused = false;
+        uart_helper_write(helper, &xon, 1);
+        TRACE(TraceEventUartFlow, 1, waiting);
+    }
+    if(length_read == 0) {
+        return false;
+    }
+
+    TRACE(TraceEventUartRx, length_read, waiting);
+    uart_helper_capture(helper, UartCaptureRx, buffer, length_read);
+    for(size_t i = 0; i < length_read; i++) {
+        if(buffer[i] == '\n' || buffer[i] == '\r') {
+            if(furi_string_size(line) > 0) {
+                APP_LOG_D("UART", "Received line: %s", furi_string_get_cstr(line));
+                TRACE(TraceEventUartLine, furi_string_size(line), 0);
+                if(helper->process_line) {
+                    helper->process_line(line, helper->context);
+                }
+                furi_string_reset(line);
+            }
+        } else {
+            furi_string_push_back(line, buffer[i]);
+        }
+    }
+    return true;
+}
+
+/**
+ * Writes one chunk from the tx_stream to the UART.  Chunks are small so received
+ * data keeps being processed while a long message goes out.  When the queue runs
+ * dry the tx_complete callback is invoked.
+ * 
+ * @param helper  UartHelper instance
+ * @return        true if any data was sent
+*/
+static bool uart_helper_process_tx(UartHelper* helper) {
+    uint8_t buffer[64];
+    size_t length = furi_stream_buffer_receive(helper->tx_stream, buffer, sizeof(buffer), 0);
+    if(length == 0) {
+        if(helper->xoff_pending || helper->xon_pending) {
+            uart_helper_write(helper, NULL, 0);
+        }
+        return false;
+    }
+
+    uart_helper_write(helper, buffer, length);
+    helper->tx_sent += length;
+    TRACE(TraceEventUartTx, length, helper->tx_sent);
+    uart_helper_capture(helper, UartCaptureTx, buffer, length);
+
+    if(furi_stream_buffer_bytes_available(helper->tx_stream) == 0) {
+        furi_hal_serial_tx_wait_complete(helper->serial_handle);
+        if(helper->tx_complete) {
+            helper->tx_complete(helper->tx_sent, helper->tx_context);
+        }
+    }
+    return true;
+}
+
 /** 
- * Worker thread that dequeues data from the stream buffer and processes it.  When
- * a delimiter is found in the data, the line is extracted and the process_line callback
- * is invoked. This thread will exit when the WorkerEventExiting flag is set.
+ * Worker thread that dequeues received data and processes it, and transmits queued
+ * data, alternating between the two until both are idle.  This thread will exit
+ * when the WorkerEventExiting flag is set, after sending whatever is still queued.
  * 
  * @param context  UartHelper instance
  * @return         0
@@ -86,32 +339,21 @@ static int32_t uart_helper_worker(void* context) {
 
     while(1) {
         events = furi_thread_flags_wait(
-            WorkerEventDataWaiting | WorkerEventExiting, FuriFlagWaitAny, FuriWaitForever);
+            WorkerEventDataWaiting | WorkerEventTxWaiting | WorkerEventExiting,
+            FuriFlagWaitAny,
+            FuriWaitForever);
 
-        if(events & WorkerEventDataWaiting) {
-            size_t length_read = 0;
-            uint8_t buffer[64];
+        if(events & (WorkerEventDataWaiting | WorkerEventTxWaiting)) {
+            bool busy;
             do {
-                length_read = furi_stream_buffer_receive(helper->rx_stream, buffer, sizeof(buffer), 0);
-                if(length_read > 0) {
-                    for(size_t i = 0; i < length_read; i++) {
-                        if(buffer[i] == '\n' || buffer[i] == '\r') {
-                            if(furi_string_size(line) > 0) {
-                                FURI_LOG_D("UART", "Received line: %s", furi_string_get_cstr(line));
-                                if(helper->process_line) {
-                                    helper->process_line(line, helper->context);
-                                }
-                                furi_string_reset(line);
-                            }
-                        } else {
-                            furi_string_push_back(line, buffer[i]);
-                        }
-                    }
-                }
-            } while(length_read > 0);
+                busy = uart_helper_process_rx(helper, line);
+                busy |= uart_helper_process_tx(helper);
+            } while(busy);
         }
 
         if(events & WorkerEventExiting) {
+            while(uart_helper_process_tx(helper)) {
+            }
             break;
         }
     }
@@ -124,8 +366,13 @@ UartHelper* uart_helper_alloc() {
     // rx_buffer_size should be large enough to hold the entire response from the device.
     const size_t rx_buffer_size = 2048;
 
+    // tx_buffer_size bounds how much can be queued before uart_helper_send refuses data,
+    // and so the longest message it takes.
+    const size_t tx_buffer_size = 1024;
+
     // worker_stack_size should be large enough stack for the worker thread (including functions it calls).
-    const size_t worker_stack_size = 1024;
+    // The process_line callbacks run here, and at 1 KB telemetry showed about 130 bytes left.
+    const size_t worker_stack_size = 2048;
 
     // uart_baud is the default baud rate for the UART.
     const uint32_t uart_baud = 115200;
@@ -158,6 +405,33 @@ UartHelper* uart_helper_alloc() {
     // callback whenever a delimiter is found in the data.
     helper->ring_buffer = ring_buffer_alloc();
 
+    // uart_helper_send queues into the tx_stream; the worker thread drains it onto the UART.
+    helper->tx_stream = furi_stream_buffer_alloc(tx_buffer_size, 1);
+    helper->tx_capacity = tx_buffer_size;
+    helper->tx_mutex = furi_mutex_alloc(FuriMutexTypeNormal);
+    helper->tx_queued = 0;
+    helper->tx_sent = 0;
+    helper->tx_complete = NULL;
+    helper->tx_context = NULL;
+
+    // Pause the ESP32 with a quarter of the buffer left: its UART FIFO and the chunk it is
+    // writing are still in flight when the XOFF arrives.
+    helper->flow_control = true;
+    helper->rx_paused = false;
+    helper->rx_xoff_level = rx_buffer_size - rx_buffer_size / 4;
+    helper->rx_xon_level = rx_buffer_size / 4;
+    helper->rx_since_xoff = 0;
+    helper->tx_busy = false;
+    helper->xoff_pending = false;
+    helper->xon_pending = false;
+    memset(&helper->stats, 0, sizeof(helper->stats));
+    helper->stats.rx_capacity = rx_buffer_size;
+
+    // Nothing is captured, and no buffer allocated, until uart_helper_capture_start
+    helper->capture_stream = NULL;
+    helper->capture_mutex = furi_mutex_alloc(FuriMutexTypeNormal);
+    helper->capturing = false;
+
     // worker_thread is the routine that will process data from the rx_stream.
     helper->worker_thread =
         furi_thread_alloc_ex("UartHelperWorker", worker_stack_size, uart_helper_worker, helper);
@@ -192,16 +466,99 @@ bool uart_helper_read(UartHelper* helper, FuriString* text) {
     return ring_buffer_read(helper->ring_buffer, text);
 }
 
-void uart_helper_send(UartHelper* helper, const char* data, size_t length) {
+void uart_helper_set_tx_callback(UartHelper* helper, TxComplete tx_complete, void* context) {
+    // Set the tx_complete callback and context.
+    helper->tx_complete = tx_complete;
+    helper->tx_context = context;
+}
+
+uint32_t uart_helper_send(UartHelper* helper, const char* data, size_t length) {
     if (length == 0) {
         length = strlen(data);
     }
 
-    FURI_LOG_I("UART", "Sending: %.*s", (int)length, data);
-    furi_hal_serial_tx(helper->serial_handle, (uint8_t*)data, length);
+    APP_LOG_D("UART", "Sending: %.*s", (int)length, data);
+
+    // Queue the whole message or none of it, so a full queue never sends half a command.
+    // Never waits: the worker that drains the queue may be waiting on the caller.
+    uint32_t ticket = 0;
+    furi_mutex_acquire(helper->tx_mutex, FuriWaitForever);
+    if(length <= helper->tx_capacity && furi_stream_buffer_spaces_available(helper->tx_stream) >= length) {
+        furi_stream_buffer_send(helper->tx_stream, data, length, 0);
+        helper->tx_queued += length;
+        ticket = helper->tx_queued;
+    }
+    furi_mutex_release(helper->tx_mutex);
+
+    if(ticket == 0) {
+        APP_LOG_W("UART", "TX queue full, dropped %u bytes", (unsigned)length);
+        return 0;
+    }
+    furi_thread_flags_set(furi_thread_get_id(helper->worker_thread), WorkerEventTxWaiting);
+    return ticket;
+}
+
+void uart_helper_set_flow_control(UartHelper* helper, bool enabled) {
+    helper->flow_control = enabled;
+    if(!enabled && helper->rx_paused) {
+        // Do not leave the sender waiting for an XON that would never come
+        helper->rx_paused = false;
+        helper->xon_pending = true;
+        furi_thread_flags_set(furi_thread_get_id(helper->worker_thread), WorkerEventTxWaiting);
+    }
+}
+
+void uart_helper_get_stats(UartHelper* helper, UartHelperStats* stats) {
+    *stats = helper->stats;
+    stats->rx_waiting = furi_stream_buffer_bytes_available(helper->rx_stream);
+    stats->worker_stack_free = furi_thread_get_stack_space(furi_thread_get_id(helper->worker_thread));
+}
+
+bool uart_helper_capture_start(UartHelper* helper, size_t buffer_size) {
+    furi_mutex_acquire(helper->capture_mutex, FuriWaitForever);
+    // A capture that was stopped but not drained is discarded
+    if(helper->capture_stream) {
+        furi_stream_buffer_free(helper->capture_stream);
+    }
+    helper->capture_stream = furi_stream_buffer_alloc(buffer_size, 1);
+    helper->capturing = helper->capture_stream != NULL;
+    furi_mutex_release(helper->capture_mutex);
+    return helper->capturing;
+}
+
+void uart_helper_capture_stop(UartHelper* helper) {
+    furi_mutex_acquire(helper->capture_mutex, FuriWaitForever);
+    helper->capturing = false;
+    furi_mutex_release(helper->capture_mutex);
+}
+
+size_t uart_helper_capture_read(UartHelper* helper, void* data, size_t size) {
+    furi_mutex_acquire(helper->capture_mutex, FuriWaitForever);
+    size_t length = 0;
+    if(helper->capture_stream) {
+        length = furi_stream_buffer_receive(helper->capture_stream, data, size, 0);
+        if(length == 0 && !helper->capturing) {
+            furi_stream_buffer_free(helper->capture_stream);
+            helper->capture_stream = NULL;
+        }
+    }
+    furi_mutex_release(helper->capture_mutex);
+    return length;
+}
+
+uint32_t uart_helper_tx_pending(UartHelper* helper) {
+    return helper->tx_queued - helper->tx_sent;
+}
+
+size_t uart_helper_tx_capacity(UartHelper* helper) {
+    return helper->tx_capacity;
 }
 
-void uart_helper_send_string(UartHelper* helper, FuriString* string) {
+uint32_t uart_helper_tx_sent(UartHelper* helper) {
+    return helper->tx_sent;
+}
+
+uint32_t uart_helper_send_string(UartHelper* helper, FuriString* string) {
     const char* str = furi_string_get_cstr(string);
 
     // UTF-8 strings can have character counts different then lengths!
@@ -212,7 +569,7 @@ void uart_helper_send_string(UartHelper* helper, FuriString* string) {
     }
 
     // Transmit data
-    uart_helper_send(helper, str, length);
+    return uart_helper_send(helper, str, length);
 }
 
 void uart_helper_free(UartHelper* helper) {
@@ -233,8 +590,14 @@ void uart_helper_free(UartHelper* helper) {
         // furi_hal_console_enable();
     }
 
-    // Free the rx_stream and ring_buffer.
+    // Free the rx_stream, tx_stream and ring_buffer.
     furi_stream_buffer_free(helper->rx_stream);
+    furi_stream_buffer_free(helper->tx_stream);
+    furi_mutex_free(helper->tx_mutex);
+    if(helper->capture_stream) {
+        furi_stream_buffer_free(helper->capture_stream);
+    }
+    furi_mutex_free(helper->capture_mutex);
     ring_buffer_free(helper->ring_buffer);
 
     free(helper);
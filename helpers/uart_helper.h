@@ -5,9 +5,19 @@
  * a ring buffer to hold data until a delimiter is found, at which point the line
  * is extracted and the process_line callback is invoked.
  * 
+ * Sends are queued and written by the same worker thread, so they never block the
+ * caller on the baud rate.
+ * 
+ * Traffic can be captured, chunk by chunk with timestamps, for replay on a host.
+ * 
+ * The receive side asks the sender to pause with XON/XOFF before its buffer overflows,
+ * and counts any bytes it had to drop anyway.
+ * 
  * @author CodeAllNight
 */
 
+#pragma once
+
 #include <furi.h>
 
 /**
@@ -22,6 +32,45 @@ typedef struct UartHelper UartHelper;
 */
 typedef void (*ProcessLine)(FuriString* line, void* context);
 
+/**
+ * Callback function invoked on the worker thread when the TX queue has drained.
+ * 
+ * @param sent  Total bytes ever transmitted; every send whose ticket is <= sent is out.
+*/
+typedef void (*TxComplete)(uint32_t sent, void* context);
+
+/**
+ * Receive-side counters since the UartHelper was allocated.
+*/
+typedef struct {
+    uint32_t rx_bytes; // bytes received from the UART
+    uint32_t rx_dropped; // bytes lost because the receive buffer was full
+    uint32_t rx_high_water; // most bytes ever waiting for the worker
+    uint32_t rx_capacity; // size of the receive buffer
+    uint32_t xoff_sent; // times the sender was asked to pause
+    uint32_t rx_waiting; // bytes waiting for the worker right now
+    uint32_t worker_stack_free; // least stack the worker thread has had left, in bytes
+    uint32_t capture_dropped; // chunks left out of the capture because its buffer was full
+} UartHelperStats;
+
+/**
+ * Direction of a captured chunk.
+*/
+typedef enum {
+    UartCaptureRx,
+    UartCaptureTx,
+} UartCaptureDirection;
+
+/**
+ * Header of one captured chunk; the chunk's `length` bytes follow it.  Little-endian and
+ * unpadded, so a capture reads back byte for byte on the host.
+*/
+typedef struct __attribute__((packed)) {
+    uint32_t tick; // furi_get_tick() when the worker handled the chunk
+    uint16_t length;
+    uint8_t direction; // UartCaptureDirection
+} UartCaptureRecord;
+
 /**
  * Allocates a new UartHelper.  The UartHelper will be initialized with a baud rate of 115200.
  * Log messages will be disabled since they also use the UART.
@@ -65,14 +114,93 @@ void uart_helper_set_baud_rate(UartHelper* helper, uint32_t baud_rate);
 bool uart_helper_read(UartHelper* helper, FuriString* text, uint32_t timeout_ms);
 
 /**
- * Sends data over the UART TX pin.
+ * Sets the callback function to be called when queued data has been transmitted.
+ * 
+ * @param helper        The UartHelper.
+ * @param tx_complete   The callback function.
+ * @param context       The context to pass to the callback function.
+*/
+void uart_helper_set_tx_callback(UartHelper* helper, TxComplete tx_complete, void* context);
+
+/**
+ * Queues data for the UART TX pin and returns without waiting for it to be sent.  A
+ * message longer than uart_helper_tx_capacity is never queued; send it in pieces.
+ * 
+ * @param helper  The UartHelper.
+ * @param data    The data to send.
+ * @param length  Number of bytes, or 0 to send up to the terminating null.
+ * @return        A ticket: the message is on the wire once TxComplete reports
+ *                sent >= ticket.  0 if the queue had no room and nothing was queued;
+ *                a message that fits the queue can be sent again once it has drained.
+*/
+uint32_t uart_helper_send(UartHelper* helper, const char* data, size_t length);
+
+/**
+ * Queues a string for the UART TX pin.  See uart_helper_send.
+*/
+uint32_t uart_helper_send_string(UartHelper* helper, FuriString* string);
+
+/**
+ * Enables or disables XON/XOFF flow control on the receive side.  Enabled by default;
+ * only disable it for a peer that does not understand XON/XOFF.
+ * 
+ * @param helper  The UartHelper.
+ * @param enabled true to send XOFF/XON as the receive buffer fills and drains.
+*/
+void uart_helper_set_flow_control(UartHelper* helper, bool enabled);
+
+/**
+ * Copies the receive-side counters, with the current fill level and the worker's
+ * stack high-water read at the time of the call.
+ * 
+ * @param helper  The UartHelper.
+ * @param stats   Receives the counters.
+*/
+void uart_helper_get_stats(UartHelper* helper, UartHelperStats* stats);
+
+/**
+ * Starts recording every chunk the worker receives or transmits, each behind a
+ * UartCaptureRecord, into a buffer of buffer_size bytes.  Recording never blocks the
+ * worker: a chunk the buffer has no room for is left out and counted in capture_dropped.
+ * XON/XOFF bytes are not recorded.
+ * 
+ * @param helper       The UartHelper.
+ * @param buffer_size  Bytes to buffer between uart_helper_capture_read calls.
+ * @return             false if the buffer could not be allocated.
+*/
+bool uart_helper_capture_start(UartHelper* helper, size_t buffer_size);
+
+/**
+ * Stops recording.  What was recorded can still be read; the buffer is freed once
+ * uart_helper_capture_read has drained it.
+*/
+void uart_helper_capture_stop(UartHelper* helper);
+
+/**
+ * Moves recorded bytes out of the capture buffer without waiting.  Records are written
+ * whole, but a read may end part way through one; the next read continues it.
+ * 
+ * @param helper  The UartHelper.
+ * @param data    Receives the bytes.
+ * @param size    Size of data.
+ * @return        Bytes read, 0 when there is nothing to read.
+*/
+size_t uart_helper_capture_read(UartHelper* helper, void* data, size_t size);
+
+/**
+ * @return  Bytes queued but not yet transmitted.
+*/
+uint32_t uart_helper_tx_pending(UartHelper* helper);
+
+/**
+ * @return  Size of the TX queue, the longest message uart_helper_send takes.
 */
-void uart_helper_send(UartHelper* helper, const char* data, size_t length);
+size_t uart_helper_tx_capacity(UartHelper* helper);
 
 /**
- * Sends a string over the UART TX pin.
+ * @return  Total bytes ever transmitted, comparable with send tickets.
 */
-void uart_helper_send_string(UartHelper* helper, FuriString* string);
+uint32_t uart_helper_tx_sent(UartHelper* helper);
 
 /**
  * Frees the UartHelper & enables log messages.
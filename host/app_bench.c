@@ -0,0 +1,1403 @@
+/**
+ * Benchmark harness for the Ollama app logic on the host.  Runs the ring buffer, the
+ * UART line reader, process_line (through injected ESP32 output), the key handler and
+ * the draw callback at native speed and prints the cost of each.
+ *
+ * With "pipeline" it instead drives the whole Flipper -> ESP32 -> server path: the
+ * firmware runs as a child process on the other end of a pty, talking to a real HTTP
+ * server, and per-segment latency comes from the app's own latency spans.  "batch"
+ * runs a generated prompt file through batch mode over the same path and reports
+ * prompts per minute with the given number of prompts in flight.
+ *
+ * The pipeline run also captures its UART traffic; "replay" feeds such a capture, or
+ * one taken on a Flipper, back through the UART helper, process_line and the draw
+ * callback, at the pace it was recorded or, with "max", as fast as they take it.
+ *
+ * "search" grows a chat archive of generated messages and, at each size, times the same
+ * searches through its index and by reading the whole archive, the way it would be
+ * searched without one.
+ *
+ * Usage: app_bench [iterations]
+ *        app_bench pipeline <firmware> <server url> [prompts]
+ *        app_bench batch <firmware> <server url> [prompts] [in flight]
+ *        app_bench replay <capture file> [max]
+ *        app_bench search [messages]
+*/
+
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <storage/storage.h>
+
+#include "ollama_app_i.h"
+#include "ui.h"
+#include "wifi.h"
+#include "latency.h"
+#include "telemetry.h"
+#include "capture.h"
+#include "batch.h"
+#include "chat.h"
+#include "search.h"
+#include "context.h"
+#include "trace.h"
+#include "helpers/ring_buffer.h"
+#include "helpers/uart_helper.h"
+#include "host_uart.h"
+
+static uint64_t now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static void report(const char* name, uint64_t elapsed_ns, uint32_t operations, const char* unit) {
+    printf(
+        "%-28s %10u %-6s %10.1f ns/op %12.0f op/s\n",
+        name,
+        operations,
+        unit,
+        (double)elapsed_ns / operations,
+        operations * 1e9 / (double)elapsed_ns);
+}
+
+// Waits until predicate(context) holds or timeout_ms passes; true if it held.
+static bool wait_for(bool (*predicate)(void*), void* context, uint32_t timeout_ms) {
+    uint64_t deadline = now_ns() + (uint64_t)timeout_ms * 1000000ULL;
+    while(!predicate(context)) {
+        if(now_ns() > deadline) return false;
+        sched_yield();
+    }
+    return true;
+}
+
+static void inject_str(const char* str) {
+    host_uart_inject((const uint8_t*)str, strlen(str));
+}
+
+// Stands in for the app's main loop, which the benches do not run: when the UART worker
+// wakes it, it does what the worker left for it, under the screen mutex as the loop does
+typedef struct {
+    OllamaAppState* state;
+    FuriThread* thread;
+    atomic_bool stop;
+} MainLoop;
+
+static int32_t main_loop_run(void* context) {
+    MainLoop* loop = context;
+    OllamaAppEvent event;
+    while(!atomic_load(&loop->stop)) {
+        // Only on a wake, so it never runs under a bench switching screens
+        if(furi_message_queue_get(loop->state->event_queue, &event, 10) != FuriStatusOk ||
+           event.type != EventTypeWake) {
+            continue;
+        }
+        furi_mutex_acquire(loop->state->screen_mutex, FuriWaitForever);
+        chat_reply_flush(loop->state);
+        wifi_scan_cache_flush(loop->state);
+        context_pump(loop->state);
+        batch_pump(loop->state);
+        furi_mutex_release(loop->state->screen_mutex);
+    }
+    return 0;
+}
+
+static void main_loop_start(MainLoop* loop, OllamaAppState* state) {
+    loop->state = state;
+    atomic_store(&loop->stop, false);
+    // The FAP's stack_size from application.fam
+    loop->thread = furi_thread_alloc_ex("MainLoop", 2 * 1024, main_loop_run, loop);
+    furi_thread_start(loop->thread);
+    // Telemetry measures the app stack on this thread, as it does the FAP's on the device
+    state->main_thread = furi_thread_get_id(loop->thread);
+}
+
+static void main_loop_stop(MainLoop* loop) {
+    loop->state->main_thread = NULL;
+    atomic_store(&loop->stop, true);
+    furi_thread_join(loop->thread);
+    furi_thread_free(loop->thread);
+}
+
+static void tx_count_hook(const uint8_t* data, size_t length, void* context) {
+    UNUSED(data);
+    *(size_t*)context += length;
+}
+
+static void bench_ring_buffer(uint32_t iterations) {
+    RingBuffer* rb = ring_buffer_alloc();
+    FuriString* line = furi_string_alloc();
+    uint8_t data[] = "NETWORK:HomeNetwork_5G,-42\n";
+
+    uint64_t start = now_ns();
+    for(uint32_t i = 0; i < iterations; i++) {
+        ring_buffer_add(rb, data, sizeof(data) - 1);
+        size_t index = ring_buffer_find_delim(rb);
+        if(index != FURI_STRING_FAILURE) {
+            ring_buffer_extract_line(rb, index, line);
+        }
+    }
+    report("ring_buffer add+extract", now_ns() - start, iterations, "lines");
+
+    furi_string_free(line);
+    ring_buffer_free(rb);
+}
+
+typedef struct {
+    atomic_uint lines;
+    uint32_t expected;
+} LineCounter;
+
+static void count_line(FuriString* line, void* context) {
+    UNUSED(line);
+    LineCounter* counter = context;
+    atomic_fetch_add(&counter->lines, 1);
+}
+
+static bool counter_reached(void* context) {
+    LineCounter* counter = context;
+    return atomic_load(&counter->lines) >= counter->expected;
+}
+
+// The ESP32 end of the flow control: XOFF from the app pauses it until XON
+typedef struct {
+    atomic_bool paused;
+} FlowPeer;
+
+static void flow_peer_hook(const uint8_t* data, size_t length, void* context) {
+    FlowPeer* peer = context;
+    for(size_t i = 0; i < length; i++) {
+        if(data[i] == 0x13) atomic_store(&peer->paused, true);
+        if(data[i] == 0x11) atomic_store(&peer->paused, false);
+    }
+}
+
+static bool flow_peer_resumed(void* context) {
+    FlowPeer* peer = context;
+    return !atomic_load(&peer->paused);
+}
+
+static void bench_uart_helper(uint32_t iterations) {
+    UartHelper* helper = uart_helper_alloc();
+    LineCounter counter = {.lines = 0};
+    uart_helper_set_callback(helper, count_line, &counter);
+    const char* line = "Ollama: \"The quick brown fox jumps over the lazy dog.\"\n";
+
+    // One line at a time: ISR -> stream buffer -> worker -> callback latency
+    uint64_t start = now_ns();
+    for(uint32_t i = 0; i < iterations; i++) {
+        inject_str(line);
+        counter.expected = i + 1;
+        if(!wait_for(counter_reached, &counter, 1000)) break;
+    }
+    report("uart_helper line latency", now_ns() - start, iterations, "lines");
+
+    // Back to back: how many lines survive when the worker falls behind, first from a
+    // sender that ignores XOFF, then from one that pauses like the ESP32 sketch does
+    for(int honour = 0; honour < 2; honour++) {
+        FlowPeer peer = {.paused = false};
+        UartHelperStats before, after;
+        host_uart_set_tx_hook(honour ? flow_peer_hook : NULL, &peer);
+        uart_helper_get_stats(helper, &before);
+
+        atomic_store(&counter.lines, 0);
+        counter.expected = iterations;
+        start = now_ns();
+        for(uint32_t i = 0; i < iterations; i++) {
+            wait_for(flow_peer_resumed, &peer, 2000);
+            inject_str(line);
+        }
+        wait_for(counter_reached, &counter, 500);
+        uint32_t delivered = atomic_load(&counter.lines);
+        uart_helper_get_stats(helper, &after);
+
+        report(honour ? "uart_helper burst XON/XOFF" : "uart_helper burst", now_ns() - start,
+               iterations, "lines");
+        printf("%-28s %10u of %u lines delivered, %lu bytes dropped, %lu XOFF, high %lu/%lu\n",
+               "", delivered, iterations,
+               (unsigned long)(after.rx_dropped - before.rx_dropped),
+               (unsigned long)(after.xoff_sent - before.xoff_sent),
+               (unsigned long)after.rx_high_water, (unsigned long)after.rx_capacity);
+    }
+    host_uart_set_tx_hook(NULL, NULL);
+
+    uart_helper_free(helper);
+}
+
+static void tx_drained(uint32_t sent, void* context) {
+    atomic_store((_Atomic uint32_t*)context, sent);
+}
+
+typedef struct {
+    _Atomic uint32_t* sent;
+    uint32_t ticket;
+} TxWait;
+
+static bool tx_ticket_reached(void* context) {
+    TxWait* wait = context;
+    return atomic_load(wait->sent) >= wait->ticket;
+}
+
+static void bench_uart_tx(void) {
+    static const uint32_t bauds[] = {9600, 115200};
+    char payload[1000];
+    memset(payload, 'x', sizeof(payload) - 2);
+    payload[sizeof(payload) - 2] = '\r';
+    payload[sizeof(payload) - 1] = '\n';
+
+    // With wire time on, a blocking send would hold the caller for ~1 s at 9600 baud
+    host_uart_set_wire_time(true);
+    for(size_t b = 0; b < COUNT_OF(bauds); b++) {
+        UartHelper* helper = uart_helper_alloc();
+        _Atomic uint32_t sent = 0;
+        uart_helper_set_tx_callback(helper, tx_drained, &sent);
+        uart_helper_set_baud_rate(helper, bauds[b]);
+
+        uint64_t start = now_ns();
+        TxWait wait = {.sent = &sent, .ticket = uart_helper_send(helper, payload, sizeof(payload))};
+        uint64_t returned = now_ns() - start;
+        wait_for(tx_ticket_reached, &wait, 5000);
+        uint64_t drained = now_ns() - start;
+
+        char name[32];
+        snprintf(name, sizeof(name), "uart send 1KB @%lu", (unsigned long)bauds[b]);
+        report(name, returned, 1, "calls");
+        snprintf(name, sizeof(name), "  on the wire @%lu", (unsigned long)bauds[b]);
+        report(name, drained, 1, "messages");
+        uart_helper_free(helper);
+    }
+
+    // A message longer than the queue is refused outright rather than waited for
+    char large[4096];
+    memset(large, 'y', sizeof(large));
+    UartHelper* helper = uart_helper_alloc();
+    if(uart_helper_send(helper, large, sizeof(large)) != 0 || uart_helper_tx_pending(helper) != 0) {
+        printf("uart send 4KB: queued, expected refused\n");
+    }
+    uart_helper_free(helper);
+    host_uart_set_wire_time(false);
+}
+
+static bool scan_finished(void* context) {
+    OllamaAppState* state = context;
+    return state->current_state != AppStateWifiScan && (!state->wifi || !state->wifi->cache_dirty);
+}
+
+typedef struct {
+    OllamaAppState* state;
+    uint8_t count;
+} ChatWait;
+
+static bool chat_reply_arrived(void* context) {
+    ChatWait* wait = context;
+    return wait->state->chat->message_count != wait->count;
+}
+
+static void bench_process_line(OllamaAppState* state, uint32_t iterations) {
+    char line[64];
+
+    // A scan is more than the RX buffer holds, so it is sent the way the ESP32 does,
+    // pausing on XOFF
+    FlowPeer peer = {.paused = false};
+    host_uart_set_tx_hook(flow_peer_hook, &peer);
+
+    // A full scan: every network seen from two BSSIDs in no particular order, then
+    // SCAN_COMPLETE; the table should hold each SSID once, strongest first
+    uint64_t start = now_ns();
+    for(uint32_t i = 0; i < iterations; i++) {
+        wifi_scan(state);
+        for(int n = 0; n < MAX_NETWORKS * 2; n++) {
+            snprintf(line, sizeof(line), "NETWORK:Network%02d,-%d\n", (n * 7) % MAX_NETWORKS, 40 + (n * 13) % 50);
+            wait_for(flow_peer_resumed, &peer, 2000);
+            inject_str(line);
+        }
+        inject_str("SCAN_COMPLETE\n");
+        if(!wait_for(scan_finished, state, 1000)) break;
+    }
+    report("process_line scan", now_ns() - start, iterations, "scans");
+    for(uint8_t n = 1; n < state->wifi->network_count; n++) {
+        if(state->wifi->networks[n].rssi > state->wifi->networks[n - 1].rssi) {
+            fprintf(stderr, "scan table out of order at %u\n", n);
+        }
+    }
+    if(state->wifi->network_count != MAX_NETWORKS) {
+        fprintf(stderr, "scan table has %u networks, expected %u\n", state->wifi->network_count, MAX_NETWORKS);
+    }
+
+    // Reopening the picker shows the cached table before the ESP32 has answered
+    start = now_ns();
+    for(uint32_t i = 0; i < iterations; i++) {
+        wifi_scan(state);
+        if(state->wifi->network_count != MAX_NETWORKS) {
+            fprintf(stderr, "picker opened with %u cached networks, expected %u\n",
+                    state->wifi->network_count, MAX_NETWORKS);
+            break;
+        }
+    }
+    report("wifi_scan cached picker", now_ns() - start, iterations, "opens");
+
+    // A scan that sees half of them, all weaker now, replaces the cached rows it saw
+    // and drops the rest when it completes
+    for(int n = 0; n < MAX_NETWORKS; n += 2) {
+        snprintf(line, sizeof(line), "NETWORK:Network%02d,-%d\n", n, 90 - n / 2);
+        wait_for(flow_peer_resumed, &peer, 2000);
+        inject_str(line);
+    }
+    inject_str("SCAN_COMPLETE\n");
+    if(wait_for(scan_finished, state, 1000)) {
+        WifiScreen* wifi = state->wifi;
+        bool merged = wifi->network_count == MAX_NETWORKS / 2;
+        for(uint8_t n = 0; n < wifi->network_count; n++) {
+            merged = merged && !wifi->networks[n].cached && (n == 0 || wifi->networks[n].rssi <= wifi->networks[n - 1].rssi);
+        }
+        if(!merged) {
+            fprintf(stderr, "scan did not replace the cached table (%u networks)\n", wifi->network_count);
+        }
+    }
+    host_uart_set_tx_hook(NULL, NULL);
+
+    // Chat replies delivered while the chat screen is open
+    ollama_app_set_state(state, AppStateChat);
+    start = now_ns();
+    for(uint32_t i = 0; i < iterations; i++) {
+        ChatWait wait = {.state = state, .count = state->chat->message_count};
+        if(wait.count >= MAX_CHAT_MESSAGES) {
+            // Once full, the count stays put; clear it so arrival is observable
+            state->chat->message_count = 0;
+            wait.count = 0;
+        }
+        inject_str("Ollama: \"I am a response from the mock server.\"\n");
+        if(!wait_for(chat_reply_arrived, &wait, 1000)) break;
+    }
+    report("process_line chat reply", now_ns() - start, iterations, "lines");
+}
+
+static void bench_trace(uint32_t iterations) {
+    uint64_t start = now_ns();
+    for(uint32_t i = 0; i < iterations; i++) {
+        trace_record(TraceEventUartRx, i, i);
+    }
+    report("trace_record", now_ns() - start, iterations, "events");
+
+    start = now_ns();
+    bool saved = trace_dump();
+    report(saved ? "trace_dump" : "trace_dump (failed)", now_ns() - start, 1, "dumps");
+}
+
+static void bench_completion(uint32_t iterations) {
+    static const char* const prefixes[] = {"w", "wh", "wha", "what", "ex", "pyt", "q", "tell me"};
+    char words[16];
+    char suggestions[COMPLETION_SUGGESTIONS][COMPLETION_MAX_LENGTH];
+
+    // Fill the trie to capacity with made-up words of mixed weight
+    Completion* completion = completion_alloc(COMPLETION_MAX_NODES);
+    uint32_t added = 0;
+    uint64_t start = now_ns();
+    for(uint32_t i = 0; i < 5000; i++) {
+        snprintf(words, sizeof(words), "w%c%c%lu", 'a' + i % 26, 'a' + i / 26 % 26, (unsigned long)i % 7);
+        if(completion_add(completion, words, 1 + i % 13)) added++;
+    }
+    completion_add(completion, "what", 40);
+    completion_add(completion, "tell me a joke", 3);
+    report("completion_add", now_ns() - start, 5000, "words");
+    printf("%-28s %10u entries, %u nodes\n", "", added, completion_node_count(completion));
+
+    uint32_t found = 0;
+    start = now_ns();
+    for(uint32_t i = 0; i < iterations; i++) {
+        const char* prefix = prefixes[i % COUNT_OF(prefixes)];
+        found += completion_lookup(
+            completion, prefix, strlen(prefix), suggestions[0], COMPLETION_MAX_LENGTH, COMPLETION_SUGGESTIONS);
+    }
+    report("completion_lookup", now_ns() - start, iterations, "lookups");
+    completion_free(completion);
+    UNUSED(found);
+}
+
+static void press(OllamaAppState* state, InputKey key, InputType type) {
+    InputEvent event = {.key = key, .type = type};
+    furi_mutex_acquire(state->screen_mutex, FuriWaitForever);
+    ollama_app_handle_key_event(state, &event);
+    furi_mutex_release(state->screen_mutex);
+}
+
+static void bench_key_events(OllamaAppState* state, uint32_t iterations) {
+    uint64_t start = now_ns();
+    uint32_t events = 0;
+    for(uint32_t i = 0; i < iterations; i++) {
+        ollama_app_set_state(state, AppStateMainMenu);
+        state->menu_index = 0;
+        press(state, InputKeyDown, InputTypeShort);
+        press(state, InputKeyUp, InputTypeShort);
+        events += 2;
+
+        // Type a short prompt, move the cursor and send it.  Keys without a chat
+        // binding insert a character.
+        ollama_app_set_state(state, AppStateChat);
+        for(int c = 0; c < 12; c++) {
+            press(state, InputKeyBack, InputTypeShort);
+        }
+        press(state, InputKeyLeft, InputTypeShort);
+        press(state, InputKeyRight, InputTypeShort);
+        press(state, InputKeyOk, InputTypeShort);
+        events += 15;
+    }
+    report("handle_key_event", now_ns() - start, events, "events");
+
+    // Back leaves the scan list, whether the scan is still running or not
+    static const AppState scan_states[] = {AppStateWifiScan, AppStateWifiSelect};
+    for(size_t i = 0; i < COUNT_OF(scan_states); i++) {
+        ollama_app_set_state(state, scan_states[i]);
+        press(state, InputKeyBack, InputTypeShort);
+        if(state->current_state != AppStateMainMenu) {
+            printf("%-28s Back in %s went to %s, expected main_menu\n", "handle_key_event",
+                   ollama_app_state_name(scan_states[i]), ollama_app_state_name(state->current_state));
+        }
+    }
+}
+
+static bool viewer_open(void* context) {
+    OllamaAppState* state = context;
+    return state->current_state == AppStateResponseView;
+}
+
+static void bench_reply_spool(OllamaAppState* state, uint32_t iterations) {
+    // A 128-row reply as the ESP32 sends it: one PART line per wrapped row, then the
+    // closing Ollama line
+    char part[64];
+    memset(part, 0, sizeof(part));
+    memcpy(part, "PART:", 5);
+    memset(part + 5, 'w', 24);
+    part[29] = '\n';
+
+    FlowPeer peer = {.paused = false};
+    host_uart_set_tx_hook(flow_peer_hook, &peer);
+    ollama_app_set_state(state, AppStateChat);
+    uint64_t start = now_ns();
+    for(uint32_t i = 0; i < iterations; i++) {
+        ChatWait wait = {.state = state, .count = state->chat->message_count};
+        if(wait.count >= MAX_CHAT_MESSAGES) {
+            state->chat->message_count = 0;
+            wait.count = 0;
+        }
+        for(int p = 0; p < 127; p++) {
+            wait_for(flow_peer_resumed, &peer, 2000);
+            inject_str(part);
+        }
+        inject_str("Ollama: \"the end\"\n");
+        if(!wait_for(chat_reply_arrived, &wait, 1000)) break;
+    }
+    report("spool 128-row reply", now_ns() - start, iterations, "replies");
+    host_uart_set_tx_hook(NULL, NULL);
+    furi_mutex_acquire(state->screen_mutex, FuriWaitForever);
+    uint32_t rows = state->chat->messages[state->chat->message_count - 1].spool_rows;
+    furi_mutex_release(state->screen_mutex);
+    if(rows != 128) {
+        printf("%-28s %lu rows spooled, expected 128\n", "", (unsigned long)rows);
+    }
+
+    // Page flips only read the visible page, wherever it is in the reply
+    press(state, InputKeyRight, InputTypeLong);
+    if(!viewer_open(state)) {
+        printf("%-28s no spooled reply to view\n", "");
+        return;
+    }
+    uint32_t flips = 0;
+    start = now_ns();
+    for(uint32_t i = 0; i < iterations; i++) {
+        for(int p = 0; p < 8; p++) {
+            press(state, InputKeyDown, InputTypeShort);
+        }
+        for(int p = 0; p < 8; p++) {
+            press(state, InputKeyUp, InputTypeShort);
+        }
+        flips += 16;
+    }
+    report("reply page flip", now_ns() - start, flips, "pages");
+    press(state, InputKeyBack, InputTypeShort);
+}
+
+static void bench_screen_switch(OllamaAppState* state, uint32_t iterations) {
+    // Entering and leaving a screen allocates and frees its whole arena
+    uint64_t start = now_ns();
+    for(uint32_t i = 0; i < iterations; i++) {
+        ollama_app_set_state(state, AppStateChat);
+        ollama_app_set_state(state, AppStateWifiScan);
+        ollama_app_set_state(state, AppStateMainMenu);
+    }
+    report("screen switch", now_ns() - start, iterations * 3, "switches");
+}
+
+static void print_heap_report(OllamaAppState* state) {
+    printf("%-28s %10s %10s\n", "heap high-water", "heap", "arena");
+    for(AppState app_state = 0; app_state < AppStateCount; app_state++) {
+        printf(
+            "  %-26s %10u %10u\n",
+            ollama_app_state_name(app_state),
+            (unsigned)state->heap_peak[app_state],
+            (unsigned)state->arena_peak[app_state]);
+    }
+    printf("%-28s %10zu bytes\n", "resident OllamaAppState", sizeof(OllamaAppState));
+}
+
+static void bench_draw(OllamaAppState* state, uint32_t iterations) {
+    static const struct {
+        AppState state;
+        const char* name;
+    } screens[] = {
+        {AppStateMainMenu, "draw main menu"},
+        {AppStateChat, "draw chat"},
+        {AppStateWifiSelect, "draw wifi select"},
+        {AppStateWifiPassword, "draw keyboard"},
+        {AppStateLatencyStats, "draw latency stats"},
+    };
+    Canvas* canvas = host_canvas_alloc();
+
+    for(size_t s = 0; s < COUNT_OF(screens); s++) {
+        ollama_app_set_state(state, screens[s].state);
+        uint64_t start = now_ns();
+        for(uint32_t i = 0; i < iterations; i++) {
+            ollama_app_draw_callback(canvas, state);
+        }
+        report(screens[s].name, now_ns() - start, iterations, "frames");
+    }
+
+    host_canvas_free(canvas);
+}
+
+static uint32_t count_file_lines(const char* path) {
+    Storage* storage = furi_record_open(RECORD_STORAGE);
+    File* file = storage_file_alloc(storage);
+    uint32_t lines = 0;
+    if(storage_file_open(file, path, FSAM_READ, FSOM_OPEN_EXISTING)) {
+        char buffer[64];
+        size_t length;
+        while((length = storage_file_read(file, buffer, sizeof(buffer))) > 0) {
+            for(size_t i = 0; i < length; i++) {
+                lines += buffer[i] == '\n';
+            }
+        }
+    }
+    storage_file_close(file);
+    storage_file_free(file);
+    furi_record_close(RECORD_STORAGE);
+    return lines;
+}
+
+static void bench_telemetry(OllamaAppState* state, uint32_t iterations) {
+    // Runs on the main loop once a second while the stats screen is open
+    uint64_t start = now_ns();
+    for(uint32_t i = 0; i < iterations; i++) {
+        telemetry_sample(state);
+    }
+    report("telemetry sample", now_ns() - start, iterations, "samples");
+
+    // With SD logging on, a due request's reply is one row of the log
+    Storage* storage = furi_record_open(RECORD_STORAGE);
+    storage_simply_remove(storage, TELEMETRY_LOG_PATH);
+    furi_record_close(RECORD_STORAGE);
+    memset(&state->telemetry, 0, sizeof(Telemetry));
+    state->latency.log_to_sd = true;
+    telemetry_poll(state);
+    telemetry_set_esp(state, "201000,150000,90000,2100,3050,-1,-61");
+    telemetry_flush_log(state);
+    state->latency.log_to_sd = false;
+
+    Telemetry* telemetry = &state->telemetry;
+    if(telemetry->esp_heap_block != 90000 || telemetry->esp_probe_stack != 3050 ||
+       telemetry->esp_batch_stack != -1 || telemetry->esp_rssi != -61) {
+        printf("%-28s reply parsed as %lu,%lu,%ld,%ld, expected 90000,3050,-1,-61\n", "telemetry",
+               (unsigned long)telemetry->esp_heap_block, (unsigned long)telemetry->esp_probe_stack,
+               (long)telemetry->esp_batch_stack, (long)telemetry->esp_rssi);
+    }
+    uint32_t lines = count_file_lines(TELEMETRY_LOG_PATH);
+    if(lines != 2) {
+        printf("%-28s %lu lines in %s, expected a header and one row\n", "telemetry",
+               (unsigned long)lines, TELEMETRY_LOG_PATH);
+    }
+    printf("%-28s heap %lu free, block %lu, stack %lu app / %lu uart worker\n", "telemetry",
+           (unsigned long)telemetry->heap_free, (unsigned long)telemetry->heap_block,
+           (unsigned long)telemetry->app_stack, (unsigned long)telemetry->uart_stack);
+}
+
+static void bench_chat_archive(OllamaAppState* state, uint32_t iterations) {
+    // The main loop archives each message the chat adds, a reply from its spool
+    ollama_app_set_state(state, AppStateChat);
+    char message[MAX_MESSAGE_LENGTH];
+    uint64_t start = now_ns();
+    for(uint32_t i = 0; i < iterations; i++) {
+        snprintf(message, sizeof(message), "question %lu about the zebra k%lu", (unsigned long)i,
+                 (unsigned long)i % 7);
+        add_chat_message(state, message, i % 2 == 0);
+        chat_archive_flush(state);
+    }
+    report("chat_archive_flush", now_ns() - start, iterations, "messages");
+
+    // Found again from the search screen, newest first
+    ollama_app_set_state(state, AppStateMainMenu);
+    state->menu_index = 5;
+    press(state, InputKeyOk, InputTypeShort);
+    SearchScreen* search = state->search;
+    if(!search || !search->archive) {
+        printf("%-28s no archive to search\n", "search");
+        return;
+    }
+    strncpy(search->query, "ZEBRA K3", SEARCH_QUERY_LENGTH - 1);
+    start = now_ns();
+    for(uint32_t i = 0; i < iterations; i++) {
+        search_run(state);
+    }
+    report("search screen query", now_ns() - start, iterations, "queries");
+
+    uint32_t newest = iterations - 1;
+    while(newest > 0 && newest % 7 != 3) {
+        newest--;
+    }
+    snprintf(message, sizeof(message), "question %lu about the zebra k3", (unsigned long)newest);
+    if(search->hit_count == 0 || !strstr(search->rows[0], message)) {
+        printf("%-28s first hit \"%s\", expected \"%s\"\n", "search",
+               search->hit_count ? search->rows[0] : "", message);
+    }
+    printf("%-28s %u hits, %lu postings in %lu reads, archive %lu KB\n", "search", search->hit_count,
+           (unsigned long)search->stats.postings, (unsigned long)search->stats.reads,
+           (unsigned long)archive_size(search->archive) / 1024);
+    ollama_app_set_state(state, AppStateMainMenu);
+}
+
+// The ESP32 end of a file upload: keeps what the app sends, command and file alike
+typedef struct {
+    char* data;
+    size_t capacity;
+    atomic_size_t length;
+} UploadPeer;
+
+static void upload_peer_hook(const uint8_t* data, size_t length, void* context) {
+    UploadPeer* peer = context;
+    size_t used = atomic_load(&peer->length);
+    if(used + length <= peer->capacity) {
+        memcpy(peer->data + used, data, length);
+        atomic_store(&peer->length, used + length);
+    }
+}
+
+typedef struct {
+    OllamaAppState* state;
+    UploadPeer* peer;
+    size_t expected;
+} UploadWait;
+
+// Stands in for the main loop, which retries chunks the TX queue had no room for
+static bool upload_received(void* context) {
+    UploadWait* wait = context;
+    furi_mutex_acquire(wait->state->screen_mutex, FuriWaitForever);
+    context_pump(wait->state);
+    furi_mutex_release(wait->state->screen_mutex);
+    return atomic_load(&wait->peer->length) >= wait->expected;
+}
+
+static bool upload_closed(void* context) {
+    OllamaAppState* state = context;
+    return state->chat->context.file == NULL;
+}
+
+static void bench_context_upload(OllamaAppState* state, uint32_t size, size_t* tx_bytes) {
+    // A log with flow control bytes in it, which must not reach the ESP32 as such
+    char* file = malloc(size);
+    for(uint32_t i = 0; i < size; i++) {
+        file[i] = i % 64 == 63 ? '\n' : i % 1000 == 500 ? 0x13 : i % 1000 == 700 ? CONTEXT_ESCAPE : 'a' + i % 26;
+    }
+    // What the ESP32 should get, and what FILE_ACK counts
+    char* line = malloc(size * 2);
+    uint32_t line_length = 0;
+    for(uint32_t i = 0; i < size; i++) {
+        if(file[i] == 0x11 || file[i] == 0x13 || file[i] == CONTEXT_ESCAPE) {
+            line[line_length++] = CONTEXT_ESCAPE;
+            line[line_length++] = file[i] ^ 0x20;
+        } else {
+            line[line_length++] = file[i];
+        }
+    }
+    Storage* storage = furi_record_open(RECORD_STORAGE);
+    File* output = storage_file_alloc(storage);
+    if(storage_file_open(output, CONTEXT_FILE_PATH, FSAM_WRITE, FSOM_CREATE_ALWAYS)) {
+        storage_file_write(output, file, size);
+    }
+    storage_file_free(output);
+    furi_record_close(RECORD_STORAGE);
+
+    UploadPeer peer = {.data = malloc(line_length + 256), .capacity = line_length + 256, .length = 0};
+    host_uart_set_tx_hook(upload_peer_hook, &peer);
+    ollama_app_set_state(state, AppStateChat);
+    strncpy(state->chat->current_message, "SUMMARIZE THIS LOG", MAX_MESSAGE_LENGTH - 1);
+    press(state, InputKeyOk, InputTypeLong);
+
+    char command[64];
+    int command_length = snprintf(command, sizeof(command), "FILE %lu SUMMARIZE THIS LOG\r\n", (unsigned long)size);
+    UploadWait wait = {.state = state, .peer = &peer, .expected = command_length};
+    bool ok = wait_for(upload_received, &wait, 1000) && memcmp(peer.data, command, command_length) == 0;
+
+    // Acknowledges every CONTEXT_CHUNK_SIZE bytes on the line as the ESP32 does once it has
+    // forwarded them
+    uint32_t acked = 0;
+    uint32_t most_ahead = 0;
+    uint64_t start = now_ns();
+    inject_str("FILE_ACK:0\n");
+    while(ok && acked < line_length) {
+        wait.expected = command_length + (acked + CONTEXT_CHUNK_SIZE < line_length ? acked + CONTEXT_CHUNK_SIZE : line_length);
+        ok = wait_for(upload_received, &wait, 1000);
+        size_t ahead = atomic_load(&peer.length) - command_length - acked;
+        if(ahead > most_ahead) most_ahead = ahead;
+        acked = wait.expected - command_length;
+        char ack[24];
+        snprintf(ack, sizeof(ack), "FILE_ACK:%lu\n", (unsigned long)acked);
+        inject_str(ack);
+    }
+    ok = ok && wait_for(upload_closed, state, 1000);
+    uint64_t elapsed = now_ns() - start;
+
+    if(!ok || atomic_load(&peer.length) != command_length + line_length ||
+       memcmp(peer.data + command_length, line, line_length) != 0) {
+        printf("%-28s %lu of %lu bytes arrived, expected all of them as sent\n", "context upload",
+               (unsigned long)(atomic_load(&peer.length) - command_length), (unsigned long)line_length);
+    } else {
+        report("context upload", elapsed, size / 1024, "KB");
+        printf("%-28s at most %lu bytes ahead of FILE_ACK, window %u, chat arena %lu bytes\n", "",
+               (unsigned long)most_ahead, CONTEXT_WINDOW, (unsigned long)state->arena_peak[AppStateChat]);
+    }
+
+    // The server turning the question down once it has all of the file is not the file
+    // failing to go, and the chat gets no note about it
+    ChatWait stale = {.state = state, .count = state->chat->message_count};
+    inject_str("FILE_FAILED:500\n");
+    if(wait_for(chat_reply_arrived, &stale, 200)) {
+        printf("%-28s FILE_FAILED after the upload added \"%s\"\n", "context upload",
+               state->chat->messages[state->chat->message_count - 1].content);
+    }
+
+    *tx_bytes += atomic_load(&peer.length);
+    host_uart_set_tx_hook(tx_count_hook, tx_bytes);
+    free(peer.data);
+    free(line);
+    free(file);
+    ollama_app_set_state(state, AppStateMainMenu);
+}
+
+static bool model_warm(void* context) {
+    OllamaAppState* state = context;
+    return state->model_warm;
+}
+
+static bool reply_delivered(void* context) {
+    OllamaAppState* state = context;
+    return state->latency.current.delivered != 0;
+}
+
+typedef struct {
+    OllamaAppState* state;
+    uint8_t sample_next;
+} SampleWait;
+
+static bool sample_committed(void* context) {
+    SampleWait* wait = context;
+    return wait->state->latency.sample_next != wait->sample_next;
+}
+
+static bool telemetry_reported(void* context) {
+    OllamaAppState* state = context;
+    return state->telemetry.esp_reported;
+}
+
+static void write_server_url(const char* url) {
+    Storage* storage = furi_record_open(RECORD_STORAGE);
+    File* file = storage_file_alloc(storage);
+    if(storage_file_open(file, URL_FILE_PATH, FSAM_WRITE, FSOM_CREATE_ALWAYS)) {
+        storage_file_write(file, url, strlen(url));
+    }
+    storage_file_free(file);
+    furi_record_close(RECORD_STORAGE);
+}
+
+// Runs the firmware on the other end of a pty; -1 if there is no pty
+static pid_t start_firmware(const char* firmware) {
+    char pty_name[64];
+    if(!host_uart_open_pty(pty_name, sizeof(pty_name))) {
+        fprintf(stderr, "could not open a pty\n");
+        return -1;
+    }
+
+    pid_t child = fork();
+    if(child == 0) {
+        setenv("ESP32_SHIM_SERIAL", pty_name, 1);
+        execl(firmware, firmware, (char*)NULL);
+        perror(firmware);
+        _exit(127);
+    }
+    return child;
+}
+
+static void stop_firmware(pid_t child) {
+    kill(child, SIGTERM);
+    waitpid(child, NULL, 0);
+    host_uart_close_pty();
+}
+
+static bool connect_answered(void* context) {
+    OllamaAppState* state = context;
+    return state->connect.phase == WifiConnectDone || state->connect.phase == WifiConnectFailed;
+}
+
+// Associates, then opens the main menu item that sends the URL and warms the model
+static void open_from_menu(OllamaAppState* state, uint8_t menu_index) {
+    furi_delay_ms(200);
+    strncpy(state->wifi_ssid, "HostNetwork", MAX_SSID_LENGTH - 1);
+    ollama_app_set_state(state, AppStateWifiPassword);
+    strncpy(state->wifi->password, "password", MAX_PASSWORD_LENGTH - 1);
+    wifi_connect(state);
+    if(!wait_for(connect_answered, state, WIFI_CONNECT_TIMEOUT_MS) || !state->wifi_connected) {
+        fprintf(stderr, "no CONNECTED from the firmware\n");
+    } else {
+        printf("connect %lu ms (ESP32 %lu ms), %s\n", (unsigned long)state->connect.total_ms,
+               (unsigned long)state->connect.esp_ms, state->connect.ip);
+    }
+    // Leaving the screen saves the network, as the main loop would on its next tick
+    furi_mutex_acquire(state->screen_mutex, FuriWaitForever);
+    ollama_app_set_state(state, AppStateMainMenu);
+    furi_mutex_release(state->screen_mutex);
+    state->menu_index = menu_index;
+    press(state, InputKeyOk, InputTypeShort);
+}
+
+static int run_pipeline(const char* firmware, const char* url, uint32_t prompts) {
+    pid_t child = start_firmware(firmware);
+    if(child < 0) {
+        return 1;
+    }
+
+    OllamaAppState* state = malloc(sizeof(OllamaAppState));
+    ollama_app_state_init(state);
+    wifi_init();
+    MainLoop loop;
+    main_loop_start(&loop, state);
+    write_server_url(url);
+    Canvas* canvas = host_canvas_alloc();
+    open_from_menu(state, 2);
+    capture_start(state);
+
+    int status = 0;
+    uint64_t start = now_ns();
+    if(!wait_for(model_warm, state, 60000)) {
+        fprintf(stderr, "no WARMUP from the firmware\n");
+        status = 1;
+    } else {
+        printf("warm-up %lu ms (model load %lu ms)\n",
+               (unsigned long)state->warmup_ms, (unsigned long)state->warmup_load_ms);
+    }
+
+    uint32_t completed = 0;
+    start = now_ns();
+    for(uint32_t i = 0; i < prompts && status == 0; i++) {
+        for(int c = 0; c < 8; c++) {
+            press(state, InputKeyBack, InputTypeShort);
+        }
+        SampleWait wait = {.state = state, .sample_next = state->latency.sample_next};
+        press(state, InputKeyOk, InputTypeShort);
+        if(!wait_for(reply_delivered, state, 60000)) {
+            fprintf(stderr, "prompt %u: no reply\n", i);
+            status = 1;
+            break;
+        }
+        // The GUI thread would redraw now; do it here so the render span closes
+        ollama_app_draw_callback(canvas, state);
+        capture_flush(state);
+        furi_mutex_acquire(state->screen_mutex, FuriWaitForever);
+        chat_archive_flush(state);
+        furi_mutex_release(state->screen_mutex);
+        if(!wait_for(sample_committed, &wait, 5000)) {
+            fprintf(stderr, "prompt %u: no STATS\n", i);
+            status = 1;
+            break;
+        }
+        completed++;
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    if(completed > 0) {
+        report("pipeline prompt", elapsed, completed, "prompts");
+        printf("%-10s %8s %8s\n", "segment", "p50 ms", "p95 ms");
+        for(LatencySegment segment = 0; segment < LatencySegmentCount; segment++) {
+            printf(
+                "%-10s %8lu %8lu\n",
+                latency_segment_name(segment),
+                (unsigned long)latency_percentile(state, segment, 50),
+                (unsigned long)latency_percentile(state, segment, 95));
+        }
+    }
+
+    // Both sides' resources after the run, as the stats screen lists them
+    if(status == 0) {
+        ollama_app_set_state(state, AppStateLatencyStats);
+        telemetry_poll(state);
+        if(!wait_for(telemetry_reported, state, 5000)) {
+            fprintf(stderr, "no TELEMETRY from the firmware\n");
+            status = 1;
+        } else {
+            for(uint8_t row = 0; row < TELEMETRY_ROWS; row++) {
+                const char* name;
+                char values[24];
+                telemetry_row(state, row, &name, values, sizeof(values));
+                printf("%-16s %s\n", name, values);
+            }
+        }
+    }
+
+    if(trace_dump()) {
+        printf("trace written to %s\n", TRACE_FILE_PATH);
+    }
+    capture_stop(state);
+    UartHelperStats uart;
+    wifi_get_uart_stats(&uart);
+    printf("capture written to %s, %lu bytes, %lu chunks dropped\n", CAPTURE_FILE_PATH,
+           (unsigned long)state->capture.bytes, (unsigned long)uart.capture_dropped);
+
+    stop_firmware(child);
+    host_canvas_free(canvas);
+    main_loop_stop(&loop);
+    wifi_deinit();
+    ollama_app_state_free(state);
+    free(state);
+    return status;
+}
+
+static void write_batch_input(uint32_t prompts) {
+    Storage* storage = furi_record_open(RECORD_STORAGE);
+    File* file = storage_file_alloc(storage);
+    if(storage_file_open(file, BATCH_INPUT_PATH, FSAM_WRITE, FSOM_CREATE_ALWAYS)) {
+        char line[128];
+        for(uint32_t i = 0; i < prompts; i++) {
+            int len = snprintf(
+                line, sizeof(line), "{\"id\":%lu,\"prompt\":\"Question %lu: what does \\\"keep-alive\\\" do?\"}\n",
+                (unsigned long)i, (unsigned long)i);
+            storage_file_write(file, line, len);
+        }
+        // Skipped without a request
+        storage_file_write(file, "{\"id\":\"none\"}\n", 15);
+    }
+    storage_file_free(file);
+    furi_record_close(RECORD_STORAGE);
+}
+
+// Stands in for the main loop, which retries prompts the TX queue had no room for
+static bool batch_finished(void* context) {
+    OllamaAppState* state = context;
+    furi_delay_ms(10);
+    furi_mutex_acquire(state->screen_mutex, FuriWaitForever);
+    batch_pump(state);
+    bool finished = state->batch->finished;
+    furi_mutex_release(state->screen_mutex);
+    return finished;
+}
+
+static int run_batch(const char* firmware, const char* url, uint32_t prompts, uint8_t window) {
+    pid_t child = start_firmware(firmware);
+    if(child < 0) {
+        return 1;
+    }
+
+    OllamaAppState* state = malloc(sizeof(OllamaAppState));
+    ollama_app_state_init(state);
+    wifi_init();
+    MainLoop loop;
+    main_loop_start(&loop, state);
+    write_server_url(url);
+    write_batch_input(prompts);
+    open_from_menu(state, 4);
+
+    int status = 0;
+    if(!wait_for(model_warm, state, 60000)) {
+        fprintf(stderr, "no WARMUP from the firmware\n");
+        status = 1;
+    } else {
+        state->batch->window = window;
+        press(state, InputKeyOk, InputTypeShort);
+        if(!wait_for(batch_finished, state, 600000)) {
+            fprintf(stderr, "batch did not finish: %lu answered, %u in flight\n",
+                    (unsigned long)state->batch->answered, state->batch->in_flight);
+            status = 1;
+        }
+    }
+
+    BatchScreen* batch = state->batch;
+    if(status == 0) {
+        uint32_t rate = batch_rate_x10(batch);
+        printf("batch, %u in flight: %lu answered, %lu errors, %lu skipped in %lu ms, "
+               "%lu.%lu prompts/min\n",
+               batch->window, (unsigned long)batch->answered, (unsigned long)batch->errors,
+               (unsigned long)batch->skipped, (unsigned long)(batch->finish_tick - batch->start_tick),
+               (unsigned long)(rate / 10), (unsigned long)(rate % 10));
+        if(batch->answered != prompts || batch->skipped != 1) {
+            status = 1;
+        }
+    }
+
+    stop_firmware(child);
+    main_loop_stop(&loop);
+    wifi_deinit();
+    ollama_app_state_free(state);
+    free(state);
+    return status;
+}
+
+// The app's TX during a replay: counted, and XOFF honoured as the ESP32 would
+typedef struct {
+    FlowPeer flow;
+    size_t tx_bytes;
+} ReplayPeer;
+
+static void replay_tx_hook(const uint8_t* data, size_t length, void* context) {
+    ReplayPeer* peer = context;
+    flow_peer_hook(data, length, &peer->flow);
+    for(size_t i = 0; i < length; i++) {
+        peer->tx_bytes += data[i] != 0x11 && data[i] != 0x13;
+    }
+}
+
+static bool replay_rx_drained(void* context) {
+    UNUSED(context);
+    UartHelperStats uart;
+    wifi_get_uart_stats(&uart);
+    return uart.rx_waiting == 0;
+}
+
+// What the main loop does between events: redraw when process_line asked for it
+static void replay_redraw(OllamaAppState* state, Canvas* canvas, uint32_t* frames, uint64_t* draw_ns) {
+    if(!state->ui_update_needed) {
+        return;
+    }
+    state->ui_update_needed = false;
+    uint64_t start = now_ns();
+    ollama_app_draw_callback(canvas, state);
+    *draw_ns += now_ns() - start;
+    (*frames)++;
+}
+
+static int run_replay(const char* path, bool max_speed) {
+    FILE* file = fopen(path, "rb");
+    if(!file) {
+        fprintf(stderr, "could not open %s\n", path);
+        return 1;
+    }
+    CaptureFileHeader header;
+    if(fread(&header, sizeof(header), 1, file) != 1 || header.magic != CAPTURE_MAGIC ||
+       header.version != CAPTURE_VERSION || header.record_size != sizeof(UartCaptureRecord)) {
+        fprintf(stderr, "%s is not a version %d UART capture\n", path, CAPTURE_VERSION);
+        fclose(file);
+        return 1;
+    }
+
+    OllamaAppState* state = malloc(sizeof(OllamaAppState));
+    ollama_app_state_init(state);
+    wifi_init();
+    MainLoop loop;
+    main_loop_start(&loop, state);
+    Canvas* canvas = host_canvas_alloc();
+    ReplayPeer peer = {.flow.paused = false, .tx_bytes = 0};
+    host_uart_set_tx_hook(replay_tx_hook, &peer);
+    ollama_app_set_state(state, header.app_state < AppStateCount ? header.app_state : AppStateMainMenu);
+    wifi_listen(state);
+    UartHelperStats before;
+    wifi_get_uart_stats(&before);
+
+    static uint8_t data[UINT16_MAX];
+    UartCaptureRecord record;
+    uint32_t chunks = 0, lines = 0, frames = 0, first_tick = 0, last_tick = 0;
+    size_t rx_bytes = 0, captured_tx = 0;
+    uint64_t draw_ns = 0, late_ns = 0;
+    int status = 0;
+    uint64_t start = now_ns();
+    while(fread(&record, sizeof(record), 1, file) == 1) {
+        if(fread(data, 1, record.length, file) != record.length) {
+            fprintf(stderr, "%s ends inside a record\n", path);
+            status = 1;
+            break;
+        }
+        if(chunks++ == 0) {
+            first_tick = record.tick;
+        }
+        last_tick = record.tick;
+        if(record.direction == UartCaptureTx) {
+            captured_tx += record.length;
+            continue;
+        }
+
+        if(max_speed) {
+            wait_for(flow_peer_resumed, &peer.flow, 2000);
+        } else {
+            uint64_t due = start + (uint64_t)(record.tick - first_tick) * 1000000ULL;
+            uint64_t now = now_ns();
+            if(now < due) {
+                usleep((due - now) / 1000);
+            } else if(now - due > late_ns) {
+                late_ns = now - due;
+            }
+        }
+        host_uart_inject(data, record.length);
+        rx_bytes += record.length;
+        for(uint16_t i = 0; i < record.length; i++) {
+            lines += data[i] == '\n';
+        }
+        replay_redraw(state, canvas, &frames, &draw_ns);
+    }
+    wait_for(replay_rx_drained, NULL, 2000);
+    uint64_t elapsed = now_ns() - start;
+    fclose(file);
+    // The worker may still be in the last chunk's process_line
+    furi_delay_ms(10);
+    replay_redraw(state, canvas, &frames, &draw_ns);
+
+    UartHelperStats after;
+    wifi_get_uart_stats(&after);
+    printf("%s at %s speed: %u chunks over %lu ms of capture\n", path, max_speed ? "maximum" : "original",
+           chunks, (unsigned long)(last_tick - first_tick));
+    if(lines > 0) {
+        report("replay", elapsed, lines, "lines");
+    }
+    if(frames > 0) {
+        report("replay draw", draw_ns, frames, "frames");
+    }
+    printf("%-28s %10zu bytes RX, %.1f KB/s\n", "", rx_bytes, rx_bytes * 1e6 / (double)elapsed);
+    if(!max_speed) {
+        printf("%-28s %10.1f ms behind the capture at worst\n", "", late_ns / 1e6);
+    }
+    printf("%-28s %s, %zu bytes TX (captured %zu)\n", "replay end",
+           ollama_app_state_name(state->current_state), peer.tx_bytes, captured_tx);
+    if(after.rx_dropped != before.rx_dropped) {
+        printf("%-28s %lu bytes dropped, expected none\n", "replay",
+               (unsigned long)(after.rx_dropped - before.rx_dropped));
+        status = 1;
+    }
+
+    host_uart_set_tx_hook(NULL, NULL);
+    host_canvas_free(canvas);
+    main_loop_stop(&loop);
+    wifi_deinit();
+    ollama_app_state_free(state);
+    free(state);
+    return status;
+}
+
+#define SEARCH_BENCH_PATH EXT_PATH("ollama/bench_chats.txt")
+#define SEARCH_BENCH_INDEX_PATH EXT_PATH("ollama/bench_chats.idx")
+
+static uint32_t bench_random(uint32_t* seed) {
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+    return *seed;
+}
+
+// A prompt of a few words or a reply of a few dozen, drawn from 4000 words of which the
+// first few are in most messages and most in very few, as in real text; one message in
+// a thousand mentions a zebra
+static void bench_archive_message(Archive* archive, uint32_t n, uint32_t* seed) {
+    bool is_user = n % 2 == 0;
+    uint32_t words = is_user ? 4 + bench_random(seed) % 8 : 20 + bench_random(seed) % 40;
+    char word[16];
+    archive_begin(archive, is_user);
+    for(uint32_t i = 0; i < words; i++) {
+        uint32_t r = bench_random(seed) % 4000;
+        int length = snprintf(word, sizeof(word), "%sw%lu", i ? " " : "", (unsigned long)(r * r / 4000 * r / 4000));
+        archive_append(archive, word, length);
+    }
+    if(n % 1000 == 999) {
+        archive_append(archive, " zebra", 6);
+    }
+    archive_end(archive);
+}
+
+// What a search costs without the index: every line read and matched, in the same
+// 256-byte reads the archive writes with
+static uint32_t bench_archive_scan(const char* word, uint32_t* bytes) {
+    Storage* storage = furi_record_open(RECORD_STORAGE);
+    File* file = storage_file_alloc(storage);
+    uint32_t hits = 0;
+    *bytes = 0;
+    if(storage_file_open(file, SEARCH_BENCH_PATH, FSAM_READ, FSOM_OPEN_EXISTING)) {
+        char buffer[ARCHIVE_BUFFER_SIZE];
+        char line[4096];
+        size_t length = 0;
+        size_t read;
+        size_t word_length = strlen(word);
+        while((read = storage_file_read(file, buffer, sizeof(buffer))) > 0) {
+            *bytes += read;
+            for(size_t i = 0; i < read; i++) {
+                if(buffer[i] != '\n') {
+                    if(length < sizeof(line) - 2) line[length++] = buffer[i];
+                    continue;
+                }
+                line[length++] = ' ';
+                line[length] = '\0';
+                for(char* p = strstr(line, word); p; p = strstr(p + 1, word)) {
+                    if(p[-1] == ' ' && p[word_length] == ' ') {
+                        hits++;
+                        break;
+                    }
+                }
+                length = 0;
+            }
+        }
+    }
+    storage_file_close(file);
+    storage_file_free(file);
+    furi_record_close(RECORD_STORAGE);
+    return hits;
+}
+
+static int run_search(uint32_t messages) {
+    static const struct {
+        const char* query;
+        const char* scan; // the rarest word, for the scan
+    } queries[] = {
+        {"zebra", "zebra"},
+        {"w0", "w0"},
+        {"w2000", "w2000"},
+        {"w1 zebra", "zebra"},
+        {"w0 w1 w2", "w2"},
+        {"platypus", "platypus"},
+    };
+
+    Storage* storage = furi_record_open(RECORD_STORAGE);
+    storage_simply_remove(storage, SEARCH_BENCH_PATH);
+    storage_simply_remove(storage, SEARCH_BENCH_INDEX_PATH);
+    furi_record_close(RECORD_STORAGE);
+    Archive* archive = archive_alloc(SEARCH_BENCH_PATH, SEARCH_BENCH_INDEX_PATH);
+    if(!archive) {
+        fprintf(stderr, "could not create %s\n", SEARCH_BENCH_PATH);
+        return 1;
+    }
+
+    // Searches stop at a screenful of hits; postings and reads are what an SD card pays for
+    printf("%9s %9s %-10s %5s %9s %6s %10s %11s %10s\n", "messages", "archive", "query", "hits", "postings",
+           "reads", "index us", "scanned KB", "scan us");
+    uint32_t seed = 2463534242u;
+    uint32_t archived = 0;
+    int status = 0;
+    for(uint32_t size = 1000; size <= messages && status == 0; size *= 10) {
+        uint32_t added = size - archived;
+        uint64_t start = now_ns();
+        for(; archived < size; archived++) {
+            bench_archive_message(archive, archived, &seed);
+        }
+        uint64_t build_ns = now_ns() - start;
+        // Reopened as the search screen would find it, which also puts it all on the card
+        archive_free(archive);
+        start = now_ns();
+        archive = archive_alloc(SEARCH_BENCH_PATH, SEARCH_BENCH_INDEX_PATH);
+        uint64_t open_ns = now_ns() - start;
+        if(!archive) {
+            fprintf(stderr, "could not reopen %s\n", SEARCH_BENCH_PATH);
+            return 1;
+        }
+
+        for(size_t q = 0; q < COUNT_OF(queries); q++) {
+            uint32_t offsets[SEARCH_MAX_HITS];
+            ArchiveSearchStats stats;
+            uint8_t hits = 0;
+            const uint32_t repeat = 20;
+            start = now_ns();
+            for(uint32_t i = 0; i < repeat; i++) {
+                hits = archive_search(archive, queries[q].query, offsets, SEARCH_MAX_HITS, &stats);
+            }
+            uint64_t index_ns = (now_ns() - start) / repeat;
+
+            uint32_t scanned;
+            start = now_ns();
+            uint32_t scan_hits = bench_archive_scan(queries[q].scan, &scanned);
+            uint64_t scan_ns = now_ns() - start;
+
+            printf("%9lu %8luK %-10s %5u %9lu %6lu %10.1f %11lu %10.1f\n", (unsigned long)archived,
+                   (unsigned long)archive_size(archive) / 1024, queries[q].query, hits,
+                   (unsigned long)stats.postings, (unsigned long)stats.reads, index_ns / 1e3,
+                   (unsigned long)scanned / 1024, scan_ns / 1e3);
+            // Each single-word search must find what reading the whole archive finds
+            uint32_t expected = scan_hits < SEARCH_MAX_HITS ? scan_hits : SEARCH_MAX_HITS;
+            if(!strchr(queries[q].query, ' ') && hits != expected) {
+                printf("%-28s %u hits for %s, expected %lu\n", "search", hits, queries[q].query,
+                       (unsigned long)expected);
+                status = 1;
+            }
+        }
+        printf("%9s %9s indexed at %.1f us/message, %lu words, reopened in %.1f us\n", "", "",
+               build_ns / 1e3 / added, (unsigned long)archive_word_count(archive), open_ns / 1e3);
+    }
+
+    archive_free(archive);
+    return status;
+}
+
+int main(int argc, char** argv) {
+    if(argc > 1 && strcmp(argv[1], "pipeline") == 0) {
+        if(argc < 4) {
+            fprintf(stderr, "usage: %s pipeline <firmware> <server url> [prompts]\n", argv[0]);
+            return 2;
+        }
+        return run_pipeline(argv[2], argv[3], argc > 4 ? (uint32_t)strtoul(argv[4], NULL, 10) : 20);
+    }
+    if(argc > 1 && strcmp(argv[1], "batch") == 0) {
+        if(argc < 4) {
+            fprintf(stderr, "usage: %s batch <firmware> <server url> [prompts] [in flight]\n", argv[0]);
+            return 2;
+        }
+        return run_batch(
+            argv[2], argv[3], argc > 4 ? (uint32_t)strtoul(argv[4], NULL, 10) : 20,
+            argc > 5 ? (uint8_t)strtoul(argv[5], NULL, 10) : BATCH_DEFAULT_IN_FLIGHT);
+    }
+
+    if(argc > 1 && strcmp(argv[1], "replay") == 0) {
+        if(argc < 3) {
+            fprintf(stderr, "usage: %s replay <capture file> [max]\n", argv[0]);
+            return 2;
+        }
+        return run_replay(argv[2], argc > 3 && strcmp(argv[3], "max") == 0);
+    }
+    if(argc > 1 && strcmp(argv[1], "search") == 0) {
+        return run_search(argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 10) : 100000);
+    }
+
+    uint32_t iterations = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 10) : 10000;
+    size_t tx_bytes = 0;
+    host_uart_set_tx_hook(tx_count_hook, &tx_bytes);
+
+    bench_ring_buffer(iterations * 10);
+    bench_trace(iterations * 10);
+    bench_completion(iterations * 10);
+    bench_uart_helper(iterations);
+    bench_uart_tx();
+
+    OllamaAppState* state = malloc(sizeof(OllamaAppState));
+    ollama_app_state_init(state);
+    wifi_init();
+    MainLoop loop;
+    main_loop_start(&loop, state);
+    state->heap_baseline = memmgr_get_free_heap();
+
+    bench_process_line(state, iterations / 10 ? iterations / 10 : 1);
+    bench_reply_spool(state, iterations / 10 ? iterations / 10 : 1);
+    bench_key_events(state, iterations);
+    bench_screen_switch(state, iterations);
+    bench_draw(state, iterations);
+    ollama_app_set_state(state, AppStateMainMenu);
+    bench_telemetry(state, iterations);
+    bench_chat_archive(state, iterations);
+    bench_context_upload(state, 65536, &tx_bytes);
+    print_heap_report(state);
+
+    main_loop_stop(&loop);
+    wifi_deinit();
+    ollama_app_state_free(state);
+    free(state);
+
+    printf("%-28s %10zu bytes sent to the ESP32\n", "uart tx", tx_bytes);
+    return 0;
+}
@@ -0,0 +1,109 @@
+// Host shim for the Arduino core used by the ESP32 sketches.  Serial maps to stdio,
+// or to the tty named by ESP32_SHIM_SERIAL (e.g. the pty opened by host/app_bench).
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include "WString.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+typedef uint8_t byte;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+
+class IPAddress {
+public:
+    IPAddress(uint8_t a = 0, uint8_t b = 0, uint8_t c = 0, uint8_t d = 0) : octets{a, b, c, d} {}
+    String toString() const;
+    uint8_t operator[](int index) const { return octets[index]; }
+
+private:
+    uint8_t octets[4];
+};
+
+// A readable byte source with Arduino's Stream helpers on top of read()/available().
+class Stream {
+public:
+    virtual ~Stream() {}
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual size_t write(const uint8_t* data, size_t length) = 0;
+    virtual void flush() {}
+
+    virtual size_t write(uint8_t c) { return write(&c, 1); }
+    size_t write(const char* str) { return write((const uint8_t*)str, strlen(str)); }
+
+    void setTimeout(unsigned long ms) { timeout_ms = ms; }
+    String readStringUntil(char terminator);
+    String readString();
+    size_t readBytes(uint8_t* buffer, size_t length);
+    size_t readBytes(char* buffer, size_t length) { return readBytes((uint8_t*)buffer, length); }
+
+    size_t print(const String& s) { return write((const uint8_t*)s.c_str(), s.length()); }
+    size_t print(const char* s) { return write(s); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int n) { return print(String(n)); }
+    size_t print(unsigned int n) { return print(String(n)); }
+    size_t print(long n) { return print(String(n)); }
+    size_t print(unsigned long n) { return print(String(n)); }
+    size_t print(long long n) { return print(String(n)); }
+    size_t print(unsigned long long n) { return print(String(n)); }
+    size_t print(double n, int digits = 2) { return print(String(n, digits)); }
+    size_t print(const IPAddress& ip) { return print(ip.toString()); }
+    template <typename T>
+    size_t println(const T& value) { return print(value) + print("\r\n"); }
+    size_t println() { return print("\r\n"); }
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+protected:
+    int timed_read();
+    unsigned long timeout_ms = 1000;
+};
+
+class HardwareSerial : public Stream {
+public:
+    void begin(unsigned long baud);
+    void end() {}
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t write(const uint8_t* data, size_t length) override;
+    void flush() override;
+    operator bool() const { return true; }
+    using Stream::write;
+
+    // Shim only: blocks until input arrives or timeout_ms passes.  main() calls it
+    // between loop() passes so an idle sketch does not spin a core.
+    void idle(int timeout_ms) { fill(timeout_ms); }
+
+private:
+    bool fill(int timeout_ms);
+    int in_fd = 0;
+    int out_fd = 1;
+    uint8_t buffer[512];
+    size_t head = 0;
+    size_t tail = 0;
+};
+
+extern HardwareSerial Serial;
+
+// The ESP32 heap as ESP32_SHIM_HEAP_BYTES (default 320 KB) less what malloc has handed out
+// since the sketch started; free chunks malloc holds on to count as fragmentation, out of
+// the largest block.  The minimum is sampled between loop() passes, on every socket write
+// and on every call.
+class EspClass {
+public:
+    uint32_t getHeapSize();
+    uint32_t getFreeHeap();
+    uint32_t getMinFreeHeap();
+    uint32_t getMaxAllocHeap();
+};
+
+extern EspClass ESP;
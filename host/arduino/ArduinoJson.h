@@ -0,0 +1,113 @@
+// Host shim for the slice of ArduinoJson 6 the sketches use: documents indexed by key,
+// typed reads via as<T>(), assignment, deserializeJson (with a filter that is accepted
+// and ignored) and serializeJson.  Capacity arguments are accepted and ignored.
+#pragma once
+
+#include <Arduino.h>
+#include <memory>
+#include <utility>
+#include <vector>
+
+struct JsonNode {
+    enum Type { Null, Bool, Integer, Float, Str, Object, Array } type = Null;
+    bool boolean = false;
+    long long integer = 0;
+    double number = 0;
+    std::string text;
+    std::vector<std::pair<std::string, JsonNode>> members;
+    std::vector<JsonNode> items;
+
+    JsonNode* find(const char* key);
+};
+
+class JsonVariant {
+public:
+    JsonVariant(JsonNode* node = nullptr, JsonNode* parent = nullptr, const char* key = nullptr)
+        : node(node), parent(parent), key(key ? key : "") {}
+
+    JsonVariant operator[](const char* key) const;
+    JsonVariant operator[](const String& key) const { return (*this)[key.c_str()]; }
+    JsonVariant operator[](int index) const;
+
+    template <typename T>
+    T as() const;
+    template <typename T>
+    bool is() const;
+    bool isNull() const { return !node || node->type == JsonNode::Null; }
+    size_t size() const;
+
+    template <typename T>
+    operator T() const { return as<T>(); }
+
+    JsonVariant& operator=(bool value);
+    JsonVariant& operator=(int value) { return set_integer(value); }
+    JsonVariant& operator=(long value) { return set_integer(value); }
+    JsonVariant& operator=(unsigned long value) { return set_integer((long long)value); }
+    JsonVariant& operator=(double value);
+    JsonVariant& operator=(const char* value);
+    JsonVariant& operator=(const String& value) { return *this = value.c_str(); }
+
+private:
+    JsonNode* materialize();
+    JsonVariant& set_integer(long long value);
+
+    JsonNode* node;
+    JsonNode* parent;
+    std::string key;
+};
+
+class JsonDocument {
+public:
+    JsonVariant operator[](const char* key) { return JsonVariant(&root)[key]; }
+    JsonVariant operator[](const String& key) { return (*this)[key.c_str()]; }
+    JsonVariant operator[](int index) { return JsonVariant(&root)[index]; }
+    JsonVariant as_variant() { return JsonVariant(&root); }
+    void clear() { root = JsonNode(); }
+    bool isNull() const { return root.type == JsonNode::Null; }
+    JsonNode root;
+};
+
+class DynamicJsonDocument : public JsonDocument {
+public:
+    explicit DynamicJsonDocument(size_t capacity) { (void)capacity; }
+};
+
+template <size_t capacity>
+class StaticJsonDocument : public JsonDocument {};
+
+class DeserializationError {
+public:
+    enum Code { Ok, EmptyInput, IncompleteInput, InvalidInput, NoMemory, TooDeep };
+    DeserializationError(Code code = Ok) : value(code) {}
+    explicit operator bool() const { return value != Ok; }
+    bool operator!() const { return value == Ok; }
+    bool operator==(Code code) const { return value == code; }
+    Code code() const { return value; }
+    const char* c_str() const;
+
+private:
+    Code value;
+};
+
+namespace DeserializationOption {
+struct Filter {
+    explicit Filter(JsonDocument& filter) { (void)filter; }
+};
+} // namespace DeserializationOption
+
+DeserializationError deserializeJson(JsonDocument& doc, const char* input, size_t length);
+inline DeserializationError deserializeJson(JsonDocument& doc, const char* input) {
+    return deserializeJson(doc, input, strlen(input));
+}
+inline DeserializationError deserializeJson(JsonDocument& doc, const String& input) {
+    return deserializeJson(doc, input.c_str(), input.length());
+}
+DeserializationError deserializeJson(JsonDocument& doc, Stream& input);
+template <typename Input>
+DeserializationError deserializeJson(JsonDocument& doc, Input&& input, DeserializationOption::Filter filter) {
+    (void)filter;
+    return deserializeJson(doc, std::forward<Input>(input));
+}
+
+size_t serializeJson(const JsonDocument& doc, String& output);
+size_t measureJson(const JsonDocument& doc);
@@ -0,0 +1,66 @@
+// Host shim for the ESP32 HTTPClient: HTTP/1.1 (or 1.0) over WiFiClient with
+// Content-Length and chunked bodies, connection reuse and the error codes the
+// sketches print.
+#pragma once
+
+#include <WiFi.h>
+#include <vector>
+
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED (-2)
+#define HTTPC_ERROR_SEND_PAYLOAD_FAILED (-3)
+#define HTTPC_ERROR_NOT_CONNECTED (-4)
+#define HTTPC_ERROR_CONNECTION_LOST (-5)
+#define HTTPC_ERROR_NO_STREAM (-6)
+#define HTTPC_ERROR_NO_HTTP_SERVER (-7)
+#define HTTPC_ERROR_TOO_LESS_RAM (-8)
+#define HTTPC_ERROR_ENCODING (-9)
+#define HTTPC_ERROR_STREAM_WRITE (-10)
+#define HTTPC_ERROR_READ_TIMEOUT (-11)
+
+#define HTTP_CODE_OK 200
+
+class HTTPClient {
+public:
+    ~HTTPClient();
+    bool begin(const String& url);
+    bool begin(WiFiClient& client, const String& url);
+    void end();
+    void setTimeout(uint16_t timeout_ms) { timeout = timeout_ms; }
+    void setConnectTimeout(int32_t timeout_ms) { connect_timeout = timeout_ms; }
+    void setReuse(bool reuse) { this->reuse = reuse; }
+    void useHTTP10(bool use) { http10 = use; }
+    void addHeader(const String& name, const String& value);
+
+    int GET();
+    int POST(const String& payload);
+    int POST(const uint8_t* payload, size_t size);
+    int sendRequest(const char* method, const uint8_t* payload, size_t size);
+
+    int getSize() { return content_length; }
+    String getString();
+    WiFiClient* getStreamPtr() { return client; }
+    WiFiClient& getStream() { return *client; }
+    bool connected() { return client && client->connected(); }
+
+    static String errorToString(int error);
+
+private:
+    bool parse_url(const String& url);
+    int read_response_headers();
+
+    WiFiClient* client = nullptr;
+    bool own_client = false;
+    String host;
+    uint16_t port = 80;
+    String uri;
+    bool https = false;
+    std::vector<std::pair<String, String>> headers;
+    uint16_t timeout = 5000;
+    int32_t connect_timeout = 5000;
+    bool reuse = true;
+    bool http10 = false;
+    int content_length = -1;
+    bool chunked = false;
+    bool server_keep_alive = false;
+};
@@ -0,0 +1,35 @@
+// Host shim for the ESP32 Preferences library (key/value storage in NVS).  Each
+// namespace is a file in ESP32_SHIM_NVS_DIR, rewritten on every put like an NVS commit;
+// without that variable nothing outlives the process, as on freshly erased flash.
+#pragma once
+
+#include <Arduino.h>
+#include <map>
+#include <string>
+
+class Preferences {
+public:
+    bool begin(const char* name, bool read_only = false, const char* partition_label = nullptr);
+    void end();
+    bool clear();
+    bool remove(const char* key);
+    bool isKey(const char* key);
+
+    size_t putString(const char* key, const char* value);
+    size_t putString(const char* key, const String& value);
+    String getString(const char* key, const String& default_value = String());
+    size_t putUInt(const char* key, uint32_t value);
+    uint32_t getUInt(const char* key, uint32_t default_value = 0);
+
+private:
+    // Values are stored as text behind a type tag, 's' or 'u', so a getter of the
+    // wrong type gets its default like on NVS
+    bool put(const char* key, char type, const std::string& value);
+    bool get(const char* key, char type, std::string& value);
+    bool commit();
+
+    std::string path;
+    bool started = false;
+    bool read_only = false;
+    std::map<std::string, std::string> values;
+};
@@ -0,0 +1,90 @@
+// Host shim: the subset of Arduino's String class used by the sketches, on std::string.
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+class String {
+public:
+    String() {}
+    String(const char* cstr) : s(cstr ? cstr : "") {}
+    String(const std::string& str) : s(str) {}
+    String(char c) : s(1, c) {}
+    String(int value) : s(std::to_string(value)) {}
+    String(unsigned int value) : s(std::to_string(value)) {}
+    String(long value) : s(std::to_string(value)) {}
+    String(unsigned long value) : s(std::to_string(value)) {}
+    String(long long value) : s(std::to_string(value)) {}
+    String(unsigned long long value) : s(std::to_string(value)) {}
+    String(float value, unsigned int decimals = 2) : String((double)value, decimals) {}
+    String(double value, unsigned int decimals = 2);
+
+    const char* c_str() const { return s.c_str(); }
+    unsigned int length() const { return (unsigned int)s.size(); }
+    bool isEmpty() const { return s.empty(); }
+    void reserve(unsigned int size) { s.reserve(size); }
+    const std::string& str() const { return s; }
+
+    char charAt(unsigned int index) const { return index < s.size() ? s[index] : 0; }
+    char operator[](unsigned int index) const { return charAt(index); }
+    char& operator[](unsigned int index) { return s[index]; }
+
+    bool concat(const String& other) { s += other.s; return true; }
+    bool concat(const char* cstr) { s += cstr; return true; }
+    bool concat(char c) { s += c; return true; }
+    String& operator+=(const String& other) { s += other.s; return *this; }
+    String& operator+=(const char* cstr) { s += cstr; return *this; }
+    String& operator+=(char c) { s += c; return *this; }
+    String& operator+=(int value) { s += std::to_string(value); return *this; }
+    String& operator+=(unsigned long value) { s += std::to_string(value); return *this; }
+
+    bool equals(const String& other) const { return s == other.s; }
+    bool operator==(const String& other) const { return s == other.s; }
+    bool operator==(const char* cstr) const { return s == (cstr ? cstr : ""); }
+    bool operator!=(const String& other) const { return s != other.s; }
+    bool operator!=(const char* cstr) const { return !(*this == cstr); }
+    bool operator<(const String& other) const { return s < other.s; }
+
+    bool startsWith(const String& prefix) const { return s.compare(0, prefix.s.size(), prefix.s) == 0; }
+    bool endsWith(const String& suffix) const {
+        return s.size() >= suffix.s.size() &&
+               s.compare(s.size() - suffix.s.size(), suffix.s.size(), suffix.s) == 0;
+    }
+
+    int indexOf(char c, unsigned int from = 0) const { return find_result(s.find(c, from)); }
+    int indexOf(const String& str, unsigned int from = 0) const { return find_result(s.find(str.s, from)); }
+    int indexOf(const char* str, unsigned int from = 0) const { return find_result(s.find(str, from)); }
+    int lastIndexOf(char c) const { return find_result(s.rfind(c)); }
+
+    String substring(unsigned int from) const { return from < s.size() ? String(s.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const {
+        if(from > to) std::swap(from, to);
+        if(from >= s.size()) return String();
+        return String(s.substr(from, to - from));
+    }
+
+    void trim();
+    void toLowerCase();
+    void toUpperCase();
+    void replace(const String& from, const String& to);
+    void replace(char from, char to);
+    void remove(unsigned int index, unsigned int count = (unsigned int)-1) { s.erase(index, count); }
+
+    long toInt() const { return std::strtol(s.c_str(), nullptr, 10); }
+    float toFloat() const { return std::strtof(s.c_str(), nullptr); }
+
+private:
+    static int find_result(std::string::size_type pos) { return pos == std::string::npos ? -1 : (int)pos; }
+    std::string s;
+};
+
+inline String operator+(const String& a, const String& b) { String r(a); r += b; return r; }
+inline String operator+(const String& a, const char* b) { String r(a); r += b; return r; }
+inline String operator+(const char* a, const String& b) { String r(a); r += b; return r; }
+inline String operator+(const String& a, char b) { String r(a); r += b; return r; }
+inline String operator+(const String& a, int b) { return a + String(b); }
+inline String operator+(const String& a, unsigned int b) { return a + String(b); }
+inline String operator+(const String& a, long b) { return a + String(b); }
+inline String operator+(const String& a, unsigned long b) { return a + String(b); }
+inline bool operator==(const char* a, const String& b) { return b == a; }
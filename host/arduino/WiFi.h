@@ -0,0 +1,80 @@
+// Host shim for the ESP32 WiFi library.  Association succeeds ESP32_SHIM_ASSOC_MS
+// (default 0) after WiFi.begin() unless the SSID matches ESP32_SHIM_FAIL_SSID; scan
+// results come from ESP32_SHIM_NETWORKS ("ssid:rssi,ssid:rssi"); the nth entry is on
+// channel n % 11 + 1, and scanning takes max_ms_per_chan per channel, all 11 of them
+// unless one is given.  WiFiClient is a plain TCP socket.
+#pragma once
+
+#include <Arduino.h>
+#include <vector>
+
+typedef enum {
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_SCAN_COMPLETED = 2,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6,
+} wl_status_t;
+
+typedef enum {
+    WIFI_OFF,
+    WIFI_STA,
+    WIFI_AP,
+    WIFI_AP_STA,
+} wifi_mode_t;
+
+class WiFiClass {
+public:
+    bool mode(wifi_mode_t mode);
+    wl_status_t begin(const char* ssid, const char* password = nullptr);
+    bool disconnect(bool wifi_off = false);
+    wl_status_t status();
+    IPAddress localIP();
+    String SSID();
+    int32_t RSSI();
+    int16_t scanNetworks(bool async = false, bool show_hidden = false, bool passive = false,
+                         uint32_t max_ms_per_chan = 300, uint8_t channel = 0);
+    String SSID(int index);
+    int32_t RSSI(int index);
+    void scanDelete();
+
+private:
+    wl_status_t current_status = WL_DISCONNECTED;
+    String connected_ssid;
+    // millis() at which a pending association completes
+    unsigned long connect_at = 0;
+    std::vector<std::pair<String, int32_t>> scan_results;
+};
+
+extern WiFiClass WiFi;
+
+class WiFiClient : public Stream {
+public:
+    WiFiClient() {}
+    ~WiFiClient() override;
+    WiFiClient(const WiFiClient&) = delete;
+    WiFiClient& operator=(const WiFiClient&) = delete;
+
+    virtual int connect(const char* host, uint16_t port);
+    virtual int connect(const char* host, uint16_t port, int32_t timeout_ms);
+    virtual uint8_t connected();
+    virtual void stop();
+    int available() override;
+    int read() override;
+    virtual int read(uint8_t* data, size_t length);
+    int peek() override;
+    size_t write(const uint8_t* data, size_t length) override;
+    using Stream::write;
+    operator bool() { return connected(); }
+
+protected:
+    virtual ssize_t raw_read(uint8_t* data, size_t length);
+    virtual ssize_t raw_write(const uint8_t* data, size_t length);
+    bool fill(int timeout_ms);
+    int fd = -1;
+    uint8_t buffer[1024];
+    size_t head = 0;
+    size_t tail = 0;
+};
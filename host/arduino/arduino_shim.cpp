@@ -0,0 +1,1701 @@
+// Host implementations of the Arduino, FreeRTOS, WiFi, mbed TLS, HTTPClient, Preferences and
+// ArduinoJson shims, plus the main() that runs a sketch's setup() and loop().
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <HTTPClient.h>
+#include <Preferences.h>
+#include <WiFi.h>
+#include <esp_crt_bundle.h>
+#include <mbedtls/platform_util.h>
+#include <mbedtls/ssl.h>
+#include <openssl/err.h>
+#include <openssl/rand.h>
+#include <openssl/ssl.h>
+#include <arpa/inet.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <mutex>
+#include <pthread.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <malloc.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Time */
+
+static uint64_t monotonic_us() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000ULL + (uint64_t)now.tv_nsec / 1000ULL;
+}
+
+static const uint64_t boot_us = monotonic_us();
+
+unsigned long millis() {
+    return (unsigned long)((monotonic_us() - boot_us) / 1000ULL);
+}
+
+unsigned long micros() {
+    return (unsigned long)(monotonic_us() - boot_us);
+}
+
+void delay(unsigned long ms) {
+    usleep(ms * 1000UL);
+}
+
+void yield() {
+}
+
+/* FreeRTOS */
+
+// Host code needs far more stack than the ESP32, so every task gets this much whatever
+// its depth; it is painted so the deepest byte ever touched can be found
+static const size_t shim_stack_bytes = 1024 * 1024;
+static const uint8_t shim_stack_paint = 0xA5;
+static const uint32_t shim_loop_stack_depth = 8192;
+
+struct ShimTask {
+    TaskFunction_t function;
+    void* parameter;
+    pthread_t thread;
+    uint8_t* stack = nullptr;
+    uint8_t* stack_top = nullptr;
+    uint32_t stack_depth = 0;
+    std::mutex notify_mutex;
+    std::condition_variable notify_signal;
+    uint32_t notify_value = 0;
+};
+
+struct ShimSemaphore {
+    std::timed_mutex mutex;
+};
+
+// The loop() task; created tasks get their own record
+static ShimTask main_task;
+static thread_local ShimTask* current_task = &main_task;
+
+static void* shim_task_entry(void* context) {
+    ShimTask* task = (ShimTask*)context;
+    uint8_t top;
+    task->stack_top = &top;
+    current_task = task;
+    task->function(task->parameter);
+    // Returning from a task function is an error on FreeRTOS; treat it as vTaskDelete(NULL)
+    return nullptr;
+}
+
+static bool shim_task_start(ShimTask* task, uint32_t stack_depth) {
+    task->stack_depth = stack_depth;
+    void* stack = mmap(nullptr, shim_stack_bytes, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+    if(stack == MAP_FAILED) {
+        return false;
+    }
+    task->stack = (uint8_t*)stack;
+    memset(task->stack, shim_stack_paint, shim_stack_bytes);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, task->stack, shim_stack_bytes);
+    bool started = pthread_create(&task->thread, &attr, shim_task_entry, task) == 0;
+    pthread_attr_destroy(&attr);
+    if(!started) {
+        munmap(task->stack, shim_stack_bytes);
+        task->stack = nullptr;
+    }
+    return started;
+}
+
+BaseType_t xTaskCreatePinnedToCore(
+    TaskFunction_t function,
+    const char* name,
+    uint32_t stack_depth,
+    void* parameter,
+    UBaseType_t priority,
+    TaskHandle_t* handle,
+    BaseType_t core) {
+    (void)name;
+    (void)priority;
+    (void)core;
+    ShimTask* task = new ShimTask();
+    task->function = function;
+    task->parameter = parameter;
+    if(handle) *handle = task;
+    if(!shim_task_start(task, stack_depth)) {
+        if(handle) *handle = nullptr;
+        delete task;
+        return pdFAIL;
+    }
+    // The stack of a task that deletes itself is never unmapped
+    pthread_detach(task->thread);
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(
+    TaskFunction_t function,
+    const char* name,
+    uint32_t stack_depth,
+    void* parameter,
+    UBaseType_t priority,
+    TaskHandle_t* handle) {
+    return xTaskCreatePinnedToCore(function, name, stack_depth, parameter, priority, handle, 0);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if(task == nullptr || task == current_task) {
+        pthread_exit(nullptr);
+    }
+}
+
+void vTaskDelay(TickType_t ticks) {
+    delay(ticks);
+}
+
+TickType_t xTaskGetTickCount() {
+    return (TickType_t)millis();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    return current_task;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    if(task == nullptr) task = current_task;
+    if(task->stack == nullptr || task->stack_top == nullptr) return 0;
+    const uint8_t* deepest = task->stack;
+    while(deepest < task->stack_top && *deepest == shim_stack_paint) {
+        deepest++;
+    }
+    size_t used = task->stack_top - deepest;
+    return used < task->stack_depth ? task->stack_depth - used : 0;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    {
+        std::lock_guard<std::mutex> lock(task->notify_mutex);
+        task->notify_value++;
+    }
+    task->notify_signal.notify_one();
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait) {
+    ShimTask* task = current_task;
+    std::unique_lock<std::mutex> lock(task->notify_mutex);
+    auto notified = [task] { return task->notify_value > 0; };
+    if(ticks_to_wait == portMAX_DELAY) {
+        task->notify_signal.wait(lock, notified);
+    } else {
+        task->notify_signal.wait_for(lock, std::chrono::milliseconds(ticks_to_wait), notified);
+    }
+    uint32_t value = task->notify_value;
+    if(value > 0) {
+        task->notify_value = clear_on_exit ? 0 : value - 1;
+    }
+    return value;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+    return new ShimSemaphore();
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait) {
+    if(ticks_to_wait == portMAX_DELAY) {
+        semaphore->mutex.lock();
+        return pdTRUE;
+    }
+    return semaphore->mutex.try_lock_for(std::chrono::milliseconds(ticks_to_wait)) ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    semaphore->mutex.unlock();
+    return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+    delete semaphore;
+}
+
+/* String */
+
+String::String(double value, unsigned int decimals) {
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%.*f", (int)decimals, value);
+    s = buffer;
+}
+
+void String::trim() {
+    size_t start = s.find_first_not_of(" \t\r\n");
+    if(start == std::string::npos) {
+        s.clear();
+        return;
+    }
+    size_t end = s.find_last_not_of(" \t\r\n");
+    s = s.substr(start, end - start + 1);
+}
+
+void String::toLowerCase() {
+    for(char& c : s) c = (char)tolower((unsigned char)c);
+}
+
+void String::toUpperCase() {
+    for(char& c : s) c = (char)toupper((unsigned char)c);
+}
+
+void String::replace(const String& from, const String& to) {
+    if(from.s.empty()) return;
+    size_t pos = 0;
+    while((pos = s.find(from.s, pos)) != std::string::npos) {
+        s.replace(pos, from.s.size(), to.s);
+        pos += to.s.size();
+    }
+}
+
+void String::replace(char from, char to) {
+    for(char& c : s) {
+        if(c == from) c = to;
+    }
+}
+
+String IPAddress::toString() const {
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", octets[0], octets[1], octets[2], octets[3]);
+    return String(buffer);
+}
+
+/* Stream */
+
+int Stream::timed_read() {
+    unsigned long start = millis();
+    do {
+        if(available() > 0) return read();
+    } while(millis() - start < timeout_ms);
+    return -1;
+}
+
+String Stream::readStringUntil(char terminator) {
+    std::string result;
+    int c;
+    while((c = timed_read()) >= 0 && c != terminator) {
+        result += (char)c;
+    }
+    return String(result);
+}
+
+String Stream::readString() {
+    std::string result;
+    int c;
+    while((c = timed_read()) >= 0) {
+        result += (char)c;
+    }
+    return String(result);
+}
+
+size_t Stream::readBytes(uint8_t* buffer, size_t length) {
+    size_t count = 0;
+    while(count < length) {
+        int c = timed_read();
+        if(c < 0) break;
+        buffer[count++] = (uint8_t)c;
+    }
+    return count;
+}
+
+size_t Stream::printf(const char* format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if(length < 0) return 0;
+    return write((const uint8_t*)buffer, (size_t)length < sizeof(buffer) ? (size_t)length : sizeof(buffer) - 1);
+}
+
+/* Serial */
+
+HardwareSerial Serial;
+
+void HardwareSerial::begin(unsigned long baud) {
+    (void)baud;
+    const char* device = getenv("ESP32_SHIM_SERIAL");
+    if(device && *device) {
+        int fd = open(device, O_RDWR | O_NOCTTY);
+        if(fd < 0) {
+            perror(device);
+            exit(1);
+        }
+        struct termios tio;
+        if(tcgetattr(fd, &tio) == 0) {
+            cfmakeraw(&tio);
+            tcsetattr(fd, TCSANOW, &tio);
+        }
+        in_fd = out_fd = fd;
+    }
+}
+
+bool HardwareSerial::fill(int wait_ms) {
+    if(head < tail) return true;
+    struct pollfd pfd = {in_fd, POLLIN, 0};
+    if(poll(&pfd, 1, wait_ms) <= 0) return false;
+    ssize_t n = ::read(in_fd, buffer, sizeof(buffer));
+    if(n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+        // The other end went away; a sketch has no way to stop, so the process does
+        exit(0);
+    }
+    if(n < 0) return false;
+    head = 0;
+    tail = (size_t)n;
+    return true;
+}
+
+int HardwareSerial::available() {
+    fill(0);
+    return (int)(tail - head);
+}
+
+int HardwareSerial::read() {
+    if(!fill(0)) return -1;
+    return buffer[head++];
+}
+
+int HardwareSerial::peek() {
+    if(!fill(0)) return -1;
+    return buffer[head];
+}
+
+size_t HardwareSerial::write(const uint8_t* data, size_t length) {
+    size_t written = 0;
+    while(written < length) {
+        ssize_t n = ::write(out_fd, data + written, length - written);
+        if(n <= 0) {
+            if(n < 0 && errno == EINTR) continue;
+            break;
+        }
+        written += (size_t)n;
+    }
+    return written;
+}
+
+void HardwareSerial::flush() {
+    if(isatty(out_fd)) tcdrain(out_fd);
+}
+
+/* WiFi */
+
+WiFiClass WiFi;
+
+bool WiFiClass::mode(wifi_mode_t mode) {
+    (void)mode;
+    return true;
+}
+
+wl_status_t WiFiClass::begin(const char* ssid, const char* password) {
+    (void)password;
+    const char* fail = getenv("ESP32_SHIM_FAIL_SSID");
+    const char* assoc_ms = getenv("ESP32_SHIM_ASSOC_MS");
+    connect_at = millis() + (assoc_ms ? strtoul(assoc_ms, nullptr, 10) : 0);
+    connected_ssid = ssid;
+    current_status = fail && strcmp(fail, ssid) == 0 ? WL_CONNECT_FAILED : WL_DISCONNECTED;
+    return status();
+}
+
+bool WiFiClass::disconnect(bool wifi_off) {
+    (void)wifi_off;
+    current_status = WL_DISCONNECTED;
+    connected_ssid = "";
+    return true;
+}
+
+wl_status_t WiFiClass::status() {
+    if(current_status == WL_DISCONNECTED && connected_ssid.length() > 0 && (long)(millis() - connect_at) >= 0) {
+        current_status = WL_CONNECTED;
+    }
+    return current_status;
+}
+
+IPAddress WiFiClass::localIP() {
+    return current_status == WL_CONNECTED ? IPAddress(127, 0, 0, 1) : IPAddress();
+}
+
+String WiFiClass::SSID() {
+    return status() == WL_CONNECTED ? connected_ssid : String();
+}
+
+int32_t WiFiClass::RSSI() {
+    return current_status == WL_CONNECTED ? -50 : 0;
+}
+
+int16_t WiFiClass::scanNetworks(bool, bool, bool, uint32_t max_ms_per_chan, uint8_t channel) {
+    scan_results.clear();
+    const char* networks = getenv("ESP32_SHIM_NETWORKS");
+    String list = networks ? networks : "HostNetwork:-42,HostNetwork_5G:-55,Neighbour:-80";
+    int start = 0;
+    int index = 0;
+    while(start < (int)list.length()) {
+        int end = list.indexOf(',', start);
+        if(end == -1) end = list.length();
+        String entry = list.substring(start, end);
+        int colon = entry.lastIndexOf(':');
+        if(colon > 0 && (channel == 0 || channel == index % 11 + 1)) {
+            scan_results.push_back({entry.substring(0, colon), (int32_t)entry.substring(colon + 1).toInt()});
+        }
+        index++;
+        start = end + 1;
+    }
+    delay(channel == 0 ? 11 * max_ms_per_chan : max_ms_per_chan);
+    return (int16_t)scan_results.size();
+}
+
+String WiFiClass::SSID(int index) {
+    return index >= 0 && index < (int)scan_results.size() ? scan_results[index].first : String();
+}
+
+int32_t WiFiClass::RSSI(int index) {
+    return index >= 0 && index < (int)scan_results.size() ? scan_results[index].second : 0;
+}
+
+void WiFiClass::scanDelete() {
+    scan_results.clear();
+}
+
+/* WiFiClient */
+
+WiFiClient::~WiFiClient() {
+    stop();
+}
+
+int WiFiClient::connect(const char* host, uint16_t port) {
+    return connect(host, port, 5000);
+}
+
+int WiFiClient::connect(const char* host, uint16_t port, int32_t timeout_ms) {
+    stop();
+    struct addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* result = nullptr;
+    char service[8];
+    snprintf(service, sizeof(service), "%u", port);
+    if(getaddrinfo(host, service, &hints, &result) != 0) return 0;
+
+    for(struct addrinfo* ai = result; ai && fd < 0; ai = ai->ai_next) {
+        int s = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if(s < 0) continue;
+        fcntl(s, F_SETFL, O_NONBLOCK);
+        int rc = ::connect(s, ai->ai_addr, ai->ai_addrlen);
+        if(rc < 0 && errno == EINPROGRESS) {
+            struct pollfd pfd = {s, POLLOUT, 0};
+            int err = 0;
+            socklen_t len = sizeof(err);
+            if(poll(&pfd, 1, timeout_ms) == 1 && getsockopt(s, SOL_SOCKET, SO_ERROR, &err, &len) == 0 &&
+               err == 0) {
+                rc = 0;
+            }
+        }
+        if(rc == 0) {
+            int one = 1;
+            setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            fd = s;
+        } else {
+            close(s);
+        }
+    }
+    freeaddrinfo(result);
+    head = tail = 0;
+    return fd >= 0;
+}
+
+ssize_t WiFiClient::raw_read(uint8_t* data, size_t length) {
+    return recv(fd, data, length, 0);
+}
+
+ssize_t WiFiClient::raw_write(const uint8_t* data, size_t length) {
+    return send(fd, data, length, MSG_NOSIGNAL);
+}
+
+bool WiFiClient::fill(int wait_ms) {
+    if(head < tail) return true;
+    if(fd < 0) return false;
+    struct pollfd pfd = {fd, POLLIN, 0};
+    if(poll(&pfd, 1, wait_ms) <= 0) return false;
+    ssize_t n = raw_read(buffer, sizeof(buffer));
+    if(n <= 0) {
+        if(n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) stop();
+        return false;
+    }
+    head = 0;
+    tail = (size_t)n;
+    return true;
+}
+
+uint8_t WiFiClient::connected() {
+    if(head < tail) return 1;
+    if(fd < 0) return 0;
+    // Peek for EOF without consuming anything
+    struct pollfd pfd = {fd, POLLIN, 0};
+    if(poll(&pfd, 1, 0) == 1) {
+        uint8_t probe;
+        ssize_t n = recv(fd, &probe, 1, MSG_PEEK | MSG_DONTWAIT);
+        if(n == 0) {
+            stop();
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void WiFiClient::stop() {
+    if(fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+    head = tail = 0;
+}
+
+int WiFiClient::available() {
+    fill(0);
+    return (int)(tail - head);
+}
+
+int WiFiClient::read() {
+    if(!fill(0)) return -1;
+    return buffer[head++];
+}
+
+int WiFiClient::read(uint8_t* data, size_t length) {
+    if(!fill(0)) return -1;
+    size_t count = tail - head < length ? tail - head : length;
+    memcpy(data, buffer + head, count);
+    head += count;
+    return (int)count;
+}
+
+int WiFiClient::peek() {
+    if(!fill(0)) return -1;
+    return buffer[head];
+}
+
+size_t WiFiClient::write(const uint8_t* data, size_t length) {
+    // The device's allocator tracks the low-water mark all the time; sampling it here
+    // too catches a request that builds up its body within one loop()
+    ESP.getFreeHeap();
+    size_t written = 0;
+    while(fd >= 0 && written < length) {
+        ssize_t n = raw_write(data + written, length - written);
+        if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd pfd = {fd, POLLOUT, 0};
+            poll(&pfd, 1, 1000);
+            continue;
+        }
+        if(n <= 0) break;
+        written += (size_t)n;
+    }
+    return written;
+}
+
+/* mbed TLS */
+
+void mbedtls_platform_zeroize(void* buf, size_t len) {
+    OPENSSL_cleanse(buf, len);
+}
+
+void mbedtls_entropy_init(mbedtls_entropy_context* ctx) {
+    ctx->unused = 0;
+}
+
+void mbedtls_entropy_free(mbedtls_entropy_context*) {
+}
+
+int mbedtls_entropy_func(void*, unsigned char* output, size_t len) {
+    return RAND_bytes(output, (int)len) == 1 ? 0 : MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+}
+
+void mbedtls_ctr_drbg_init(mbedtls_ctr_drbg_context* ctx) {
+    ctx->seeded = 0;
+}
+
+void mbedtls_ctr_drbg_free(mbedtls_ctr_drbg_context* ctx) {
+    ctx->seeded = 0;
+}
+
+int mbedtls_ctr_drbg_seed(
+    mbedtls_ctr_drbg_context* ctx,
+    int (*f_entropy)(void*, unsigned char*, size_t),
+    void* p_entropy,
+    const unsigned char*,
+    size_t) {
+    unsigned char seed[32];
+    int ret = f_entropy(p_entropy, seed, sizeof(seed));
+    ctx->seeded = ret == 0;
+    return ret;
+}
+
+int mbedtls_ctr_drbg_random(void*, unsigned char* output, size_t output_len) {
+    return RAND_bytes(output, (int)output_len) == 1 ? 0 : MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+}
+
+// OpenSSL reads and writes records through a BIO that calls the mbedtls_ssl_set_bio
+// callbacks, mapping their WANT_READ/WANT_WRITE onto BIO retries.
+static int shim_bio_write(BIO* bio, const char* data, int length) {
+    mbedtls_ssl_context* ssl = (mbedtls_ssl_context*)BIO_get_data(bio);
+    BIO_clear_retry_flags(bio);
+    if(!ssl->f_send) return -1;
+    int ret = ssl->f_send(ssl->p_bio, (const unsigned char*)data, (size_t)length);
+    if(ret == MBEDTLS_ERR_SSL_WANT_WRITE) BIO_set_retry_write(bio);
+    return ret < 0 ? -1 : ret;
+}
+
+static int shim_bio_read(BIO* bio, char* data, int length) {
+    mbedtls_ssl_context* ssl = (mbedtls_ssl_context*)BIO_get_data(bio);
+    BIO_clear_retry_flags(bio);
+    if(!ssl->f_recv) return -1;
+    int ret = ssl->f_recv(ssl->p_bio, (unsigned char*)data, (size_t)length);
+    if(ret == MBEDTLS_ERR_SSL_WANT_READ) BIO_set_retry_read(bio);
+    return ret < 0 ? -1 : ret;
+}
+
+static long shim_bio_ctrl(BIO*, int command, long, void*) {
+    return command == BIO_CTRL_FLUSH ? 1 : 0;
+}
+
+static int shim_bio_create(BIO* bio) {
+    BIO_set_init(bio, 1);
+    return 1;
+}
+
+static BIO_METHOD* shim_bio_method() {
+    static BIO_METHOD* method = [] {
+        BIO_METHOD* m = BIO_meth_new(BIO_get_new_index() | BIO_TYPE_SOURCE_SINK, "mbedtls bio");
+        BIO_meth_set_write(m, shim_bio_write);
+        BIO_meth_set_read(m, shim_bio_read);
+        BIO_meth_set_ctrl(m, shim_bio_ctrl);
+        BIO_meth_set_create(m, shim_bio_create);
+        return m;
+    }();
+    return method;
+}
+
+void mbedtls_ssl_config_init(mbedtls_ssl_config* conf) {
+    conf->ctx = nullptr;
+    conf->authmode = MBEDTLS_SSL_VERIFY_REQUIRED;
+}
+
+void mbedtls_ssl_config_free(mbedtls_ssl_config* conf) {
+    SSL_CTX_free((SSL_CTX*)conf->ctx);
+    conf->ctx = nullptr;
+}
+
+int mbedtls_ssl_config_defaults(mbedtls_ssl_config* conf, int endpoint, int, int) {
+    if(endpoint != MBEDTLS_SSL_IS_CLIENT) return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    SSL_CTX* ctx = SSL_CTX_new(TLS_client_method());
+    if(!ctx) return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_max_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_free((SSL_CTX*)conf->ctx);
+    conf->ctx = ctx;
+    return 0;
+}
+
+void mbedtls_ssl_conf_authmode(mbedtls_ssl_config* conf, int authmode) {
+    conf->authmode = authmode;
+}
+
+void mbedtls_ssl_conf_rng(mbedtls_ssl_config*, int (*)(void*, unsigned char*, size_t), void*) {
+}
+
+void mbedtls_ssl_conf_session_tickets(mbedtls_ssl_config* conf, int use_tickets) {
+    if(use_tickets == MBEDTLS_SSL_SESSION_TICKETS_ENABLED) {
+        SSL_CTX_clear_options((SSL_CTX*)conf->ctx, SSL_OP_NO_TICKET);
+    } else {
+        SSL_CTX_set_options((SSL_CTX*)conf->ctx, SSL_OP_NO_TICKET);
+    }
+}
+
+esp_err_t esp_crt_bundle_attach(void* conf) {
+    SSL_CTX* ctx = (SSL_CTX*)((mbedtls_ssl_config*)conf)->ctx;
+    if(!ctx || SSL_CTX_set_default_verify_paths(ctx) != 1) return ESP_FAIL;
+    const char* extra = getenv("ESP32_SHIM_CA_FILE");
+    if(extra && SSL_CTX_load_verify_locations(ctx, extra, nullptr) != 1) return ESP_FAIL;
+    return ESP_OK;
+}
+
+void mbedtls_ssl_init(mbedtls_ssl_context* ssl) {
+    memset(ssl, 0, sizeof(*ssl));
+}
+
+void mbedtls_ssl_free(mbedtls_ssl_context* ssl) {
+    SSL_free((SSL*)ssl->ssl);
+    free(ssl->hostname);
+    memset(ssl, 0, sizeof(*ssl));
+}
+
+// A fresh OpenSSL connection object; mbed TLS reuses one context across connections
+static int shim_ssl_create(mbedtls_ssl_context* ssl) {
+    SSL_free((SSL*)ssl->ssl);
+    SSL* handle = SSL_new((SSL_CTX*)ssl->conf->ctx);
+    if(!handle) return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    BIO* bio = BIO_new(shim_bio_method());
+    BIO_set_data(bio, ssl);
+    SSL_set_bio(handle, bio, bio);
+    SSL_set_connect_state(handle);
+    SSL_set_verify(handle, ssl->conf->authmode == MBEDTLS_SSL_VERIFY_REQUIRED ? SSL_VERIFY_PEER : SSL_VERIFY_NONE, nullptr);
+    ssl->ssl = handle;
+    return 0;
+}
+
+int mbedtls_ssl_setup(mbedtls_ssl_context* ssl, const mbedtls_ssl_config* conf) {
+    ssl->conf = conf;
+    return shim_ssl_create(ssl);
+}
+
+int mbedtls_ssl_session_reset(mbedtls_ssl_context* ssl) {
+    int ret = shim_ssl_create(ssl);
+    if(ret == 0 && ssl->hostname) ret = mbedtls_ssl_set_hostname(ssl, ssl->hostname);
+    return ret;
+}
+
+int mbedtls_ssl_set_hostname(mbedtls_ssl_context* ssl, const char* hostname) {
+    if(hostname != ssl->hostname) {
+        free(ssl->hostname);
+        ssl->hostname = hostname ? strdup(hostname) : nullptr;
+    }
+    SSL* handle = (SSL*)ssl->ssl;
+    if(!hostname) return 0;
+    unsigned char address[16];
+    bool literal = inet_pton(AF_INET, hostname, address) == 1 || inet_pton(AF_INET6, hostname, address) == 1;
+    if(literal) {
+        X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(handle), hostname);
+    } else {
+        SSL_set_tlsext_host_name(handle, hostname);
+        SSL_set1_host(handle, hostname);
+    }
+    return 0;
+}
+
+void mbedtls_ssl_set_bio(
+    mbedtls_ssl_context* ssl,
+    void* p_bio,
+    mbedtls_ssl_send_t* f_send,
+    mbedtls_ssl_recv_t* f_recv,
+    mbedtls_ssl_recv_timeout_t*) {
+    ssl->p_bio = p_bio;
+    ssl->f_send = f_send;
+    ssl->f_recv = f_recv;
+}
+
+static int shim_ssl_error(mbedtls_ssl_context* ssl, int ret) {
+    switch(SSL_get_error((SSL*)ssl->ssl, ret)) {
+        case SSL_ERROR_WANT_READ:
+            return MBEDTLS_ERR_SSL_WANT_READ;
+        case SSL_ERROR_WANT_WRITE:
+            return MBEDTLS_ERR_SSL_WANT_WRITE;
+        case SSL_ERROR_ZERO_RETURN:
+            return MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY;
+        case SSL_ERROR_SYSCALL:
+            ERR_clear_error();
+            return MBEDTLS_ERR_NET_CONN_RESET;
+        default:
+            ERR_clear_error();
+            return SSL_get_verify_result((SSL*)ssl->ssl) != X509_V_OK ? MBEDTLS_ERR_X509_CERT_VERIFY_FAILED
+                                                                      : MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+    }
+}
+
+int mbedtls_ssl_handshake(mbedtls_ssl_context* ssl) {
+    int ret = SSL_do_handshake((SSL*)ssl->ssl);
+    return ret == 1 ? 0 : shim_ssl_error(ssl, ret);
+}
+
+uint32_t mbedtls_ssl_get_verify_result(const mbedtls_ssl_context* ssl) {
+    return SSL_get_verify_result((SSL*)ssl->ssl) == X509_V_OK ? 0 : 0x08; // MBEDTLS_X509_BADCERT_NOT_TRUSTED
+}
+
+int mbedtls_ssl_read(mbedtls_ssl_context* ssl, unsigned char* buf, size_t len) {
+    int ret = SSL_read((SSL*)ssl->ssl, buf, (int)len);
+    return ret > 0 ? ret : shim_ssl_error(ssl, ret);
+}
+
+int mbedtls_ssl_write(mbedtls_ssl_context* ssl, const unsigned char* buf, size_t len) {
+    int ret = SSL_write((SSL*)ssl->ssl, buf, (int)len);
+    return ret > 0 ? ret : shim_ssl_error(ssl, ret);
+}
+
+int mbedtls_ssl_close_notify(mbedtls_ssl_context* ssl) {
+    int ret = SSL_shutdown((SSL*)ssl->ssl);
+    return ret >= 0 ? 0 : shim_ssl_error(ssl, ret);
+}
+
+void mbedtls_ssl_session_init(mbedtls_ssl_session* session) {
+    memset(session, 0, sizeof(*session));
+}
+
+void mbedtls_ssl_session_free(mbedtls_ssl_session* session) {
+    SSL_SESSION_free((SSL_SESSION*)session->handle);
+    memset(session, 0, sizeof(*session));
+}
+
+// mbed TLS copies the session out; OpenSSL would share it, and a later unclean close of
+// the connection would then mark the cached copy as not resumable
+int mbedtls_ssl_get_session(const mbedtls_ssl_context* ssl, mbedtls_ssl_session* session) {
+    SSL_SESSION* current = SSL_get0_session((SSL*)ssl->ssl);
+    SSL_SESSION* handle = current ? SSL_SESSION_dup(current) : nullptr;
+    if(!handle) return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    SSL_SESSION_free((SSL_SESSION*)session->handle);
+    session->handle = handle;
+    unsigned int id_len = 0;
+    const unsigned char* id = SSL_SESSION_get_id(handle, &id_len);
+    session->id_len = id_len < sizeof(session->id) ? id_len : sizeof(session->id);
+    memcpy(session->id, id, session->id_len);
+    SSL_SESSION_get_master_key(handle, session->master, sizeof(session->master));
+    return 0;
+}
+
+int mbedtls_ssl_set_session(mbedtls_ssl_context* ssl, const mbedtls_ssl_session* session) {
+    if(!session->handle) return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    return SSL_set_session((SSL*)ssl->ssl, (SSL_SESSION*)session->handle) == 1 ? 0 : MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+}
+
+/* Preferences */
+
+// A namespace file holds "<key> <type> <length>\n<value>\n" per entry
+bool Preferences::begin(const char* name, bool read_only_mode, const char* partition_label) {
+    (void)partition_label;
+    if(started || !name || strlen(name) > 15) return false;
+    const char* dir = getenv("ESP32_SHIM_NVS_DIR");
+    path = dir && *dir ? std::string(dir) + "/" + name + ".nvs" : std::string();
+    read_only = read_only_mode;
+    values.clear();
+    started = true;
+
+    FILE* file = path.empty() ? nullptr : fopen(path.c_str(), "rb");
+    if(!file) return !read_only;
+    char key[16];
+    char type;
+    size_t length;
+    while(fscanf(file, "%15s %c %zu", key, &type, &length) == 3 && fgetc(file) == '\n') {
+        std::string value(length, '\0');
+        if(fread(&value[0], 1, length, file) != length) break;
+        fgetc(file);
+        values[key] = std::string(1, type) + value;
+    }
+    fclose(file);
+    return true;
+}
+
+void Preferences::end() {
+    started = false;
+    values.clear();
+}
+
+bool Preferences::commit() {
+    if(path.empty()) return true;
+    std::string temp = path + ".tmp";
+    FILE* file = fopen(temp.c_str(), "wb");
+    if(!file) return false;
+    for(const auto& entry : values) {
+        fprintf(file, "%s %c %zu\n", entry.first.c_str(), entry.second[0], entry.second.size() - 1);
+        fwrite(entry.second.data() + 1, 1, entry.second.size() - 1, file);
+        fputc('\n', file);
+    }
+    bool ok = fclose(file) == 0;
+    return ok && rename(temp.c_str(), path.c_str()) == 0;
+}
+
+bool Preferences::put(const char* key, char type, const std::string& value) {
+    if(!started || read_only || !key || strlen(key) > 15) return false;
+    values[key] = std::string(1, type) + value;
+    return commit();
+}
+
+bool Preferences::get(const char* key, char type, std::string& value) {
+    auto entry = started && key ? values.find(key) : values.end();
+    if(entry == values.end() || entry->second[0] != type) return false;
+    value = entry->second.substr(1);
+    return true;
+}
+
+bool Preferences::clear() {
+    if(!started || read_only) return false;
+    values.clear();
+    return commit();
+}
+
+bool Preferences::remove(const char* key) {
+    if(!started || read_only || !key || values.erase(key) == 0) return false;
+    return commit();
+}
+
+bool Preferences::isKey(const char* key) {
+    return started && key && values.count(key) > 0;
+}
+
+size_t Preferences::putString(const char* key, const char* value) {
+    return put(key, 's', value) ? strlen(value) : 0;
+}
+
+size_t Preferences::putString(const char* key, const String& value) {
+    return putString(key, value.c_str());
+}
+
+String Preferences::getString(const char* key, const String& default_value) {
+    std::string value;
+    return get(key, 's', value) ? String(value.c_str()) : default_value;
+}
+
+size_t Preferences::putUInt(const char* key, uint32_t value) {
+    return put(key, 'u', std::to_string(value)) ? sizeof(value) : 0;
+}
+
+uint32_t Preferences::getUInt(const char* key, uint32_t default_value) {
+    std::string value;
+    return get(key, 'u', value) ? (uint32_t)strtoul(value.c_str(), nullptr, 10) : default_value;
+}
+
+/* HTTPClient */
+
+HTTPClient::~HTTPClient() {
+    end();
+    if(own_client) delete client;
+}
+
+bool HTTPClient::parse_url(const String& url) {
+    int scheme_end = url.indexOf("://");
+    String scheme = scheme_end == -1 ? String("http") : url.substring(0, scheme_end);
+    https = scheme == "https";
+    int host_start = scheme_end == -1 ? 0 : scheme_end + 3;
+    int path_start = url.indexOf('/', host_start);
+    if(path_start == -1) path_start = url.length();
+    String host_port = url.substring(host_start, path_start);
+    uri = path_start < (int)url.length() ? url.substring(path_start) : String("/");
+    int colon = host_port.indexOf(':');
+    if(colon == -1) {
+        host = host_port;
+        port = https ? 443 : 80;
+    } else {
+        host = host_port.substring(0, colon);
+        port = (uint16_t)host_port.substring(colon + 1).toInt();
+    }
+    return host.length() > 0;
+}
+
+bool HTTPClient::begin(const String& url) {
+    if(!client || !own_client) {
+        client = new WiFiClient();
+        own_client = true;
+    }
+    headers.clear();
+    return parse_url(url);
+}
+
+bool HTTPClient::begin(WiFiClient& external, const String& url) {
+    if(own_client) delete client;
+    client = &external;
+    own_client = false;
+    headers.clear();
+    return parse_url(url);
+}
+
+void HTTPClient::end() {
+    if(client && !(reuse && server_keep_alive && !http10)) {
+        client->stop();
+    }
+}
+
+void HTTPClient::addHeader(const String& name, const String& value) {
+    headers.push_back({name, value});
+}
+
+int HTTPClient::GET() {
+    return sendRequest("GET", nullptr, 0);
+}
+
+int HTTPClient::POST(const String& payload) {
+    return sendRequest("POST", (const uint8_t*)payload.c_str(), payload.length());
+}
+
+int HTTPClient::POST(const uint8_t* payload, size_t size) {
+    return sendRequest("POST", payload, size);
+}
+
+int HTTPClient::sendRequest(const char* method, const uint8_t* payload, size_t size) {
+    if(!client) return HTTPC_ERROR_NOT_CONNECTED;
+    if(!client->connected() && !client->connect(host.c_str(), port, connect_timeout)) {
+        return HTTPC_ERROR_CONNECTION_REFUSED;
+    }
+    client->setTimeout(timeout);
+
+    String request = String(method) + " " + uri + (http10 ? " HTTP/1.0\r\n" : " HTTP/1.1\r\n");
+    request += "Host: " + host + ":" + String((unsigned int)port) + "\r\n";
+    request += "User-Agent: ESP32HTTPClient\r\n";
+    request += String("Connection: ") + (reuse && !http10 ? "keep-alive" : "close") + "\r\n";
+    for(auto& header : headers) {
+        request += header.first + ": " + header.second + "\r\n";
+    }
+    if(payload || strcmp(method, "POST") == 0) {
+        request += "Content-Length: " + String((unsigned long)size) + "\r\n";
+    }
+    request += "\r\n";
+
+    if(client->write((const uint8_t*)request.c_str(), request.length()) != request.length()) {
+        return HTTPC_ERROR_SEND_HEADER_FAILED;
+    }
+    if(size > 0 && client->write(payload, size) != size) {
+        return HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+    }
+    return read_response_headers();
+}
+
+int HTTPClient::read_response_headers() {
+    content_length = -1;
+    chunked = false;
+    server_keep_alive = !http10;
+    int code = 0;
+
+    unsigned long start = millis();
+    while(client->connected() || client->available()) {
+        if(!client->available()) {
+            if(millis() - start > timeout) return HTTPC_ERROR_READ_TIMEOUT;
+            delay(1);
+            continue;
+        }
+        String line = client->readStringUntil('\n');
+        line.trim();
+        if(code == 0) {
+            if(!line.startsWith("HTTP/")) return HTTPC_ERROR_NO_HTTP_SERVER;
+            code = (int)line.substring(line.indexOf(' ') + 1).toInt();
+            continue;
+        }
+        if(line.length() == 0) return code;
+
+        int colon = line.indexOf(':');
+        String name = line.substring(0, colon);
+        String value = line.substring(colon + 1);
+        name.toLowerCase();
+        value.trim();
+        if(name == "content-length") {
+            content_length = (int)value.toInt();
+        } else if(name == "transfer-encoding") {
+            value.toLowerCase();
+            chunked = value == "chunked";
+        } else if(name == "connection") {
+            value.toLowerCase();
+            server_keep_alive = value != "close";
+        }
+    }
+    return code ? code : HTTPC_ERROR_CONNECTION_LOST;
+}
+
+String HTTPClient::getString() {
+    if(!client) return String();
+    std::string body;
+    if(chunked) {
+        while(true) {
+            String size_line = client->readStringUntil('\n');
+            size_line.trim();
+            if(size_line.length() == 0 && !client->connected()) break;
+            long chunk = strtol(size_line.c_str(), nullptr, 16);
+            if(chunk <= 0) {
+                client->readStringUntil('\n');
+                break;
+            }
+            std::string data((size_t)chunk, '\0');
+            size_t got = client->readBytes((uint8_t*)&data[0], (size_t)chunk);
+            body.append(data, 0, got);
+            client->readStringUntil('\n');
+        }
+    } else if(content_length >= 0) {
+        std::string data((size_t)content_length, '\0');
+        size_t got = client->readBytes((uint8_t*)&data[0], (size_t)content_length);
+        body.assign(data, 0, got);
+    } else {
+        body = client->readString().str();
+    }
+    return String(body);
+}
+
+String HTTPClient::errorToString(int error) {
+    switch(error) {
+    case HTTPC_ERROR_CONNECTION_REFUSED:
+        return "connection refused";
+    case HTTPC_ERROR_SEND_HEADER_FAILED:
+        return "send header failed";
+    case HTTPC_ERROR_SEND_PAYLOAD_FAILED:
+        return "send payload failed";
+    case HTTPC_ERROR_NOT_CONNECTED:
+        return "not connected";
+    case HTTPC_ERROR_CONNECTION_LOST:
+        return "connection lost";
+    case HTTPC_ERROR_NO_STREAM:
+        return "no stream";
+    case HTTPC_ERROR_NO_HTTP_SERVER:
+        return "no HTTP server";
+    case HTTPC_ERROR_TOO_LESS_RAM:
+        return "too less ram";
+    case HTTPC_ERROR_ENCODING:
+        return "Transfer-Encoding not supported";
+    case HTTPC_ERROR_STREAM_WRITE:
+        return "Stream write error";
+    case HTTPC_ERROR_READ_TIMEOUT:
+        return "read Timeout";
+    default:
+        return String();
+    }
+}
+
+/* ArduinoJson */
+
+JsonNode* JsonNode::find(const char* key) {
+    for(auto& member : members) {
+        if(member.first == key) return &member.second;
+    }
+    return nullptr;
+}
+
+JsonVariant JsonVariant::operator[](const char* member) const {
+    if(node && node->type == JsonNode::Object) {
+        return JsonVariant(node->find(member), node, member);
+    }
+    // Missing or null: remember where to create the member on assignment
+    return JsonVariant(nullptr, node && node->type == JsonNode::Null ? node : nullptr, member);
+}
+
+JsonVariant JsonVariant::operator[](int index) const {
+    if(node && node->type == JsonNode::Array && index >= 0 && index < (int)node->items.size()) {
+        return JsonVariant(&node->items[index]);
+    }
+    return JsonVariant();
+}
+
+size_t JsonVariant::size() const {
+    if(!node) return 0;
+    if(node->type == JsonNode::Object) return node->members.size();
+    if(node->type == JsonNode::Array) return node->items.size();
+    return 0;
+}
+
+JsonNode* JsonVariant::materialize() {
+    if(node) return node;
+    if(!parent) return nullptr;
+    if(parent->type == JsonNode::Null) parent->type = JsonNode::Object;
+    parent->members.push_back({key, JsonNode()});
+    node = &parent->members.back().second;
+    return node;
+}
+
+JsonVariant& JsonVariant::operator=(bool value) {
+    if(JsonNode* n = materialize()) {
+        *n = JsonNode();
+        n->type = JsonNode::Bool;
+        n->boolean = value;
+    }
+    return *this;
+}
+
+JsonVariant& JsonVariant::set_integer(long long value) {
+    if(JsonNode* n = materialize()) {
+        *n = JsonNode();
+        n->type = JsonNode::Integer;
+        n->integer = value;
+        n->number = (double)value;
+    }
+    return *this;
+}
+
+JsonVariant& JsonVariant::operator=(double value) {
+    if(JsonNode* n = materialize()) {
+        *n = JsonNode();
+        n->type = JsonNode::Float;
+        n->number = value;
+        n->integer = (long long)value;
+    }
+    return *this;
+}
+
+JsonVariant& JsonVariant::operator=(const char* value) {
+    if(JsonNode* n = materialize()) {
+        *n = JsonNode();
+        if(value) {
+            n->type = JsonNode::Str;
+            n->text = value;
+        }
+    }
+    return *this;
+}
+
+template <>
+const char* JsonVariant::as<const char*>() const {
+    return node && node->type == JsonNode::Str ? node->text.c_str() : nullptr;
+}
+template <>
+String JsonVariant::as<String>() const {
+    if(!node) return String("null");
+    switch(node->type) {
+    case JsonNode::Str:
+        return String(node->text);
+    case JsonNode::Integer:
+        return String(node->integer);
+    case JsonNode::Float:
+        return String(node->number, 6);
+    case JsonNode::Bool:
+        return String(node->boolean ? "true" : "false");
+    default:
+        return String("null");
+    }
+}
+template <>
+bool JsonVariant::as<bool>() const {
+    return node && (node->type == JsonNode::Bool ? node->boolean : node->integer != 0);
+}
+template <>
+double JsonVariant::as<double>() const {
+    return node && (node->type == JsonNode::Integer || node->type == JsonNode::Float) ? node->number : 0;
+}
+template <>
+float JsonVariant::as<float>() const {
+    return (float)as<double>();
+}
+template <>
+long long JsonVariant::as<long long>() const {
+    return node && (node->type == JsonNode::Integer || node->type == JsonNode::Float) ? node->integer : 0;
+}
+template <>
+unsigned long long JsonVariant::as<unsigned long long>() const {
+    return (unsigned long long)as<long long>();
+}
+template <>
+long JsonVariant::as<long>() const {
+    return (long)as<long long>();
+}
+template <>
+unsigned long JsonVariant::as<unsigned long>() const {
+    return (unsigned long)as<long long>();
+}
+template <>
+int JsonVariant::as<int>() const {
+    return (int)as<long long>();
+}
+template <>
+unsigned int JsonVariant::as<unsigned int>() const {
+    return (unsigned int)as<long long>();
+}
+
+template <>
+bool JsonVariant::is<const char*>() const {
+    return node && node->type == JsonNode::Str;
+}
+template <>
+bool JsonVariant::is<String>() const {
+    return is<const char*>();
+}
+template <>
+bool JsonVariant::is<bool>() const {
+    return node && node->type == JsonNode::Bool;
+}
+
+const char* DeserializationError::c_str() const {
+    static const char* const names[] = {"Ok", "EmptyInput", "IncompleteInput", "InvalidInput", "NoMemory", "TooDeep"};
+    return names[value];
+}
+
+namespace {
+
+class JsonParser {
+public:
+    JsonParser(const char* input, size_t length) : p(input), end(input + length) {}
+
+    DeserializationError parse(JsonNode& root) {
+        skip_ws();
+        if(p == end) return DeserializationError::EmptyInput;
+        return value(root, 0);
+    }
+
+private:
+    void skip_ws() {
+        while(p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) p++;
+    }
+
+    DeserializationError value(JsonNode& node, int depth) {
+        if(depth > 10) return DeserializationError::TooDeep;
+        skip_ws();
+        if(p == end) return DeserializationError::IncompleteInput;
+        node = JsonNode();
+        switch(*p) {
+        case '{':
+            return object(node, depth);
+        case '[':
+            return array(node, depth);
+        case '"':
+            node.type = JsonNode::Str;
+            return string(node.text);
+        case 't':
+            node.type = JsonNode::Bool;
+            node.boolean = true;
+            return literal("true");
+        case 'f':
+            node.type = JsonNode::Bool;
+            return literal("false");
+        case 'n':
+            return literal("null");
+        default:
+            return number(node);
+        }
+    }
+
+    DeserializationError literal(const char* word) {
+        size_t length = strlen(word);
+        if((size_t)(end - p) < length) return DeserializationError::IncompleteInput;
+        if(strncmp(p, word, length) != 0) return DeserializationError::InvalidInput;
+        p += length;
+        return DeserializationError::Ok;
+    }
+
+    DeserializationError number(JsonNode& node) {
+        const char* start = p;
+        bool is_float = false;
+        if(p < end && (*p == '-' || *p == '+')) p++;
+        while(p < end && (isdigit((unsigned char)*p) || *p == '.' || *p == 'e' || *p == 'E' || *p == '-' || *p == '+')) {
+            if(*p == '.' || *p == 'e' || *p == 'E') is_float = true;
+            p++;
+        }
+        if(p == start) return DeserializationError::InvalidInput;
+        std::string text(start, p);
+        node.number = strtod(text.c_str(), nullptr);
+        if(is_float) {
+            node.type = JsonNode::Float;
+            node.integer = (long long)node.number;
+        } else {
+            node.type = JsonNode::Integer;
+            node.integer = strtoll(text.c_str(), nullptr, 10);
+        }
+        return DeserializationError::Ok;
+    }
+
+    static void append_utf8(std::string& out, unsigned long cp) {
+        if(cp < 0x80) {
+            out += (char)cp;
+        } else if(cp < 0x800) {
+            out += (char)(0xC0 | (cp >> 6));
+            out += (char)(0x80 | (cp & 0x3F));
+        } else if(cp < 0x10000) {
+            out += (char)(0xE0 | (cp >> 12));
+            out += (char)(0x80 | ((cp >> 6) & 0x3F));
+            out += (char)(0x80 | (cp & 0x3F));
+        } else {
+            out += (char)(0xF0 | (cp >> 18));
+            out += (char)(0x80 | ((cp >> 12) & 0x3F));
+            out += (char)(0x80 | ((cp >> 6) & 0x3F));
+            out += (char)(0x80 | (cp & 0x3F));
+        }
+    }
+
+    DeserializationError string(std::string& out) {
+        p++; // opening quote
+        while(p < end && *p != '"') {
+            if(*p != '\\') {
+                out += *p++;
+                continue;
+            }
+            if(++p == end) return DeserializationError::IncompleteInput;
+            char escape = *p++;
+            switch(escape) {
+            case 'n':
+                out += '\n';
+                break;
+            case 't':
+                out += '\t';
+                break;
+            case 'r':
+                out += '\r';
+                break;
+            case 'b':
+                out += '\b';
+                break;
+            case 'f':
+                out += '\f';
+                break;
+            case 'u': {
+                if(end - p < 4) return DeserializationError::IncompleteInput;
+                unsigned long cp = strtoul(std::string(p, p + 4).c_str(), nullptr, 16);
+                p += 4;
+                if(cp >= 0xD800 && cp < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                    unsigned long low = strtoul(std::string(p + 2, p + 6).c_str(), nullptr, 16);
+                    p += 6;
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                }
+                append_utf8(out, cp);
+                break;
+            }
+            default:
+                out += escape;
+                break;
+            }
+        }
+        if(p == end) return DeserializationError::IncompleteInput;
+        p++; // closing quote
+        return DeserializationError::Ok;
+    }
+
+    DeserializationError object(JsonNode& node, int depth) {
+        node.type = JsonNode::Object;
+        p++;
+        skip_ws();
+        if(p < end && *p == '}') {
+            p++;
+            return DeserializationError::Ok;
+        }
+        while(p < end) {
+            skip_ws();
+            if(p == end) break;
+            if(*p != '"') return DeserializationError::InvalidInput;
+            std::string key;
+            DeserializationError error = string(key);
+            if(error) return error;
+            skip_ws();
+            if(p == end) break;
+            if(*p++ != ':') return DeserializationError::InvalidInput;
+            node.members.push_back({key, JsonNode()});
+            error = value(node.members.back().second, depth + 1);
+            if(error) return error;
+            skip_ws();
+            if(p == end) break;
+            if(*p == ',') {
+                p++;
+            } else if(*p == '}') {
+                p++;
+                return DeserializationError::Ok;
+            } else {
+                return DeserializationError::InvalidInput;
+            }
+        }
+        return DeserializationError::IncompleteInput;
+    }
+
+    DeserializationError array(JsonNode& node, int depth) {
+        node.type = JsonNode::Array;
+        p++;
+        skip_ws();
+        if(p < end && *p == ']') {
+            p++;
+            return DeserializationError::Ok;
+        }
+        while(p < end) {
+            node.items.push_back(JsonNode());
+            DeserializationError error = value(node.items.back(), depth + 1);
+            if(error) return error;
+            skip_ws();
+            if(p == end) break;
+            if(*p == ',') {
+                p++;
+            } else if(*p == ']') {
+                p++;
+                return DeserializationError::Ok;
+            } else {
+                return DeserializationError::InvalidInput;
+            }
+        }
+        return DeserializationError::IncompleteInput;
+    }
+
+    const char* p;
+    const char* end;
+};
+
+void serialize_node(const JsonNode& node, std::string& out) {
+    switch(node.type) {
+    case JsonNode::Null:
+        out += "null";
+        break;
+    case JsonNode::Bool:
+        out += node.boolean ? "true" : "false";
+        break;
+    case JsonNode::Integer:
+        out += std::to_string(node.integer);
+        break;
+    case JsonNode::Float: {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%.9g", node.number);
+        out += buffer;
+        break;
+    }
+    case JsonNode::Str:
+        out += '"';
+        for(char c : node.text) {
+            switch(c) {
+            case '"':
+                out += "\\\"";
+                break;
+            case '\\':
+                out += "\\\\";
+                break;
+            case '\n':
+                out += "\\n";
+                break;
+            case '\r':
+                out += "\\r";
+                break;
+            case '\t':
+                out += "\\t";
+                break;
+            default:
+                if((unsigned char)c < 0x20) {
+                    char buffer[8];
+                    snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+                    out += buffer;
+                } else {
+                    out += c;
+                }
+            }
+        }
+        out += '"';
+        break;
+    case JsonNode::Object:
+        out += '{';
+        for(size_t i = 0; i < node.members.size(); i++) {
+            if(i) out += ',';
+            JsonNode key;
+            key.type = JsonNode::Str;
+            key.text = node.members[i].first;
+            serialize_node(key, out);
+            out += ':';
+            serialize_node(node.members[i].second, out);
+        }
+        out += '}';
+        break;
+    case JsonNode::Array:
+        out += '[';
+        for(size_t i = 0; i < node.items.size(); i++) {
+            if(i) out += ',';
+            serialize_node(node.items[i], out);
+        }
+        out += ']';
+        break;
+    }
+}
+
+} // namespace
+
+DeserializationError deserializeJson(JsonDocument& doc, const char* input, size_t length) {
+    doc.clear();
+    return JsonParser(input, length).parse(doc.root);
+}
+
+DeserializationError deserializeJson(JsonDocument& doc, Stream& input) {
+    // Reads one complete top-level value, tracking nesting and strings
+    std::string text;
+    int depth = 0;
+    bool in_string = false;
+    bool escaped = false;
+    uint8_t c;
+    while(input.readBytes(&c, 1) == 1) {
+        text += (char)c;
+        if(in_string) {
+            if(escaped) {
+                escaped = false;
+            } else if(c == '\\') {
+                escaped = true;
+            } else if(c == '"') {
+                in_string = false;
+            }
+            continue;
+        }
+        if(c == '"') {
+            in_string = true;
+        } else if(c == '{' || c == '[') {
+            depth++;
+        } else if((c == '}' || c == ']') && --depth == 0) {
+            break;
+        }
+    }
+    return deserializeJson(doc, text.c_str(), text.size());
+}
+
+size_t serializeJson(const JsonDocument& doc, String& output) {
+    std::string out;
+    serialize_node(doc.root, out);
+    output = String(out);
+    return out.size();
+}
+
+size_t measureJson(const JsonDocument& doc) {
+    std::string out;
+    serialize_node(doc.root, out);
+    return out.size();
+}
+
+/* ESP */
+
+EspClass ESP;
+
+static size_t heap_baseline = 0;
+// Sampled from every task that writes to a socket
+static std::atomic<uint32_t> heap_minimum_free{UINT32_MAX};
+
+uint32_t EspClass::getHeapSize() {
+    const char* bytes = getenv("ESP32_SHIM_HEAP_BYTES");
+    return bytes ? strtoul(bytes, nullptr, 10) : 320 * 1024;
+}
+
+uint32_t EspClass::getFreeHeap() {
+    struct mallinfo2 info = mallinfo2();
+    size_t used = info.uordblks > heap_baseline ? info.uordblks - heap_baseline : 0;
+    uint32_t size = getHeapSize();
+    uint32_t free_heap = used < size ? size - used : 0;
+    uint32_t minimum = heap_minimum_free.load();
+    while(free_heap < minimum && !heap_minimum_free.compare_exchange_weak(minimum, free_heap)) {
+    }
+    return free_heap;
+}
+
+uint32_t EspClass::getMinFreeHeap() {
+    getFreeHeap();
+    return heap_minimum_free;
+}
+
+uint32_t EspClass::getMaxAllocHeap() {
+    // Free chunks below the top of malloc's heap are the holes
+    struct mallinfo2 info = mallinfo2();
+    size_t holes = info.fordblks > info.keepcost ? info.fordblks - info.keepcost : 0;
+    uint32_t free_heap = getFreeHeap();
+    return free_heap > holes ? free_heap - holes : 0;
+}
+
+/* Sketch entry point */
+
+void setup();
+void loop();
+
+// The Arduino core runs setup() and loop() in a task of its own
+static void loop_task(void*) {
+    setup();
+    for(;;) {
+        loop();
+        ESP.getFreeHeap();
+        Serial.idle(1);
+    }
+}
+
+int main() {
+    // One malloc arena for all tasks, as the ESP32 has one heap; its free top is then
+    // keepcost and the rest of the free chunks are holes
+    mallopt(M_ARENA_MAX, 1);
+    heap_baseline = mallinfo2().uordblks;
+    main_task.function = loop_task;
+    if(!shim_task_start(&main_task, shim_loop_stack_depth)) {
+        return 1;
+    }
+    pthread_join(main_task.thread, nullptr);
+    return 0;
+}
@@ -0,0 +1,12 @@
+// Host shim for ESP-IDF's certificate bundle: attaching it trusts the system CA store,
+// plus the PEM file named by ESP32_SHIM_CA_FILE, such as a test server's self-signed
+// certificate.
+#pragma once
+
+#include "mbedtls/ssl.h"
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+esp_err_t esp_crt_bundle_attach(void* conf);
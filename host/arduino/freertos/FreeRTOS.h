@@ -0,0 +1,21 @@
+// Host shim for the FreeRTOS calls the sketches make.  Tasks are detached pthreads,
+// mutexes are timed mutexes and a tick is one millisecond.
+#pragma once
+
+#include <cstdint>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef struct ShimTask* TaskHandle_t;
+typedef void (*TaskFunction_t)(void* parameter);
+typedef struct ShimSemaphore* SemaphoreHandle_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS 1
+#define pdFAIL 0
+#define portMAX_DELAY 0xFFFFFFFFUL
+#define portTICK_PERIOD_MS 1
+#define configTICK_RATE_HZ 1000
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+BaseType_t xTaskCreatePinnedToCore(
+    TaskFunction_t function,
+    const char* name,
+    uint32_t stack_depth,
+    void* parameter,
+    UBaseType_t priority,
+    TaskHandle_t* handle,
+    BaseType_t core);
+BaseType_t xTaskCreate(
+    TaskFunction_t function,
+    const char* name,
+    uint32_t stack_depth,
+    void* parameter,
+    UBaseType_t priority,
+    TaskHandle_t* handle);
+// Only vTaskDelete(NULL), a task ending itself, is supported
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount();
+TaskHandle_t xTaskGetCurrentTaskHandle();
+// Least stack the task (NULL: the calling one) has had left, in bytes as on ESP-IDF.  Task
+// stacks are painted and measured against the depth they were created with; the loop()
+// task has the Arduino core's 8 KB.
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait);
@@ -0,0 +1,6 @@
+// Host shim for mbed TLS's platform utilities the sketches use.
+#pragma once
+
+#include <cstddef>
+
+void mbedtls_platform_zeroize(void* buf, size_t len);
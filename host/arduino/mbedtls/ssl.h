@@ -0,0 +1,84 @@
+// Host shim for the part of mbed TLS's SSL API the sketches use, on top of OpenSSL.
+// It is TLS 1.2 only, like mbed TLS 2.28 on the ESP32, so sessions resume by session
+// ID or RFC 5077 ticket.  Records go through the application's send/recv callbacks,
+// as with mbedtls_ssl_set_bio.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/entropy.h"
+
+#define MBEDTLS_ERR_NET_CONN_RESET -0x0050
+#define MBEDTLS_ERR_NET_SEND_FAILED -0x004E
+#define MBEDTLS_ERR_X509_CERT_VERIFY_FAILED -0x2700
+#define MBEDTLS_ERR_SSL_BAD_INPUT_DATA -0x7100
+#define MBEDTLS_ERR_SSL_ALLOC_FAILED -0x7F00
+#define MBEDTLS_ERR_SSL_INTERNAL_ERROR -0x6C00
+#define MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY -0x7880
+#define MBEDTLS_ERR_SSL_WANT_READ -0x6900
+#define MBEDTLS_ERR_SSL_WANT_WRITE -0x6880
+#define MBEDTLS_ERR_SSL_TIMEOUT -0x6800
+
+#define MBEDTLS_SSL_IS_CLIENT 0
+#define MBEDTLS_SSL_TRANSPORT_STREAM 0
+#define MBEDTLS_SSL_PRESET_DEFAULT 0
+#define MBEDTLS_SSL_VERIFY_NONE 0
+#define MBEDTLS_SSL_VERIFY_OPTIONAL 1
+#define MBEDTLS_SSL_VERIFY_REQUIRED 2
+#define MBEDTLS_SSL_SESSION_TICKETS_DISABLED 0
+#define MBEDTLS_SSL_SESSION_TICKETS_ENABLED 1
+
+typedef int mbedtls_ssl_send_t(void* ctx, const unsigned char* buf, size_t len);
+typedef int mbedtls_ssl_recv_t(void* ctx, unsigned char* buf, size_t len);
+typedef int mbedtls_ssl_recv_timeout_t(void* ctx, unsigned char* buf, size_t len, uint32_t timeout);
+
+typedef struct mbedtls_ssl_session {
+    unsigned char id[32];
+    size_t id_len;
+    unsigned char master[48];
+    void* handle; // SSL_SESSION
+} mbedtls_ssl_session;
+
+typedef struct mbedtls_ssl_config {
+    void* ctx; // SSL_CTX
+    int authmode;
+} mbedtls_ssl_config;
+
+typedef struct mbedtls_ssl_context {
+    const mbedtls_ssl_config* conf;
+    void* ssl; // SSL, recreated by mbedtls_ssl_session_reset
+    char* hostname;
+    void* p_bio;
+    mbedtls_ssl_send_t* f_send;
+    mbedtls_ssl_recv_t* f_recv;
+} mbedtls_ssl_context;
+
+void mbedtls_ssl_config_init(mbedtls_ssl_config* conf);
+void mbedtls_ssl_config_free(mbedtls_ssl_config* conf);
+int mbedtls_ssl_config_defaults(mbedtls_ssl_config* conf, int endpoint, int transport, int preset);
+void mbedtls_ssl_conf_authmode(mbedtls_ssl_config* conf, int authmode);
+void mbedtls_ssl_conf_rng(mbedtls_ssl_config* conf, int (*f_rng)(void*, unsigned char*, size_t), void* p_rng);
+void mbedtls_ssl_conf_session_tickets(mbedtls_ssl_config* conf, int use_tickets);
+
+void mbedtls_ssl_init(mbedtls_ssl_context* ssl);
+void mbedtls_ssl_free(mbedtls_ssl_context* ssl);
+int mbedtls_ssl_setup(mbedtls_ssl_context* ssl, const mbedtls_ssl_config* conf);
+int mbedtls_ssl_session_reset(mbedtls_ssl_context* ssl);
+int mbedtls_ssl_set_hostname(mbedtls_ssl_context* ssl, const char* hostname);
+void mbedtls_ssl_set_bio(
+    mbedtls_ssl_context* ssl,
+    void* p_bio,
+    mbedtls_ssl_send_t* f_send,
+    mbedtls_ssl_recv_t* f_recv,
+    mbedtls_ssl_recv_timeout_t* f_recv_timeout);
+int mbedtls_ssl_handshake(mbedtls_ssl_context* ssl);
+uint32_t mbedtls_ssl_get_verify_result(const mbedtls_ssl_context* ssl);
+int mbedtls_ssl_read(mbedtls_ssl_context* ssl, unsigned char* buf, size_t len);
+int mbedtls_ssl_write(mbedtls_ssl_context* ssl, const unsigned char* buf, size_t len);
+int mbedtls_ssl_close_notify(mbedtls_ssl_context* ssl);
+
+void mbedtls_ssl_session_init(mbedtls_ssl_session* session);
+void mbedtls_ssl_session_free(mbedtls_ssl_session* session);
+int mbedtls_ssl_get_session(const mbedtls_ssl_context* ssl, mbedtls_ssl_session* session);
+int mbedtls_ssl_set_session(mbedtls_ssl_context* ssl, const mbedtls_ssl_session* session);
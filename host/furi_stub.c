@@ -0,0 +1,976 @@
+/**
+ * Host implementations of the furi, furi_hal, gui and storage APIs declared in
+ * host/include.  Threads, mutexes, queues and stream buffers are backed by pthreads;
+ * the USART is backed by an in-memory pipe or a pty (see host_uart.h).
+*/
+
+#define _GNU_SOURCE
+#include <furi.h>
+#include <furi_hal.h>
+#include <gui/gui.h>
+#include <storage/storage.h>
+#include "host_uart.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static void deadline_from_timeout(struct timespec* deadline, uint32_t timeout) {
+    clock_gettime(CLOCK_REALTIME, deadline);
+    deadline->tv_sec += timeout / 1000;
+    deadline->tv_nsec += (long)(timeout % 1000) * 1000000L;
+    if(deadline->tv_nsec >= 1000000000L) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+// Waits on cond; returns false once timeout has expired.  A zero timeout never waits.
+static bool cond_wait_timeout(pthread_cond_t* cond, pthread_mutex_t* mutex, uint32_t timeout) {
+    if(timeout == 0) {
+        return false;
+    }
+    if(timeout == FuriWaitForever) {
+        pthread_cond_wait(cond, mutex);
+        return true;
+    }
+    struct timespec deadline;
+    deadline_from_timeout(&deadline, timeout);
+    return pthread_cond_timedwait(cond, mutex, &deadline) != ETIMEDOUT;
+}
+
+uint32_t furi_get_tick(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)(now.tv_sec * 1000ULL + now.tv_nsec / 1000000ULL);
+}
+
+void furi_delay_ms(uint32_t milliseconds) {
+    usleep(milliseconds * 1000U);
+}
+
+static size_t heap_minimum_free = HOST_HEAP_SIZE;
+
+size_t memmgr_get_free_heap(void) {
+    struct mallinfo2 info = mallinfo2();
+    size_t free_heap = info.uordblks < HOST_HEAP_SIZE ? HOST_HEAP_SIZE - info.uordblks : 0;
+    if(free_heap < heap_minimum_free) {
+        heap_minimum_free = free_heap;
+    }
+    return free_heap;
+}
+
+size_t memmgr_get_minimum_free_heap(void) {
+    return heap_minimum_free;
+}
+
+// One malloc arena for every thread, as the Flipper has one heap; its free top is then
+// keepcost and the rest of malloc's free chunks are holes
+__attribute__((constructor)) static void memmgr_single_arena(void) {
+    mallopt(M_ARENA_MAX, 1);
+}
+
+size_t memmgr_heap_get_max_free_block(void) {
+    struct mallinfo2 info = mallinfo2();
+    size_t holes = info.fordblks > info.keepcost ? info.fordblks - info.keepcost : 0;
+    size_t free_heap = memmgr_get_free_heap();
+    return free_heap > holes ? free_heap - holes : 0;
+}
+
+/* Records */
+
+struct Gui {
+    ViewPort* view_port;
+};
+
+struct Storage {
+    int unused;
+};
+
+static Gui host_gui;
+static Storage host_storage;
+
+void* furi_record_open(const char* name) {
+    if(strcmp(name, RECORD_GUI) == 0) return &host_gui;
+    if(strcmp(name, RECORD_STORAGE) == 0) return &host_storage;
+    return NULL;
+}
+
+void furi_record_close(const char* name) {
+    UNUSED(name);
+}
+
+/* Strings */
+
+struct FuriString {
+    char* data;
+    size_t size;
+    size_t capacity;
+};
+
+static void furi_string_reserve(FuriString* string, size_t size) {
+    if(size + 1 > string->capacity) {
+        size_t capacity = string->capacity ? string->capacity : 16;
+        while(capacity < size + 1) capacity *= 2;
+        string->data = realloc(string->data, capacity);
+        string->capacity = capacity;
+    }
+}
+
+FuriString* furi_string_alloc(void) {
+    FuriString* string = calloc(1, sizeof(FuriString));
+    furi_string_reserve(string, 0);
+    string->data[0] = '\0';
+    return string;
+}
+
+FuriString* furi_string_alloc_set_str(const char* cstr) {
+    FuriString* string = furi_string_alloc();
+    furi_string_set_str(string, cstr);
+    return string;
+}
+
+void furi_string_free(FuriString* string) {
+    free(string->data);
+    free(string);
+}
+
+const char* furi_string_get_cstr(const FuriString* string) {
+    return string->data;
+}
+
+size_t furi_string_size(const FuriString* string) {
+    return string->size;
+}
+
+void furi_string_reset(FuriString* string) {
+    string->size = 0;
+    string->data[0] = '\0';
+}
+
+void furi_string_push_back(FuriString* string, char c) {
+    furi_string_reserve(string, string->size + 1);
+    string->data[string->size++] = c;
+    string->data[string->size] = '\0';
+}
+
+void furi_string_set_strn(FuriString* string, const char* cstr, size_t n) {
+    furi_string_reserve(string, n);
+    memmove(string->data, cstr, n);
+    string->size = n;
+    string->data[n] = '\0';
+}
+
+void furi_string_set_str(FuriString* string, const char* cstr) {
+    furi_string_set_strn(string, cstr, strlen(cstr));
+}
+
+void furi_string_cat_str(FuriString* string, const char* cstr) {
+    size_t length = strlen(cstr);
+    furi_string_reserve(string, string->size + length);
+    memcpy(string->data + string->size, cstr, length + 1);
+    string->size += length;
+}
+
+int furi_string_printf(FuriString* string, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if(length < 0) return length;
+
+    furi_string_reserve(string, (size_t)length);
+    va_start(args, format);
+    vsnprintf(string->data, (size_t)length + 1, format, args);
+    va_end(args);
+    string->size = (size_t)length;
+    return length;
+}
+
+/* Mutex */
+
+struct FuriMutex {
+    pthread_mutex_t mutex;
+};
+
+FuriMutex* furi_mutex_alloc(FuriMutexType type) {
+    FuriMutex* mutex = malloc(sizeof(FuriMutex));
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    if(type == FuriMutexTypeRecursive) {
+        pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    }
+    pthread_mutex_init(&mutex->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    return mutex;
+}
+
+void furi_mutex_free(FuriMutex* mutex) {
+    pthread_mutex_destroy(&mutex->mutex);
+    free(mutex);
+}
+
+FuriStatus furi_mutex_acquire(FuriMutex* mutex, uint32_t timeout) {
+    if(timeout == FuriWaitForever) {
+        return pthread_mutex_lock(&mutex->mutex) == 0 ? FuriStatusOk : FuriStatusError;
+    }
+    if(timeout == 0) {
+        return pthread_mutex_trylock(&mutex->mutex) == 0 ? FuriStatusOk : FuriStatusErrorResource;
+    }
+    struct timespec deadline;
+    deadline_from_timeout(&deadline, timeout);
+    return pthread_mutex_timedlock(&mutex->mutex, &deadline) == 0 ? FuriStatusOk :
+                                                                      FuriStatusErrorTimeout;
+}
+
+FuriStatus furi_mutex_release(FuriMutex* mutex) {
+    return pthread_mutex_unlock(&mutex->mutex) == 0 ? FuriStatusOk : FuriStatusError;
+}
+
+/* Message queue */
+
+struct FuriMessageQueue {
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    uint8_t* slots;
+    uint32_t msg_count;
+    uint32_t msg_size;
+    uint32_t head;
+    uint32_t count;
+};
+
+FuriMessageQueue* furi_message_queue_alloc(uint32_t msg_count, uint32_t msg_size) {
+    FuriMessageQueue* queue = calloc(1, sizeof(FuriMessageQueue));
+    pthread_mutex_init(&queue->mutex, NULL);
+    pthread_cond_init(&queue->changed, NULL);
+    queue->slots = malloc((size_t)msg_count * msg_size);
+    queue->msg_count = msg_count;
+    queue->msg_size = msg_size;
+    return queue;
+}
+
+void furi_message_queue_free(FuriMessageQueue* instance) {
+    pthread_cond_destroy(&instance->changed);
+    pthread_mutex_destroy(&instance->mutex);
+    free(instance->slots);
+    free(instance);
+}
+
+FuriStatus furi_message_queue_put(FuriMessageQueue* instance, const void* msg_ptr, uint32_t timeout) {
+    FuriStatus status = FuriStatusOk;
+    pthread_mutex_lock(&instance->mutex);
+    while(instance->count == instance->msg_count) {
+        if(!cond_wait_timeout(&instance->changed, &instance->mutex, timeout)) {
+            status = timeout ? FuriStatusErrorTimeout : FuriStatusErrorResource;
+            break;
+        }
+    }
+    if(status == FuriStatusOk) {
+        uint32_t tail = (instance->head + instance->count) % instance->msg_count;
+        memcpy(instance->slots + (size_t)tail * instance->msg_size, msg_ptr, instance->msg_size);
+        instance->count++;
+        pthread_cond_broadcast(&instance->changed);
+    }
+    pthread_mutex_unlock(&instance->mutex);
+    return status;
+}
+
+FuriStatus furi_message_queue_get(FuriMessageQueue* instance, void* msg_ptr, uint32_t timeout) {
+    FuriStatus status = FuriStatusOk;
+    pthread_mutex_lock(&instance->mutex);
+    while(instance->count == 0) {
+        if(!cond_wait_timeout(&instance->changed, &instance->mutex, timeout)) {
+            status = timeout ? FuriStatusErrorTimeout : FuriStatusErrorResource;
+            break;
+        }
+    }
+    if(status == FuriStatusOk) {
+        memcpy(msg_ptr, instance->slots + (size_t)instance->head * instance->msg_size, instance->msg_size);
+        instance->head = (instance->head + 1) % instance->msg_count;
+        instance->count--;
+        pthread_cond_broadcast(&instance->changed);
+    }
+    pthread_mutex_unlock(&instance->mutex);
+    return status;
+}
+
+uint32_t furi_message_queue_get_count(FuriMessageQueue* instance) {
+    pthread_mutex_lock(&instance->mutex);
+    uint32_t count = instance->count;
+    pthread_mutex_unlock(&instance->mutex);
+    return count;
+}
+
+/* Stream buffer */
+
+struct FuriStreamBuffer {
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    uint8_t* data;
+    size_t size;
+    size_t head;
+    size_t count;
+};
+
+FuriStreamBuffer* furi_stream_buffer_alloc(size_t size, size_t trigger_level) {
+    UNUSED(trigger_level);
+    FuriStreamBuffer* stream = calloc(1, sizeof(FuriStreamBuffer));
+    pthread_mutex_init(&stream->mutex, NULL);
+    pthread_cond_init(&stream->changed, NULL);
+    stream->data = malloc(size);
+    stream->size = size;
+    return stream;
+}
+
+void furi_stream_buffer_free(FuriStreamBuffer* stream_buffer) {
+    pthread_cond_destroy(&stream_buffer->changed);
+    pthread_mutex_destroy(&stream_buffer->mutex);
+    free(stream_buffer->data);
+    free(stream_buffer);
+}
+
+size_t furi_stream_buffer_send(
+    FuriStreamBuffer* stream_buffer,
+    const void* data,
+    size_t length,
+    uint32_t timeout) {
+    const uint8_t* bytes = data;
+    size_t sent = 0;
+    pthread_mutex_lock(&stream_buffer->mutex);
+    while(sent < length) {
+        if(stream_buffer->count == stream_buffer->size) {
+            if(!cond_wait_timeout(&stream_buffer->changed, &stream_buffer->mutex, timeout)) break;
+            continue;
+        }
+        size_t tail = (stream_buffer->head + stream_buffer->count) % stream_buffer->size;
+        stream_buffer->data[tail] = bytes[sent++];
+        stream_buffer->count++;
+    }
+    if(sent > 0) pthread_cond_broadcast(&stream_buffer->changed);
+    pthread_mutex_unlock(&stream_buffer->mutex);
+    return sent;
+}
+
+size_t furi_stream_buffer_receive(
+    FuriStreamBuffer* stream_buffer,
+    void* data,
+    size_t length,
+    uint32_t timeout) {
+    uint8_t* bytes = data;
+    size_t received = 0;
+    pthread_mutex_lock(&stream_buffer->mutex);
+    while(stream_buffer->count == 0) {
+        if(!cond_wait_timeout(&stream_buffer->changed, &stream_buffer->mutex, timeout)) break;
+    }
+    while(received < length && stream_buffer->count > 0) {
+        bytes[received++] = stream_buffer->data[stream_buffer->head];
+        stream_buffer->head = (stream_buffer->head + 1) % stream_buffer->size;
+        stream_buffer->count--;
+    }
+    if(received > 0) pthread_cond_broadcast(&stream_buffer->changed);
+    pthread_mutex_unlock(&stream_buffer->mutex);
+    return received;
+}
+
+size_t furi_stream_buffer_bytes_available(FuriStreamBuffer* stream_buffer) {
+    pthread_mutex_lock(&stream_buffer->mutex);
+    size_t count = stream_buffer->count;
+    pthread_mutex_unlock(&stream_buffer->mutex);
+    return count;
+}
+
+size_t furi_stream_buffer_spaces_available(FuriStreamBuffer* stream_buffer) {
+    pthread_mutex_lock(&stream_buffer->mutex);
+    size_t spaces = stream_buffer->size - stream_buffer->count;
+    pthread_mutex_unlock(&stream_buffer->mutex);
+    return spaces;
+}
+
+/* Threads */
+
+// Thread stacks are this big whatever the thread asked for, since host code needs more;
+// they are filled with HOST_STACK_PAINT so the deepest byte ever used can be found.  Host
+// frames run about HOST_STACK_SCALE times the size of Thumb-2 ones (64-bit registers and
+// pointers, glibc's stdio), so use is measured against the requested size times that and
+// reported back in Flipper-sized bytes.
+#define HOST_THREAD_STACK_SIZE (256 * 1024)
+#define HOST_STACK_PAINT 0xA5
+#define HOST_STACK_SCALE 4
+
+struct FuriThread {
+    pthread_t pthread;
+    uint8_t* stack;
+    uint8_t* stack_top; // the thread body's frame; use below it is the thread's own
+    uint32_t stack_size;
+    pthread_mutex_t mutex;
+    pthread_cond_t flags_changed;
+    uint32_t flags;
+    FuriThreadCallback callback;
+    void* context;
+    int32_t ret;
+    bool started;
+};
+
+static __thread FuriThread* current_thread;
+
+static void* furi_thread_body(void* arg) {
+    FuriThread* thread = arg;
+    uint8_t top;
+    thread->stack_top = &top;
+    current_thread = thread;
+    thread->ret = thread->callback(thread->context);
+    return NULL;
+}
+
+FuriThread* furi_thread_alloc_ex(
+    const char* name,
+    uint32_t stack_size,
+    FuriThreadCallback callback,
+    void* context) {
+    UNUSED(name);
+    FuriThread* thread = calloc(1, sizeof(FuriThread));
+    thread->stack_size = stack_size;
+    pthread_mutex_init(&thread->mutex, NULL);
+    pthread_cond_init(&thread->flags_changed, NULL);
+    thread->callback = callback;
+    thread->context = context;
+    return thread;
+}
+
+void furi_thread_free(FuriThread* thread) {
+    pthread_cond_destroy(&thread->flags_changed);
+    pthread_mutex_destroy(&thread->mutex);
+    if(thread->stack) {
+        munmap(thread->stack, HOST_THREAD_STACK_SIZE);
+    }
+    free(thread);
+}
+
+void furi_thread_start(FuriThread* thread) {
+    if(!thread->stack) {
+        thread->stack = mmap(NULL, HOST_THREAD_STACK_SIZE, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+        if(thread->stack == MAP_FAILED) {
+            thread->stack = NULL;
+        }
+    }
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if(thread->stack) {
+        memset(thread->stack, HOST_STACK_PAINT, HOST_THREAD_STACK_SIZE);
+        pthread_attr_setstack(&attr, thread->stack, HOST_THREAD_STACK_SIZE);
+    }
+    thread->started = pthread_create(&thread->pthread, &attr, furi_thread_body, thread) == 0;
+    pthread_attr_destroy(&attr);
+}
+
+bool furi_thread_join(FuriThread* thread) {
+    if(thread->started) {
+        pthread_join(thread->pthread, NULL);
+        thread->started = false;
+    }
+    return true;
+}
+
+FuriThreadId furi_thread_get_id(FuriThread* thread) {
+    return thread;
+}
+
+FuriThreadId furi_thread_get_current_id(void) {
+    return current_thread;
+}
+
+uint32_t furi_thread_get_stack_space(FuriThreadId thread_id) {
+    if(!thread_id || !thread_id->stack || !thread_id->stack_top) {
+        return 0;
+    }
+    // Only the thread's scaled budget is scanned, like FreeRTOS scans only its own stack
+    size_t budget = (size_t)thread_id->stack_size * HOST_STACK_SCALE;
+    size_t window = (size_t)(thread_id->stack_top - thread_id->stack);
+    const uint8_t* deepest = thread_id->stack_top - (budget < window ? budget : window);
+    while(deepest < thread_id->stack_top && *deepest == HOST_STACK_PAINT) {
+        deepest++;
+    }
+    size_t used = thread_id->stack_top - deepest;
+    return used < budget ? (budget - used) / HOST_STACK_SCALE : 0;
+}
+
+uint32_t furi_thread_flags_set(FuriThreadId thread_id, uint32_t flags) {
+    pthread_mutex_lock(&thread_id->mutex);
+    thread_id->flags |= flags;
+    uint32_t result = thread_id->flags;
+    pthread_cond_broadcast(&thread_id->flags_changed);
+    pthread_mutex_unlock(&thread_id->mutex);
+    return result;
+}
+
+uint32_t furi_thread_flags_wait(uint32_t flags, uint32_t options, uint32_t timeout) {
+    FuriThread* thread = current_thread;
+    if(!thread) return FuriFlagError;
+
+    uint32_t result = FuriFlagErrorTimeout;
+    pthread_mutex_lock(&thread->mutex);
+    while(true) {
+        uint32_t set = thread->flags & flags;
+        bool satisfied = (options & FuriFlagWaitAll) ? set == flags : set != 0;
+        if(satisfied) {
+            result = set;
+            if(!(options & FuriFlagNoClear)) thread->flags &= ~set;
+            break;
+        }
+        if(!cond_wait_timeout(&thread->flags_changed, &thread->mutex, timeout)) break;
+    }
+    pthread_mutex_unlock(&thread->mutex);
+    return result;
+}
+
+/* Serial */
+
+struct FuriHalSerialHandle {
+    pthread_mutex_t rx_mutex;
+    FuriHalSerialAsyncRxCallback rx_callback;
+    void* rx_context;
+    uint8_t rx_byte;
+    HostUartTxHook tx_hook;
+    void* tx_context;
+    int pty_fd;
+    pthread_t pty_reader;
+    volatile bool pty_running;
+    uint32_t baud;
+    bool wire_time;
+};
+
+static FuriHalSerialHandle host_serial = {
+    .rx_mutex = PTHREAD_MUTEX_INITIALIZER,
+    .pty_fd = -1,
+    .baud = 115200,
+};
+
+uint32_t furi_hal_cortex_instructions_per_microsecond(void) {
+    return 64;
+}
+
+FuriHalCortexTimer furi_hal_cortex_timer_get(uint32_t timeout_us) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t us = now.tv_sec * 1000000ULL + now.tv_nsec / 1000ULL;
+    FuriHalCortexTimer timer = {
+        .start = (uint32_t)(us * 64),
+        .value = timeout_us * 64,
+    };
+    return timer;
+}
+
+bool furi_hal_bus_is_enabled(FuriHalBus bus) {
+    UNUSED(bus);
+    return true;
+}
+
+uint32_t furi_hal_rtc_get_timestamp(void) {
+    return (uint32_t)time(NULL);
+}
+
+FuriHalSerialHandle* furi_hal_serial_control_acquire(FuriHalSerialId serial_id) {
+    UNUSED(serial_id);
+    return &host_serial;
+}
+
+void furi_hal_serial_control_release(FuriHalSerialHandle* handle) {
+    furi_hal_serial_async_rx_stop(handle);
+}
+
+void furi_hal_serial_init(FuriHalSerialHandle* handle, uint32_t baud) {
+    UNUSED(handle);
+    UNUSED(baud);
+}
+
+void furi_hal_serial_deinit(FuriHalSerialHandle* handle) {
+    UNUSED(handle);
+}
+
+void furi_hal_serial_set_br(FuriHalSerialHandle* handle, uint32_t baud) {
+    handle->baud = baud;
+}
+
+void furi_hal_serial_tx(FuriHalSerialHandle* handle, const uint8_t* buffer, size_t buffer_size) {
+    if(handle->wire_time && handle->baud > 0) {
+        usleep((useconds_t)(buffer_size * 10ULL * 1000000ULL / handle->baud));
+    }
+    if(handle->tx_hook) {
+        handle->tx_hook(buffer, buffer_size, handle->tx_context);
+    }
+    if(handle->pty_fd >= 0) {
+        size_t written = 0;
+        while(written < buffer_size) {
+            ssize_t n = write(handle->pty_fd, buffer + written, buffer_size - written);
+            if(n <= 0) break;
+            written += (size_t)n;
+        }
+    }
+}
+
+void furi_hal_serial_tx_wait_complete(FuriHalSerialHandle* handle) {
+    UNUSED(handle);
+}
+
+void furi_hal_serial_async_rx_start(
+    FuriHalSerialHandle* handle,
+    FuriHalSerialAsyncRxCallback callback,
+    void* context,
+    bool report_errors) {
+    UNUSED(report_errors);
+    pthread_mutex_lock(&handle->rx_mutex);
+    handle->rx_callback = callback;
+    handle->rx_context = context;
+    pthread_mutex_unlock(&handle->rx_mutex);
+}
+
+void furi_hal_serial_async_rx_stop(FuriHalSerialHandle* handle) {
+    pthread_mutex_lock(&handle->rx_mutex);
+    handle->rx_callback = NULL;
+    handle->rx_context = NULL;
+    pthread_mutex_unlock(&handle->rx_mutex);
+}
+
+uint8_t furi_hal_serial_async_rx(FuriHalSerialHandle* handle) {
+    return handle->rx_byte;
+}
+
+void host_uart_inject(const uint8_t* data, size_t length) {
+    // Serialised like a single interrupt source: one byte at a time into the callback
+    pthread_mutex_lock(&host_serial.rx_mutex);
+    for(size_t i = 0; i < length && host_serial.rx_callback; i++) {
+        host_serial.rx_byte = data[i];
+        host_serial.rx_callback(&host_serial, FuriHalSerialRxEventData, host_serial.rx_context);
+    }
+    pthread_mutex_unlock(&host_serial.rx_mutex);
+}
+
+void host_uart_set_wire_time(bool enabled) {
+    host_serial.wire_time = enabled;
+}
+
+void host_uart_set_tx_hook(HostUartTxHook hook, void* context) {
+    host_serial.tx_hook = hook;
+    host_serial.tx_context = context;
+}
+
+static void* host_uart_pty_reader(void* arg) {
+    UNUSED(arg);
+    uint8_t buffer[256];
+    while(host_serial.pty_running) {
+        ssize_t n = read(host_serial.pty_fd, buffer, sizeof(buffer));
+        if(n > 0) {
+            host_uart_inject(buffer, (size_t)n);
+        } else if(n < 0 && errno != EAGAIN && errno != EINTR && errno != EIO) {
+            break;
+        } else {
+            usleep(1000);
+        }
+    }
+    return NULL;
+}
+
+bool host_uart_open_pty(char* name, size_t name_size) {
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if(fd < 0) return false;
+    if(grantpt(fd) != 0 || unlockpt(fd) != 0 || ptsname_r(fd, name, name_size) != 0) {
+        close(fd);
+        return false;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    host_serial.pty_fd = fd;
+    host_serial.pty_running = true;
+    if(pthread_create(&host_serial.pty_reader, NULL, host_uart_pty_reader, NULL) != 0) {
+        host_serial.pty_running = false;
+        host_serial.pty_fd = -1;
+        close(fd);
+        return false;
+    }
+    return true;
+}
+
+void host_uart_close_pty(void) {
+    if(host_serial.pty_fd < 0) return;
+    host_serial.pty_running = false;
+    pthread_join(host_serial.pty_reader, NULL);
+    close(host_serial.pty_fd);
+    host_serial.pty_fd = -1;
+}
+
+/* GUI */
+
+struct ViewPort {
+    ViewPortDrawCallback draw_callback;
+    void* draw_context;
+    ViewPortInputCallback input_callback;
+    void* input_context;
+    bool enabled;
+};
+
+struct Canvas {
+    Font font;
+    uint32_t draw_count;
+};
+
+ViewPort* view_port_alloc(void) {
+    ViewPort* view_port = calloc(1, sizeof(ViewPort));
+    view_port->enabled = true;
+    return view_port;
+}
+
+void view_port_free(ViewPort* view_port) {
+    free(view_port);
+}
+
+void view_port_enabled_set(ViewPort* view_port, bool enabled) {
+    view_port->enabled = enabled;
+}
+
+void view_port_draw_callback_set(ViewPort* view_port, ViewPortDrawCallback callback, void* context) {
+    view_port->draw_callback = callback;
+    view_port->draw_context = context;
+}
+
+void view_port_input_callback_set(
+    ViewPort* view_port,
+    ViewPortInputCallback callback,
+    void* context) {
+    view_port->input_callback = callback;
+    view_port->input_context = context;
+}
+
+void view_port_update(ViewPort* view_port) {
+    // The firmware redraws asynchronously on the GUI thread; the host draws in place.
+    if(view_port->enabled && view_port->draw_callback) {
+        Canvas canvas = {.font = FontPrimary};
+        view_port->draw_callback(&canvas, view_port->draw_context);
+    }
+}
+
+void gui_add_view_port(Gui* gui, ViewPort* view_port, GuiLayer layer) {
+    UNUSED(layer);
+    gui->view_port = view_port;
+}
+
+void gui_remove_view_port(Gui* gui, ViewPort* view_port) {
+    if(gui->view_port == view_port) gui->view_port = NULL;
+}
+
+Canvas* host_canvas_alloc(void) {
+    return calloc(1, sizeof(Canvas));
+}
+
+void host_canvas_free(Canvas* canvas) {
+    free(canvas);
+}
+
+uint32_t host_canvas_draw_count(Canvas* canvas) {
+    return canvas->draw_count;
+}
+
+void canvas_clear(Canvas* canvas) {
+    canvas->draw_count++;
+}
+
+void canvas_set_font(Canvas* canvas, Font font) {
+    canvas->font = font;
+}
+
+void canvas_draw_str(Canvas* canvas, int32_t x, int32_t y, const char* str) {
+    UNUSED(x);
+    UNUSED(y);
+    canvas->draw_count += (uint32_t)strlen(str);
+}
+
+void canvas_draw_str_aligned(
+    Canvas* canvas,
+    int32_t x,
+    int32_t y,
+    Align horizontal,
+    Align vertical,
+    const char* str) {
+    UNUSED(horizontal);
+    UNUSED(vertical);
+    canvas_draw_str(canvas, x, y, str);
+}
+
+uint16_t canvas_glyph_width(Canvas* canvas, uint16_t symbol) {
+    UNUSED(symbol);
+    return canvas->font == FontPrimary ? 6 : 5;
+}
+
+uint16_t canvas_string_width(Canvas* canvas, const char* str) {
+    uint16_t width = 0;
+    while(*str) {
+        width += canvas_glyph_width(canvas, (uint8_t)*str++);
+    }
+    return width;
+}
+
+void canvas_draw_glyph(Canvas* canvas, int32_t x, int32_t y, uint16_t ch) {
+    UNUSED(x);
+    UNUSED(y);
+    UNUSED(ch);
+    canvas->draw_count++;
+}
+
+void canvas_draw_line(Canvas* canvas, int32_t x1, int32_t y1, int32_t x2, int32_t y2) {
+    UNUSED(x1);
+    UNUSED(y1);
+    UNUSED(x2);
+    UNUSED(y2);
+    canvas->draw_count++;
+}
+
+void canvas_draw_frame(Canvas* canvas, int32_t x, int32_t y, size_t width, size_t height) {
+    UNUSED(x);
+    UNUSED(y);
+    UNUSED(width);
+    UNUSED(height);
+    canvas->draw_count++;
+}
+
+void canvas_set_color(Canvas* canvas, Color color) {
+    UNUSED(color);
+    canvas->draw_count++;
+}
+
+void canvas_draw_box(Canvas* canvas, int32_t x, int32_t y, size_t width, size_t height) {
+    canvas_draw_frame(canvas, x, y, width, height);
+}
+
+/* Storage */
+
+struct File {
+    FILE* fp;
+};
+
+static void storage_host_path(const char* path, char* host_path, size_t size) {
+    const char* root = getenv("HOST_SD_ROOT");
+    if(!root) root = "./sd";
+    if(strncmp(path, "/ext/", 5) == 0) path += 5;
+    snprintf(host_path, size, "%s/%s", root, path);
+}
+
+static void storage_host_mkdirs(const char* host_path) {
+    char dir[512];
+    snprintf(dir, sizeof(dir), "%s", host_path);
+    for(char* p = dir + 1; *p; p++) {
+        if(*p == '/') {
+            *p = '\0';
+            mkdir(dir, 0755);
+            *p = '/';
+        }
+    }
+}
+
+File* storage_file_alloc(Storage* storage) {
+    UNUSED(storage);
+    return calloc(1, sizeof(File));
+}
+
+void storage_file_free(File* file) {
+    storage_file_close(file);
+    free(file);
+}
+
+bool storage_file_open(File* file, const char* path, FS_AccessMode access_mode, FS_OpenMode open_mode) {
+    char host_path[512];
+    storage_host_path(path, host_path, sizeof(host_path));
+
+    const char* mode;
+    if(open_mode == FSOM_OPEN_EXISTING) {
+        mode = (access_mode & FSAM_WRITE) ? "r+b" : "rb";
+    } else if(open_mode == FSOM_OPEN_APPEND) {
+        mode = (access_mode & FSAM_READ) ? "a+b" : "ab";
+    } else if(open_mode == FSOM_CREATE_ALWAYS) {
+        mode = (access_mode & FSAM_READ) ? "w+b" : "wb";
+    } else {
+        // FSOM_OPEN_ALWAYS / FSOM_CREATE_NEW: create if missing, never truncate
+        if(open_mode == FSOM_CREATE_NEW && access(host_path, F_OK) == 0) return false;
+        storage_host_mkdirs(host_path);
+        FILE* touch = fopen(host_path, "ab");
+        if(touch) fclose(touch);
+        mode = "r+b";
+    }
+    if(mode[0] != 'r') storage_host_mkdirs(host_path);
+
+    file->fp = fopen(host_path, mode);
+    return file->fp != NULL;
+}
+
+bool storage_file_close(File* file) {
+    if(file->fp) {
+        fclose(file->fp);
+        file->fp = NULL;
+    }
+    return true;
+}
+
+bool storage_file_is_open(File* file) {
+    return file->fp != NULL;
+}
+
+size_t storage_file_read(File* file, void* buff, size_t bytes_to_read) {
+    return file->fp ? fread(buff, 1, bytes_to_read, file->fp) : 0;
+}
+
+size_t storage_file_write(File* file, const void* buff, size_t bytes_to_write) {
+    return file->fp ? fwrite(buff, 1, bytes_to_write, file->fp) : 0;
+}
+
+bool storage_file_seek(File* file, uint32_t offset, bool from_start) {
+    return file->fp && fseek(file->fp, (long)offset, from_start ? SEEK_SET : SEEK_CUR) == 0;
+}
+
+uint64_t storage_file_tell(File* file) {
+    return file->fp ? (uint64_t)ftell(file->fp) : 0;
+}
+
+uint64_t storage_file_size(File* file) {
+    if(!file->fp) return 0;
+    long position = ftell(file->fp);
+    fseek(file->fp, 0, SEEK_END);
+    long size = ftell(file->fp);
+    fseek(file->fp, position, SEEK_SET);
+    return (uint64_t)size;
+}
+
+bool storage_file_eof(File* file) {
+    if(!file->fp) return true;
+    return storage_file_tell(file) >= storage_file_size(file);
+}
+
+bool storage_file_sync(File* file) {
+    return file->fp && fflush(file->fp) == 0;
+}
+
+bool storage_simply_mkdir(Storage* storage, const char* path) {
+    UNUSED(storage);
+    char host_path[512];
+    storage_host_path(path, host_path, sizeof(host_path));
+    storage_host_mkdirs(host_path);
+    return mkdir(host_path, 0755) == 0 || errno == EEXIST;
+}
+
+bool storage_simply_remove(Storage* storage, const char* path) {
+    UNUSED(storage);
+    char host_path[512];
+    storage_host_path(path, host_path, sizeof(host_path));
+    return remove(host_path) == 0 || errno == ENOENT;
+}
+
+bool storage_file_exists(Storage* storage, const char* path) {
+    UNUSED(storage);
+    char host_path[512];
+    storage_host_path(path, host_path, sizeof(host_path));
+    return access(host_path, F_OK) == 0;
+}
@@ -0,0 +1,45 @@
+/**
+ * Host side of the stubbed USART.  Bytes the app transmits go to a TX sink, and bytes
+ * injected here are delivered to the app's async RX callback one at a time, the way
+ * the UART interrupt does on the device.
+*/
+#pragma once
+
+#include <furi_hal.h>
+
+typedef void (*HostUartTxHook)(const uint8_t* data, size_t length, void* context);
+
+/**
+ * Delivers data to the RX callback, byte by byte, on the calling thread.
+ *
+ * @param data   The bytes "received" from the ESP32
+ * @param length Number of bytes
+*/
+void host_uart_inject(const uint8_t* data, size_t length);
+
+/**
+ * Routes everything the app transmits to hook.  Without a hook TX data is discarded.
+*/
+void host_uart_set_tx_hook(HostUartTxHook hook, void* context);
+
+/**
+ * When enabled, furi_hal_serial_tx takes as long as the bytes would on the wire at
+ * the current baud rate (10 bits per byte), like the blocking TX on the device.
+*/
+void host_uart_set_wire_time(bool enabled);
+
+/**
+ * Bridges the USART to a new pseudo terminal.  A reader thread injects whatever is
+ * written to the pty, and app TX is written back to it.
+ *
+ * @param name      Receives the slave device path, e.g. /dev/pts/3
+ * @param name_size Size of name
+ *
+ * @return true if the pty was opened
+*/
+bool host_uart_open_pty(char* name, size_t name_size);
+
+/**
+ * Closes the pty bridge, if any.
+*/
+void host_uart_close_pty(void);
@@ -0,0 +1,144 @@
+/**
+ * Host stand-in for the parts of the furi core API used by the Ollama app.  Only what
+ * the app and its helpers call is provided; behaviour follows the firmware closely
+ * enough to exercise parsing and state transitions off-device.
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define UNUSED(x) (void)(x)
+#define COUNT_OF(x) (sizeof(x) / sizeof(x[0]))
+#define EXT_PATH(path) "/ext/" path
+
+#define furi_assert(x) ((void)(x))
+#define furi_check(x) ((void)(x))
+
+// Logging compiles to a format-checked no-op unless HOST_FURI_LOG is defined.
+#ifdef HOST_FURI_LOG
+#define FURI_LOG_HOST(level, tag, fmt, ...) \
+    fprintf(stderr, "[%s][%s] " fmt "\n", level, tag, ##__VA_ARGS__)
+#else
+#define FURI_LOG_HOST(level, tag, fmt, ...)                  \
+    do {                                                     \
+        if(0) fprintf(stderr, "%s%s" fmt, level, tag, ##__VA_ARGS__); \
+    } while(0)
+#endif
+#define FURI_LOG_E(tag, fmt, ...) FURI_LOG_HOST("E", tag, fmt, ##__VA_ARGS__)
+#define FURI_LOG_W(tag, fmt, ...) FURI_LOG_HOST("W", tag, fmt, ##__VA_ARGS__)
+#define FURI_LOG_I(tag, fmt, ...) FURI_LOG_HOST("I", tag, fmt, ##__VA_ARGS__)
+#define FURI_LOG_D(tag, fmt, ...) FURI_LOG_HOST("D", tag, fmt, ##__VA_ARGS__)
+#define FURI_LOG_T(tag, fmt, ...) FURI_LOG_HOST("T", tag, fmt, ##__VA_ARGS__)
+
+#define FuriWaitForever 0xFFFFFFFFU
+
+typedef enum {
+    FuriStatusOk = 0,
+    FuriStatusError = -1,
+    FuriStatusErrorTimeout = -2,
+    FuriStatusErrorResource = -3,
+    FuriStatusErrorParameter = -4,
+} FuriStatus;
+
+typedef enum {
+    FuriFlagWaitAny = 0x00000000U,
+    FuriFlagWaitAll = 0x00000001U,
+    FuriFlagNoClear = 0x00000002U,
+} FuriFlag;
+
+#define FuriFlagError 0x80000000U
+#define FuriFlagErrorTimeout 0xFFFFFFFEU
+
+uint32_t furi_get_tick(void);
+void furi_delay_ms(uint32_t milliseconds);
+
+// Heap: free bytes are reported against a nominal HOST_HEAP_SIZE using malloc's own
+// bookkeeping, so differences between two calls are meaningful, absolute values are not.
+#define HOST_HEAP_SIZE (256 * 1024)
+size_t memmgr_get_free_heap(void);
+size_t memmgr_get_minimum_free_heap(void);
+size_t memmgr_heap_get_max_free_block(void);
+
+// Records
+#define RECORD_GUI "gui"
+#define RECORD_STORAGE "storage"
+void* furi_record_open(const char* name);
+void furi_record_close(const char* name);
+
+// Strings
+#define FURI_STRING_FAILURE ((size_t)-1)
+typedef struct FuriString FuriString;
+FuriString* furi_string_alloc(void);
+FuriString* furi_string_alloc_set_str(const char* cstr);
+void furi_string_free(FuriString* string);
+const char* furi_string_get_cstr(const FuriString* string);
+size_t furi_string_size(const FuriString* string);
+void furi_string_reset(FuriString* string);
+void furi_string_push_back(FuriString* string, char c);
+void furi_string_set_str(FuriString* string, const char* cstr);
+void furi_string_set_strn(FuriString* string, const char* cstr, size_t n);
+void furi_string_cat_str(FuriString* string, const char* cstr);
+int furi_string_printf(FuriString* string, const char* format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+// Mutex
+typedef enum {
+    FuriMutexTypeNormal,
+    FuriMutexTypeRecursive,
+} FuriMutexType;
+typedef struct FuriMutex FuriMutex;
+FuriMutex* furi_mutex_alloc(FuriMutexType type);
+void furi_mutex_free(FuriMutex* mutex);
+FuriStatus furi_mutex_acquire(FuriMutex* mutex, uint32_t timeout);
+FuriStatus furi_mutex_release(FuriMutex* mutex);
+
+// Message queue
+typedef struct FuriMessageQueue FuriMessageQueue;
+FuriMessageQueue* furi_message_queue_alloc(uint32_t msg_count, uint32_t msg_size);
+void furi_message_queue_free(FuriMessageQueue* instance);
+FuriStatus furi_message_queue_put(FuriMessageQueue* instance, const void* msg_ptr, uint32_t timeout);
+FuriStatus furi_message_queue_get(FuriMessageQueue* instance, void* msg_ptr, uint32_t timeout);
+uint32_t furi_message_queue_get_count(FuriMessageQueue* instance);
+
+// Stream buffer
+typedef struct FuriStreamBuffer FuriStreamBuffer;
+FuriStreamBuffer* furi_stream_buffer_alloc(size_t size, size_t trigger_level);
+void furi_stream_buffer_free(FuriStreamBuffer* stream_buffer);
+size_t furi_stream_buffer_send(
+    FuriStreamBuffer* stream_buffer,
+    const void* data,
+    size_t length,
+    uint32_t timeout);
+size_t furi_stream_buffer_receive(
+    FuriStreamBuffer* stream_buffer,
+    void* data,
+    size_t length,
+    uint32_t timeout);
+size_t furi_stream_buffer_bytes_available(FuriStreamBuffer* stream_buffer);
+size_t furi_stream_buffer_spaces_available(FuriStreamBuffer* stream_buffer);
+
+// Threads
+typedef struct FuriThread FuriThread;
+typedef FuriThread* FuriThreadId;
+typedef int32_t (*FuriThreadCallback)(void* context);
+FuriThread* furi_thread_alloc_ex(
+    const char* name,
+    uint32_t stack_size,
+    FuriThreadCallback callback,
+    void* context);
+void furi_thread_free(FuriThread* thread);
+void furi_thread_start(FuriThread* thread);
+bool furi_thread_join(FuriThread* thread);
+FuriThreadId furi_thread_get_id(FuriThread* thread);
+FuriThreadId furi_thread_get_current_id(void);
+// Least stack a thread has had left, in bytes.  Threads the stub starts run on a painted
+// stack measured against the size they asked for, scaled for host frames (see
+// furi_stub.c); the host's main thread is not a FuriThread and reports 0.
+uint32_t furi_thread_get_stack_space(FuriThreadId thread_id);
+uint32_t furi_thread_flags_set(FuriThreadId thread_id, uint32_t flags);
+uint32_t furi_thread_flags_wait(uint32_t flags, uint32_t options, uint32_t timeout);
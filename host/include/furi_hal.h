@@ -0,0 +1,59 @@
+/**
+ * Host stand-in for the furi_hal serial API.  There is a single USART whose TX and
+ * RX are routed through host_uart.h, either to an in-memory pipe or to a pty.  The
+ * RTC reads the host's wall clock.
+*/
+#pragma once
+
+#include <furi.h>
+
+typedef enum {
+    FuriHalBusUSART1,
+    FuriHalBusLPUART1,
+} FuriHalBus;
+
+typedef enum {
+    FuriHalSerialIdUsart,
+    FuriHalSerialIdLpuart,
+} FuriHalSerialId;
+
+typedef enum {
+    FuriHalSerialRxEventData = (1 << 0),
+    FuriHalSerialRxEventIdle = (1 << 1),
+} FuriHalSerialRxEvent;
+
+typedef struct FuriHalSerialHandle FuriHalSerialHandle;
+
+typedef void (*FuriHalSerialAsyncRxCallback)(
+    FuriHalSerialHandle* handle,
+    FuriHalSerialRxEvent event,
+    void* context);
+
+// The cycle counter runs at a nominal 64 MHz derived from the monotonic clock.
+typedef struct {
+    uint32_t start;
+    uint32_t value;
+} FuriHalCortexTimer;
+
+uint32_t furi_hal_cortex_instructions_per_microsecond(void);
+FuriHalCortexTimer furi_hal_cortex_timer_get(uint32_t timeout_us);
+
+bool furi_hal_bus_is_enabled(FuriHalBus bus);
+
+// Seconds since the Unix epoch
+uint32_t furi_hal_rtc_get_timestamp(void);
+
+FuriHalSerialHandle* furi_hal_serial_control_acquire(FuriHalSerialId serial_id);
+void furi_hal_serial_control_release(FuriHalSerialHandle* handle);
+void furi_hal_serial_init(FuriHalSerialHandle* handle, uint32_t baud);
+void furi_hal_serial_deinit(FuriHalSerialHandle* handle);
+void furi_hal_serial_set_br(FuriHalSerialHandle* handle, uint32_t baud);
+void furi_hal_serial_tx(FuriHalSerialHandle* handle, const uint8_t* buffer, size_t buffer_size);
+void furi_hal_serial_tx_wait_complete(FuriHalSerialHandle* handle);
+void furi_hal_serial_async_rx_start(
+    FuriHalSerialHandle* handle,
+    FuriHalSerialAsyncRxCallback callback,
+    void* context,
+    bool report_errors);
+void furi_hal_serial_async_rx_stop(FuriHalSerialHandle* handle);
+uint8_t furi_hal_serial_async_rx(FuriHalSerialHandle* handle);
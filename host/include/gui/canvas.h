@@ -0,0 +1,55 @@
+/**
+ * Host stand-in for the canvas API.  Drawing is not rasterised; calls are counted so
+ * the draw callbacks can be benchmarked, and string widths come from a fixed
+ * per-font advance.
+*/
+#pragma once
+
+#include <furi.h>
+
+typedef enum {
+    FontPrimary,
+    FontSecondary,
+    FontKeyboard,
+    FontBigNumbers,
+    FontTotalNumber,
+} Font;
+
+typedef enum {
+    AlignLeft,
+    AlignRight,
+    AlignTop,
+    AlignBottom,
+    AlignCenter,
+} Align;
+
+typedef enum {
+    ColorWhite = 0x00,
+    ColorBlack = 0x01,
+    ColorXOR = 0x02,
+} Color;
+
+typedef struct Canvas Canvas;
+
+void canvas_clear(Canvas* canvas);
+void canvas_set_font(Canvas* canvas, Font font);
+void canvas_draw_str(Canvas* canvas, int32_t x, int32_t y, const char* str);
+void canvas_draw_str_aligned(
+    Canvas* canvas,
+    int32_t x,
+    int32_t y,
+    Align horizontal,
+    Align vertical,
+    const char* str);
+uint16_t canvas_string_width(Canvas* canvas, const char* str);
+uint16_t canvas_glyph_width(Canvas* canvas, uint16_t symbol);
+void canvas_draw_glyph(Canvas* canvas, int32_t x, int32_t y, uint16_t ch);
+void canvas_draw_line(Canvas* canvas, int32_t x1, int32_t y1, int32_t x2, int32_t y2);
+void canvas_draw_frame(Canvas* canvas, int32_t x, int32_t y, size_t width, size_t height);
+void canvas_set_color(Canvas* canvas, Color color);
+void canvas_draw_box(Canvas* canvas, int32_t x, int32_t y, size_t width, size_t height);
+
+// Host only: allocate a canvas and read back how many primitives were drawn.
+Canvas* host_canvas_alloc(void);
+void host_canvas_free(Canvas* canvas);
+uint32_t host_canvas_draw_count(Canvas* canvas);
@@ -0,0 +1,40 @@
+/**
+ * Host stand-in for the storage API.  Paths under /ext/ are mapped to the directory
+ * named by the HOST_SD_ROOT environment variable (default "./sd").
+*/
+#pragma once
+
+#include <furi.h>
+
+typedef enum {
+    FSAM_READ = (1 << 0),
+    FSAM_WRITE = (1 << 1),
+    FSAM_READ_WRITE = FSAM_READ | FSAM_WRITE,
+} FS_AccessMode;
+
+typedef enum {
+    FSOM_OPEN_EXISTING = 1,
+    FSOM_OPEN_ALWAYS = 2,
+    FSOM_OPEN_APPEND = 4,
+    FSOM_CREATE_NEW = 8,
+    FSOM_CREATE_ALWAYS = 16,
+} FS_OpenMode;
+
+typedef struct Storage Storage;
+typedef struct File File;
+
+File* storage_file_alloc(Storage* storage);
+void storage_file_free(File* file);
+bool storage_file_open(File* file, const char* path, FS_AccessMode access_mode, FS_OpenMode open_mode);
+bool storage_file_close(File* file);
+bool storage_file_is_open(File* file);
+size_t storage_file_read(File* file, void* buff, size_t bytes_to_read);
+size_t storage_file_write(File* file, const void* buff, size_t bytes_to_write);
+bool storage_file_seek(File* file, uint32_t offset, bool from_start);
+uint64_t storage_file_tell(File* file);
+uint64_t storage_file_size(File* file);
+bool storage_file_eof(File* file);
+bool storage_file_sync(File* file);
+bool storage_simply_mkdir(Storage* storage, const char* path);
+bool storage_simply_remove(Storage* storage, const char* path);
+bool storage_file_exists(Storage* storage, const char* path);
@@ -0,0 +1,240 @@
+#include <js_modules.h>
+#include <furi.h>
+#include "helpers/uart_helper.h"
+#include "ap_store.h"
+
+/**
+ * The "wexbide" JS module gives the Wexbide_AI.js scripts the app's native UART line
+ * reader and saved AP parsing:
+ *
+ *     let wexbide = require("wexbide");
+ *     wexbide.open(115200);
+ *     wexbide.write("SCAN\n");                 // false if the UART stayed busy for a second
+ *     let line = wexbide.readLine(250);        // one whole line, or undefined
+ *     let aps = wexbide.loadAPs(path);         // [{ssid: ..., password: ...}, ...]
+ *     wexbide.saveAP(path, ssid, password);
+ *     let version = wexbide.hash(text);        // FNV-1a in decimal, as the ESP32 versions its settings
+ *
+ * Lines are split on the uart_helper worker thread and queued here, so the script
+ * never touches individual characters.  It takes the USART for itself, so do not
+ * set up the serial module in the same script.
+*/
+
+// Lines waiting for the script before the worker holds back
+#define JS_WEXBIDE_LINE_QUEUE 16
+// How long write() waits for room in the TX queue before giving up
+#define JS_WEXBIDE_WRITE_TIMEOUT_MS 1000
+
+typedef struct {
+    UartHelper* uart;
+    FuriMessageQueue* lines; // FuriString*, owned by whoever dequeues them
+    volatile bool closing;
+} JsWexbideInst;
+
+static JsWexbideInst* js_wexbide_get_inst(struct mjs* mjs) {
+    mjs_val_t obj_inst = mjs_get(mjs, mjs_get_this(mjs), INST_PROP_NAME, ~0);
+    JsWexbideInst* inst = mjs_get_ptr(mjs, obj_inst);
+    furi_assert(inst);
+    return inst;
+}
+
+static bool js_wexbide_check_open(struct mjs* mjs, JsWexbideInst* inst) {
+    if(!inst->uart) {
+        mjs_prepend_errorf(mjs, MJS_INTERNAL_ERROR, "UART is not open");
+        mjs_return(mjs, MJS_UNDEFINED);
+        return false;
+    }
+    return true;
+}
+
+static bool js_wexbide_get_string_arg(struct mjs* mjs, size_t index, const char** value) {
+    mjs_val_t arg = mjs_arg(mjs, index);
+    if(!mjs_is_string(arg)) {
+        mjs_prepend_errorf(mjs, MJS_BAD_ARGS_ERROR, "Argument %u must be a string", (unsigned)index);
+        mjs_return(mjs, MJS_UNDEFINED);
+        return false;
+    }
+    size_t length = 0;
+    *value = mjs_get_string(mjs, &arg, &length);
+    return true;
+}
+
+// Runs on the uart_helper worker.  Waiting here while the script is behind stops the
+// worker draining the receive buffer, which in turn sends XOFF to the ESP32.
+static void js_wexbide_line(FuriString* line, void* context) {
+    JsWexbideInst* inst = context;
+    FuriString* copy = furi_string_alloc_set(line);
+    while(furi_message_queue_put(inst->lines, &copy, 100) != FuriStatusOk) {
+        if(inst->closing) {
+            furi_string_free(copy);
+            return;
+        }
+    }
+}
+
+static void js_wexbide_open(struct mjs* mjs) {
+    JsWexbideInst* inst = js_wexbide_get_inst(mjs);
+    if(inst->uart) {
+        mjs_prepend_errorf(mjs, MJS_INTERNAL_ERROR, "UART is already open");
+        mjs_return(mjs, MJS_UNDEFINED);
+        return;
+    }
+
+    uint32_t baud_rate = 115200;
+    if(mjs_nargs(mjs) > 0) {
+        mjs_val_t arg = mjs_arg(mjs, 0);
+        if(!mjs_is_number(arg)) {
+            mjs_prepend_errorf(mjs, MJS_BAD_ARGS_ERROR, "Baud rate must be a number");
+            mjs_return(mjs, MJS_UNDEFINED);
+            return;
+        }
+        baud_rate = mjs_get_int32(mjs, arg);
+    }
+
+    inst->uart = uart_helper_alloc();
+    uart_helper_set_baud_rate(inst->uart, baud_rate);
+    uart_helper_set_callback(inst->uart, js_wexbide_line, inst);
+    mjs_return(mjs, MJS_UNDEFINED);
+}
+
+static void js_wexbide_write(struct mjs* mjs) {
+    JsWexbideInst* inst = js_wexbide_get_inst(mjs);
+    const char* data;
+    if(!js_wexbide_check_open(mjs, inst) || !js_wexbide_get_string_arg(mjs, 0, &data)) {
+        return;
+    }
+
+    // The TX queue takes a message no longer than itself, so a long string goes in
+    // pieces, each waiting for room.  The script's thread holds nothing the worker needs.
+    size_t length = strlen(data);
+    size_t capacity = uart_helper_tx_capacity(inst->uart);
+    uint32_t waited = 0;
+    while(length > 0 && waited < JS_WEXBIDE_WRITE_TIMEOUT_MS) {
+        size_t piece = length < capacity ? length : capacity;
+        if(uart_helper_send(inst->uart, data, piece) == 0) {
+            furi_delay_ms(10);
+            waited += 10;
+            continue;
+        }
+        data += piece;
+        length -= piece;
+        waited = 0;
+    }
+    mjs_return(mjs, mjs_mk_boolean(mjs, length == 0));
+}
+
+// readLine(timeout_ms): the next line without its terminator, or undefined on timeout
+static void js_wexbide_read_line(struct mjs* mjs) {
+    JsWexbideInst* inst = js_wexbide_get_inst(mjs);
+    if(!js_wexbide_check_open(mjs, inst)) {
+        return;
+    }
+
+    uint32_t timeout = FuriWaitForever;
+    if(mjs_nargs(mjs) > 0 && mjs_is_number(mjs_arg(mjs, 0))) {
+        timeout = mjs_get_int32(mjs, mjs_arg(mjs, 0));
+    }
+
+    FuriString* line;
+    if(furi_message_queue_get(inst->lines, &line, timeout) != FuriStatusOk) {
+        mjs_return(mjs, MJS_UNDEFINED);
+        return;
+    }
+    mjs_val_t result = mjs_mk_string(mjs, furi_string_get_cstr(line), furi_string_size(line), true);
+    furi_string_free(line);
+    mjs_return(mjs, result);
+}
+
+static void js_wexbide_load_aps(struct mjs* mjs) {
+    const char* path;
+    if(!js_wexbide_get_string_arg(mjs, 0, &path)) {
+        return;
+    }
+
+    ApRecord* records = malloc(sizeof(ApRecord) * AP_STORE_MAX_RECORDS);
+    size_t count = ap_store_load(path, records, AP_STORE_MAX_RECORDS);
+    mjs_val_t result = mjs_mk_array(mjs);
+    for(size_t i = 0; i < count; i++) {
+        mjs_val_t record = mjs_mk_object(mjs);
+        mjs_set(mjs, record, "ssid", ~0, mjs_mk_string(mjs, records[i].ssid, ~0, true));
+        mjs_set(mjs, record, "password", ~0, mjs_mk_string(mjs, records[i].password, ~0, true));
+        mjs_array_push(mjs, result, record);
+    }
+    free(records);
+    mjs_return(mjs, result);
+}
+
+static void js_wexbide_save_ap(struct mjs* mjs) {
+    const char* path;
+    const char* ssid;
+    const char* password;
+    if(!js_wexbide_get_string_arg(mjs, 0, &path) || !js_wexbide_get_string_arg(mjs, 1, &ssid) ||
+       !js_wexbide_get_string_arg(mjs, 2, &password)) {
+        return;
+    }
+    mjs_return(mjs, mjs_mk_boolean(mjs, ap_store_save(path, ssid, password)));
+}
+
+static void js_wexbide_hash(struct mjs* mjs) {
+    const char* text;
+    if(!js_wexbide_get_string_arg(mjs, 0, &text)) {
+        return;
+    }
+    uint32_t hash = 2166136261UL;
+    for(; *text; text++) {
+        hash ^= (uint8_t)*text;
+        hash *= 16777619UL;
+    }
+    // As a string: mJS would print a number above INT32_MAX as a negative one
+    char digits[11];
+    snprintf(digits, sizeof(digits), "%lu", (unsigned long)hash);
+    mjs_return(mjs, mjs_mk_string(mjs, digits, ~0, true));
+}
+
+static void* js_wexbide_create(struct mjs* mjs, mjs_val_t* object) {
+    JsWexbideInst* inst = malloc(sizeof(JsWexbideInst));
+    inst->uart = NULL;
+    inst->lines = furi_message_queue_alloc(JS_WEXBIDE_LINE_QUEUE, sizeof(FuriString*));
+    inst->closing = false;
+
+    mjs_val_t wexbide_obj = mjs_mk_object(mjs);
+    mjs_set(mjs, wexbide_obj, INST_PROP_NAME, ~0, mjs_mk_foreign(mjs, inst));
+    mjs_set(mjs, wexbide_obj, "open", ~0, MJS_MK_FN(js_wexbide_open));
+    mjs_set(mjs, wexbide_obj, "write", ~0, MJS_MK_FN(js_wexbide_write));
+    mjs_set(mjs, wexbide_obj, "readLine", ~0, MJS_MK_FN(js_wexbide_read_line));
+    mjs_set(mjs, wexbide_obj, "loadAPs", ~0, MJS_MK_FN(js_wexbide_load_aps));
+    mjs_set(mjs, wexbide_obj, "saveAP", ~0, MJS_MK_FN(js_wexbide_save_ap));
+    mjs_set(mjs, wexbide_obj, "hash", ~0, MJS_MK_FN(js_wexbide_hash));
+    *object = wexbide_obj;
+    return inst;
+}
+
+static void js_wexbide_destroy(void* context) {
+    JsWexbideInst* inst = context;
+    inst->closing = true;
+    if(inst->uart) {
+        uart_helper_free(inst->uart);
+    }
+    FuriString* line;
+    while(furi_message_queue_get(inst->lines, &line, 0) == FuriStatusOk) {
+        furi_string_free(line);
+    }
+    furi_message_queue_free(inst->lines);
+    free(inst);
+}
+
+static const JsModuleDescriptor js_wexbide_desc = {
+    "wexbide",
+    js_wexbide_create,
+    js_wexbide_destroy,
+};
+
+static const FlipperAppPluginDescriptor plugin_descriptor = {
+    .appid = PLUGIN_APP_ID,
+    .ep_api_version = PLUGIN_API_VERSION,
+    .entry_point = &js_wexbide_desc,
+};
+
+const FlipperAppPluginDescriptor* js_wexbide_ep(void) {
+    return &plugin_descriptor;
+}
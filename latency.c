@@ -0,0 +1,137 @@
+#include "latency.h"
+#include "file_ops.h"
+#include "trace.h"
+#include <furi.h>
+
+static const char* const segment_names[LatencySegmentCount] = {
+    "key>tx",
+    "uart",
+    "connect",
+    "ttfb",
+    "body",
+    "esp tx",
+    "render",
+};
+
+static void latency_commit(OllamaAppState* state) {
+    LatencyStats* stats = &state->latency;
+    LatencySpan* span = &stats->current;
+
+    if(!span->pending || !span->esp_reported || span->delivered == 0 || span->rendered == 0) {
+        return;
+    }
+
+    // Everything between TX done and delivery that the ESP32 did not account for
+    // was spent on the serial link.
+    uint32_t esp_total = span->esp[0] + span->esp[1] + span->esp[2] + span->esp[3];
+    uint32_t round_trip = span->delivered - span->tx_done;
+
+    uint8_t i = stats->sample_next;
+    stats->samples[LatencySegmentKeyToTx][i] = span->tx_done - span->key_ok;
+    stats->samples[LatencySegmentUart][i] = round_trip > esp_total ? round_trip - esp_total : 0;
+    stats->samples[LatencySegmentHttpConnect][i] = span->esp[0];
+    stats->samples[LatencySegmentFirstByte][i] = span->esp[1];
+    stats->samples[LatencySegmentBody][i] = span->esp[2];
+    stats->samples[LatencySegmentEspTx][i] = span->esp[3];
+    stats->samples[LatencySegmentRender][i] = span->rendered - span->delivered;
+
+    stats->sample_next = (stats->sample_next + 1) % LATENCY_SAMPLE_COUNT;
+    if(stats->sample_count < LATENCY_SAMPLE_COUNT) {
+        stats->sample_count++;
+    }
+    stats->log_pending = stats->log_to_sd;
+    span->pending = false;
+    TRACE(TraceEventLatency, stats->sample_count, span->rendered - span->key_ok);
+}
+
+void latency_mark_key_ok(OllamaAppState* state) {
+    memset(&state->latency.current, 0, sizeof(LatencySpan));
+    state->latency.current.key_ok = furi_get_tick();
+    state->latency.current.pending = true;
+}
+
+// A prompt that never went out has no span to record
+void latency_cancel(OllamaAppState* state) {
+    state->latency.current.pending = false;
+}
+
+void latency_mark_tx_done(OllamaAppState* state) {
+    if(state->latency.current.pending) {
+        state->latency.current.tx_done = furi_get_tick();
+    }
+}
+
+void latency_mark_delivered(OllamaAppState* state) {
+    if(state->latency.current.pending && state->latency.current.delivered == 0) {
+        state->latency.current.delivered = furi_get_tick();
+    }
+}
+
+void latency_mark_rendered(OllamaAppState* state) {
+    LatencySpan* span = &state->latency.current;
+    if(span->pending && span->delivered != 0 && span->rendered == 0) {
+        span->rendered = furi_get_tick();
+        latency_commit(state);
+    }
+}
+
+void latency_set_esp_stats(OllamaAppState* state, const char* stats) {
+    // STATS:<connect>,<first byte>,<body>,<esp tx> - all in milliseconds
+    LatencySpan* span = &state->latency.current;
+    if(!span->pending) {
+        return;
+    }
+
+    const char* p = stats;
+    for(size_t i = 0; i < COUNT_OF(span->esp); i++) {
+        span->esp[i] = strtoul(p, NULL, 10);
+        p = strchr(p, ',');
+        if(!p) {
+            break;
+        }
+        p++;
+    }
+    span->esp_reported = true;
+    latency_commit(state);
+}
+
+uint32_t latency_percentile(OllamaAppState* state, LatencySegment segment, uint8_t percent) {
+    LatencyStats* stats = &state->latency;
+    if(stats->sample_count == 0) {
+        return 0;
+    }
+
+    // Insertion sort a copy; there are at most LATENCY_SAMPLE_COUNT samples
+    uint32_t sorted[LATENCY_SAMPLE_COUNT];
+    for(uint8_t i = 0; i < stats->sample_count; i++) {
+        uint32_t value = stats->samples[segment][i];
+        int8_t j = i - 1;
+        while(j >= 0 && sorted[j] > value) {
+            sorted[j + 1] = sorted[j];
+            j--;
+        }
+        sorted[j + 1] = value;
+    }
+
+    uint8_t rank = (stats->sample_count * percent + 99) / 100;
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+const char* latency_segment_name(LatencySegment segment) {
+    return segment < LatencySegmentCount ? segment_names[segment] : "?";
+}
+
+void latency_flush_log(OllamaAppState* state) {
+    LatencyStats* stats = &state->latency;
+    if(!stats->log_pending) {
+        return;
+    }
+    stats->log_pending = false;
+
+    uint8_t last = (stats->sample_next + LATENCY_SAMPLE_COUNT - 1) % LATENCY_SAMPLE_COUNT;
+    uint32_t segments[LatencySegmentCount];
+    for(size_t i = 0; i < LatencySegmentCount; i++) {
+        segments[i] = stats->samples[i][last];
+    }
+    append_latency_log(segments, LatencySegmentCount);
+}
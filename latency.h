@@ -0,0 +1,13 @@
+#pragma once
+
+#include "ollama_app_i.h"
+
+void latency_mark_key_ok(OllamaAppState* state);
+void latency_cancel(OllamaAppState* state);
+void latency_mark_tx_done(OllamaAppState* state);
+void latency_mark_delivered(OllamaAppState* state);
+void latency_mark_rendered(OllamaAppState* state);
+void latency_set_esp_stats(OllamaAppState* state, const char* stats);
+uint32_t latency_percentile(OllamaAppState* state, LatencySegment segment, uint8_t percent);
+const char* latency_segment_name(LatencySegment segment);
+void latency_flush_log(OllamaAppState* state);
@@ -0,0 +1,86 @@
+// The Flipper sends XOFF when its receive buffer is nearly full and XON once it has
+// caught up.  All traffic to the Flipper goes through this wrapper, which waits while
+// paused and keeps the flow control bytes out of the commands it reads.
+#pragma once
+
+#include <Arduino.h>
+
+const uint8_t XON = 0x11;
+const uint8_t XOFF = 0x13;
+// Written between checks for XOFF; the UART FIFO holds up to 128 more bytes in flight
+const size_t flowChunkSize = 32;
+// Resume without an XON after this long, in case it was lost
+const unsigned long flowPauseTimeoutMs = 2000;
+
+class FlowControlSerial : public Stream {
+public:
+  int available() override {
+    pump();
+    return count;
+  }
+
+  int read() override {
+    pump();
+    if (count == 0) return -1;
+    uint8_t c = buffer[head];
+    head = (head + 1) % sizeof(buffer);
+    count--;
+    return c;
+  }
+
+  int peek() override {
+    pump();
+    return count == 0 ? -1 : buffer[head];
+  }
+
+  size_t write(uint8_t c) override {
+    return write(&c, 1);
+  }
+
+  size_t write(const uint8_t *data, size_t length) override {
+    size_t written = 0;
+    while (written < length) {
+      waitWhilePaused();
+      size_t chunk = length - written < flowChunkSize ? length - written : flowChunkSize;
+      written += Serial.write(data + written, chunk);
+    }
+    return written;
+  }
+
+  void flush() override {
+    Serial.flush();
+  }
+
+  using Stream::write;
+
+private:
+  // Moves received bytes into the command buffer, acting on XON/XOFF as they arrive
+  void pump() {
+    while (count < sizeof(buffer) && Serial.available() > 0) {
+      int c = Serial.read();
+      if (c == XOFF) {
+        paused = true;
+      } else if (c == XON) {
+        paused = false;
+      } else if (c >= 0) {
+        buffer[(head + count) % sizeof(buffer)] = (uint8_t)c;
+        count++;
+      }
+    }
+  }
+
+  void waitWhilePaused() {
+    pump();
+    unsigned long start = millis();
+    while (paused && millis() - start < flowPauseTimeoutMs) {
+      delay(1);
+      pump();
+    }
+    paused = false;
+  }
+
+  uint8_t buffer[256];
+  size_t head = 0;
+  size_t count = 0;
+  bool paused = false;
+};
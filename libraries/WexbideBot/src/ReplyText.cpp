@@ -0,0 +1,244 @@
+#include "ReplyText.h"
+
+// Advance widths in pixels of FontSecondary (haxrcorp 4089) for ' ' to '~'
+static const uint8_t fontSecondaryWidth[95] = {
+  4, 2, 4, 6, 6, 6, 6, 2, 3, 3, 4, 6, 3, 4, 2, 4,  //  !"#$%&'()*+,-./
+  5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 2, 3, 4, 4, 4, 5,  // 0123456789:;<=>?
+  6, 5, 5, 5, 5, 5, 5, 5, 5, 4, 5, 5, 5, 6, 5, 5,  // @ABCDEFGHIJKLMNO
+  5, 5, 5, 5, 6, 5, 6, 6, 6, 6, 5, 3, 4, 3, 4, 5,  // PQRSTUVWXYZ[\]^_
+  3, 5, 5, 5, 5, 5, 4, 5, 5, 2, 3, 5, 2, 6, 5, 5,  // `abcdefghijklmno
+  5, 5, 4, 5, 4, 5, 6, 6, 6, 5, 5, 4, 2, 4, 5,     // pqrstuvwxyz{|}~
+};
+// ui.c draws rows from x = 2
+static const unsigned int rowWidthPx = 124;
+// RESPONSE_ROW_CHARS on the Flipper
+static const unsigned int rowMaxChars = 32;
+
+static uint8_t charWidth(char c) {
+  return c >= ' ' && c <= '~' ? fontSecondaryWidth[c - ' '] : 0;
+}
+
+// Decodes the UTF-8 sequence at text[i] and moves i past it; stray bytes decode as 0
+static uint32_t nextCodepoint(const char *text, size_t &i) {
+  uint8_t lead = (uint8_t)text[i++];
+  if (lead < 0x80) return lead;
+  int extra = lead >= 0xF0 ? 3 : lead >= 0xE0 ? 2 : lead >= 0xC0 ? 1 : 0;
+  if (extra == 0) return 0;
+  uint32_t c = lead & (0x3F >> extra);
+  for (int k = 0; k < extra; k++) {
+    if (((uint8_t)text[i] & 0xC0) != 0x80) return 0;
+    c = (c << 6) | ((uint8_t)text[i++] & 0x3F);
+  }
+  return c;
+}
+
+// Appends the closest ASCII for c; characters without one (emoji, CJK) are dropped
+static void transliterate(uint32_t c, String &out) {
+  static const char latinUpper[] = "AAAAAA?CEEEEIIIIDNOOOOOxOUUUUY??";
+  static const char latinLower[] = "aaaaaa?ceeeeiiiidnooooo/ouuuuy?y";
+  if (c == '\t' || c == '\n' || c == '\r') {
+    out += (char)c;
+  } else if (c >= ' ' && c <= '~') {
+    out += (char)c;
+  } else if (c >= 0xC0 && c <= 0xFF) {
+    const char *table = c < 0xE0 ? latinUpper : latinLower;
+    char ascii = table[c & 0x1F];
+    if (ascii != '?') out += ascii;
+    else if (c == 0xC6) out += "AE";
+    else if (c == 0xE6) out += "ae";
+    else if (c == 0xDE) out += "Th";
+    else if (c == 0xFE) out += "th";
+    else if (c == 0xDF) out += "ss";
+  } else if (c == 0xA0 || (c >= 0x2000 && c <= 0x200A) || c == 0x202F || c == 0x3000) {
+    out += ' ';
+  } else if ((c >= 0x2010 && c <= 0x2015) || c == 0x2212 || c == 0x2022 || c == 0x2043 || c == 0xB7) {
+    out += '-';
+  } else if ((c >= 0x2018 && c <= 0x201B) || c == 0x2032) {
+    out += '\'';
+  } else if ((c >= 0x201C && c <= 0x201F) || c == 0x2033 || c == 0xAB || c == 0xBB) {
+    out += '"';
+  } else if (c == 0x2026) {
+    out += "...";
+  } else if (c == 0x2192) {
+    out += "->";
+  } else if (c == 0x2190) {
+    out += "<-";
+  } else if (c == 0x2264) {
+    out += "<=";
+  } else if (c == 0x2265) {
+    out += ">=";
+  } else if (c == 0x2260) {
+    out += "!=";
+  } else if (c == 0xD7) {
+    out += 'x';
+  } else if (c == 0xB1) {
+    out += "+/-";
+  } else if (c == 0xA9) {
+    out += "(c)";
+  }
+}
+
+static bool isWordChar(char c) {
+  return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+}
+
+// Removes inline markdown: code marks, emphasis, strikethrough and link targets
+static String stripInlineMarkdown(const String &line) {
+  String out;
+  out.reserve(line.length());
+  for (unsigned int i = 0; i < line.length(); i++) {
+    char c = line[i];
+    char prev = i > 0 ? line[i - 1] : ' ';
+    char next = i + 1 < line.length() ? line[i + 1] : ' ';
+    if (c == '`') continue;
+    if ((c == '*' || c == '~') && next == c) {
+      i++;
+      continue;
+    }
+    if (c == '_' && next == '_') {
+      i++;
+      continue;
+    }
+    // A lone * is emphasis unless it stands between spaces, as in "2 * 3"
+    if (c == '*' && !(prev == ' ' && next == ' ')) continue;
+    // A lone _ inside a word is part of an identifier such as snake_case
+    if (c == '_' && !(isWordChar(prev) && isWordChar(next))) continue;
+    if (c == '!' && next == '[') continue;
+    if (c == '[') {
+      int close = line.indexOf("](", i);
+      int end = close == -1 ? -1 : line.indexOf(')', close);
+      if (end != -1) {
+        out += stripInlineMarkdown(line.substring(i + 1, close));
+        i = end;
+        continue;
+      }
+    }
+    out += c;
+  }
+  return out;
+}
+
+String normalizeReply(const String &text) {
+  String ascii;
+  ascii.reserve(text.length());
+  const char *raw = text.c_str();
+  for (size_t i = 0; i < text.length();) {
+    transliterate(nextCodepoint(raw, i), ascii);
+  }
+
+  String out;
+  out.reserve(ascii.length());
+  bool inCode = false;
+  bool breakBefore = false;
+  int start = 0;
+  while (start <= (int)ascii.length()) {
+    int end = ascii.indexOf('\n', start);
+    if (end == -1) end = ascii.length();
+    String line = ascii.substring(start, end);
+    start = end + 1;
+    line.replace('\t', ' ');
+    line.replace('\r', ' ');
+    line.trim();
+
+    if (line.startsWith("```")) {
+      inCode = !inCode;
+      breakBefore = true;
+      continue;
+    }
+    // Code lines keep their own rows; so do headings and list items
+    bool hardLine = inCode;
+    bool heading = false;
+    if (!inCode) {
+      bool rule = line.length() >= 3;
+      for (unsigned int k = 0; k < line.length() && rule; k++) {
+        rule = line[k] == '-' || line[k] == '*' || line[k] == '_' || line[k] == ' ';
+      }
+      if (rule) line = "";
+
+      unsigned int marks = 0;
+      while (marks < line.length() && (line[marks] == '#' || line[marks] == '>')) marks++;
+      if (marks > 0 && (marks == line.length() || line[marks] == ' ')) {
+        heading = line[0] == '#';
+        line = line.substring(marks);
+        line.trim();
+      }
+      int numbered = line.indexOf(". ");
+      if (line.startsWith("* ") || line.startsWith("+ ") || line.startsWith("- ")) {
+        line = "- " + line.substring(2);
+        hardLine = true;
+      } else if (numbered > 0 && numbered <= 3 && isdigit((unsigned char)line[0])) {
+        hardLine = true;
+      }
+      hardLine |= heading;
+      line = stripInlineMarkdown(line);
+    }
+
+    if (line.length() == 0) {
+      breakBefore = true;
+      continue;
+    }
+    if (out.length() > 0) {
+      out += (breakBefore || hardLine) ? '\n' : ' ';
+    }
+    // Collapse runs of spaces inside the line
+    for (unsigned int k = 0; k < line.length(); k++) {
+      if (line[k] != ' ' || (k > 0 && line[k - 1] != ' ')) out += line[k];
+    }
+    breakBefore = heading || inCode;
+  }
+  return out;
+}
+
+// Sends each finished row, holding the newest back so the last can go on the Ollama: line
+static void sendRow(Stream &out, String &pending, bool &havePending, const String &row) {
+  if (havePending) out.println("PART:" + pending);
+  pending = row;
+  havePending = true;
+}
+
+void sendReply(Stream &out, const String &text) {
+  String reply = normalizeReply(text);
+  String pending;
+  bool havePending = false;
+  String row;
+  unsigned int rowWidth = 0;
+
+  int start = 0;
+  while (start < (int)reply.length()) {
+    int end = start;
+    while (end < (int)reply.length() && reply[end] != ' ' && reply[end] != '\n') end++;
+    unsigned int wordWidth = 0;
+    for (int k = start; k < end; k++) wordWidth += charWidth(reply[k]);
+
+    unsigned int joined = rowWidth + (row.length() > 0 ? charWidth(' ') : 0) + wordWidth;
+    unsigned int joinedChars = row.length() + (row.length() > 0 ? 1 : 0) + (end - start);
+    if (row.length() > 0 && (joined > rowWidthPx || joinedChars > rowMaxChars)) {
+      sendRow(out, pending, havePending, row);
+      row = "";
+      rowWidth = 0;
+    }
+    if (row.length() > 0) {
+      row += ' ';
+      rowWidth += charWidth(' ');
+    }
+    // A word wider than a whole row is split wherever it fills one
+    for (int k = start; k < end; k++) {
+      if (rowWidth + charWidth(reply[k]) > rowWidthPx || row.length() >= rowMaxChars) {
+        sendRow(out, pending, havePending, row);
+        row = "";
+        rowWidth = 0;
+      }
+      row += reply[k];
+      rowWidth += charWidth(reply[k]);
+    }
+
+    if (end < (int)reply.length() && reply[end] == '\n') {
+      sendRow(out, pending, havePending, row);
+      row = "";
+      rowWidth = 0;
+    }
+    start = end + 1;
+  }
+  if (row.length() > 0) sendRow(out, pending, havePending, row);
+  out.println("Ollama: \"" + (havePending ? pending : String("")) + "\"");
+}
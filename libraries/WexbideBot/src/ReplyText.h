@@ -0,0 +1,14 @@
+// Replies are cleaned up here before they reach the Flipper, whose fonts only cover
+// printable ASCII: markdown is stripped, typographic characters are transliterated,
+// whitespace is collapsed and the text is wrapped into rows that fit the 128-pixel
+// screen in FontSecondary.  Each row goes out as a PART: line, which the Flipper
+// spools to SD as it arrives, and the last one on the usual Ollama: line.
+#pragma once
+
+#include <Arduino.h>
+
+// ASCII text with single spaces; '\n' only where a new paragraph, heading or list item starts
+String normalizeReply(const String &text);
+
+// Normalizes text and sends it to the Flipper over out as PART: rows and an Ollama: line
+void sendReply(Stream &out, const String &text);
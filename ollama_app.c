@@ -4,7 +4,14 @@
 #include "ui.h"
 #include "wifi.h"
 #include "chat.h"
+#include "batch.h"
+#include "search.h"
+#include "context.h"
 #include "file_ops.h"
+#include "latency.h"
+#include "telemetry.h"
+#include "capture.h"
+#include "trace.h"
 #include "helpers/uart_helper.h"
 #include "helpers/ring_buffer.h"
 
@@ -15,6 +22,152 @@ static void ollama_app_input_callback(InputEvent* input_event, void* ctx) {
     furi_message_queue_put(state->event_queue, &event, FuriWaitForever);
 }
 
+static const char* const app_state_names[AppStateCount] = {
+    "main_menu",
+    "show_url",
+    "chat",
+    "wifi_connect",
+    "wifi_scan",
+    "wifi_select",
+    "wifi_password",
+    "latency_stats",
+    "response_view",
+    "batch",
+    "search",
+};
+
+static ScreenArenaKind screen_arena_kind(AppState app_state) {
+    switch(app_state) {
+        case AppStateWifiScan:
+        case AppStateWifiSelect:
+        case AppStateWifiPassword:
+        case AppStateWifiConnect:
+            return ScreenArenaWifi;
+        case AppStateShowURL:
+            return ScreenArenaUrl;
+        case AppStateChat:
+        case AppStateResponseView:
+            return ScreenArenaChat;
+        case AppStateBatch:
+            return ScreenArenaBatch;
+        case AppStateSearch:
+            return ScreenArenaSearch;
+        default:
+            return ScreenArenaNone;
+    }
+}
+
+// Releases the current screen's arena; every pointer into it goes with it
+static void screen_arena_release(OllamaAppState* state) {
+    if(state->chat) {
+        // Reply rows and messages the main loop has not stored yet would go with the screen
+        chat_reply_flush(state);
+        chat_archive_flush(state);
+    }
+    if(state->chat && state->chat->archive) {
+        archive_free(state->chat->archive);
+    }
+    if(state->chat && state->chat->completion) {
+        completion_free(state->chat->completion);
+    }
+    if(state->chat && state->chat->spool) {
+        spool_free(state->chat->spool);
+    }
+    if(state->chat) {
+        // The ESP32 gives up on the rest of the file by itself
+        context_close(&state->chat->context);
+    }
+    if(state->wifi) {
+        wifi_scan_cache_flush(state);
+        wifi_connect_save(state);
+    }
+    if(state->batch) {
+        batch_close(state->batch);
+    }
+    if(state->search) {
+        search_close(state->search);
+    }
+    if(state->screen_arena) {
+        arena_free(state->screen_arena);
+    }
+    state->screen_arena = NULL;
+    state->screen_kind = ScreenArenaNone;
+    state->wifi = NULL;
+    state->url = NULL;
+    state->chat = NULL;
+    state->batch = NULL;
+    state->search = NULL;
+}
+
+static void screen_arena_acquire(OllamaAppState* state, ScreenArenaKind kind) {
+    state->screen_kind = kind;
+    switch(kind) {
+        case ScreenArenaWifi:
+            state->screen_arena = arena_alloc(sizeof(WifiScreen));
+            state->wifi = arena_push(state->screen_arena, sizeof(WifiScreen));
+            break;
+        case ScreenArenaUrl:
+            state->screen_arena = arena_alloc(sizeof(UrlScreen));
+            state->url = arena_push(state->screen_arena, sizeof(UrlScreen));
+            break;
+        case ScreenArenaChat:
+            // Room for the server URL that is read and sent once on entry
+            state->screen_arena = arena_alloc(sizeof(ChatScreen) + MAX_URL_LENGTH);
+            state->chat = arena_push(state->screen_arena, sizeof(ChatScreen));
+            break;
+        case ScreenArenaBatch:
+            // Room for the server URL, as for the chat screen
+            state->screen_arena = arena_alloc(sizeof(BatchScreen) + MAX_URL_LENGTH);
+            state->batch = arena_push(state->screen_arena, sizeof(BatchScreen));
+            state->batch->window = BATCH_DEFAULT_IN_FLIGHT;
+            break;
+        case ScreenArenaSearch:
+            state->screen_arena = arena_alloc(sizeof(SearchScreen));
+            state->search = arena_push(state->screen_arena, sizeof(SearchScreen));
+            break;
+        default:
+            break;
+    }
+}
+
+void ollama_app_wake(OllamaAppState* state) {
+    OllamaAppEvent event = {.type = EventTypeWake};
+    // A full queue means the loop is coming round anyway
+    furi_message_queue_put(state->event_queue, &event, 0);
+}
+
+const char* ollama_app_state_name(AppState app_state) {
+    return app_state < AppStateCount ? app_state_names[app_state] : "?";
+}
+
+void ollama_app_sample_heap(OllamaAppState* state) {
+    size_t free_heap = memmgr_get_free_heap();
+    size_t in_use = state->heap_baseline > free_heap ? state->heap_baseline - free_heap : 0;
+    AppState app_state = state->current_state;
+    if(in_use > state->heap_peak[app_state]) {
+        state->heap_peak[app_state] = in_use;
+    }
+    if(state->screen_arena && arena_used(state->screen_arena) > state->arena_peak[app_state]) {
+        state->arena_peak[app_state] = arena_used(state->screen_arena);
+    }
+}
+
+void ollama_app_set_state(OllamaAppState* state, AppState next) {
+    furi_mutex_acquire(state->screen_mutex, FuriWaitForever);
+    ollama_app_sample_heap(state);
+
+    ScreenArenaKind kind = screen_arena_kind(next);
+    if(kind != state->screen_kind) {
+        screen_arena_release(state);
+        screen_arena_acquire(state, kind);
+    }
+    state->current_state = next;
+    state->ui_update_needed = true;
+
+    ollama_app_sample_heap(state);
+    furi_mutex_release(state->screen_mutex);
+}
+
 void ollama_app_state_init(OllamaAppState* state) {
     memset(state, 0, sizeof(OllamaAppState));
     state->current_state = AppStateMainMenu;
@@ -23,15 +176,17 @@ void ollama_app_state_init(OllamaAppState* state) {
     strncpy(state->user_name, "User", MAX_SSID_LENGTH - 1);
     state->user_name[MAX_SSID_LENGTH - 1] = '\0';
     state->event_queue = furi_message_queue_alloc(8, sizeof(OllamaAppEvent));
+    state->main_thread = furi_thread_get_current_id();
     state->ui_update_needed = false;  // Initialize the new flag
+    state->screen_mutex = furi_mutex_alloc(FuriMutexTypeRecursive);
+    state->heap_baseline = memmgr_get_free_heap();
 }
 
 void ollama_app_state_free(OllamaAppState* state) {
+    // The view port belongs to ollama_app(), which tears it down before calling this
+    screen_arena_release(state);
+    furi_mutex_free(state->screen_mutex);
     furi_message_queue_free(state->event_queue);
-    view_port_enabled_set(state->view_port, false);
-    gui_remove_view_port(state->gui, state->view_port);
-    view_port_free(state->view_port);
-    furi_record_close(RECORD_GUI);
 }
 
 bool ollama_app_handle_key_event(OllamaAppState* state, InputEvent* event) {
@@ -40,126 +195,168 @@ bool ollama_app_handle_key_event(OllamaAppState* state, InputEvent* event) {
         switch(state->current_state) {
             case AppStateMainMenu:
                 if(event->key == InputKeyUp) {
-                    state->menu_index = (state->menu_index - 1 + 3) % 3;
+                    state->menu_index = (state->menu_index - 1 + MENU_ITEM_COUNT) % MENU_ITEM_COUNT;
                     state->ui_update_needed = true;
                 } else if(event->key == InputKeyDown) {
-                    state->menu_index = (state->menu_index + 1) % 3;
+                    state->menu_index = (state->menu_index + 1) % MENU_ITEM_COUNT;
                     state->ui_update_needed = true;
                 } else if(event->key == InputKeyOk) {
                     if(state->menu_index == 0) {
-                        state->current_state = AppStateWifiScan;
                         wifi_scan(state);
                     } else if(state->menu_index == 1) {
-                        if(read_url_from_file(state)) {
-                            state->current_state = AppStateShowURL;
+                        ollama_app_set_state(state, AppStateShowURL);
+                        state->url->url_count = read_url_from_file(state->url->server_url, MAX_URL_LENGTH);
+                        if(state->url->url_count == 0) {
+                            ollama_app_set_state(state, AppStateMainMenu);
                         }
                     } else if(state->menu_index == 2) {
-                        state->current_state = AppStateChat;
-                        state->chat_message_count = 0;
-                        state->current_message[0] = '\0';
-                        state->cursor_position = 0;
+                        // The URL is only needed to send it once, so it borrows chat arena space
+                        ollama_app_set_state(state, AppStateChat);
+                        char* server_url = arena_push(state->screen_arena, MAX_URL_LENGTH);
+                        uint8_t url_count = server_url ? read_url_from_file(server_url, MAX_URL_LENGTH) : 0;
+                        if(url_count > 0) {
+                            wifi_send_server_url(state, server_url);
+                        }
+                        // A second endpoint is somewhere to hedge slow prompts to
+                        if(url_count > 1) {
+                            wifi_set_hedge(state, true);
+                        }
+                    } else if(state->menu_index == 3) {
+                        ollama_app_set_state(state, AppStateLatencyStats);
+                        state->latency.scroll = 0;
+                    } else if(state->menu_index == 4) {
+                        ollama_app_set_state(state, AppStateBatch);
+                        char* server_url = arena_push(state->screen_arena, MAX_URL_LENGTH);
+                        if(server_url && read_url_from_file(server_url, MAX_URL_LENGTH) > 0) {
+                            wifi_send_server_url(state, server_url);
+                        }
+                    } else if(state->menu_index == 5) {
+                        ollama_app_set_state(state, AppStateSearch);
+                        search_open(state);
                     }
                     state->ui_update_needed = true;
                 }
                 break;
+            case AppStateWifiScan:
             case AppStateWifiSelect:
+                // Results are listed as they arrive, so one can be picked mid-scan
                 if(event->key == InputKeyUp) {
-                    if(state->selected_network > 0) {
-                        state->selected_network--;
+                    if(state->wifi->selected_network > 0) {
+                        state->wifi->selected_network--;
+                        wifi_scan_follow_selection(state->wifi);
                         state->ui_update_needed = true;
                     }
                 } else if(event->key == InputKeyDown) {
-                    if(state->selected_network < state->network_count - 1) {
-                        state->selected_network++;
+                    if(state->wifi->selected_network + 1 < state->wifi->network_count) {
+                        state->wifi->selected_network++;
+                        wifi_scan_follow_selection(state->wifi);
                         state->ui_update_needed = true;
                     }
                 } else if(event->key == InputKeyOk) {
-                    if(state->network_count > 0) {
-                        strncpy(state->wifi_ssid, state->networks[state->selected_network].ssid, MAX_SSID_LENGTH - 1);
+                    if(state->wifi->network_count > 0) {
+                        strncpy(state->wifi_ssid, state->wifi->networks[state->wifi->selected_network].ssid, MAX_SSID_LENGTH - 1);
                         state->wifi_ssid[MAX_SSID_LENGTH - 1] = '\0';
-                        state->current_state = AppStateWifiPassword;
-                        state->keyboard_index = 0;
-                        memset(state->wifi_password, 0, sizeof(state->wifi_password));
-                        state->ui_update_needed = true;
+                        ollama_app_set_state(state, AppStateWifiPassword);
+                        state->wifi->keyboard_index = 0;
+                        memset(state->wifi->password, 0, sizeof(state->wifi->password));
                     }
+                } else if(event->key == InputKeyBack) {
+                    ollama_app_set_state(state, AppStateMainMenu);
                 }
                 break;
             case AppStateWifiPassword:
                 if(event->key == InputKeyUp) {
-                    if(state->keyboard_index >= 10) state->keyboard_index -= 10;
+                    if(state->wifi->keyboard_index >= 10) state->wifi->keyboard_index -= 10;
                     state->ui_update_needed = true;
                 } else if(event->key == InputKeyDown) {
-                    if(state->keyboard_index < 30) state->keyboard_index += 10;
+                    if(state->wifi->keyboard_index < 30) state->wifi->keyboard_index += 10;
                     state->ui_update_needed = true;
                 } else if(event->key == InputKeyLeft) {
-                    if(state->keyboard_index % 10 > 0) state->keyboard_index--;
+                    if(state->wifi->keyboard_index % 10 > 0) state->wifi->keyboard_index--;
                     state->ui_update_needed = true;
                 } else if(event->key == InputKeyRight) {
-                    if(state->keyboard_index % 10 < 9) state->keyboard_index++;
+                    if(state->wifi->keyboard_index % 10 < 9) state->wifi->keyboard_index++;
                     state->ui_update_needed = true;
                 } else if(event->key == InputKeyOk) {
                     const char* keyboard = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789!@#$%^&*()";
-                    size_t pwd_len = strlen(state->wifi_password);
+                    size_t pwd_len = strlen(state->wifi->password);
                     if(pwd_len < MAX_PASSWORD_LENGTH - 1) {
-                        state->wifi_password[pwd_len] = keyboard[state->keyboard_index];
-                        state->wifi_password[pwd_len + 1] = '\0';
+                        state->wifi->password[pwd_len] = keyboard[state->wifi->keyboard_index];
+                        state->wifi->password[pwd_len + 1] = '\0';
                     }
                     state->ui_update_needed = true;
                 } else if(event->key == InputKeyBack) {
-                    size_t pwd_len = strlen(state->wifi_password);
+                    size_t pwd_len = strlen(state->wifi->password);
                     if(pwd_len > 0) {
-                        state->wifi_password[pwd_len - 1] = '\0';
+                        state->wifi->password[pwd_len - 1] = '\0';
                     } else {
-                        state->current_state = AppStateWifiSelect;
+                        ollama_app_set_state(state, AppStateWifiSelect);
                     }
                     state->ui_update_needed = true;
                 }
                 break;
             case AppStateChat:
-                if(event->key == InputKeyUp || event->key == InputKeyDown) {
-                    // TODO: Implement chat history scrolling
+                process_chat(state, event);
+                state->ui_update_needed = true;
+                break;
+            case AppStateResponseView:
+                process_response_view(state, event);
+                state->ui_update_needed = true;
+                break;
+            case AppStateBatch:
+                process_batch(state, event);
+                state->ui_update_needed = true;
+                break;
+            case AppStateSearch:
+                process_search(state, event);
+                state->ui_update_needed = true;
+                break;
+            case AppStateLatencyStats:
+                if(event->key == InputKeyUp) {
+                    if(state->latency.scroll > 0) state->latency.scroll--;
+                } else if(event->key == InputKeyDown) {
+                    if(state->latency.scroll < LatencySegmentCount + LATENCY_UART_ROWS + TELEMETRY_ROWS - 6) state->latency.scroll++;
+                } else if(event->key == InputKeyOk) {
+                    state->latency.log_to_sd = !state->latency.log_to_sd;
                 } else if(event->key == InputKeyRight) {
-                    if (state->cursor_position < strlen(state->current_message)) {
-                        state->cursor_position++;
-                    }
+                    state->latency.trace_saved = trace_dump();
                 } else if(event->key == InputKeyLeft) {
-                    if (state->cursor_position > 0) {
-                        state->cursor_position--;
-                    }
-                } else if(event->key == InputKeyOk) {
-                    if (strlen(state->current_message) > 0) {
-                        add_chat_message(state, state->current_message, true);
-                        // TODO: Implement API call to get AI response
-                        add_chat_message(state, "I am a simulated response.", false);
-                        state->current_message[0] = '\0';
-                        state->cursor_position = 0;
-                    }
-                } else {
-                    if (strlen(state->current_message) < MAX_MESSAGE_LENGTH - 1) {
-                        memmove(
-                            &state->current_message[state->cursor_position + 1],
-                            &state->current_message[state->cursor_position],
-                            strlen(&state->current_message[state->cursor_position]) + 1
-                        );
-                        state->current_message[state->cursor_position] = 'A' + (event->key % 26); // Simple key to char mapping
-                        state->cursor_position++;
+                    if(state->capture.active) {
+                        capture_stop(state);
+                    } else {
+                        capture_start(state);
                     }
+                } else if(event->key == InputKeyBack) {
+                    ollama_app_set_state(state, AppStateMainMenu);
                 }
                 state->ui_update_needed = true;
                 break;
-            case AppStateShowURL:
             case AppStateWifiConnect:
-            case AppStateWifiScan:
+                // OK starts over once the retries have run out
+                if(event->key == InputKeyOk && state->connect.phase == WifiConnectFailed) {
+                    wifi_connect(state);
+                } else if(event->key == InputKeyBack) {
+                    ollama_app_set_state(state, AppStateMainMenu);
+                }
+                break;
+            case AppStateShowURL:
+            case AppStateCount:
                 // These states don't have specific key handling, just return to main menu
                 if(event->key == InputKeyBack) {
-                    state->current_state = AppStateMainMenu;
-                    state->ui_update_needed = true;
+                    ollama_app_set_state(state, AppStateMainMenu);
                 }
                 break;
         }
     } else if(event->type == InputTypeLong && event->key == InputKeyOk && state->current_state == AppStateWifiPassword) {
         wifi_connect(state);
-        state->current_state = AppStateWifiConnect;
+        ollama_app_set_state(state, AppStateWifiConnect);
+    } else if(event->type == InputTypeLong && event->key == InputKeyRight && state->current_state == AppStateChat) {
+        chat_open_viewer(state);
+    } else if(event->type == InputTypeLong && event->key == InputKeyOk && state->current_state == AppStateChat) {
+        process_chat(state, event);
+        state->ui_update_needed = true;
+    } else if(event->type == InputTypeLong && event->key == InputKeyOk && state->current_state == AppStateSearch) {
+        process_search(state, event);
         state->ui_update_needed = true;
     } else if(event->type == InputTypeShort && event->key == InputKeyBack) {
         // Global back button handling
@@ -173,8 +370,15 @@ bool ollama_app_handle_key_event(OllamaAppState* state, InputEvent* event) {
             case AppStateWifiScan:
             case AppStateWifiSelect:
             case AppStateWifiPassword:
-                state->current_state = AppStateMainMenu;
-                state->ui_update_needed = true;
+            case AppStateLatencyStats:
+            case AppStateBatch:
+            case AppStateSearch:
+                ollama_app_set_state(state, AppStateMainMenu);
+                break;
+            case AppStateResponseView:
+                ollama_app_set_state(state, AppStateChat);
+                break;
+            case AppStateCount:
                 break;
         }
     }
@@ -182,13 +386,8 @@ bool ollama_app_handle_key_event(OllamaAppState* state, InputEvent* event) {
 }
 
 void ollama_app_handle_tick_event(OllamaAppState* state) {
-    if(state->current_state == AppStateWifiConnect && !state->wifi_connected) {
-        wifi_connect(state);
-        if(state->wifi_connected) {
-            save_ap(state);
-            state->current_state = AppStateMainMenu;
-        }
-    }
+    wifi_connect_poll(state);
+    telemetry_poll(state);
 }
 
 int32_t ollama_app(void* p) {
@@ -208,15 +407,20 @@ int32_t ollama_app(void* p) {
     state->gui = furi_record_open(RECORD_GUI);
     gui_add_view_port(state->gui, state->view_port, GuiLayerFullscreen);
 
+    // Per-state heap high-water is measured from here, once the UART and GUI are set up
+    state->heap_baseline = memmgr_get_free_heap();
+
     // Main loop
     OllamaAppEvent event;
     bool running = true;
     AppState previous_state = state->current_state;
     while(running) {
         FuriStatus status = furi_message_queue_get(state->event_queue, &event, 100);
+        furi_mutex_acquire(state->screen_mutex, FuriWaitForever);
         if(status == FuriStatusOk) {
             switch(event.type) {
                 case EventTypeKey:
+                    TRACE(TraceEventKey, event.input.key, event.input.type);
                     running = ollama_app_handle_key_event(state, &event.input);
                     break;
                 case EventTypeTick:
@@ -229,14 +433,46 @@ int32_t ollama_app(void* p) {
 
         // Check for state changes
         if(state->current_state != previous_state) {
-            FURI_LOG_I("OllamaApp", "State changed from %d to %d", previous_state, state->current_state);
+            APP_LOG_I("OllamaApp", "State changed from %d to %d", previous_state, state->current_state);
+            TRACE(TraceEventStateChange, previous_state, state->current_state);
+            // Keep the model resident on the server only while the chat screen is open
+            if(state->current_state == AppStateChat) {
+                wifi_set_keep_warm(state, true);
+            } else if(previous_state == AppStateChat) {
+                wifi_set_keep_warm(state, false);
+                wifi_set_hedge(state, false);
+            }
+            APP_LOG_I("OllamaApp", "Heap high-water in %s: %u bytes (arena %u)",
+                      ollama_app_state_name(previous_state),
+                      (unsigned)state->heap_peak[previous_state],
+                      (unsigned)state->arena_peak[previous_state]);
+            TRACE(TraceEventHeap, previous_state, state->heap_peak[previous_state]);
             previous_state = state->current_state;
             state->ui_update_needed = true;
         }
+        // Retries a batch prompt the UART TX queue had no room for
+        batch_pump(state);
+        // Likewise a file chunk, and gives up on an upload the ESP32 stopped acknowledging
+        context_pump(state);
+        // Spools the reply rows the UART worker staged, then moves the chat's new messages
+        // into the searchable archive
+        chat_reply_flush(state);
+        chat_archive_flush(state);
+        // Saves the table of a scan that just finished
+        wifi_scan_cache_flush(state);
+        // Nothing posts EventTypeTick; the loop comes round at least every 100 ms
+        ollama_app_handle_tick_event(state);
+        ollama_app_sample_heap(state);
+        furi_mutex_release(state->screen_mutex);
+
+        latency_flush_log(state);
+        telemetry_flush_log(state);
+        capture_flush(state);
 
         // Check if UI update is needed
         if(state->ui_update_needed) {
-            FURI_LOG_I("OllamaApp", "UI update triggered, current state: %d", state->current_state);
+            APP_LOG_D("OllamaApp", "UI update triggered, current state: %d", state->current_state);
+            TRACE(TraceEventUiUpdate, state->current_state, 0);
             view_port_update(state->view_port);
             state->ui_update_needed = false;
         }
@@ -247,11 +483,14 @@ int32_t ollama_app(void* p) {
     gui_remove_view_port(state->gui, state->view_port);
     view_port_free(state->view_port);
     furi_record_close(RECORD_GUI);
-    ollama_app_state_free(state);
-    free(state);
 
-    // Deinitialize WiFi module
+    capture_stop(state);
+    // Deinitialize WiFi module before the state its UART callback points at goes away
     wifi_deinit();
 
+    save_heap_report(state);
+    ollama_app_state_free(state);
+    free(state);
+
     return 0;
 }
\ No newline at end of file
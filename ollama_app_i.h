@@ -3,17 +3,107 @@
 #include <furi.h>
 #include <gui/gui.h>
 #include <input/input.h>
+#include <storage/storage.h>
 #include <stdlib.h>
+#include "helpers/arena.h"
+#include "completion.h"
+#include "spool.h"
+#include "archive.h"
 
 #define MAX_URL_LENGTH 256
+// server_url.txt lists endpoints one per line; the ESP32 routes to the fastest healthy one
+#define MAX_SERVER_URLS 4
 #define MAX_MESSAGE_LENGTH 128
 #define MAX_CHAT_MESSAGES 5
 #define MAX_SSID_LENGTH 32
 #define MAX_PASSWORD_LENGTH 64
-#define MAX_NETWORKS 10
+// Scan table: one entry per SSID, strongest first; the weakest drops out when it is full
+#define MAX_NETWORKS 48
+// Scan rows on screen; only these are drawn however long the table gets
+#define WIFI_SCAN_ROWS 3
+// Networks kept in SavedAPs.txt
+#define AP_STORE_MAX_RECORDS 16
+// CONNECT is sent again after a failure, waiting twice as long each time; the ESP32
+// gives up on an association after 10 s, so no answer by the timeout is a failure too
+#define WIFI_CONNECT_ATTEMPTS 4
+#define WIFI_CONNECT_BACKOFF_MS 1000
+#define WIFI_CONNECT_TIMEOUT_MS 15000
+// With a second endpoint in URL_FILE_PATH, a chat prompt whose first token has not come
+// by then is sent to it as well (HEDGE); about a warm model's p95, so few prompts go twice
+#define WIFI_HEDGE_DELAY_MS 2000
+#define LATENCY_SAMPLE_COUNT 32
+// UART counter rows listed after the latency segments
+#define LATENCY_UART_ROWS 3
+// Resource rows listed after those; sampled every TELEMETRY_INTERVAL_MS while they are on
+// screen and every TELEMETRY_LOG_INTERVAL_MS while SD logging is on, never otherwise
+#define TELEMETRY_ROWS 10
+#define TELEMETRY_INTERVAL_MS 1000
+#define TELEMETRY_LOG_INTERVAL_MS 10000
+#define MENU_ITEM_COUNT 6
+#define COMPLETION_SUGGESTIONS 3
+#define COMPLETION_MAX_LENGTH 48
+#define COMPLETION_MAX_NODES 1024
+#define COMPLETION_FILE_COMPACT_RATIO 2
+#define SPOOL_BUFFER_SIZE 256
+// Replies arrive wrapped to screen rows by the ESP32 and are spooled as fixed-size
+// records, so any page's offset is page * RESPONSE_PAGE_BYTES
+#define RESPONSE_ROW_CHARS 32
+#define RESPONSE_ROW_BYTES (RESPONSE_ROW_CHARS + 1)
+#define RESPONSE_VIEW_ROWS 6
+#define RESPONSE_PAGE_BYTES (RESPONSE_ROW_BYTES * RESPONSE_VIEW_ROWS)
+// Rows the UART worker holds until the main loop spools them, about 40 ms of reply at
+// 115200 baud; the worker wakes the loop on the first and waits for it when all are taken
+#define REPLY_STAGE_ROWS 16
+// Batch mode keeps up to this many prompts at the ESP32, which runs them concurrently
+#define BATCH_MAX_IN_FLIGHT 4
+#define BATCH_DEFAULT_IN_FLIGHT 2
+#define BATCH_LINE_LENGTH 1024
+// Still JSON-escaped; a BATCH command has to fit the UART TX queue in one piece
+#define BATCH_PROMPT_LENGTH 768
+// A BATCH_DONE answer as the main loop writes it, quotes included; longer ones are cut
+#define BATCH_ANSWER_LENGTH 1024
+// UART capture: the worker buffers this much between the main loop's writes to SD, which
+// come every CAPTURE_FLUSH_MS; at 115200 baud both ways that is under 3 KB
+#define CAPTURE_BUFFER_SIZE 4096
+#define CAPTURE_FLUSH_MS 250
+// Chat archive: the index holds a table of ARCHIVE_INDEX_SLOTS words, never filled past
+// 3/4, then the postings, which link back one and up to ARCHIVE_SKIP_INTERVAL at a time.
+// Words shorter than ARCHIVE_MIN_WORD are not indexed, nor any beyond a message's first
+// ARCHIVE_MESSAGE_WORDS distinct ones
+#define ARCHIVE_INDEX_SLOTS 8192
+#define ARCHIVE_SKIP_INTERVAL 16
+#define ARCHIVE_BUFFER_SIZE 256
+#define ARCHIVE_MIN_WORD 2
+#define ARCHIVE_MESSAGE_WORDS 128
+#define ARCHIVE_QUERY_WORDS 4
+#define SEARCH_QUERY_LENGTH 32
+#define SEARCH_MAX_HITS 32
+#define SEARCH_VIEW_ROWS 4
+#define SEARCH_ROW_CHARS 48
+// File context: CONTEXT_FILE_PATH goes to the ESP32 in chunks as it acknowledges them,
+// never more than CONTEXT_WINDOW bytes ahead on the line; that has to fit its 256-byte
+// serial buffer, which nothing else drains while it forwards the file.  XON, XOFF and
+// CONTEXT_ESCAPE itself go as CONTEXT_ESCAPE and the byte XOR 0x20.
+#define CONTEXT_CHUNK_SIZE 128
+#define CONTEXT_WINDOW 256
+#define CONTEXT_ESCAPE 0x10
+#define CONTEXT_ACK_TIMEOUT_MS 10000
 
 #define URL_FILE_PATH EXT_PATH("ollama/server_url.txt")
 #define WIFI_CONFIG_PATH EXT_PATH("ollama/SavedAPs.txt")
+#define LATENCY_LOG_PATH EXT_PATH("ollama/latency.csv")
+#define TELEMETRY_LOG_PATH EXT_PATH("ollama/telemetry.csv")
+#define TRACE_FILE_PATH EXT_PATH("ollama/trace.bin")
+#define HEAP_REPORT_PATH EXT_PATH("ollama/heap.csv")
+#define COMPLETION_FILE_PATH EXT_PATH("ollama/completions.txt")
+#define SPOOL_FILE_PATH EXT_PATH("ollama/replies.spool")
+#define BATCH_INPUT_PATH EXT_PATH("ollama/batch.jsonl")
+#define BATCH_OUTPUT_PATH EXT_PATH("ollama/batch_out.jsonl")
+#define WIFI_SCAN_CACHE_PATH EXT_PATH("ollama/scan_cache.txt")
+#define CAPTURE_FILE_PATH EXT_PATH("ollama/uart_capture.bin")
+#define ARCHIVE_FILE_PATH EXT_PATH("ollama/chats.txt")
+#define ARCHIVE_INDEX_PATH EXT_PATH("ollama/chats.idx")
+#define CONTEXT_FILE_PATH EXT_PATH("ollama/context.txt")
 
 typedef enum {
     AppStateMainMenu,
@@ -23,44 +113,307 @@ typedef enum {
     AppStateWifiScan,
     AppStateWifiSelect,
     AppStateWifiPassword,
+    AppStateLatencyStats,
+    AppStateResponseView,
+    AppStateBatch,
+    AppStateSearch,
+    AppStateCount,
 } AppState;
 
 typedef struct {
     char content[MAX_MESSAGE_LENGTH];
     bool is_user;
+    // Where the whole reply is in the spool; spool_rows is 0 when content holds all of it
+    uint32_t spool_offset;
+    uint32_t spool_rows;
 } ChatMessage;
 
+// A reply row on its way from the UART worker to the main loop
+typedef struct {
+    char text[RESPONSE_ROW_CHARS];
+    uint8_t length;
+    bool end; // closes the reply and carries no text
+} ReplyRow;
+
 typedef struct {
     char ssid[MAX_SSID_LENGTH];
     int32_t rssi;
+    bool cached; // from WIFI_SCAN_CACHE_PATH and not seen by the running scan yet
 } WiFiNetwork;
 
+// Per-screen data lives in an arena that only exists while one of its states is active
+typedef enum {
+    ScreenArenaNone,  // main menu, latency stats
+    ScreenArenaWifi,  // scan, select, password, connect
+    ScreenArenaUrl,   // show URL
+    ScreenArenaChat,  // chat, reply viewer
+    ScreenArenaBatch, // batch run
+    ScreenArenaSearch, // chat search
+    ScreenArenaCount,
+} ScreenArenaKind;
+
+typedef struct {
+    WiFiNetwork networks[MAX_NETWORKS];
+    uint8_t network_count;
+    uint8_t selected_network;
+    uint8_t scroll; // first scan row on screen
+    uint32_t cache_time; // RTC timestamp of the cached rows
+    bool cache_dirty; // a finished scan the main loop has not written to the cache yet
+    uint8_t keyboard_index;
+    char password[MAX_PASSWORD_LENGTH];
+} WifiScreen;
+
+typedef struct {
+    char server_url[MAX_URL_LENGTH];
+    uint8_t url_count;
+} UrlScreen;
+
+// A file on its way to the ESP32 as prompt context; only one chunk of it is read at a time
+typedef struct {
+    Storage* storage;
+    File* file; // NULL when no upload is running
+    uint32_t size;
+    uint32_t read; // file bytes read from the SD card
+    uint32_t sent; // file bytes queued for the UART
+    uint32_t queued; // the same, escaped, in bytes on the line
+    uint32_t acked; // line bytes the ESP32 has forwarded, from its last FILE_ACK
+    bool ready; // the first FILE_ACK came back, the ESP32's request is open
+    uint32_t start_tick;
+    uint32_t ack_tick;
+    char failure[24]; // from a FILE_FAILED the main loop has not reported yet
+    // Read from the file but not escaped yet
+    char raw[CONTEXT_CHUNK_SIZE];
+    uint16_t raw_length;
+    uint16_t raw_next;
+    // Escaped but not queued for the UART yet; chunk_bytes of the file
+    char chunk[CONTEXT_CHUNK_SIZE];
+    uint16_t chunk_length;
+    uint16_t chunk_bytes;
+    // The second half of an escape that did not fit in the last chunk
+    bool carry_pending;
+    char carry;
+} ContextUpload;
+
+typedef struct {
+    ChatMessage messages[MAX_CHAT_MESSAGES];
+    uint8_t message_count;
+    char current_message[MAX_MESSAGE_LENGTH];
+    uint8_t cursor_position;
+    // Loaded from COMPLETION_FILE_PATH on the first key press, freed with the screen
+    Completion* completion;
+    char suggestions[COMPLETION_SUGGESTIONS][COMPLETION_MAX_LENGTH];
+    uint8_t suggestion_from[COMPLETION_SUGGESTIONS]; // where in current_message each one starts
+    uint8_t suggestion_count;
+    uint8_t suggestion_index;
+    // Opened on the first reply, freed with the screen; NULL if the SD card is unusable
+    Spool* spool;
+    // Rows the UART worker has staged for the main loop
+    ReplyRow reply_stage[REPLY_STAGE_ROWS];
+    uint8_t reply_staged;
+    // The reply the main loop is spooling: its spool offset, rows so far and first bytes
+    bool reply_open;
+    uint32_t reply_offset;
+    uint32_t reply_rows;
+    char reply_preview[MAX_MESSAGE_LENGTH];
+    // Reply viewer: only the page on screen is read from the spool
+    uint32_t view_offset;
+    uint32_t view_row_count;
+    uint32_t view_page;
+    char view_rows[RESPONSE_VIEW_ROWS][RESPONSE_ROW_BYTES];
+    // Messages at the end of messages[] the main loop has not archived yet; the archive is
+    // opened by the first one and freed with the screen, NULL if the SD card is unusable
+    uint8_t archive_pending;
+    Archive* archive;
+    ContextUpload context;
+} ChatScreen;
+
+typedef struct {
+    Archive* archive; // opened on entry, freed with the screen; NULL if the SD card is unusable
+    char query[SEARCH_QUERY_LENGTH];
+    uint8_t keyboard_index;
+    bool showing_hits; // the hits are on screen rather than the keyboard
+    uint32_t hits[SEARCH_MAX_HITS]; // archive line offsets, newest first
+    uint8_t hit_count;
+    uint8_t selected;
+    uint8_t scroll;
+    uint32_t search_ms;
+    ArchiveSearchStats stats;
+    // Only the hits on screen are read from the archive
+    char rows[SEARCH_VIEW_ROWS][SEARCH_ROW_CHARS];
+} SearchScreen;
+
+typedef struct {
+    uint32_t id; // input line number, 0 when the slot is free
+    uint32_t sent; // tick the BATCH command was queued
+    bool truncated;
+} BatchSlot;
+
+// A BATCH_DONE the UART worker has parsed, waiting for the main loop to write it out
+typedef struct {
+    bool ready;
+    uint32_t id;
+    long fields[5]; // status, queue_ms, ttfb_ms, total_ms, tokens
+    uint32_t flipper_ms;
+    bool cut; // the answer was longer than BATCH_ANSWER_LENGTH
+    char answer[BATCH_ANSWER_LENGTH]; // a JSON string literal
+} BatchDone;
+
+typedef struct {
+    Storage* storage;
+    File* input;  // NULL until started; the prompt file may be missing
+    File* output;
+    bool running;
+    bool finished;
+    bool input_done;
+    uint8_t window; // prompts kept in flight, 1..BATCH_MAX_IN_FLIGHT
+    uint8_t in_flight;
+    BatchSlot slots[BATCH_MAX_IN_FLIGHT];
+    uint32_t line_number; // of the last line read from the input
+    uint32_t answered;
+    uint32_t errors;
+    uint32_t skipped;
+    uint32_t start_tick;
+    uint32_t finish_tick;
+    uint32_t last_ms;
+    // Read-ahead from the input file
+    char read_buffer[256];
+    uint16_t read_pos;
+    uint16_t read_length;
+    char line[BATCH_LINE_LENGTH];
+    // The next BATCH command, kept until the TX queue has room for it
+    char command[BATCH_PROMPT_LENGTH + 24];
+    size_t command_length;
+    uint32_t command_id;
+    bool command_truncated;
+    BatchDone done;
+} BatchScreen;
+
+// Segments of a prompt's round trip, in the order they happen
+typedef enum {
+    LatencySegmentKeyToTx,      // key OK -> UART TX done
+    LatencySegmentUart,         // UART transit both ways (total minus ESP32 time)
+    LatencySegmentHttpConnect,  // ESP32 receive -> HTTP connect
+    LatencySegmentFirstByte,    // HTTP connect -> first byte
+    LatencySegmentBody,         // first byte -> last byte
+    LatencySegmentEspTx,        // last byte -> ESP32 UART write done
+    LatencySegmentRender,       // Flipper delivery -> first render in draw_chat
+    LatencySegmentCount,
+} LatencySegment;
+
+// Timestamps (furi ticks) of the prompt currently in flight plus the ESP32's own spans
+typedef struct {
+    uint32_t key_ok;
+    uint32_t tx_done;
+    uint32_t delivered;
+    uint32_t rendered;
+    uint32_t esp[4];
+    bool esp_reported;
+    bool pending;
+} LatencySpan;
+
+typedef struct {
+    LatencySpan current;
+    uint32_t samples[LatencySegmentCount][LATENCY_SAMPLE_COUNT];
+    uint8_t sample_count;
+    uint8_t sample_next;
+    uint8_t scroll;
+    bool log_to_sd; // LATENCY_LOG_PATH, and TELEMETRY_LOG_PATH every TELEMETRY_LOG_INTERVAL_MS
+    bool log_pending;
+    bool trace_saved;
+} LatencyStats;
+
+// Free resources on both sides, in bytes; stacks are the least ever free (high-water)
+typedef struct {
+    uint32_t next_tick;
+    uint32_t log_tick;
+    bool awaiting;  // TELEMETRY sent, no reply yet
+    bool log_due;   // the reply to the request out now goes to TELEMETRY_LOG_PATH
+    bool log_pending;
+    uint32_t heap_free;
+    uint32_t heap_min;
+    uint32_t heap_block;  // largest free block
+    uint32_t app_stack;
+    uint32_t uart_stack;  // uart_helper worker
+    uint32_t rx_waiting;  // rx_stream fill when sampled
+    uint32_t rx_high_water;
+    uint32_t queue_depth; // event_queue, including its high-water seen by the main loop
+    uint32_t queue_high;
+    // The ESP32's last TELEMETRY: reply
+    bool esp_reported;
+    uint32_t esp_heap_free;
+    uint32_t esp_heap_min;
+    uint32_t esp_heap_block;
+    uint32_t esp_loop_stack;
+    uint32_t esp_probe_stack;
+    int32_t esp_batch_stack; // -1 until the batch workers exist
+    int32_t esp_rssi;
+} Telemetry;
+
+typedef struct {
+    bool active;
+    uint32_t flush_tick;
+    uint32_t bytes; // written to CAPTURE_FILE_PATH, header included
+} UartCapture;
+
+typedef enum {
+    WifiConnectIdle,
+    WifiConnectWaiting, // CONNECT sent, no CONNECTED or CONNECT_FAILED yet
+    WifiConnectBackoff, // failed, CONNECT goes again at retry_tick
+    WifiConnectFailed,  // out of attempts, or the password was refused
+    WifiConnectDone,
+} WifiConnectPhase;
+
+typedef struct {
+    WifiConnectPhase phase;
+    uint8_t attempt;
+    uint32_t start_tick;
+    uint32_t sent_tick;
+    uint32_t retry_tick;
+    uint32_t esp_ms;     // the successful attempt's association time on the ESP32
+    uint32_t total_ms;   // first CONNECT to CONNECTED, retries included
+    char ip[16];
+    char error[16];
+    bool save_pending; // CONNECTED came; the main loop saves the network
+} WifiConnect;
+
 typedef struct {
     FuriMessageQueue* event_queue;
+    FuriThreadId main_thread; // runs the main loop; telemetry measures its stack
     ViewPort* view_port;
     Gui* gui;
     AppState current_state;
     int8_t menu_index;
-    char server_url[MAX_URL_LENGTH];
-    ChatMessage chat_messages[MAX_CHAT_MESSAGES];
-    uint8_t chat_message_count;
-    char current_message[MAX_MESSAGE_LENGTH];
-    uint8_t cursor_position;
     char wifi_ssid[MAX_SSID_LENGTH];
-    char wifi_password[MAX_PASSWORD_LENGTH];
     bool wifi_connected;
+    WifiConnect connect;
     char user_name[MAX_SSID_LENGTH];
-    WiFiNetwork networks[MAX_NETWORKS];
-    uint8_t network_count;
-    uint8_t selected_network;
-    uint8_t keyboard_index;
     bool ui_update_needed;
+    // Guards current_state and the screen arena against the GUI and UART threads
+    FuriMutex* screen_mutex;
+    Arena* screen_arena;
+    ScreenArenaKind screen_kind;
+    WifiScreen* wifi;  // set while screen_kind is ScreenArenaWifi
+    UrlScreen* url;    // set while screen_kind is ScreenArenaUrl
+    ChatScreen* chat;  // set while screen_kind is ScreenArenaChat
+    BatchScreen* batch; // set while screen_kind is ScreenArenaBatch
+    SearchScreen* search; // set while screen_kind is ScreenArenaSearch
+    // Heap in use above what the app started with, worst case per state
+    size_t heap_baseline;
+    size_t heap_peak[AppStateCount];
+    size_t arena_peak[AppStateCount];
+    bool model_warm;
+    uint32_t warmup_ms;
+    uint32_t warmup_load_ms;
+    LatencyStats latency;
+    Telemetry telemetry;
+    UartCapture capture;
 } OllamaAppState;
 
 typedef enum {
     EventTypeTick,
     EventTypeKey,
     EventTypeUpdateUI,  // Add this line
+    EventTypeWake, // the UART worker left work for the main loop
 } EventType;
 
 typedef struct {
@@ -70,5 +423,10 @@ typedef struct {
 
 void ollama_app_state_init(OllamaAppState* state);
 void ollama_app_state_free(OllamaAppState* state);
+void ollama_app_set_state(OllamaAppState* state, AppState next);
+void ollama_app_sample_heap(OllamaAppState* state);
+// Brings the main loop round now rather than at its next 100 ms; never blocks
+void ollama_app_wake(OllamaAppState* state);
+const char* ollama_app_state_name(AppState app_state);
 bool ollama_app_handle_key_event(OllamaAppState* state, InputEvent* event);
 void ollama_app_handle_tick_event(OllamaAppState* state);
\ No newline at end of file
@@ -0,0 +1,111 @@
+#include "search.h"
+#include "trace.h"
+#include <string.h>
+
+void search_open(OllamaAppState* state) {
+    state->search->archive = archive_alloc(ARCHIVE_FILE_PATH, ARCHIVE_INDEX_PATH);
+}
+
+void search_close(SearchScreen* search) {
+    if(search->archive) {
+        archive_free(search->archive);
+        search->archive = NULL;
+    }
+}
+
+static void search_load_rows(SearchScreen* search) {
+    memset(search->rows, 0, sizeof(search->rows));
+    for(uint8_t row = 0; row < SEARCH_VIEW_ROWS && search->scroll + row < search->hit_count; row++) {
+        archive_read(search->archive, search->hits[search->scroll + row], search->rows[row], SEARCH_ROW_CHARS);
+    }
+}
+
+void search_run(OllamaAppState* state) {
+    SearchScreen* search = state->search;
+    if(!search->archive) {
+        return;
+    }
+
+    uint32_t start = furi_get_tick();
+    search->hit_count = archive_search(search->archive, search->query, search->hits, SEARCH_MAX_HITS, &search->stats);
+    search->search_ms = furi_get_tick() - start;
+    search->selected = 0;
+    search->scroll = 0;
+    search->showing_hits = true;
+    search_load_rows(search);
+    APP_LOG_I("Search", "\"%s\": %u hits in %lu ms, %lu postings, %lu reads", search->query,
+              search->hit_count, (unsigned long)search->search_ms, (unsigned long)search->stats.postings,
+              (unsigned long)search->stats.reads);
+}
+
+static void process_search_hits(SearchScreen* search, InputEvent* event) {
+    if(event->key == InputKeyUp) {
+        if(search->selected > 0) {
+            search->selected--;
+        }
+        if(search->selected < search->scroll) {
+            search->scroll = search->selected;
+            search_load_rows(search);
+        }
+    } else if(event->key == InputKeyDown) {
+        if(search->selected + 1 < search->hit_count) {
+            search->selected++;
+        }
+        if(search->selected >= search->scroll + SEARCH_VIEW_ROWS) {
+            search->scroll = search->selected - SEARCH_VIEW_ROWS + 1;
+            search_load_rows(search);
+        }
+    } else if(event->key == InputKeyBack) {
+        search->showing_hits = false;
+    }
+}
+
+void process_search(OllamaAppState* state, InputEvent* event) {
+    SearchScreen* search = state->search;
+    if(event->type == InputTypeLong && event->key == InputKeyOk) {
+        search_run(state);
+        return;
+    }
+    if(event->type != InputTypeShort && event->type != InputTypeRepeat) {
+        return;
+    }
+    if(search->showing_hits) {
+        process_search_hits(search, event);
+        return;
+    }
+
+    const uint8_t keys = sizeof(SEARCH_KEYS) - 1;
+    size_t length = strlen(search->query);
+    switch(event->key) {
+        case InputKeyUp:
+            if(search->keyboard_index >= SEARCH_KEYS_PER_ROW) search->keyboard_index -= SEARCH_KEYS_PER_ROW;
+            break;
+        case InputKeyDown:
+            if(search->keyboard_index + SEARCH_KEYS_PER_ROW < keys) search->keyboard_index += SEARCH_KEYS_PER_ROW;
+            break;
+        case InputKeyLeft:
+            if(search->keyboard_index % SEARCH_KEYS_PER_ROW > 0) search->keyboard_index--;
+            break;
+        case InputKeyRight:
+            if(search->keyboard_index % SEARCH_KEYS_PER_ROW < SEARCH_KEYS_PER_ROW - 1 &&
+               search->keyboard_index + 1 < keys) {
+                search->keyboard_index++;
+            }
+            break;
+        case InputKeyOk:
+            if(length < SEARCH_QUERY_LENGTH - 1) {
+                search->query[length] = SEARCH_KEYS[search->keyboard_index];
+                search->query[length + 1] = '\0';
+            }
+            break;
+        case InputKeyBack:
+            if(length > 0) {
+                search->query[length - 1] = '\0';
+            } else {
+                ollama_app_set_state(state, AppStateMainMenu);
+            }
+            break;
+        default:
+            break;
+    }
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "ollama_app_i.h"
+
+/**
+ * The search screen finds archived chat messages holding every word typed, newest
+ * first.  Words come from an on-screen keyboard; holding OK searches, and only the
+ * postings of those words and the hits on screen are read from the SD card.
+*/
+#define SEARCH_KEYS "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 "
+#define SEARCH_KEYS_PER_ROW 13
+
+void search_open(OllamaAppState* state);
+void search_close(SearchScreen* search);
+void search_run(OllamaAppState* state);
+void process_search(OllamaAppState* state, InputEvent* event);
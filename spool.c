@@ -0,0 +1,91 @@
+#include "spool.h"
+#include "ollama_app_i.h"
+#include <storage/storage.h>
+#include <string.h>
+
+struct Spool {
+    Storage* storage;
+    File* file;
+    uint32_t flushed; // bytes on the card; the buffer holds what follows
+    uint16_t buffered;
+    char buffer[SPOOL_BUFFER_SIZE];
+};
+
+static bool spool_flush(Spool* spool) {
+    if(spool->buffered == 0) {
+        return true;
+    }
+
+    bool success = storage_file_seek(spool->file, spool->flushed, true) &&
+                   storage_file_write(spool->file, spool->buffer, spool->buffered) == spool->buffered;
+    spool->flushed += spool->buffered;
+    spool->buffered = 0;
+    return success;
+}
+
+Spool* spool_alloc(const char* path) {
+    Spool* spool = malloc(sizeof(Spool));
+    spool->storage = furi_record_open(RECORD_STORAGE);
+    spool->file = storage_file_alloc(spool->storage);
+    spool->flushed = 0;
+    spool->buffered = 0;
+
+    if(!storage_file_open(spool->file, path, FSAM_READ_WRITE, FSOM_CREATE_ALWAYS)) {
+        spool_free(spool);
+        return NULL;
+    }
+    return spool;
+}
+
+void spool_free(Spool* spool) {
+    spool_flush(spool);
+    storage_file_close(spool->file);
+    storage_file_free(spool->file);
+    furi_record_close(RECORD_STORAGE);
+    free(spool);
+}
+
+bool spool_append(Spool* spool, const char* data, size_t length) {
+    bool success = true;
+    while(length > 0) {
+        size_t space = SPOOL_BUFFER_SIZE - spool->buffered;
+        size_t chunk = length < space ? length : space;
+        memcpy(spool->buffer + spool->buffered, data, chunk);
+        spool->buffered += chunk;
+        data += chunk;
+        length -= chunk;
+        if(spool->buffered == SPOOL_BUFFER_SIZE) {
+            success &= spool_flush(spool);
+        }
+    }
+    return success;
+}
+
+uint32_t spool_size(const Spool* spool) {
+    return spool->flushed + spool->buffered;
+}
+
+size_t spool_read(Spool* spool, uint32_t offset, char* out, size_t size) {
+    size_t copied = 0;
+
+    // The part already on the card
+    if(offset < spool->flushed && size > 0) {
+        size_t want = spool->flushed - offset < size ? spool->flushed - offset : size;
+        if(storage_file_seek(spool->file, offset, true)) {
+            copied = storage_file_read(spool->file, out, want);
+        }
+        if(copied < want) {
+            return copied;
+        }
+    }
+
+    // The tail that is still in the write-behind buffer
+    uint32_t position = offset + copied;
+    if(position >= spool->flushed && position < spool_size(spool) && copied < size) {
+        size_t start = position - spool->flushed;
+        size_t want = spool->buffered - start < size - copied ? spool->buffered - start : size - copied;
+        memcpy(out + copied, spool->buffer + start, want);
+        copied += want;
+    }
+    return copied;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Spool is an append-only file on the SD card holding the chat's replies in full.
+ * Appends go through a small write-behind buffer, so a reply arriving in many short
+ * pieces costs one SD write per buffer rather than one per piece.  Reads take any
+ * byte range, which is what the paged viewer needs to hold just one page in RAM.
+*/
+typedef struct Spool Spool;
+
+/**
+ * Opens the spool at path, discarding what it held before.
+ * 
+ * @return  NULL if the file could not be created
+*/
+Spool* spool_alloc(const char* path);
+void spool_free(Spool* spool);
+
+/**
+ * Appends data at the end of the spool.
+ * 
+ * @return  false if a buffer flush failed; the data is lost
+*/
+bool spool_append(Spool* spool, const char* data, size_t length);
+
+/**
+ * @return  Bytes appended so far, the offset the next append lands at.
+*/
+uint32_t spool_size(const Spool* spool);
+
+/**
+ * Copies up to size bytes from offset, including any still in the write-behind buffer.
+ * 
+ * @return  bytes copied
+*/
+size_t spool_read(Spool* spool, uint32_t offset, char* out, size_t size);
@@ -0,0 +1,158 @@
+#include "telemetry.h"
+#include "file_ops.h"
+#include "wifi.h"
+#include <furi.h>
+
+void telemetry_sample(OllamaAppState* state) {
+    Telemetry* telemetry = &state->telemetry;
+    UartHelperStats uart;
+    wifi_get_uart_stats(&uart);
+
+    telemetry->heap_free = memmgr_get_free_heap();
+    telemetry->heap_min = memmgr_get_minimum_free_heap();
+    telemetry->heap_block = memmgr_heap_get_max_free_block();
+    // The main loop's thread, whose stack is the FAP's stack_size, whichever thread samples
+    telemetry->app_stack = furi_thread_get_stack_space(state->main_thread);
+    telemetry->uart_stack = uart.worker_stack_free;
+    telemetry->rx_waiting = uart.rx_waiting;
+    telemetry->rx_high_water = uart.rx_high_water;
+    telemetry->queue_depth = furi_message_queue_get_count(state->event_queue);
+}
+
+void telemetry_poll(OllamaAppState* state) {
+    Telemetry* telemetry = &state->telemetry;
+    uint32_t depth = furi_message_queue_get_count(state->event_queue);
+    if(depth > telemetry->queue_high) {
+        telemetry->queue_high = depth;
+    }
+
+    bool on_screen = state->current_state == AppStateLatencyStats;
+    if(!on_screen && !state->latency.log_to_sd) {
+        return;
+    }
+    uint32_t now = furi_get_tick();
+    if(telemetry->next_tick != 0 && (int32_t)(now - telemetry->next_tick) < 0) {
+        return;
+    }
+    telemetry->next_tick = now + (on_screen ? TELEMETRY_INTERVAL_MS : TELEMETRY_LOG_INTERVAL_MS);
+
+    // No reply since the last request: the ESP32 is busy with a prompt or not there at
+    // all, and a row that is due goes to the log with the Flipper side only
+    if(telemetry->awaiting) {
+        telemetry->esp_reported = false;
+        telemetry->log_pending = telemetry->log_due;
+        telemetry->log_due = false;
+    }
+    if(state->latency.log_to_sd && (telemetry->log_tick == 0 || now - telemetry->log_tick >= TELEMETRY_LOG_INTERVAL_MS)) {
+        telemetry->log_tick = now;
+        telemetry->log_due = true;
+    }
+
+    telemetry_sample(state);
+    telemetry->awaiting = true;
+    wifi_request_telemetry(state);
+    if(on_screen) {
+        state->ui_update_needed = true;
+    }
+}
+
+void telemetry_set_esp(OllamaAppState* state, const char* text) {
+    // TELEMETRY:<free heap>,<min free heap>,<largest free block>,<loop stack>,<probe stack>,
+    // <batch stack>,<rssi> - sizes in bytes, stacks as their high-water, batch -1 if unused
+    Telemetry* telemetry = &state->telemetry;
+    int32_t fields[7] = {0};
+    const char* p = text;
+    for(size_t i = 0; i < COUNT_OF(fields); i++) {
+        fields[i] = strtol(p, NULL, 10);
+        p = strchr(p, ',');
+        if(!p) {
+            break;
+        }
+        p++;
+    }
+
+    telemetry->esp_heap_free = fields[0];
+    telemetry->esp_heap_min = fields[1];
+    telemetry->esp_heap_block = fields[2];
+    telemetry->esp_loop_stack = fields[3];
+    telemetry->esp_probe_stack = fields[4];
+    telemetry->esp_batch_stack = fields[5];
+    telemetry->esp_rssi = fields[6];
+    telemetry->esp_reported = true;
+    telemetry->awaiting = false;
+    telemetry->log_pending = telemetry->log_due;
+    telemetry->log_due = false;
+    if(state->current_state == AppStateLatencyStats) {
+        state->ui_update_needed = true;
+    }
+}
+
+void telemetry_row(OllamaAppState* state, uint8_t row, const char** name, char* values, size_t size) {
+    Telemetry* telemetry = &state->telemetry;
+    static const char* const names[TELEMETRY_ROWS] = {
+        "Heap/min",
+        "Heap block",
+        "Stack app/uart",
+        "RX now",
+        "Queue now/max",
+        "ESP heap/min",
+        "ESP block",
+        "ESP loop/probe",
+        "ESP batch stack",
+        "ESP RSSI",
+    };
+    *name = row < TELEMETRY_ROWS ? names[row] : "?";
+
+    if(row >= 5 && !telemetry->esp_reported) {
+        snprintf(values, size, "-");
+        return;
+    }
+    switch(row) {
+        case 0:
+            snprintf(values, size, "%lu/%lu", (unsigned long)telemetry->heap_free, (unsigned long)telemetry->heap_min);
+            break;
+        case 1:
+            snprintf(values, size, "%lu", (unsigned long)telemetry->heap_block);
+            break;
+        case 2:
+            snprintf(values, size, "%lu / %lu", (unsigned long)telemetry->app_stack, (unsigned long)telemetry->uart_stack);
+            break;
+        case 3:
+            snprintf(values, size, "%lu", (unsigned long)telemetry->rx_waiting);
+            break;
+        case 4:
+            snprintf(values, size, "%lu / %lu", (unsigned long)telemetry->queue_depth, (unsigned long)telemetry->queue_high);
+            break;
+        case 5:
+            snprintf(values, size, "%lu/%lu", (unsigned long)telemetry->esp_heap_free, (unsigned long)telemetry->esp_heap_min);
+            break;
+        case 6:
+            snprintf(values, size, "%lu", (unsigned long)telemetry->esp_heap_block);
+            break;
+        case 7:
+            snprintf(values, size, "%lu / %lu", (unsigned long)telemetry->esp_loop_stack, (unsigned long)telemetry->esp_probe_stack);
+            break;
+        case 8:
+            if(telemetry->esp_batch_stack < 0) {
+                snprintf(values, size, "-");
+            } else {
+                snprintf(values, size, "%ld", (long)telemetry->esp_batch_stack);
+            }
+            break;
+        case 9:
+            snprintf(values, size, "%ld dBm", (long)telemetry->esp_rssi);
+            break;
+        default:
+            values[0] = '\0';
+            break;
+    }
+}
+
+void telemetry_flush_log(OllamaAppState* state) {
+    Telemetry* telemetry = &state->telemetry;
+    if(!telemetry->log_pending) {
+        return;
+    }
+    telemetry->log_pending = false;
+    append_telemetry_log(telemetry);
+}
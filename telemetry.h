@@ -0,0 +1,12 @@
+#pragma once
+
+#include "ollama_app_i.h"
+
+// Called every time round the main loop: tracks the event queue's high-water and, when a
+// sample is due, samples the Flipper side and sends TELEMETRY to the ESP32
+void telemetry_poll(OllamaAppState* state);
+void telemetry_sample(OllamaAppState* state);
+void telemetry_set_esp(OllamaAppState* state, const char* telemetry);
+// Name and values of one of the TELEMETRY_ROWS stats screen rows
+void telemetry_row(OllamaAppState* state, uint8_t row, const char** name, char* values, size_t size);
+void telemetry_flush_log(OllamaAppState* state);
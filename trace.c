@@ -0,0 +1,40 @@
+// trace.c
+#include <furi.h>
+#include <furi_hal.h>
+#include "trace.h"
+#include "file_ops.h"
+
+static TraceRecord trace_ring[TRACE_CAPACITY];
+static uint32_t trace_head;
+
+void trace_record(TraceEventId id, uint16_t arg0, uint32_t arg1) {
+    // The ISR and the worker can both record; claiming the slot atomically is enough
+    uint32_t slot = __atomic_fetch_add(&trace_head, 1, __ATOMIC_RELAXED) & (TRACE_CAPACITY - 1);
+    TraceRecord* record = &trace_ring[slot];
+    record->timestamp = furi_hal_cortex_timer_get(0).start;
+    record->id = id;
+    record->arg0 = arg0;
+    record->arg1 = arg1;
+}
+
+bool trace_dump(void) {
+    uint32_t head = __atomic_load_n(&trace_head, __ATOMIC_RELAXED);
+    uint32_t count = head < TRACE_CAPACITY ? head : TRACE_CAPACITY;
+
+    TraceFileHeader header = {
+        .magic = TRACE_MAGIC,
+        .version = TRACE_VERSION,
+        .record_size = sizeof(TraceRecord),
+        .count = count,
+        .cycles_per_us = furi_hal_cortex_instructions_per_microsecond(),
+        .overwritten = head - count,
+    };
+
+    // Oldest first: the part of the ring after head, then the part before it
+    uint32_t first = head & (TRACE_CAPACITY - 1);
+    if(count < TRACE_CAPACITY) {
+        return write_trace_file(&header, trace_ring, count, NULL, 0);
+    }
+    return write_trace_file(
+        &header, trace_ring + first, TRACE_CAPACITY - first, trace_ring, first);
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Compile-time log levels.  APP_LOG_LEVEL is set through cdefines in application.fam;
+ * calls above it compile out entirely, so hot paths can keep their log statements
+ * without paying for them in release builds.
+*/
+#define APP_LOG_LEVEL_NONE 0
+#define APP_LOG_LEVEL_ERROR 1
+#define APP_LOG_LEVEL_WARN 2
+#define APP_LOG_LEVEL_INFO 3
+#define APP_LOG_LEVEL_DEBUG 4
+#define APP_LOG_LEVEL_TRACE 5
+
+#ifndef APP_LOG_LEVEL
+#define APP_LOG_LEVEL APP_LOG_LEVEL_INFO
+#endif
+
+#define APP_LOG_NONE(tag, fmt, ...) \
+    do {                            \
+    } while(0)
+
+#if APP_LOG_LEVEL >= APP_LOG_LEVEL_ERROR
+#define APP_LOG_E(tag, fmt, ...) FURI_LOG_E(tag, fmt, ##__VA_ARGS__)
+#else
+#define APP_LOG_E APP_LOG_NONE
+#endif
+
+#if APP_LOG_LEVEL >= APP_LOG_LEVEL_WARN
+#define APP_LOG_W(tag, fmt, ...) FURI_LOG_W(tag, fmt, ##__VA_ARGS__)
+#else
+#define APP_LOG_W APP_LOG_NONE
+#endif
+
+#if APP_LOG_LEVEL >= APP_LOG_LEVEL_INFO
+#define APP_LOG_I(tag, fmt, ...) FURI_LOG_I(tag, fmt, ##__VA_ARGS__)
+#else
+#define APP_LOG_I APP_LOG_NONE
+#endif
+
+#if APP_LOG_LEVEL >= APP_LOG_LEVEL_DEBUG
+#define APP_LOG_D(tag, fmt, ...) FURI_LOG_D(tag, fmt, ##__VA_ARGS__)
+#else
+#define APP_LOG_D APP_LOG_NONE
+#endif
+
+#if APP_LOG_LEVEL >= APP_LOG_LEVEL_TRACE
+#define APP_LOG_T(tag, fmt, ...) FURI_LOG_T(tag, fmt, ##__VA_ARGS__)
+#else
+#define APP_LOG_T APP_LOG_NONE
+#endif
+
+/**
+ * Binary trace ring.  Each record is a cycle-counter timestamp, an event id and two
+ * arguments; recording is a handful of stores, safe from the UART ISR.  The ring
+ * keeps the last TRACE_CAPACITY events and is written to TRACE_FILE_PATH on demand.
+ * Define APP_TRACE=0 in application.fam to compile every TRACE() call out.
+*/
+#ifndef APP_TRACE
+#define APP_TRACE 1
+#endif
+
+#define TRACE_CAPACITY 128 // must be a power of two
+#define TRACE_MAGIC 0x4352544F // "OTRC"
+#define TRACE_VERSION 1
+
+typedef enum {
+    TraceEventUartRx, // arg0 = bytes dequeued, arg1 = bytes left in rx_stream
+    TraceEventUartLine, // arg0 = line length
+    TraceEventUartTx, // arg0 = bytes sent
+    TraceEventLine, // arg0 = first two characters of the line, arg1 = app state after it
+    TraceEventStateChange, // arg0 = previous state, arg1 = new state
+    TraceEventUiUpdate, // arg0 = app state
+    TraceEventKey, // arg0 = key, arg1 = input type
+    TraceEventLatency, // arg0 = samples, arg1 = key to render ms
+    TraceEventHeap, // arg0 = app state left, arg1 = its heap high-water in bytes
+    TraceEventUartFlow, // arg0 = 0 for XOFF, 1 for XON, arg1 = bytes waiting in rx_stream
+    TraceEventCount,
+} TraceEventId;
+
+typedef struct {
+    uint32_t timestamp; // CPU cycles, see TraceFileHeader.cycles_per_us
+    uint16_t id;
+    uint16_t arg0;
+    uint32_t arg1;
+} TraceRecord;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+    uint32_t count;
+    uint32_t cycles_per_us;
+    uint32_t overwritten; // events recorded before the oldest one in the file
+} TraceFileHeader;
+
+void trace_record(TraceEventId id, uint16_t arg0, uint32_t arg1);
+bool trace_dump(void);
+
+#if APP_TRACE
+#define TRACE(id, arg0, arg1) trace_record(id, arg0, arg1)
+#else
+#define TRACE(id, arg0, arg1) \
+    do {                      \
+    } while(0)
+#endif
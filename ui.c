@@ -1,67 +1,296 @@
 #include "ui.h"
+#include "latency.h"
+#include "telemetry.h"
+#include "wifi.h"
+#include "batch.h"
+#include "search.h"
 #include <gui/canvas.h>
 #include <furi.h>
+#include <furi_hal.h>
 
 static void draw_main_menu(Canvas* canvas, OllamaAppState* state) {
+    static const char* const items[MENU_ITEM_COUNT] = {
+        "Scan WiFi",
+        "Show URL",
+        "Start Chat",
+        "Latency Stats",
+        "Batch Run",
+        "Search Chats",
+    };
     canvas_set_font(canvas, FontPrimary);
     canvas_draw_str(canvas, 2, 10, "Ollama AI");
     canvas_set_font(canvas, FontSecondary);
-    canvas_draw_str(canvas, 2, 26, state->menu_index == 0 ? "> Scan WiFi" : "  Scan WiFi");
-    canvas_draw_str(canvas, 2, 38, state->menu_index == 1 ? "> Show URL" : "  Show URL");
-    canvas_draw_str(canvas, 2, 50, state->menu_index == 2 ? "> Start Chat" : "  Start Chat");
+    // Five rows fit below the title; the list scrolls to keep the selection on screen
+    uint8_t first = state->menu_index > 4 ? state->menu_index - 4 : 0;
+    for(uint8_t i = first; i < MENU_ITEM_COUNT && i < first + 5; i++) {
+        char item[24];
+        snprintf(item, sizeof(item), "%s%s", state->menu_index == i ? "> " : "  ", items[i]);
+        canvas_draw_str(canvas, 2, 22 + (i - first) * 10, item);
+    }
 }
 
 static void draw_show_url(Canvas* canvas, OllamaAppState* state) {
     canvas_set_font(canvas, FontPrimary);
-    canvas_draw_str(canvas, 2, 10, "Server URL");
+    canvas_draw_str(canvas, 2, 10, state->url->url_count > 1 ? "Server URLs" : "Server URL");
     canvas_set_font(canvas, FontSecondary);
-    canvas_draw_str_aligned(canvas, 64, 32, AlignCenter, AlignCenter, state->server_url);
+    // One centred line per endpoint, in file order
+    const char* url = state->url->server_url;
+    uint8_t count = state->url->url_count;
+    for(uint8_t i = 0; i < count; i++) {
+        size_t length = strcspn(url, " ");
+        char line[MAX_URL_LENGTH];
+        snprintf(line, sizeof(line), "%.*s", (int)length, url);
+        canvas_draw_str_aligned(canvas, 64, 32 - (count - 1) * 5 + i * 10, AlignCenter, AlignCenter, line);
+        url += length + (url[length] == ' ');
+    }
 }
 
 static void draw_chat(Canvas* canvas, OllamaAppState* state) {
     canvas_set_font(canvas, FontPrimary);
     canvas_draw_str(canvas, 2, 10, "Chat");
     canvas_set_font(canvas, FontSecondary);
+
+    // Show how long the last warm-up took so cold and warm starts can be told apart,
+    // or how much of a file has gone while one is being sent
+    ContextUpload* context = &state->chat->context;
+    if(context->file) {
+        // FILE_ACK counts escaped bytes on the line; scaled back to bytes of the file
+        uint64_t acked = context->queued > 0 ? (uint64_t)context->acked * context->sent / context->queued : 0;
+        char progress[24];
+        snprintf(progress, sizeof(progress), "file %lu%%",
+                 context->size > 0 ? (unsigned long)(acked * 100 / context->size) : 0UL);
+        canvas_draw_str_aligned(canvas, 126, 10, AlignRight, AlignBottom, progress);
+    } else if(state->model_warm) {
+        char warmup_info[24];
+        snprintf(warmup_info, sizeof(warmup_info), "%s %lums",
+                 state->warmup_load_ms > 0 ? "cold" : "warm", (unsigned long)state->warmup_ms);
+        canvas_draw_str_aligned(canvas, 126, 10, AlignRight, AlignBottom, warmup_info);
+    }
     
     // Draw chat messages
     int y = 20;
-    for (int i = 0; i < state->chat_message_count; i++) {
-        canvas_draw_str(canvas, 2, y, state->chat_messages[i].is_user ? "You: " : "AI: ");
+    ChatScreen* chat = state->chat;
+    for (int i = 0; i < chat->message_count; i++) {
+        const char* label = chat->messages[i].is_user ? "You: " :
+                            chat->messages[i].spool_rows > 0 ? "AI (hold > for all): " :
+                                                                  "AI: ";
+        canvas_draw_str(canvas, 2, y, label);
         y += 10;
-        canvas_draw_str(canvas, 2, y, state->chat_messages[i].content);
+        canvas_draw_str(canvas, 2, y, chat->messages[i].content);
         y += 10;
     }
     
+    // Completions for the text before the cursor; Up inserts the framed one, Down moves on
+    if(chat->suggestion_count > 0) {
+        canvas_set_color(canvas, ColorWhite);
+        canvas_draw_box(canvas, 0, 39, 128, 11);
+        canvas_set_color(canvas, ColorBlack);
+        int x = 2;
+        for(uint8_t i = 0; i < chat->suggestion_count && x < 128; i++) {
+            const char* suggestion = chat->suggestions[i];
+            uint16_t width = canvas_string_width(canvas, suggestion);
+            canvas_draw_str(canvas, x, 48, suggestion);
+            if(i == chat->suggestion_index) {
+                canvas_draw_frame(canvas, x - 2, 39, width + 4, 11);
+            }
+            x += width + 6;
+        }
+    }
+
     // Draw input field
     canvas_draw_line(canvas, 0, 50, 128, 50);
-    canvas_draw_str(canvas, 2, 62, state->current_message);
-    if (strlen(state->current_message) < MAX_MESSAGE_LENGTH - 1) {
-        canvas_draw_str(canvas, 2 + canvas_string_width(canvas, state->current_message), 62, "_");
+    canvas_draw_str(canvas, 2, 62, chat->current_message);
+    if (strlen(chat->current_message) < MAX_MESSAGE_LENGTH - 1) {
+        canvas_draw_str(canvas, 2 + canvas_string_width(canvas, chat->current_message), 62, "_");
+    }
+
+    latency_mark_rendered(state);
+}
+
+static void draw_response_view(Canvas* canvas, OllamaAppState* state) {
+    ChatScreen* chat = state->chat;
+    canvas_set_font(canvas, FontPrimary);
+    canvas_draw_str(canvas, 2, 10, "Reply");
+    canvas_set_font(canvas, FontSecondary);
+
+    char page[24];
+    snprintf(page, sizeof(page), "%lu/%lu", (unsigned long)chat->view_page + 1,
+             (unsigned long)((chat->view_row_count + RESPONSE_VIEW_ROWS - 1) / RESPONSE_VIEW_ROWS));
+    canvas_draw_str_aligned(canvas, 126, 10, AlignRight, AlignBottom, page);
+
+    // The ESP32 already wrapped the rows to the screen width; they are drawn as they are
+    for(uint8_t row = 0; row < RESPONSE_VIEW_ROWS; row++) {
+        canvas_draw_str(canvas, 2, 19 + row * 9, chat->view_rows[row]);
+    }
+}
+
+static void draw_batch(Canvas* canvas, OllamaAppState* state) {
+    BatchScreen* batch = state->batch;
+    canvas_set_font(canvas, FontPrimary);
+    canvas_draw_str(canvas, 2, 10, "Batch Run");
+    canvas_set_font(canvas, FontSecondary);
+
+    char line[64];
+    snprintf(line, sizeof(line), "In flight: %u of %u (</>)", batch->in_flight, batch->window);
+    canvas_draw_str(canvas, 2, 22, line);
+    snprintf(line, sizeof(line), "Done %lu  err %lu  skip %lu",
+             (unsigned long)batch->answered, (unsigned long)batch->errors, (unsigned long)batch->skipped);
+    canvas_draw_str(canvas, 2, 32, line);
+    uint32_t rate = batch_rate_x10(batch);
+    snprintf(line, sizeof(line), "%lu.%lu prompts/min, last %lu ms",
+             (unsigned long)(rate / 10), (unsigned long)(rate % 10), (unsigned long)batch->last_ms);
+    canvas_draw_str(canvas, 2, 42, line);
+
+    const char* status = batch->running ? "Running..." :
+                         batch->finished && batch->output ? "Finished, OK to run again" :
+                         batch->finished ? "No ollama/batch.jsonl" :
+                         state->model_warm ? "OK to start" : "OK to start (model cold)";
+    canvas_draw_str(canvas, 2, 56, status);
+}
+
+static void draw_search(Canvas* canvas, OllamaAppState* state) {
+    SearchScreen* search = state->search;
+    canvas_set_font(canvas, FontPrimary);
+    canvas_draw_str(canvas, 2, 10, "Search");
+    canvas_set_font(canvas, FontSecondary);
+
+    if(!search->archive) {
+        canvas_draw_str(canvas, 2, 26, "No chat archive on SD");
+        return;
+    }
+
+    char line[40];
+    if(search->showing_hits) {
+        snprintf(line, sizeof(line), "%u hits, %lu ms", search->hit_count, (unsigned long)search->search_ms);
+        canvas_draw_str_aligned(canvas, 126, 10, AlignRight, AlignBottom, line);
+        if(search->hit_count == 0) {
+            canvas_draw_str(canvas, 2, 24, "Nothing holds all of:");
+            canvas_draw_str(canvas, 2, 34, search->query);
+        }
+        for(uint8_t row = 0; row < SEARCH_VIEW_ROWS && search->scroll + row < search->hit_count; row++) {
+            canvas_draw_str(canvas, 2, 21 + row * 10, search->scroll + row == search->selected ? ">" : " ");
+            canvas_draw_str(canvas, 8, 21 + row * 10, search->rows[row]);
+        }
+        // What the search cost: only the postings of the query's words are read
+        snprintf(line, sizeof(line), "%lu postings, %lu reads", (unsigned long)search->stats.postings,
+                 (unsigned long)search->stats.reads);
+        canvas_draw_str(canvas, 2, 62, line);
+        return;
+    }
+
+    uint32_t size = archive_size(search->archive);
+    snprintf(line, sizeof(line), "%lu KB, %lu words", (unsigned long)(size + 1023) / 1024,
+             (unsigned long)archive_word_count(search->archive));
+    canvas_draw_str_aligned(canvas, 126, 10, AlignRight, AlignBottom, line);
+    canvas_draw_str(canvas, 2, 21, search->query);
+    canvas_draw_str(canvas, 2 + canvas_string_width(canvas, search->query), 21, "_");
+
+    // Space is the last key, drawn as an underscore
+    const char* keys = SEARCH_KEYS;
+    for(uint8_t i = 0; keys[i]; i++) {
+        int x = (i % SEARCH_KEYS_PER_ROW) * 9 + 2;
+        int y = (i / SEARCH_KEYS_PER_ROW) * 10 + 24;
+        if(i == search->keyboard_index) {
+            canvas_draw_frame(canvas, x, y, 9, 10);
+        }
+        canvas_draw_glyph(canvas, x + 2, y + 8, keys[i] == ' ' ? '_' : keys[i]);
+    }
+    canvas_draw_str(canvas, 2, 63, "Hold OK to search");
+}
+
+static void draw_latency_stats(Canvas* canvas, OllamaAppState* state) {
+    canvas_set_font(canvas, FontPrimary);
+    canvas_draw_str(canvas, 2, 10, "Latency ms");
+    canvas_set_font(canvas, FontSecondary);
+
+    char header[24];
+    snprintf(header, sizeof(header), "n=%u%s%s%s", state->latency.sample_count,
+             state->latency.log_to_sd ? " SD" : "",
+             state->latency.trace_saved ? " T" : "",
+             state->capture.active ? " C" : "");
+    canvas_draw_str_aligned(canvas, 126, 10, AlignRight, AlignBottom, header);
+
+    UartHelperStats uart;
+    wifi_get_uart_stats(&uart);
+
+    // Six rows fit below the title; Up/Down scrolls through the rest
+    for(uint8_t row = 0; row < 6; row++) {
+        uint8_t index = state->latency.scroll + row;
+        const char* name;
+        char values[24];
+        if(index < LatencySegmentCount) {
+            name = latency_segment_name(index);
+            snprintf(values, sizeof(values), "%lu / %lu",
+                     (unsigned long)latency_percentile(state, index, 50),
+                     (unsigned long)latency_percentile(state, index, 95));
+        } else if(index == LatencySegmentCount) {
+            name = "RX drop/XOFF";
+            snprintf(values, sizeof(values), "%lu / %lu",
+                     (unsigned long)uart.rx_dropped, (unsigned long)uart.xoff_sent);
+        } else if(index == LatencySegmentCount + 1) {
+            name = "RX high/size";
+            snprintf(values, sizeof(values), "%lu / %lu",
+                     (unsigned long)uart.rx_high_water, (unsigned long)uart.rx_capacity);
+        } else if(index == LatencySegmentCount + 2) {
+            name = "Capture/drop";
+            snprintf(values, sizeof(values), "%lu / %lu",
+                     (unsigned long)state->capture.bytes, (unsigned long)uart.capture_dropped);
+        } else if(index < LatencySegmentCount + LATENCY_UART_ROWS + TELEMETRY_ROWS) {
+            telemetry_row(state, index - LatencySegmentCount - LATENCY_UART_ROWS, &name, values, sizeof(values));
+        } else {
+            break;
+        }
+        canvas_draw_str(canvas, 2, 19 + row * 9, name);
+        canvas_draw_str_aligned(canvas, 126, 19 + row * 9, AlignRight, AlignBottom, values);
     }
 }
 
 static void draw_wifi_scan(Canvas* canvas, OllamaAppState* state) {
+    WifiScreen* wifi = state->wifi;
+    bool scanning = state->current_state == AppStateWifiScan;
     canvas_set_font(canvas, FontPrimary);
     canvas_draw_str(canvas, 2, 10, "WiFi Scan");
     canvas_set_font(canvas, FontSecondary);
 
-    if(state->current_state == AppStateWifiScan) {
-        canvas_draw_str(canvas, 2, 26, "Scanning networks...");
-    } else if(state->current_state == AppStateWifiSelect) {
-        if(state->network_count == 0) {
-            canvas_draw_str(canvas, 2, 26, "No networks found");
+    if(wifi->network_count == 0) {
+        canvas_draw_str(canvas, 2, 26, scanning ? "Scanning networks..." : "No networks found");
+        return;
+    }
+
+    char position[12];
+    snprintf(position, sizeof(position), "%u/%u", wifi->selected_network + 1, wifi->network_count);
+    canvas_draw_str_aligned(canvas, 126, 10, AlignRight, AlignBottom, position);
+
+    // Rows the running scan has not confirmed yet are the last scan's, marked with ~
+    bool cached = false;
+    for(uint8_t i = 0; i < wifi->network_count && !cached; i++) {
+        cached = wifi->networks[i].cached;
+    }
+    if(cached) {
+        uint32_t age = furi_hal_rtc_get_timestamp() - wifi->cache_time;
+        char header[32];
+        if(age < 60) {
+            snprintf(header, sizeof(header), "Cached %lus ago, OK to pick:", (unsigned long)age);
+        } else if(age < 3600) {
+            snprintf(header, sizeof(header), "Cached %lum ago, OK to pick:", (unsigned long)age / 60);
+        } else if(age < 86400) {
+            snprintf(header, sizeof(header), "Cached %luh ago, OK to pick:", (unsigned long)age / 3600);
         } else {
-            canvas_draw_str(canvas, 2, 26, "Select a network:");
-            int start_index = (state->selected_network / 3) * 3;
-            for(int i = start_index; i < start_index + 3 && i < state->network_count; i++) {
-                char network_info[32];
-                snprintf(network_info, sizeof(network_info), "%s (%ld dBm)", 
-                         state->networks[i].ssid, (long)state->networks[i].rssi);
-                canvas_draw_str(canvas, 2, 38 + (i - start_index) * 10, 
-                                i == state->selected_network ? "> " : "  ");
-                canvas_draw_str(canvas, 14, 38 + (i - start_index) * 10, network_info);
-            }
+            snprintf(header, sizeof(header), "Cached %lud ago, OK to pick:", (unsigned long)age / 86400);
         }
+        canvas_draw_str(canvas, 2, 26, header);
+    } else {
+        canvas_draw_str(canvas, 2, 26, scanning ? "Scanning, OK to pick:" : "Select a network:");
+    }
+
+    // Only the rows on screen are formatted, however many networks were found
+    for(uint8_t row = 0; row < WIFI_SCAN_ROWS && wifi->scroll + row < wifi->network_count; row++) {
+        uint8_t i = wifi->scroll + row;
+        char network_info[32];
+        snprintf(network_info, sizeof(network_info), "%s (%s%ld dBm)", wifi->networks[i].ssid,
+                 wifi->networks[i].cached ? "~" : "", (long)wifi->networks[i].rssi);
+        canvas_draw_str(canvas, 2, 38 + row * 10, i == wifi->selected_network ? "> " : "  ");
+        canvas_draw_str(canvas, 14, 38 + row * 10, network_info);
     }
 }
 
@@ -75,8 +304,8 @@ static void draw_keyboard(Canvas* canvas, OllamaAppState* state) {
     
     // Draw the entered password
     canvas_draw_str(canvas, 2, 10, "Enter Password:");
-    canvas_draw_str(canvas, 2, 22, state->wifi_password);
-    canvas_draw_str(canvas, 2 + canvas_string_width(canvas, state->wifi_password), 22, "_");
+    canvas_draw_str(canvas, 2, 22, state->wifi->password);
+    canvas_draw_str(canvas, 2 + canvas_string_width(canvas, state->wifi->password), 22, "_");
 
     // Draw the keyboard
     for(size_t i = 0; i < strlen(keyboard); i++) {
@@ -85,7 +314,7 @@ static void draw_keyboard(Canvas* canvas, OllamaAppState* state) {
         int x = col * key_width + 2;
         int y = row * key_height + 34;
 
-        if(i == state->keyboard_index) {
+        if(i == state->wifi->keyboard_index) {
             canvas_draw_frame(canvas, x, y, key_width, key_height);
         }
         canvas_draw_glyph(canvas, x + 2, y + 8, keyboard[i]);
@@ -96,13 +325,27 @@ static void draw_wifi_connect(Canvas* canvas, OllamaAppState* state) {
     canvas_set_font(canvas, FontPrimary);
     canvas_draw_str(canvas, 2, 10, "WiFi Connection");
     canvas_set_font(canvas, FontSecondary);
+    const WifiConnect* connect = &state->connect;
+    char line[40];
     if (state->wifi_connected) {
         canvas_draw_str(canvas, 2, 26, "Connected to:");
         canvas_draw_str(canvas, 2, 38, state->wifi_ssid);
+        snprintf(line, sizeof(line), "%s in %lums", connect->ip, (unsigned long)connect->total_ms);
+        canvas_draw_str(canvas, 2, 50, line);
+    } else if(connect->phase == WifiConnectFailed) {
+        canvas_draw_str(canvas, 2, 26, "Could not connect to:");
+        canvas_draw_str(canvas, 2, 38, state->wifi_ssid);
+        snprintf(line, sizeof(line), "%s, OK to retry", connect->error);
+        canvas_draw_str(canvas, 2, 50, line);
     } else {
         canvas_draw_str(canvas, 2, 26, "Connecting to:");
         canvas_draw_str(canvas, 2, 38, state->wifi_ssid);
-        canvas_draw_str(canvas, 2, 50, "Please wait...");
+        if(connect->phase == WifiConnectBackoff) {
+            snprintf(line, sizeof(line), "%s, retry %u/%u soon", connect->error, connect->attempt + 1, WIFI_CONNECT_ATTEMPTS);
+        } else {
+            snprintf(line, sizeof(line), "Please wait... (%u/%u)", connect->attempt, WIFI_CONNECT_ATTEMPTS);
+        }
+        canvas_draw_str(canvas, 2, 50, line);
     }
 }
 
@@ -110,6 +353,9 @@ void ollama_app_draw_callback(Canvas* canvas, void* ctx) {
     OllamaAppState* state = ctx;
     canvas_clear(canvas);
 
+    // The screen arena must not be swapped out while it is being drawn
+    furi_mutex_acquire(state->screen_mutex, FuriWaitForever);
+
     switch(state->current_state) {
         case AppStateMainMenu:
             draw_main_menu(canvas, state);
@@ -130,5 +376,20 @@ void ollama_app_draw_callback(Canvas* canvas, void* ctx) {
         case AppStateWifiPassword:
             draw_keyboard(canvas, state);
             break;
+        case AppStateLatencyStats:
+            draw_latency_stats(canvas, state);
+            break;
+        case AppStateResponseView:
+            draw_response_view(canvas, state);
+            break;
+        case AppStateBatch:
+            draw_batch(canvas, state);
+            break;
+        case AppStateSearch:
+            draw_search(canvas, state);
+            break;
+        case AppStateCount:
+            break;
     }
+    furi_mutex_release(state->screen_mutex);
 }
\ No newline at end of file
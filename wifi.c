@@ -3,74 +3,421 @@
 #include <furi.h>
 #include <furi_hal.h>
 #include "helpers/uart_helper.h"
+#include "chat.h"
+#include "batch.h"
+#include "context.h"
+#include "latency.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "file_ops.h"
 
 static UartHelper* uart_helper;
 
-static void process_line(FuriString* line, void* context) {
+// Ticket of the prompt in flight; its TX completion closes the key-to-TX latency span
+static uint32_t prompt_ticket;
+
+static void tx_complete(uint32_t sent, void* context) {
+    OllamaAppState* state = context;
+    if(state && prompt_ticket != 0 && (int32_t)(sent - prompt_ticket) >= 0) {
+        prompt_ticket = 0;
+        latency_mark_tx_done(state);
+    }
+}
+
+void wifi_scan_follow_selection(WifiScreen* wifi) {
+    if(wifi->selected_network < wifi->scroll) {
+        wifi->scroll = wifi->selected_network;
+    } else if(wifi->selected_network >= wifi->scroll + WIFI_SCAN_ROWS) {
+        wifi->scroll = wifi->selected_network - WIFI_SCAN_ROWS + 1;
+    }
+}
+
+// Takes a row out of the table; the selection stays on the row that moves up into it
+static void wifi_scan_table_remove(WifiScreen* wifi, uint8_t index) {
+    wifi->network_count--;
+    memmove(&wifi->networks[index], &wifi->networks[index + 1],
+            (wifi->network_count - index) * sizeof(WiFiNetwork));
+    if(wifi->selected_network > index ||
+       (wifi->selected_network == wifi->network_count && wifi->selected_network > 0)) {
+        wifi->selected_network--;
+    }
+}
+
+/**
+ * Inserts a scan result, keeping one entry per SSID with its best RSSI and the table
+ * sorted strongest first, so it is ready to show at any point of the scan.  A reading
+ * from this scan replaces a cached one whatever its strength, and when the table is
+ * full a cached row goes first.  The selection stays on the network it was on when
+ * rows move under it.
+*/
+static void wifi_scan_table_add(WifiScreen* wifi, const char* ssid, int32_t rssi) {
+    uint8_t count = wifi->network_count;
+    uint8_t from = count;
+    for(uint8_t i = 0; i < count; i++) {
+        if(strncmp(wifi->networks[i].ssid, ssid, MAX_SSID_LENGTH - 1) == 0) {
+            from = i;
+            break;
+        }
+    }
+
+    if(from < count) {
+        if(!wifi->networks[from].cached && rssi <= wifi->networks[from].rssi) {
+            return;
+        }
+    } else if(count == MAX_NETWORKS) {
+        // Full: replaces the weakest cached row, or else the weakest if this one is stronger
+        from = count - 1;
+        while(from > 0 && !wifi->networks[from].cached) {
+            from--;
+        }
+        if(!wifi->networks[from].cached) {
+            if(rssi <= wifi->networks[count - 1].rssi) {
+                return;
+            }
+            from = count - 1;
+        }
+    }
+
+    bool selected = from < count && wifi->selected_network == from;
+    if(from < count) {
+        wifi_scan_table_remove(wifi, from);
+    }
+
+    // Ties keep arrival order
+    uint8_t to = 0;
+    while(to < wifi->network_count && wifi->networks[to].rssi >= rssi) {
+        to++;
+    }
+    memmove(&wifi->networks[to + 1], &wifi->networks[to], (wifi->network_count - to) * sizeof(WiFiNetwork));
+    wifi->network_count++;
+    strncpy(wifi->networks[to].ssid, ssid, MAX_SSID_LENGTH - 1);
+    wifi->networks[to].ssid[MAX_SSID_LENGTH - 1] = '\0';
+    wifi->networks[to].rssi = rssi;
+    wifi->networks[to].cached = false;
+
+    if(selected) {
+        wifi->selected_network = to;
+    } else if(wifi->selected_network >= to && wifi->network_count > 1) {
+        wifi->selected_network++;
+    }
+    wifi_scan_follow_selection(wifi);
+}
+
+// Drops the cached rows the finished scan did not see and caches the result for next time
+static void wifi_scan_table_finish(WifiScreen* wifi) {
+    for(uint8_t i = wifi->network_count; i > 0; i--) {
+        if(wifi->networks[i - 1].cached) {
+            wifi_scan_table_remove(wifi, i - 1);
+        }
+    }
+    uint8_t last_scroll = wifi->network_count > WIFI_SCAN_ROWS ? wifi->network_count - WIFI_SCAN_ROWS : 0;
+    if(wifi->scroll > last_scroll) {
+        wifi->scroll = last_scroll;
+    }
+    wifi_scan_follow_selection(wifi);
+    // Written by the main loop, off the UART worker's stack
+    wifi->cache_dirty = wifi->network_count > 0;
+}
+
+void wifi_scan_cache_flush(OllamaAppState* state) {
+    if(state->wifi && state->wifi->cache_dirty) {
+        write_scan_cache(state->wifi);
+        state->wifi->cache_dirty = false;
+    }
+}
+
+// A refused password is not retried; anything else is, after a growing pause
+static void wifi_connect_failed(OllamaAppState* state, const char* reason) {
+    WifiConnect* connect = &state->connect;
+    strncpy(connect->error, reason, sizeof(connect->error) - 1);
+    connect->error[sizeof(connect->error) - 1] = '\0';
+    if(strcmp(reason, "auth") != 0 && connect->attempt < WIFI_CONNECT_ATTEMPTS) {
+        connect->phase = WifiConnectBackoff;
+        connect->retry_tick = furi_get_tick() + (WIFI_CONNECT_BACKOFF_MS << (connect->attempt - 1));
+    } else {
+        connect->phase = WifiConnectFailed;
+    }
+    state->ui_update_needed = true;
+    APP_LOG_W("WiFi", "Connecting to %s failed: %s (attempt %u)", state->wifi_ssid, reason, connect->attempt);
+}
+
+void process_line(FuriString* line, void* context) {
     OllamaAppState* state = (OllamaAppState*)context;
     const char* line_str = furi_string_get_cstr(line);
 
-    FURI_LOG_I("WiFi", "Processing line: %s", line_str);
-
-    if(strcmp(line_str, "SCAN_COMPLETE") == 0) {
-        FURI_LOG_I("WiFi", "Scan complete, found %d networks", state->network_count);
-        if(state->network_count > 0) {
-            state->current_state = AppStateWifiSelect;
-            state->selected_network = 0;
-            FURI_LOG_I("WiFi", "Transitioning to AppStateWifiSelect");
-        } else {
-            state->current_state = AppStateMainMenu;
-            FURI_LOG_I("WiFi", "No networks found, returning to AppStateMainMenu");
+    if(!state) {
+        return;
+    }
+
+    // Replies may land while the main thread is switching screens and arenas
+    furi_mutex_acquire(state->screen_mutex, FuriWaitForever);
+
+    APP_LOG_D("WiFi", "Processing line: %s", line_str);
+
+    if(strcmp(line_str, "SCAN_COMPLETE") == 0 && state->wifi) {
+        // The picker may have moved on to the password screen; the table is still here
+        wifi_scan_table_finish(state->wifi);
+        ollama_app_wake(state);
+        state->ui_update_needed = true;
+        APP_LOG_I("WiFi", "Scan complete, found %d networks", state->wifi->network_count);
+        if(state->current_state == AppStateWifiScan) {
+            if(state->wifi->network_count > 0) {
+                // The table and selection carry over; rows may have been picked already
+                ollama_app_set_state(state, AppStateWifiSelect);
+                APP_LOG_I("WiFi", "Transitioning to AppStateWifiSelect");
+            } else {
+                ollama_app_set_state(state, AppStateMainMenu);
+                APP_LOG_I("WiFi", "No networks found, returning to AppStateMainMenu");
+            }
         }
+        APP_LOG_I("WiFi", "UI update flagged, new state: %d", state->current_state);
+    } else if(strncmp(line_str, "CONNECTED:", 10) == 0) {
+        // CONNECTED:<ip>,<ms> - associated and given an address after <ms>
+        WifiConnect* connect = &state->connect;
+        const char* ip = line_str + 10;
+        size_t ip_length = strcspn(ip, ",");
+        snprintf(connect->ip, sizeof(connect->ip), "%.*s", (int)ip_length, ip);
+        connect->esp_ms = ip[ip_length] == ',' ? strtoul(ip + ip_length + 1, NULL, 10) : 0;
+        connect->total_ms = furi_get_tick() - connect->start_tick;
+        state->wifi_connected = true;
         state->ui_update_needed = true;
-        FURI_LOG_I("WiFi", "UI update flagged, new state: %d", state->current_state);
+        // Only a network that let us in is worth remembering
+        if(connect->phase == WifiConnectWaiting && state->current_state == AppStateWifiConnect) {
+            connect->save_pending = true;
+            ollama_app_wake(state);
+        }
+        connect->phase = WifiConnectDone;
+        APP_LOG_I("WiFi", "Connected to %s as %s: %lu ms on the ESP32, %lu ms in %u attempts",
+                  state->wifi_ssid, connect->ip, (unsigned long)connect->esp_ms,
+                  (unsigned long)connect->total_ms, connect->attempt);
+    } else if(strncmp(line_str, "CONNECT_FAILED:", 15) == 0) {
+        // CONNECT_FAILED:<reason>,<ms> - reason is auth, no_ssid or timeout
+        if(state->connect.phase == WifiConnectWaiting) {
+            char reason[16];
+            const char* text = line_str + 15;
+            snprintf(reason, sizeof(reason), "%.*s", (int)strcspn(text, ","), text);
+            state->wifi_connected = false;
+            wifi_connect_failed(state, reason);
+        }
+    } else if(strncmp(line_str, "PART:", 5) == 0) {
+        // PART:<text> - a long reply arrives as PART lines followed by the Ollama line
+        chat_reply_append(state, line_str + 5, strlen(line_str + 5));
+    } else if(strncmp(line_str, "Ollama: \"", 9) == 0) {
+        // Ollama: "<response>" - strip the quotes before storing the message
+        const char* text = line_str + 9;
+        size_t text_len = strlen(text);
+        if(text_len > 0 && text[text_len - 1] == '"') {
+            text_len--;
+        }
+        chat_reply_append(state, text, text_len);
+        chat_reply_finish(state);
+        // Ask for the ESP32's side of the timing now that its request is finished
+        uart_helper_send(uart_helper, "STATS\r\n", 7);
+    } else if(strncmp(line_str, "BATCH_DONE:", 11) == 0) {
+        batch_complete(state, line_str + 11);
+    } else if(strncmp(line_str, "FILE_ACK:", 9) == 0) {
+        context_ack(state, line_str + 9);
+    } else if(strncmp(line_str, "FILE_FAILED:", 12) == 0) {
+        context_fail(state, line_str + 12);
+    } else if(strncmp(line_str, "STATS:", 6) == 0) {
+        latency_set_esp_stats(state, line_str + 6);
+    } else if(strncmp(line_str, "TELEMETRY:", 10) == 0) {
+        telemetry_set_esp(state, line_str + 10);
+    } else if(strncmp(line_str, "WARMUP:", 7) == 0) {
+        // WARMUP:<total_ms>,<load_ms> - load_ms is non-zero when the model was cold
+        const char* load_str = strchr(line_str + 7, ',');
+        state->warmup_ms = strtoul(line_str + 7, NULL, 10);
+        state->warmup_load_ms = load_str ? strtoul(load_str + 1, NULL, 10) : 0;
+        state->model_warm = true;
+        state->ui_update_needed = true;
+        APP_LOG_I("WiFi", "Model warm-up took %lu ms (load %lu ms)",
+                   (unsigned long)state->warmup_ms, (unsigned long)state->warmup_load_ms);
+    } else if(strncmp(line_str, "WARMUP_FAILED:", 14) == 0) {
+        state->model_warm = false;
+        state->ui_update_needed = true;
+        APP_LOG_W("WiFi", "Model warm-up failed: %s", line_str + 14);
     } else if(strncmp(line_str, "NETWORK:", 8) == 0) {
+        // NETWORK:<ssid>,<rssi> - one per BSSID, arriving while the scan goes on
         char* network_info = (char*)line_str + 8;
         char* rssi_str = strrchr(network_info, ',');
-        if(rssi_str && state->network_count < MAX_NETWORKS) {
+        if(rssi_str && state->wifi) {
             *rssi_str = '\0';
-            rssi_str++;
-            strncpy(state->networks[state->network_count].ssid, network_info, MAX_SSID_LENGTH - 1);
-            state->networks[state->network_count].ssid[MAX_SSID_LENGTH - 1] = '\0';
-            state->networks[state->network_count].rssi = atoi(rssi_str);
-            state->network_count++;
-            FURI_LOG_I("WiFi", "Added network: %s (%ld dBm)", 
-                       state->networks[state->network_count-1].ssid, 
-                       (long)state->networks[state->network_count-1].rssi);
+            wifi_scan_table_add(state->wifi, network_info, atoi(rssi_str + 1));
+            APP_LOG_D("WiFi", "Added network: %s (%s dBm)", network_info, rssi_str + 1);
+            state->ui_update_needed = true;
         }
     }
 
-    FURI_LOG_I("WiFi", "Current state after processing: %d", state->current_state);
-    FURI_LOG_I("WiFi", "UI update needed: %s", state->ui_update_needed ? "Yes" : "No");
+    APP_LOG_D("WiFi", "Current state after processing: %d", state->current_state);
+    APP_LOG_D("WiFi", "UI update needed: %s", state->ui_update_needed ? "Yes" : "No");
+    TRACE(TraceEventLine, (uint8_t)line_str[0] | (uint8_t)line_str[1] << 8, state->current_state);
+    furi_mutex_release(state->screen_mutex);
 }
 
 void wifi_init() {
     uart_helper = uart_helper_alloc();
     uart_helper_set_callback(uart_helper, process_line, NULL);
-    FURI_LOG_I("WiFi", "WiFi module initialized");
+    APP_LOG_I("WiFi", "WiFi module initialized");
 }
 
 void wifi_deinit() {
     uart_helper_free(uart_helper);
-    FURI_LOG_I("WiFi", "WiFi module deinitialized");
+    APP_LOG_I("WiFi", "WiFi module deinitialized");
+}
+
+void wifi_listen(OllamaAppState* state) {
+    uart_helper_set_callback(uart_helper, process_line, state);
 }
 
 void wifi_scan(OllamaAppState* state) {
-    FURI_LOG_I("WiFi", "Starting WiFi scan");
-    state->network_count = 0;
-    state->current_state = AppStateWifiScan;
-    state->selected_network = 0;
-    state->ui_update_needed = true;
+    APP_LOG_I("WiFi", "Starting WiFi scan");
+    ollama_app_set_state(state, AppStateWifiScan);
+    state->wifi->selected_network = 0;
+    state->wifi->scroll = 0;
+    // The last scan's table is on screen at once; this scan's rows merge into it
+    wifi_scan_cache_flush(state);
+    read_scan_cache(state->wifi);
+    APP_LOG_I("WiFi", "Showing %u cached networks", state->wifi->network_count);
 
     uart_helper_set_callback(uart_helper, process_line, state);
     uart_helper_send(uart_helper, "SCAN\r\n", 6);
 }
 
-void wifi_connect(OllamaAppState* state) {
-    state->current_state = AppStateWifiConnect;
-
+static void wifi_connect_send(OllamaAppState* state) {
+    WifiConnect* connect = &state->connect;
     char connect_cmd[MAX_SSID_LENGTH + MAX_PASSWORD_LENGTH + 10];
-    snprintf(connect_cmd, sizeof(connect_cmd), "CONNECT %s %s\r\n", state->wifi_ssid, state->wifi_password);
+    snprintf(connect_cmd, sizeof(connect_cmd), "CONNECT %s %s\r\n", state->wifi_ssid, state->wifi->password);
+    uart_helper_set_callback(uart_helper, process_line, state);
     uart_helper_send(uart_helper, connect_cmd, strlen(connect_cmd));
-    FURI_LOG_I("WiFi", "Attempting to connect to WiFi: %s", state->wifi_ssid);
-}
\ No newline at end of file
+    connect->phase = WifiConnectWaiting;
+    connect->attempt++;
+    connect->sent_tick = furi_get_tick();
+    state->ui_update_needed = true;
+    APP_LOG_I("WiFi", "Attempting to connect to WiFi: %s (attempt %u)", state->wifi_ssid, connect->attempt);
+}
+
+void wifi_connect(OllamaAppState* state) {
+    ollama_app_set_state(state, AppStateWifiConnect);
+    state->wifi_connected = false;
+    memset(&state->connect, 0, sizeof(WifiConnect));
+    state->connect.start_tick = furi_get_tick();
+    wifi_connect_send(state);
+}
+
+void wifi_connect_save(OllamaAppState* state) {
+    if(state->connect.save_pending) {
+        state->connect.save_pending = false;
+        save_ap(state);
+    }
+}
+
+void wifi_connect_poll(OllamaAppState* state) {
+    WifiConnect* connect = &state->connect;
+    wifi_connect_save(state);
+    if(connect->phase != WifiConnectWaiting && connect->phase != WifiConnectBackoff) {
+        return;
+    }
+    // Leaving the screen takes the password with it: no more retries, though an
+    // answer to the CONNECT already sent still sets wifi_connected
+    if(state->current_state != AppStateWifiConnect) {
+        if(connect->phase == WifiConnectBackoff) {
+            connect->phase = WifiConnectIdle;
+        }
+        return;
+    }
+
+    uint32_t now = furi_get_tick();
+    if(connect->phase == WifiConnectWaiting && now - connect->sent_tick >= WIFI_CONNECT_TIMEOUT_MS) {
+        wifi_connect_failed(state, "no reply");
+    } else if(connect->phase == WifiConnectBackoff && (int32_t)(now - connect->retry_tick) >= 0) {
+        wifi_connect_send(state);
+    }
+}
+
+void wifi_send_server_url(OllamaAppState* state, const char* server_url) {
+    if(server_url[0] == '\0') {
+        return;
+    }
+
+    // Space-separated endpoint list from read_url_from_file
+    char url_cmd[MAX_URL_LENGTH + 8];
+    snprintf(url_cmd, sizeof(url_cmd), "URL %s\r\n", server_url);
+
+    uart_helper_set_callback(uart_helper, process_line, state);
+    uart_helper_send(uart_helper, url_cmd, strlen(url_cmd));
+    APP_LOG_I("WiFi", "Sent server URL, ESP32 will warm up the model");
+}
+
+void wifi_set_keep_warm(OllamaAppState* state, bool enabled) {
+    uart_helper_set_callback(uart_helper, process_line, state);
+    if(enabled) {
+        uart_helper_send(uart_helper, "WARMUP ON\r\n", 11);
+    } else {
+        uart_helper_send(uart_helper, "WARMUP OFF\r\n", 12);
+    }
+}
+
+void wifi_set_hedge(OllamaAppState* state, bool enabled) {
+    char hedge_cmd[24];
+    if(enabled) {
+        snprintf(hedge_cmd, sizeof(hedge_cmd), "HEDGE %u\r\n", (unsigned)WIFI_HEDGE_DELAY_MS);
+    } else {
+        snprintf(hedge_cmd, sizeof(hedge_cmd), "HEDGE OFF\r\n");
+    }
+
+    uart_helper_set_callback(uart_helper, process_line, state);
+    uart_helper_send(uart_helper, hedge_cmd, strlen(hedge_cmd));
+}
+
+bool wifi_send_prompt(OllamaAppState* state, const char* prompt) {
+    char prompt_cmd[MAX_MESSAGE_LENGTH + 3];
+    snprintf(prompt_cmd, sizeof(prompt_cmd), "%s\r\n", prompt);
+
+    uart_helper_set_callback(uart_helper, process_line, state);
+    uart_helper_set_tx_callback(uart_helper, tx_complete, state);
+    prompt_ticket = uart_helper_send(uart_helper, prompt_cmd, strlen(prompt_cmd));
+    if(prompt_ticket == 0) {
+        return false;
+    }
+    // The worker may have finished before the ticket was stored
+    tx_complete(uart_helper_tx_sent(uart_helper), state);
+    return true;
+}
+
+bool wifi_send_batch(OllamaAppState* state, const char* command, size_t length) {
+    uart_helper_set_callback(uart_helper, process_line, state);
+    return uart_helper_send(uart_helper, command, length) != 0;
+}
+
+bool wifi_send_file(OllamaAppState* state, uint32_t size, const char* question) {
+    char file_cmd[MAX_MESSAGE_LENGTH + 20];
+    int length = snprintf(file_cmd, sizeof(file_cmd), "FILE %lu %s\r\n", (unsigned long)size, question);
+    uart_helper_set_callback(uart_helper, process_line, state);
+    return length > 0 && uart_helper_send(uart_helper, file_cmd, length) != 0;
+}
+
+bool wifi_send_file_data(OllamaAppState* state, const char* data, size_t length) {
+    uart_helper_set_callback(uart_helper, process_line, state);
+    return uart_helper_send(uart_helper, data, length) != 0;
+}
+
+void wifi_request_telemetry(OllamaAppState* state) {
+    uart_helper_set_callback(uart_helper, process_line, state);
+    uart_helper_send(uart_helper, "TELEMETRY\r\n", 11);
+}
+
+bool wifi_capture_start(size_t buffer_size) {
+    return uart_helper_capture_start(uart_helper, buffer_size);
+}
+
+void wifi_capture_stop(void) {
+    uart_helper_capture_stop(uart_helper);
+}
+
+size_t wifi_capture_read(void* data, size_t size) {
+    return uart_helper_capture_read(uart_helper, data, size);
+}
+
+void wifi_get_uart_stats(UartHelperStats* stats) {
+    uart_helper_get_stats(uart_helper, stats);
+}
@@ -1,8 +1,40 @@
 #pragma once
 
 #include "ollama_app_i.h"
+#include "helpers/uart_helper.h"
 
 void wifi_init();
 void wifi_deinit();
+// Routes ESP32 lines to state without sending anything first, as a replay needs
+void wifi_listen(OllamaAppState* state);
 void wifi_scan(OllamaAppState* state);
-void wifi_connect(OllamaAppState* state);
\ No newline at end of file
+// Writes a finished scan's table to the cache file; from the main loop
+void wifi_scan_cache_flush(OllamaAppState* state);
+// Scrolls the scan list so the selected row is on screen
+void wifi_scan_follow_selection(WifiScreen* wifi);
+// Sends CONNECT once; CONNECTED or CONNECT_FAILED from the ESP32 decides what follows
+void wifi_connect(OllamaAppState* state);
+// Retries a failed connect when its backoff is up and fails one the ESP32 never answered,
+// and saves one that succeeded
+void wifi_connect_poll(OllamaAppState* state);
+// Saves the network a CONNECTED came from, before the wifi arena takes its password
+void wifi_connect_save(OllamaAppState* state);
+void wifi_send_server_url(OllamaAppState* state, const char* server_url);
+void wifi_set_keep_warm(OllamaAppState* state, bool enabled);
+// HEDGE WIFI_HEDGE_DELAY_MS or HEDGE OFF; the ESP32 hedges to the next endpoint in its list
+void wifi_set_hedge(OllamaAppState* state, bool enabled);
+// Sends a chat prompt; false if the TX queue has no room for it yet
+bool wifi_send_prompt(OllamaAppState* state, const char* prompt);
+// Queues a whole BATCH command; false if the TX queue has no room for it yet
+bool wifi_send_batch(OllamaAppState* state, const char* command, size_t length);
+// Sends FILE <size> <question>; false if the TX queue has no room for it
+bool wifi_send_file(OllamaAppState* state, uint32_t size, const char* question);
+// Queues raw file bytes; false if the TX queue has no room for all of them yet
+bool wifi_send_file_data(OllamaAppState* state, const char* data, size_t length);
+// Asks the ESP32 for its TELEMETRY: line
+void wifi_request_telemetry(OllamaAppState* state);
+// UART capture, see uart_helper_capture_start
+bool wifi_capture_start(size_t buffer_size);
+void wifi_capture_stop(void);
+size_t wifi_capture_read(void* data, size_t size);
+void wifi_get_uart_stats(UartHelperStats* stats);